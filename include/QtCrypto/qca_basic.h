@@ -37,6 +37,7 @@
 #include "qca_core.h"
 
 #include <QIODevice>
+#include <QVector>
 
 // Qt5 comes with QStringLiteral for wrapping string literals, which Qt4 does
 // not have. It is needed if the headers are built with QT_NO_CAST_FROM_ASCII.
@@ -142,6 +143,55 @@ myRandomInt = QCA::Random::randomInt();
 	*/
 	static int randomInt();
 
+	/**
+	   Provide a random 32 bit unsigned integer
+
+	   This, randomUInt64(), randomBounded(), fill(), randomChar() and
+	   randomInt() are served from a buffer kept for each thread, which
+	   is refilled from the global random provider a few kilobytes at a
+	   time.  Taking many small values therefore doesn't lock and call
+	   the provider for each one.  The buffer is discarded when the
+	   global random provider changes, and after fork() on Unix.
+
+	   \since 2.3
+	*/
+	static quint32 randomUInt32();
+
+	/**
+	   Provide a random 64 bit unsigned integer
+
+	   \sa randomUInt32
+
+	   \since 2.3
+	*/
+	static quint64 randomUInt64();
+
+	/**
+	   Provide a uniformly distributed random integer in [0, bound)
+
+	   Unlike randomUInt32() % bound, this has no bias towards small
+	   values.
+
+	   \param bound the upper limit (exclusive), 0 returns 0
+
+	   \sa randomUInt32
+
+	   \since 2.3
+	*/
+	static quint32 randomBounded(quint32 bound);
+
+	/**
+	   Fill a buffer with random bytes
+
+	   \param data the buffer to fill
+	   \param size the number of bytes to write
+
+	   \sa randomUInt32
+
+	   \since 2.3
+	*/
+	static void fill(char *data, int size);
+
 	/**
 	   Provide a specified number of random bytes.
 
@@ -788,6 +838,140 @@ public:
 	*/
 	void setup(Direction dir, const SymmetricKey &key, const InitializationVector &iv, const AuthTag &tag);
 
+	/**
+	   Encrypt or decrypt a complete message using several threads
+
+	   The message is split into block aligned segments which are
+	   processed concurrently, each with its own provider context. The
+	   result is identical to process(), and like process() the Cipher
+	   is reset before the operation and finished afterwards, so tag()
+	   returns the authentication tag of the whole message.
+
+	   Only modes where the segments are independent can be split:
+	   CTR, GCM (with the GHASH of each segment combined at the end),
+	   ECB without padding and CBC decryption without padding. Other
+	   modes, small messages and providers that lack the CTR or ECB
+	   variant of the cipher needed for the split are handled by
+	   process() on the calling thread.
+
+	   \param a the complete message to encrypt / decrypt
+	   \param threads the maximum number of threads to use, or 0 to use
+	   QThread::idealThreadCount()
+
+	   \since 2.3
+	*/
+	MemoryRegion processParallel(const MemoryRegion &a, int threads = 0);
+
+	/**
+	   \class QCA::Cipher::Record qca_basic.h QtCrypto
+
+	   One message for encryptBatch() and decryptBatch()
+
+	   A record only points at its data, the caller keeps the buffers
+	   alive for the duration of the call.  The output must have room for
+	   size bytes and may be the same buffer as the input.
+
+	   \since 2.3
+	*/
+	class Record
+	{
+	public:
+		/**
+		   The nonce, used as the InitializationVector of this message
+		*/
+		const char *nonce;
+
+		/**
+		   The size of the nonce in bytes
+		*/
+		int nonceSize;
+
+		/**
+		   Additional authenticated data, for the AEAD modes (GCM and
+		   chacha20-poly1305).  May be null if aadSize is 0.
+		*/
+		const char *aad;
+
+		/**
+		   The size of the additional authenticated data in bytes
+		*/
+		int aadSize;
+
+		/**
+		   The payload to encrypt or decrypt
+		*/
+		const char *in;
+
+		/**
+		   Where the result is written, size bytes
+		*/
+		char *out;
+
+		/**
+		   The size of the payload, and of the result
+		*/
+		int size;
+
+		/**
+		   For AEAD modes, the authentication tag.  It is written by
+		   encryptBatch() and checked by decryptBatch().
+		*/
+		char *tag;
+
+		/**
+		   The size of the authentication tag in bytes, 0 if not used
+		*/
+		int tagSize;
+
+		/**
+		   Constructs an empty record
+		*/
+		Record() : nonce(0), nonceSize(0), aad(0), aadSize(0), in(0), out(0), size(0), tag(0), tagSize(0) {}
+	};
+
+	/**
+	   Encrypt many independent messages under the current key
+
+	   Each record is encrypted as if by setup() with the key of this
+	   Cipher and the nonce of the record, followed by update() and
+	   final(), but the key setup is done once for the whole batch and no
+	   arrays are allocated per message.  This is meant for protocols
+	   sending many small packets, each with its own nonce.
+
+	   The ciphertext of each record must be the same size as its
+	   plaintext, so padding modes can't be used.  Additional
+	   authenticated data is only supported by providers that implement
+	   batches natively; the default implementation fails records that
+	   have some.
+
+	   The Cipher is reset afterwards, as if by clear().
+
+	   \param records the messages to encrypt
+
+	   \return true if every record was encrypted
+
+	   \since 2.3
+	*/
+	bool encryptBatch(const QVector<Record> &records);
+
+	/**
+	   Decrypt many independent messages under the current key
+
+	   This is the reverse of encryptBatch().  For the AEAD modes, the tag
+	   of each record is checked.  The output of a record that fails is
+	   overwritten with zeros, so no unauthenticated plaintext is left in
+	   it.
+
+	   \param records the messages to decrypt
+	   \param failed if not null, receives the indexes of the records
+	   that could not be decrypted or authenticated
+
+	   \return true if every record was decrypted and authenticated
+
+	   \since 2.3
+	*/
+	bool decryptBatch(const QVector<Record> &records, QList<int> *failed = 0);
+
 	/**
 	   Construct a Cipher type string
 
@@ -796,6 +980,11 @@ public:
 	   QCA::CFB)
 	   \param paddingType the padding required (eg QCA::NoPadding,
 	   QCA::PCKS7)
+
+	   \note "chacha20" and "chacha20-poly1305" have no modes or padding.
+	   For them the type string is just the cipher name and modeType and
+	   paddingType are ignored.  By convention CTR is passed for chacha20 and
+	   GCM for chacha20-poly1305.
 	*/
 	static QString withAlgorithms(const QString &cipherType, Mode modeType, Padding paddingType);
 private:
@@ -1004,6 +1193,161 @@ public:
 						 int msecInterval,
 						 unsigned int *iterationCount);
 
+	/**
+	   \class QCA::KeyDerivationFunction::Parameters qca_basic.h QtCrypto
+
+	   Cost settings for makeKey()
+
+	   The memory-hard functions are tuned by more than an iteration
+	   count.  What each member means depends on the function, and a
+	   member left at 0 takes the default of the function:
+
+	   - argon2id: memoryCost is the memory in KiB (m, default 65536),
+	     timeCost the number of passes (t, default 3) and lanes the
+	     parallelism (p, default 4)
+	   - scrypt: memoryCost is the cost N, a power of 2 (default 32768),
+	     blockSize is r (default 8) and lanes the parallelization p
+	     (default 1)
+	   - pbkdf1 and pbkdf2: timeCost is the iteration count
+
+	   The lanes are computed on up to \a threads threads.  Changing
+	   the number of threads does not change the key, changing the number
+	   of lanes does.
+
+	   \since 2.3
+	*/
+	class Parameters
+	{
+	public:
+		/**
+		   The amount of memory to use, see the table above
+		*/
+		unsigned int memoryCost;
+
+		/**
+		   The number of passes or iterations
+		*/
+		unsigned int timeCost;
+
+		/**
+		   The block size of scrypt
+		*/
+		unsigned int blockSize;
+
+		/**
+		   The number of independent lanes
+		*/
+		unsigned int lanes;
+
+		/**
+		   The maximum number of threads for the lanes, or 0 to use up
+		   to QThread::idealThreadCount()
+		*/
+		int threads;
+
+		/**
+		   The optional secret value K of Argon2, a key kept apart from
+		   the stored hashes
+		*/
+		SecureArray secretKey;
+
+		/**
+		   The optional associated data X of Argon2
+		*/
+		QByteArray associatedData;
+
+		/**
+		   Constructs parameters with every cost at the default of the
+		   function
+		*/
+		Parameters() : memoryCost(0), timeCost(0), blockSize(0), lanes(0), threads(0) {}
+	};
+
+	/**
+	   Generate the key from a specified secret, salt and cost parameters
+
+	   \param secret the secret (password or passphrase)
+	   \param salt the salt to use
+	   \param keyLength the length of key to return
+	   \param parameters the cost of the derivation, see Parameters
+
+	   \return the derived key, or an empty key if the parameters are not
+	   valid for the function
+
+	   \since 2.3
+	*/
+	SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt, unsigned int keyLength, const Parameters &parameters);
+
+	/**
+	   \class QCA::KeyDerivationFunction::Job qca_basic.h QtCrypto
+
+	   One key to derive with makeKeys()
+
+	   \since 2.3
+	*/
+	class Job
+	{
+	public:
+		/**
+		   The secret (password or passphrase)
+		*/
+		SecureArray secret;
+
+		/**
+		   The salt to use
+		*/
+		InitializationVector salt;
+
+		/**
+		   The length of key to return
+		*/
+		unsigned int keyLength;
+
+		/**
+		   The number of iterations to perform
+		*/
+		unsigned int iterationCount;
+
+		/**
+		   Constructs an empty job
+		*/
+		Job() : keyLength(0), iterationCount(0) {}
+
+		/**
+		   Constructs a job with the arguments of makeKey()
+
+		   \param secret the secret (password or passphrase)
+		   \param salt the salt to use
+		   \param keyLength the length of key to return
+		   \param iterationCount the number of iterations to perform
+		*/
+		Job(const SecureArray &secret, const InitializationVector &salt, unsigned int keyLength, unsigned int iterationCount)
+			: secret(secret), salt(salt), keyLength(keyLength), iterationCount(iterationCount) {}
+	};
+
+	/**
+	   Generate many keys using several threads
+
+	   Each job gives the same key as makeKey() with its arguments.  The
+	   jobs are divided among the threads, and each thread works through
+	   its share with one provider context, so no object has to be
+	   created per key.  Providers may also derive several keys at once,
+	   the default provider runs the PBKDF2 blocks of different jobs
+	   side by side in SIMD lanes.
+
+	   This is meant for servers that check many passwords at the same
+	   time.
+
+	   \param jobs the keys to derive
+	   \param threads the maximum number of threads to use, or 0 to use
+	   QThread::idealThreadCount()
+
+	   \return the derived keys, in the order of the jobs
+
+	   \since 2.3
+	*/
+	QList<SymmetricKey> makeKeys(const QList<Job> &jobs, int threads = 0);
+
 	/**
 	   Construct the name of the algorithm
 
@@ -1078,6 +1422,63 @@ public:
 		: KeyDerivationFunction(withAlgorithm(QStringLiteral("pbkdf2"), algorithm), provider) {}
 };
 
+/**
+   \class Argon2id qca_basic.h QtCrypto
+   \since 2.3
+
+   Argon2id memory-hard password hashing function
+
+   This class implements Argon2id as specified in RFC9106.  Use the
+   makeKey() overload that takes KeyDerivationFunction::Parameters to set
+   the memory, passes and lanes.  The overload with an iteration count
+   takes it as the number of passes, and the timed overload picks the
+   number of passes.
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT Argon2id : public KeyDerivationFunction
+{
+public:
+	/**
+	   Standard constructor
+
+	   \param provider the name of the provider to use, if available
+	*/
+	explicit Argon2id(const QString &provider = QString())
+		: KeyDerivationFunction(QStringLiteral("argon2id"), provider) {}
+};
+
+/**
+   \class Scrypt qca_basic.h QtCrypto
+   \since 2.3
+
+   scrypt memory-hard password based key derivation function
+
+   This class implements scrypt as specified in RFC7914.  Use the
+   makeKey() overload that takes KeyDerivationFunction::Parameters to set
+   N, r and p.  The overload with an iteration count takes it as N, and
+   the timed overload picks N.
+
+   scrypt uses 128 * r * (N + p) bytes of memory, and another
+   128 * r * N for each further lane computed in parallel.  Parameters
+   that need more than 2 GiB for a single lane give an empty key, and
+   the timed overload picks an N that needs at most 1 GiB whatever the
+   speed of the machine.
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT Scrypt : public KeyDerivationFunction
+{
+public:
+	/**
+	   Standard constructor
+
+	   \param provider the name of the provider to use, if available
+	*/
+	explicit Scrypt(const QString &provider = QString())
+		: KeyDerivationFunction(QStringLiteral("scrypt"), provider) {}
+};
+
 /**
    \class HKDF qca_basic.h QtCrypto
    \since 2.3
@@ -1133,6 +1534,357 @@ public:
 	*/
 	SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt,
 						 const InitializationVector &info, unsigned int keyLength);
+
+	/**
+	   Run the extract step of HKDF and return the pseudorandom key
+
+	   When several keys are derived from one secret, extract it once and
+	   call expand() for each key, rather than calling makeKey() each time.
+
+	   \param secret the secret (input keying material)
+	   \param salt the salt to use, or an empty array for none
+
+	   \return the pseudorandom key, as long as the hash output
+
+	   \since 2.3
+	*/
+	SymmetricKey extract(const SecureArray &secret, const InitializationVector &salt);
+
+	/**
+	   Run the expand step of HKDF on a pseudorandom key
+
+	   Expanding the same pseudorandom key again reuses the keyed HMAC
+	   state where the provider supports it.
+
+	   \param prk the pseudorandom key returned by extract()
+	   \param info the info to use
+	   \param keyLength the length of key to return, at most 255 times the
+	   length of the hash
+
+	   \return the derived key, or an empty key if keyLength is too large
+
+	   \since 2.3
+	*/
+	SymmetricKey expand(const SymmetricKey &prk, const InitializationVector &info, unsigned int keyLength);
+};
+
+/**
+   \class CipherDevice qca_basic.h QtCrypto
+   \since 2.3
+
+   QIODevice that passes data through a Filter on its way to or from
+   another device
+
+   CipherDevice lets code that works with a QIODevice encrypt or decrypt
+   a stream on the fly.  Opened for reading, it reads from the underlying
+   device and returns the filtered data.  Opened for writing, it filters
+   the data written to it and writes the result to the underlying device.
+   Any Filter can be used, such as a Cipher, Hex or Base64.
+
+   \code
+QFile file("secret.bin");
+file.open(QIODevice::ReadOnly);
+QCA::Cipher cipher("aes256", QCA::Cipher::CTR, QCA::Cipher::NoPadding,
+	QCA::Decode, key, iv);
+QCA::CipherDevice plain(&cipher, &file);
+plain.open(QIODevice::ReadOnly);
+while(!plain.atEnd())
+	consume(plain.read(65536));
+   \endcode
+
+   Data moves through a reused buffer of at most maximumBufferSize()
+   bytes at a time, so streams of any length run in constant memory.
+   When writing, no more data is accepted (write() returns 0) while the
+   underlying device has maximumBufferSize() or more bytes queued, as
+   reported by its bytesToWrite().  Wait for bytesWritten() and try
+   again.
+
+   When reading, Filter::final() is called once the underlying device
+   reaches its end.  When writing, it is called by close().  The filter
+   and the device are not owned and must outlive the CipherDevice.  The
+   device must already be open, and is left open by close().
+
+   \note When decrypting with an authenticating mode, the data read is
+   only authenticated once atEnd() is true and the last read() did not
+   fail.  Check ok() before trusting it.
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT CipherDevice : public QIODevice
+{
+	Q_OBJECT
+public:
+	/**
+	   Standard constructor
+
+	   \param filter the filter to pass the data through
+	   \param device the device to read from or write to
+	   \param parent the parent object for this object
+	*/
+	CipherDevice(Filter *filter, QIODevice *device, QObject *parent = 0);
+
+	~CipherDevice();
+
+	/**
+	   The filter the data is passed through
+	*/
+	Filter *filter() const;
+
+	/**
+	   The underlying device
+	*/
+	QIODevice *device() const;
+
+	/**
+	   Set the largest amount of data processed at once, and queued
+	   for the underlying device before further writes are refused.
+	   The default is 64 KiB.
+
+	   \param size the size in bytes
+	*/
+	void setMaximumBufferSize(int size);
+
+	/**
+	   The largest amount of data processed at once
+	*/
+	int maximumBufferSize() const;
+
+	/**
+	   Test if the filter has succeeded so far.  After a decryption
+	   that authenticates its data, this is only meaningful once the
+	   device is at its end or has been closed.
+	*/
+	bool ok() const;
+
+	virtual bool open(OpenMode mode);
+	virtual void close();
+	virtual bool isSequential() const;
+	virtual bool atEnd() const;
+	virtual qint64 bytesAvailable() const;
+	virtual qint64 bytesToWrite() const;
+	virtual bool waitForReadyRead(int msecs);
+	virtual bool waitForBytesWritten(int msecs);
+
+protected:
+	virtual qint64 readData(char *data, qint64 maxSize);
+	virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private slots:
+	void device_readChannelFinished();
+	void device_bytesWritten(qint64 bytes);
+
+private:
+	Q_DISABLE_COPY(CipherDevice)
+
+	class Private;
+	Private *d;
+};
+
+/**
+   \class HashingDevice qca_basic.h QtCrypto
+   \since 2.3
+
+   QIODevice that feeds the data passing through it to a hash or MAC
+
+   HashingDevice passes data to or from another device unchanged, and
+   updates a BufferedComputation, such as a Hash or
+   MessageAuthenticationCode, with every byte that goes by.  Only bytes
+   that were actually read, or accepted by the underlying device, are
+   hashed.  Call final() on the computation when done.
+
+   \code
+QCA::Hash hash("sha256");
+QCA::HashingDevice tee(&hash, &socket);
+tee.open(QIODevice::WriteOnly);
+tee.write(data);
+   \endcode
+
+   As with CipherDevice, writes are refused while the underlying device
+   has maximumBufferSize() or more bytes queued.  The computation and the
+   device are not owned and must outlive the HashingDevice.  The device
+   must already be open, and is left open by close().
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT HashingDevice : public QIODevice
+{
+	Q_OBJECT
+public:
+	/**
+	   Standard constructor
+
+	   \param computation the hash or MAC to update
+	   \param device the device to read from or write to
+	   \param parent the parent object for this object
+	*/
+	HashingDevice(BufferedComputation *computation, QIODevice *device, QObject *parent = 0);
+
+	~HashingDevice();
+
+	/**
+	   The hash or MAC that is updated
+	*/
+	BufferedComputation *computation() const;
+
+	/**
+	   The underlying device
+	*/
+	QIODevice *device() const;
+
+	/**
+	   Set the amount of data that may be queued for the underlying
+	   device before further writes are refused.  The default is 64 KiB.
+
+	   \param size the size in bytes
+	*/
+	void setMaximumBufferSize(int size);
+
+	/**
+	   The amount of data that may be queued for the underlying device
+	*/
+	int maximumBufferSize() const;
+
+	virtual bool open(OpenMode mode);
+	virtual bool isSequential() const;
+	virtual bool atEnd() const;
+	virtual qint64 bytesAvailable() const;
+	virtual qint64 bytesToWrite() const;
+	virtual bool waitForReadyRead(int msecs);
+	virtual bool waitForBytesWritten(int msecs);
+
+protected:
+	virtual qint64 readData(char *data, qint64 maxSize);
+	virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+	Q_DISABLE_COPY(HashingDevice)
+
+	class Private;
+	Private *d;
+};
+
+/**
+   \class Pipeline qca_basic.h QtCrypto
+   \since 2.3
+
+   Chain of Filter and BufferedComputation stages that data passes through
+   in a single pass
+
+   A Pipeline connects several Filter objects, such as Cipher, Hex or
+   Base64, and BufferedComputation objects, such as Hash or
+   MessageAuthenticationCode.  Each Filter transforms the data and hands
+   it to the next stage.  Each BufferedComputation is updated with the
+   data as it is at that point, and passes it on unchanged.
+
+   Input is cut into blocks of blockSize() bytes, and each block goes
+   through every stage before the next block is started.  The data stays
+   in the cache on its way through, and no stage needs to hold a complete
+   intermediate copy of the message.
+
+   \code
+QCA::Cipher cipher("aes128", QCA::Cipher::CBC, QCA::Cipher::PKCS7,
+	QCA::Encode, key, iv);
+QCA::MessageAuthenticationCode mac("hmac(sha256)", macKey);
+QCA::Base64 armor;
+
+QCA::Pipeline pipeline;
+pipeline.append(&cipher).append(&mac).append(&armor);
+QByteArray text = pipeline.process(plainText).toByteArray();
+QCA::SecureArray tag = mac.final();
+   \endcode
+
+   Pipeline is itself a Filter, so it can be used as a stage of another
+   Pipeline, or read and written through a CipherDevice to pull data
+   from or push data to a QIODevice.
+
+   The stages are not owned, and must outlive the Pipeline.  final() is
+   called on every Filter stage when the Pipeline is finalized, but a
+   BufferedComputation stage is only ever updated, so that its result can
+   be collected with its own final() afterwards.  clear() clears all the
+   stages.
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT Pipeline : public Filter
+{
+public:
+	/**
+	   Construct an empty pipeline, which passes data through unchanged
+	*/
+	Pipeline();
+
+	~Pipeline();
+
+	/**
+	   Add a Filter as the last stage of the pipeline
+
+	   \param filter the filter to add
+
+	   \return a reference to this pipeline, so that calls can be chained
+	*/
+	Pipeline & append(Filter *filter);
+
+	/**
+	   Add a BufferedComputation as the last stage of the pipeline.
+	   It is updated with the data that reaches this stage, which is
+	   passed on unchanged.
+
+	   \param computation the hash or MAC to add
+
+	   \return a reference to this pipeline, so that calls can be chained
+	*/
+	Pipeline & append(BufferedComputation *computation);
+
+	/**
+	   The number of stages in the pipeline
+	*/
+	int count() const;
+
+	/**
+	   Set the number of input bytes moved through all the stages at a
+	   time.  The default is 16 KiB.
+
+	   \param size the size in bytes
+	*/
+	void setBlockSize(int size);
+
+	/**
+	   The number of input bytes moved through all the stages at a time
+	*/
+	int blockSize() const;
+
+	/**
+	   Clear all the stages, and any error
+	*/
+	virtual void clear();
+
+	/**
+	   Process more data through the pipeline
+
+	   \param a the data to process
+
+	   \return the output of the last stage
+	*/
+	virtual MemoryRegion update(const MemoryRegion &a);
+
+	/**
+	   Complete the processing.  Each Filter stage is finalized in
+	   turn, and its last output is passed through the stages after it.
+
+	   \return the remaining output of the last stage
+	*/
+	virtual MemoryRegion final();
+
+	/**
+	   Test if every stage has succeeded so far
+	*/
+	virtual bool ok() const;
+
+private:
+	Q_DISABLE_COPY(Pipeline)
+
+	class Private;
+	Private *d;
 };
 
 }
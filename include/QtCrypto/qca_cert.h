@@ -46,6 +46,8 @@ class Certificate;
 class CRL;
 class CertificateCollection;
 class CertificateChain;
+class TrustStoreFile;
+class TrustStore;
 
 
 /**
@@ -504,6 +506,10 @@ enum Validity
 
 /**
    The conditions to validate for a certificate
+
+   ValidateAll checks every condition.  Any other value checks only the
+   conditions whose flags are set, so ValidateExpired | ValidatePolicy
+   leaves out the revocation check.
 */
 enum ValidateFlags
 {
@@ -566,6 +572,24 @@ QCA_EXPORT QString orderedToDNString(const CertificateInfoOrdered &in);
 */
 QCA_EXPORT CertificateInfoOrdered orderedDNOnly(const CertificateInfoOrdered &in);
 
+/**
+   Return a CertificateInfoOrdered equal to the input object, sharing its
+   data with every other interned one that has the same contents
+
+   Certificates issued by the same authority all carry the same issuer
+   name.  Providers use this so that a large number of loaded
+   certificates keeps only one copy of each name, and of each information
+   type in it.  Interned names that are no longer used anywhere are
+   released as new ones are added.
+
+   This function is thread-safe.
+
+   \param in the certificate info to intern
+
+   \since 2.3
+*/
+QCA_EXPORT CertificateInfoOrdered internCertificateInfo(const CertificateInfoOrdered &in);
+
 inline QString CertificateInfoOrdered::toString() const
 {
 	return orderedToDNString(*this);
@@ -1009,6 +1033,45 @@ CertificateInfoOrdered info = cert.subjectInfoOrdered();
 	*/
 	BigInteger serialNumber() const;
 
+	/**
+	   A 64-bit hash of the subject name
+
+	   The hash is worked out from the DER of the certificate, without
+	   decoding the rest of it.  Names that differ only in the case or
+	   spacing of their text hash the same, as they match when building
+	   a certificate chain, so this hash can be compared with
+	   issuerNameHash() of another certificate to find possible
+	   issuers.  Different names may have the same hash.
+
+	   Returns 0 for a null certificate, or one whose DER can't be
+	   read.
+
+	   \since 2.3
+	*/
+	quint64 subjectNameHash() const;
+
+	/**
+	   A 64-bit hash of the issuer name
+
+	   \sa subjectNameHash()
+
+	   \since 2.3
+	*/
+	quint64 issuerNameHash() const;
+
+	/**
+	   The SHA-256 fingerprint of the certificate
+
+	   This is the digest of the DER encoding.  It is worked out the
+	   first time it is needed and kept with the certificate, and two
+	   certificates are equal when their fingerprints are.
+
+	   Returns an empty array for a null certificate.
+
+	   \since 2.3
+	*/
+	QByteArray fingerprint() const;
+
 	/**
 	   The public key associated with the subject of the certificate
 	*/
@@ -1068,10 +1131,35 @@ CertificateInfoOrdered info = cert.subjectInfoOrdered();
 	   \param u the use required for the certificate
 	   \param vf the conditions to validate
 
+	   Since 2.3, qca-ossl checks only the conditions named by \a vf,
+	   where it used to check all of them whatever the flags.  It
+	   doesn't check the CRLs, so ValidateRevoked has no effect there.
+
 	   \note This function may block
 	*/
 	Validity validate(const CertificateCollection &trusted, const CertificateCollection &untrusted, UsageMode u = UsageAny, ValidateFlags vf = ValidateAll) const;
 
+	/**
+	   Check the validity of a certificate against a prepared trust
+	   store
+
+	   This gives the same result as validating against the collection
+	   the store was made from, without preparing the trusted
+	   certificates again.  It may be called from several threads at
+	   once with the same store.
+
+	   \param trusted the trusted certificates
+	   \param untrusted a collection of additional certificates, not
+	   necessarily trusted
+	   \param u the use required for the certificate
+	   \param vf the conditions to validate
+
+	   \note This function may block
+
+	   \since 2.3
+	*/
+	Validity validate(const TrustStore &trusted, const CertificateCollection &untrusted, UsageMode u = UsageAny, ValidateFlags vf = ValidateAll) const;
+
 	/**
 	   Export the Certificate into a DER format
 	*/
@@ -1149,6 +1237,9 @@ CertificateInfoOrdered info = cert.subjectInfoOrdered();
 	/**
 	   Test for equality of two certificates
 
+	   Certificates are the same if their DER encodings are, which is
+	   checked by comparing their fingerprints.
+
 	   \param a the certificate to compare this certificate with
 
 	   \return true if the two certificates are the same
@@ -1178,10 +1269,27 @@ private:
 	QSharedDataPointer<Private> d;
 
 	friend class CertificateChain;
+	friend class CertIssuerIndex;
 	Validity chain_validate(const CertificateChain &chain, const CertificateCollection &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const;
+	Validity chain_validate(const CertificateChain &chain, const TrustStore &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const;
+	Validity provider_chain_validate(const CertificateChain &chain, const CertificateCollection &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const;
 	CertificateChain chain_complete(const CertificateChain &chain, const QList<Certificate> &issuers, Validity *result) const;
+	CertificateChain chain_complete(const CertificateChain &chain, const QList<Certificate> &issuers, const TrustStoreFile &roots, Validity *result) const;
 };
 
+/**
+   Hash function for a certificate, so that it can be used as a key of
+   QHash or in a QSet
+
+   The hash is taken from Certificate::fingerprint(), so it is cheap once
+   the fingerprint has been worked out.
+
+   \param cert the certificate to hash
+
+   \since 2.3
+*/
+QCA_EXPORT uint qHash(const Certificate &cert);
+
 /**
    \class CertificateChain qca_cert.h QtCrypto
 
@@ -1232,7 +1340,8 @@ public:
 	   \param untrusted_crls a list of additional CRLs, not necessarily
 	   trusted
 	   \param u the use required for the primary certificate
-	   \param vf the conditions to validate
+	   \param vf the conditions to validate, see Certificate::validate()
+	   about how qca-ossl treats them
 
 	   \note This function may block
 
@@ -1240,6 +1349,22 @@ public:
 	*/
 	inline Validity validate(const CertificateCollection &trusted, const QList<CRL> &untrusted_crls = QList<CRL>(), UsageMode u = UsageAny, ValidateFlags vf = ValidateAll) const;
 
+	/**
+	   Check the validity of a certificate chain against a prepared
+	   trust store
+
+	   \param trusted the trusted certificates
+	   \param untrusted_crls a list of additional CRLs, not necessarily
+	   trusted
+	   \param u the use required for the primary certificate
+	   \param vf the conditions to validate
+
+	   \note This function may block
+
+	   \since 2.3
+	*/
+	inline Validity validate(const TrustStore &trusted, const QList<CRL> &untrusted_crls = QList<CRL>(), UsageMode u = UsageAny, ValidateFlags vf = ValidateAll) const;
+
 	/**
 	   Complete a certificate chain for the primary certificate, using the
 	   rest of the certificates in the chain object, as well as those in
@@ -1264,6 +1389,20 @@ public:
 	   \sa validate
 	*/
 	inline CertificateChain complete(const QList<Certificate> &issuers = QList<Certificate>(), Validity *result = 0) const;
+
+	/**
+	   Complete a certificate chain for the primary certificate, as
+	   above, and if no issuer is found in the chain or \a issuers then
+	   look in \a roots.  Only the certificates of \a roots that are
+	   looked up are decoded.
+
+	   \param roots a precompiled file of trusted certificates
+	   \param issuers a pool of issuers to draw from as necessary
+	   \param result the result of the completion operation
+
+	   \since 2.3
+	*/
+	inline CertificateChain complete(const TrustStoreFile &roots, const QList<Certificate> &issuers = QList<Certificate>(), Validity *result = 0) const;
 };
 
 inline Validity CertificateChain::validate(const CertificateCollection &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const
@@ -1273,6 +1412,13 @@ inline Validity CertificateChain::validate(const CertificateCollection &trusted,
 	return first().chain_validate(*this, trusted, untrusted_crls, u, vf);
 }
 
+inline Validity CertificateChain::validate(const TrustStore &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const
+{
+	if(isEmpty())
+		return ErrorValidityUnknown;
+	return first().chain_validate(*this, trusted, untrusted_crls, u, vf);
+}
+
 inline CertificateChain CertificateChain::complete(const QList<Certificate> &issuers, Validity *result) const
 {
 	if(isEmpty())
@@ -1280,6 +1426,13 @@ inline CertificateChain CertificateChain::complete(const QList<Certificate> &iss
 	return first().chain_complete(*this, issuers, result);
 }
 
+inline CertificateChain CertificateChain::complete(const TrustStoreFile &roots, const QList<Certificate> &issuers, Validity *result) const
+{
+	if(isEmpty())
+		return CertificateChain();
+	return first().chain_complete(*this, issuers, roots, result);
+}
+
 /**
    \class CertificateRequest qca_cert.h QtCrypto
 
@@ -1780,6 +1933,18 @@ public:
 	*/
 	QByteArray issuerKeyId() const;
 
+	/**
+	   The SHA-256 fingerprint of the CRL
+
+	   This is the digest of the DER encoding, worked out the first time
+	   it is needed.  Two CRLs are equal when their fingerprints are.
+
+	   Returns an empty array for a null CRL.
+
+	   \since 2.3
+	*/
+	QByteArray fingerprint() const;
+
 	/**
 	   Test for equality of two %Certificate Revocation Lists
 
@@ -1872,8 +2037,20 @@ private:
 	class Private;
 	friend class Private;
 	QSharedDataPointer<Private> d;
+
+	friend class ValidationCache;
 };
 
+/**
+   Hash function for a CRL, so that it can be used as a key of QHash
+   or in a QSet
+
+   \param crl the CRL to hash
+
+   \since 2.3
+*/
+QCA_EXPORT uint qHash(const CRL &crl);
+
 /**
    \class CertificateCollection qca_cert.h QtCrypto
 
@@ -1928,6 +2105,9 @@ public:
 
 	/**
 	   The Certificates in this collection
+
+	   This includes the certificates of trustStoreFile(), which are all
+	   decoded by this call.
 	*/
 	QList<Certificate> certificates() const;
 
@@ -1936,6 +2116,44 @@ public:
 	*/
 	QList<CRL> crls() const;
 
+	/**
+	   The certificates of this collection that issued \a cert, in the
+	   order they were added
+
+	   Candidates are found through an index of subject names and key
+	   identifiers, which is built on first use, and are then checked
+	   with Certificate::isIssuerOf().
+
+	   \param cert the certificate to find the issuers of
+
+	   \since 2.3
+	*/
+	QList<Certificate> issuersOf(const Certificate &cert) const;
+
+	/**
+	   The certificate of this collection with the SHA-256 fingerprint
+	   \a fingerprint, or a null Certificate if there is none
+
+	   \param fingerprint the SHA-256 hash of the certificate's DER
+
+	   \since 2.3
+	*/
+	Certificate findFingerprint(const QByteArray &fingerprint) const;
+
+	/**
+	   The trust store file whose certificates this collection holds
+	   without decoding them, or a null TrustStoreFile
+
+	   A collection made by TrustStoreFile::toCertificateCollection(),
+	   such as the one systemStore() gives for a trust store file, reads
+	   the certificates from the file as they are needed.  issuersOf(),
+	   findFingerprint() and validation against the collection decode
+	   only the certificates they look up.
+
+	   \since 2.3
+	*/
+	TrustStoreFile trustStoreFile() const;
+
 	/**
 	   Add another CertificateCollection to this collection
 
@@ -2021,11 +2239,316 @@ public:
 	*/
 	static CertificateCollection fromPKCS7File(const QString &fileName, ConvertResult *result = 0, const QString &provider = QString());
 
+private:
+	class Private;
+	QSharedDataPointer<Private> d;
+
+	friend class Certificate;
+	friend class TrustStoreFile;
+	friend class ValidationCache;
+};
+
+/**
+   \class TrustStoreFile qca_cert.h QtCrypto
+   \since 2.3
+
+   A precompiled file of trusted certificates
+
+   A trust store file holds certificates in DER form behind an index of
+   their subject names, subject key identifiers and SHA-256
+   fingerprints.  Opening one maps the file and reads the index only; a
+   certificate is decoded the first time it is asked for, for instance
+   when chain completion looks for the issuer of another certificate.
+   This makes it a cheap way to carry a large set of roots, such as the
+   one the mozcerts tool makes from Mozilla's certdata.txt.
+
+   TrustStoreFile is implicitly shared and may be used from several
+   threads at once.
+
+   \sa CertificateChain::complete()
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT TrustStoreFile
+{
+public:
+	/**
+	   Create an empty trust store
+	*/
+	TrustStoreFile();
+
+	/**
+	   Standard copy constructor
+
+	   \param from the TrustStoreFile to copy from
+	*/
+	TrustStoreFile(const TrustStoreFile &from);
+
+	~TrustStoreFile();
+
+	/**
+	   Standard assignment operator
+
+	   \param from the TrustStoreFile to copy from
+	*/
+	TrustStoreFile & operator=(const TrustStoreFile &from);
+
+	/**
+	   Test if no file is loaded
+	*/
+	bool isNull() const;
+
+	/**
+	   The number of certificates in the store
+	*/
+	int count() const;
+
+	/**
+	   The DER encoding of a certificate, without decoding it
+
+	   \param index the certificate, from 0 to count() - 1
+	*/
+	QByteArray certificateDER(int index) const;
+
+	/**
+	   A certificate of the store.  It is decoded on first use, and the
+	   same Certificate is returned after that.  A certificate the
+	   provider can't decode is returned as a null Certificate.
+
+	   \param index the certificate, from 0 to count() - 1
+	*/
+	Certificate certificate(int index) const;
+
+	/**
+	   The certificates of the store that issued \a cert, found through
+	   the index by the issuer name and authority key identifier of
+	   \a cert.  Only the candidates are decoded.
+
+	   \param cert the certificate to find the issuers of
+	*/
+	QList<Certificate> issuersOf(const Certificate &cert) const;
+
+	/**
+	   The certificate with the SHA-256 fingerprint \a fingerprint, or a
+	   null Certificate if there is none
+
+	   \param fingerprint the SHA-256 hash of the certificate's DER
+	*/
+	Certificate findFingerprint(const QByteArray &fingerprint) const;
+
+	/**
+	   A collection of the certificates of the store.  They are not
+	   decoded until the collection looks them up, or
+	   CertificateCollection::certificates() is called.
+
+	   \sa CertificateCollection::trustStoreFile()
+	*/
+	CertificateCollection toCertificateCollection() const;
+
+	/**
+	   Open a trust store file
+
+	   \param fileName the name (and path, if required) of the file
+	   \param result a pointer to a ConvertResult, which if not-null will
+	   be set to the conversion status
+	   \param provider the provider to decode certificates with, if a
+	   specific provider is required
+	*/
+	static TrustStoreFile fromFile(const QString &fileName, ConvertResult *result = 0, const QString &provider = QString());
+
+	/**
+	   Write a trust store file
+
+	   \param fileName the name (and path, if required) of the file
+	   \param certs the certificates, in DER form
+
+	   \return false if the file could not be written, or if one of
+	   \a certs is not a certificate
+	*/
+	static bool toFile(const QString &fileName, const QList<QByteArray> &certs);
+
+	/**
+	   \overload
+
+	   \param fileName the name (and path, if required) of the file
+	   \param certs the certificates
+	*/
+	static bool toFile(const QString &fileName, const QList<Certificate> &certs);
+
+	/**
+	   Test if a file is a trust store file, by its header
+
+	   \param fileName the name (and path, if required) of the file
+	*/
+	static bool isTrustStoreFile(const QString &fileName);
+
 private:
 	class Private;
 	QSharedDataPointer<Private> d;
 };
 
+/**
+   \class TrustStore qca_cert.h QtCrypto
+   \since 2.3
+
+   Trusted certificates prepared for validation
+
+   Validating against a CertificateCollection hands every trusted
+   certificate and CRL to the provider on each call.  A TrustStore does
+   that once, when it is made, and keeps the provider's store for
+   Certificate::validate() and CertificateChain::validate() to reuse.
+
+   The store doesn't change once made, and it may be used from several
+   threads at once.  If the provider can't prepare a store, validation
+   falls back to the collection.
+
+   Preparing the store decodes every certificate of the collection,
+   including those of its CertificateCollection::trustStoreFile().  For
+   a large file of which few roots are used, validating against the
+   collection itself decodes only the roots the chains lead to.
+
+   The ValidateFlags given to validation are honoured as they are for a
+   collection: ValidateAll checks every condition, and other flags only
+   the conditions they name.  qca-ossl doesn't check the certificates
+   against the CRLs, so ValidateRevoked has no effect there.
+
+   \code
+QCA::TrustStore roots(QCA::systemStore());
+foreach(const QCA::Certificate &cert, certs)
+	results += cert.validate(roots, intermediates);
+   \endcode
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT TrustStore : public Algorithm
+{
+public:
+	/**
+	   Create an empty trust store, which trusts nothing
+	*/
+	TrustStore();
+
+	/**
+	   Prepare a trust store
+
+	   \param trusted the trusted certificates and CRLs
+	   \param provider the provider to use, if a specific provider is
+	   required.  By default it is the one of the certificates.
+	*/
+	explicit TrustStore(const CertificateCollection &trusted, const QString &provider = QString());
+
+	/**
+	   Standard copy constructor
+
+	   \param from the TrustStore to copy from
+	*/
+	TrustStore(const TrustStore &from);
+
+	~TrustStore();
+
+	/**
+	   Standard assignment operator
+
+	   \param from the TrustStore to copy from
+	*/
+	TrustStore & operator=(const TrustStore &from);
+
+	/**
+	   The certificates and CRLs the store was made from
+	*/
+	CertificateCollection collection() const;
+
+private:
+	class Private;
+	QSharedDataPointer<Private> d;
+};
+
+/**
+   Enable or disable the certificate validation cache
+
+   When enabled, the results of Certificate::validate() and
+   CertificateChain::validate() are remembered, and asking again with the
+   same certificates, trusted collection, CRLs, usage and flags gives the
+   remembered result without asking the provider.  TLS in qca-ossl
+   always has openssl check the peer's certificates; only where it
+   validates the peer's chain again through CertificateChain::validate()
+   (on Mac OS X) is that answered from the cache.
+
+   Certificates and CRLs are compared by their SHA-256 fingerprints.  The
+   trusted collection is compared by identity: each change to a
+   CertificateCollection, or a copy that is changed, starts a new
+   generation, so keep and reuse the same collection (or TrustStore) for
+   the cache to be of use.
+
+   A result is kept until the time to live passes, or until the first
+   time at which it could change: the earliest expiry or start of a
+   certificate in the chain, or the earliest next update of a CRL.
+
+   The cache is disabled by default, and is shared by all threads.
+   Disabling it forgets the cached results and resets the counters.
+
+   \param enabled whether to cache validation results
+
+   \sa setValidationCacheTimeToLive, clearValidationCache
+
+   \since 2.3
+*/
+QCA_EXPORT void setValidationCacheEnabled(bool enabled);
+
+/**
+   Test if the certificate validation cache is enabled
+
+   \sa setValidationCacheEnabled
+
+   \since 2.3
+*/
+QCA_EXPORT bool validationCacheEnabled();
+
+/**
+   Set how long a validation result is kept at most
+
+   The default is 300 seconds.  Results already cached keep the time they
+   were given.
+
+   \param seconds the longest time to keep a result
+
+   \since 2.3
+*/
+QCA_EXPORT void setValidationCacheTimeToLive(int seconds);
+
+/**
+   The longest time a validation result is kept, in seconds
+
+   \since 2.3
+*/
+QCA_EXPORT int validationCacheTimeToLive();
+
+/**
+   The number of validations answered from the cache
+
+   \sa validationCacheMisses
+
+   \since 2.3
+*/
+QCA_EXPORT quint64 validationCacheHits();
+
+/**
+   The number of validations, while the cache was enabled, that were not
+   answered from it
+
+   \sa validationCacheHits
+
+   \since 2.3
+*/
+QCA_EXPORT quint64 validationCacheMisses();
+
+/**
+   Forget all cached validation results and reset the counters
+
+   \since 2.3
+*/
+QCA_EXPORT void clearValidationCache();
+
 /**
    \class CertificateAuthority qca_cert.h QtCrypto
 
@@ -2670,6 +3193,141 @@ private:
 	Private *d;
 };
 
+/**
+   \class CertificateValidator qca_cert.h QtCrypto
+   \since 2.3
+
+   Asynchronous validation of many certificates
+
+   The certificates given to start() are validated against the same
+   TrustStore on a pool of worker threads, by default one per processor.
+   A validated() signal is emitted for each certificate as its result
+   comes in, in no particular order, and finished() is emitted after the
+   last one.  The signals are emitted in the thread that owns the
+   validator.
+
+   \code
+QCA::CertificateValidator *validator = new QCA::CertificateValidator(this);
+connect(validator, SIGNAL(validated(int, QCA::Validity)), SLOT(report(int, QCA::Validity)));
+connect(validator, SIGNAL(finished()), SLOT(done()));
+validator->start(certs, QCA::TrustStore(QCA::systemStore()));
+   \endcode
+
+   \sa validateMany
+
+   \ingroup UserAPI
+*/
+class QCA_EXPORT CertificateValidator : public QObject
+{
+	Q_OBJECT
+public:
+	/**
+	   Create a CertificateValidator object
+
+	   \param parent the parent object for this object
+	*/
+	CertificateValidator(QObject *parent = 0);
+
+	/**
+	   Destroys the validator, stopping any validation in progress.
+	   Validations already running in the pool are waited for.
+	*/
+	~CertificateValidator();
+
+	/**
+	   Set the most worker threads to use.  This takes effect on the next
+	   call to start().
+
+	   \param count the number of threads
+	*/
+	void setMaxThreadCount(int count);
+
+	/**
+	   The most worker threads used
+	*/
+	int maxThreadCount() const;
+
+	/**
+	   Start validating certificates
+
+	   This function returns immediately.
+
+	   \param certs the certificates to validate
+	   \param trusted the trusted certificates, shared by all workers
+	   \param untrusted a collection of additional certificates, not
+	   necessarily trusted
+	   \param u the use required for the certificates
+	   \param vf the conditions to validate
+	*/
+	void start(const QList<Certificate> &certs, const TrustStore &trusted, const CertificateCollection &untrusted = CertificateCollection(), UsageMode u = UsageAny, ValidateFlags vf = ValidateAll);
+
+	/**
+	   Test if validation is in progress, that is if finished() has not
+	   been emitted yet since start()
+	*/
+	bool isActive() const;
+
+	/**
+	   Block until all of the certificates have been validated.  The
+	   validated() signals not yet emitted, and finished(), are emitted
+	   before this returns.
+	*/
+	void waitForFinished();
+
+	/**
+	   The results, in the order of the certificates given to start().
+	   A certificate whose validated() signal hasn't been emitted yet has
+	   ErrorValidityUnknown, so this may be called while validation is in
+	   progress.
+	*/
+	QList<Validity> results() const;
+
+Q_SIGNALS:
+	/**
+	   Emitted when a certificate has been validated
+
+	   \param index the position of the certificate in the list given
+	   to start()
+	   \param result the result of validating it
+	*/
+	void validated(int index, QCA::Validity result);
+
+	/**
+	   Emitted when all of the certificates have been validated
+	*/
+	void finished();
+
+private:
+	Q_DISABLE_COPY(CertificateValidator)
+
+	class Private;
+	friend class Private;
+	Private *d;
+};
+
+/**
+   Validate many certificates at once
+
+   This is Certificate::validate() for each of \a certs, run on a pool
+   of worker threads with one TrustStore made from \a trusted.
+
+   \param certs the certificates to validate
+   \param trusted a collection of trusted certificates
+   \param untrusted a collection of additional certificates, not
+   necessarily trusted
+   \param u the use required for the certificates
+   \param vf the conditions to validate
+
+   \return the results, in the order of \a certs
+
+   \note This function blocks until all of the certificates are validated
+
+   \sa CertificateValidator
+
+   \since 2.3
+*/
+QCA_EXPORT QList<Validity> validateMany(const QList<Certificate> &certs, const CertificateCollection &trusted, const CertificateCollection &untrusted = CertificateCollection(), UsageMode u = UsageAny, ValidateFlags vf = ValidateAll);
+
 }
 
 #endif
@@ -37,6 +37,7 @@
 #include <QString>
 #include <QStringList>
 #include <QList>
+#include <QMap>
 #include <QSharedData>
 #include <QSharedDataPointer>
 #include "qca_export.h"
@@ -347,6 +348,70 @@ QCA_EXPORT void setProviderPriority(const QString &name, int priority);
 */
 QCA_EXPORT int providerPriority(const QString &name);
 
+/**
+   Enable or disable provider calibration
+
+   When calibration is enabled, the first time a hash, cipher or MAC
+   feature is requested without naming a provider, every provider that
+   supports it is timed on a few representative message sizes and the
+   fastest one is used for that feature from then on, in place of the
+   priority order described in setProviderPriority().  A provider named
+   at object instantiation time is still used when it supports the
+   feature.
+
+   The results are saved in the user's QCA settings, keyed on the host,
+   its processor features and the versions of the loaded providers, so
+   the measurements only need to be repeated when one of those changes.
+
+   Calibration is disabled by default.  It can also be enabled by
+   setting QCA_CALIBRATE_PROVIDERS=1 in the environment.
+
+   \param enabled whether to calibrate features on first use
+
+   \sa calibrateProviders
+
+   \since 2.3
+*/
+QCA_EXPORT void setProviderCalibration(bool enabled);
+
+/**
+   Test if provider calibration is enabled
+
+   \sa setProviderCalibration
+
+   \since 2.3
+*/
+QCA_EXPORT bool providerCalibration();
+
+/**
+   Measure the providers now and use the fastest one for each feature
+
+   This does the same measurements as calibration on first use, but
+   immediately and without consulting the saved results, which are
+   replaced.  The choices made are used whether or not
+   setProviderCalibration() has been enabled.
+
+   \param features the hash, cipher and MAC features to measure (eg
+   "sha256", "aes128-gcm").  If empty, every such feature of every
+   provider is measured, which may take a few seconds.
+
+   \sa calibratedProviders
+
+   \since 2.3
+*/
+QCA_EXPORT void calibrateProviders(const QStringList &features = QStringList());
+
+/**
+   Return the provider chosen by calibration for each feature
+
+   The map is keyed on the feature name, with the provider name as the
+   value.  Features that were not calibrated, or that only one provider
+   supports, are not included.
+
+   \since 2.3
+*/
+QCA_EXPORT QMap<QString,QString> calibratedProviders();
+
 /**
    Return a list of the current providers
 
@@ -547,6 +612,14 @@ QCA_EXPORT bool haveSystemStore();
    %QCA was built. You can test whether the system certificates
    are available using the haveSystemStore() function.
 
+   The store is loaded once and the same snapshot is shared by
+   later calls, until the store's files change or the providers or
+   their configuration do.
+
+   When the store is a trust store file, loading it only maps the
+   file.  Its certificates are decoded as validation looks them up
+   (see CertificateCollection::trustStoreFile()).
+
 */
 QCA_EXPORT CertificateCollection systemStore();
 
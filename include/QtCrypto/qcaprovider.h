@@ -267,6 +267,26 @@ public:
 	   \param out pointer to an array that should store the result
 	*/
 	virtual bool final(SecureArray *out) = 0;
+
+	/**
+	   Encrypt or decrypt many independent messages with one key.  Returns
+	   true if every record succeeded.
+
+	   The default implementation calls setup(), update() and final() for
+	   each record, and fails records with additional authenticated data.
+	   Providers can reimplement this to set up the key only once, to
+	   support additional data and to work on several records at a time.
+	   The state of the context afterwards is unspecified, the caller
+	   calls setup() again before further use.
+
+	   \param dir the direction for the cipher (encryption/decryption)
+	   \param key the symmetric key to use for every record
+	   \param records the messages, see Cipher::Record
+	   \param failed receives the indexes of the records that failed
+
+	   \since 2.3
+	*/
+	virtual bool processBatch(Direction dir, const SymmetricKey &key, const QVector<Cipher::Record> &records, QList<int> *failed);
 };
 
 /**
@@ -377,6 +397,39 @@ public:
 								 unsigned int keyLength,
 								 int msecInterval,
 								 unsigned int *iterationCount) = 0;
+
+	/**
+	   Create a key with cost parameters and return it
+
+	   The default implementation calls makeKey() with
+	   parameters.timeCost as the iteration count.  The memory-hard
+	   functions reimplement this, and return an empty key for
+	   parameters they can't use.
+
+	   \param secret the secret part (typically password)
+	   \param salt the salt / initialization vector
+	   \param keyLength the length of the key to be produced
+	   \param parameters the cost of the derivation, see KeyDerivationFunction::Parameters
+
+	   \since 2.3
+	*/
+	virtual SymmetricKey makeKeyWithParameters(const SecureArray &secret, const InitializationVector &salt,
+											   unsigned int keyLength, const KeyDerivationFunction::Parameters &parameters);
+
+	/**
+	   Create several keys and return them, in the order of the jobs
+
+	   The default implementation calls makeKey() for each job.
+	   Providers can reimplement this to work on several keys at a
+	   time.  KeyDerivationFunction::makeKeys() already spreads the jobs
+	   over threads, so this is called on a worker thread and should not
+	   start threads of its own.
+
+	   \param jobs the keys to derive, see KeyDerivationFunction::Job
+
+	   \since 2.3
+	*/
+	virtual QList<SymmetricKey> makeKeys(const QList<KeyDerivationFunction::Job> &jobs);
 };
 
 /**
@@ -411,6 +464,35 @@ public:
 	*/
 	virtual SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt,
 								 const InitializationVector &info, unsigned int keyLength) = 0;
+
+	/**
+	   Run the extract step and return the pseudorandom key
+
+	   The default implementation uses the provider's HMAC.
+
+	   \param secret the input keying material
+	   \param salt the salt, or an empty array for none
+
+	   \since 2.3
+	*/
+	virtual SymmetricKey extract(const SecureArray &secret, const InitializationVector &salt);
+
+	/**
+	   Run the expand step on a pseudorandom key and return the derived key
+
+	   Callers typically expand one pseudorandom key many times, so an
+	   implementation may keep the keyed HMAC state of the last one.  The
+	   default implementation uses the provider's HMAC.
+
+	   \param prk the pseudorandom key
+	   \param info the info
+	   \param keyLength the length of the key to be produced, at most 255
+	   times the length of the hash
+
+	   \since 2.3
+	*/
+	virtual SymmetricKey expand(const SymmetricKey &prk, const InitializationVector &info,
+								unsigned int keyLength);
 };
 
 /**
@@ -1300,6 +1382,31 @@ public:
 	*/
 	virtual const CertContextProps *props() const = 0;
 
+	/**
+	   Returns the serial number of this certificate
+
+	   Providers that decode the properties on first use of props() can
+	   reimplement this, and the two functions below, to read the value
+	   alone.  The default implementation uses props().
+
+	   \since 2.3
+	*/
+	virtual BigInteger serialNumber() const;
+
+	/**
+	   Returns the time this certificate becomes valid
+
+	   \since 2.3
+	*/
+	virtual QDateTime notValidBefore() const;
+
+	/**
+	   Returns the time this certificate stops being valid
+
+	   \since 2.3
+	*/
+	virtual QDateTime notValidAfter() const;
+
 	/**
 	   Returns true if this certificate is equal to another certificate,
 	   otherwise false
@@ -1517,6 +1624,75 @@ public:
 	virtual ConvertResult fromPKCS7(const QByteArray &a, QList<CertContext*> *certs, QList<CRLContext*> *crls) const = 0;
 };
 
+/**
+   \class TrustStoreContext qcaprovider.h QtCrypto
+
+   Prepared set of trusted certificates provider
+
+   A trust store is set up once from trusted certificates and CRLs, and is
+   then used to validate any number of certificates without preparing
+   the trusted items again.  The validation functions are called from
+   several threads at once, and must be safe for that.
+
+   \note This class is part of the provider plugin interface and should not
+   be used directly by applications.  You probably want TrustStore
+   instead.
+
+   \since 2.3
+
+   \ingroup ProviderAPI
+*/
+class QCA_EXPORT TrustStoreContext : public BasicContext
+{
+	Q_OBJECT
+public:
+	/**
+	   Standard constructor
+
+	   \param p the provider associated with this context
+	*/
+	TrustStoreContext(Provider *p) : BasicContext(p, QStringLiteral("truststore")) {}
+
+	/**
+	   Set up the store.  This is called once, before any validation.
+
+	   Returns true if successful, otherwise false.
+
+	   \param trusted list of trusted certificates
+	   \param crls list of trusted CRLs (can be empty)
+	*/
+	virtual bool setup(const QList<CertContext*> &trusted, const QList<CRLContext*> &crls) = 0;
+
+	/**
+	   Validate a certificate against the store
+
+	   This function is blocking.
+
+	   \param cert the certificate to validate
+	   \param untrusted list of untrusted certificates (can be empty)
+	   \param crls list of additional CRLs (can be empty)
+	   \param u the desired usage for the certificate
+	   \param vf validation options
+	   \param chain if not null, receives the chain that was validated,
+	   starting with the user certificate.  The caller owns the contexts.
+	*/
+	virtual Validity validate(const CertContext *cert, const QList<CertContext*> &untrusted, const QList<CRLContext*> &crls, UsageMode u, ValidateFlags vf, QList<CertContext*> *chain) const = 0;
+
+	/**
+	   Validate a certificate chain against the store
+
+	   This function is blocking.
+
+	   \param chain list of certificates in the chain, starting with the
+	   user certificate.  It is not necessary for the chain to contain
+	   the final root certificate.
+	   \param crls list of additional CRLs (can be empty)
+	   \param u the desired usage for the user certificate in the chain
+	   \param vf validation options
+	*/
+	virtual Validity validate_chain(const QList<CertContext*> &chain, const QList<CRLContext*> &crls, UsageMode u, ValidateFlags vf) const = 0;
+};
+
 /**
    \class CAContext qcaprovider.h QtCrypto
 
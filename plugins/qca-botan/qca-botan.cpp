@@ -41,6 +41,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 
 //-----------------------------------------------------------
@@ -209,8 +210,21 @@ public:
 	{
 		Q_ASSERT(iterationCount != NULL);
 		Botan::OctetString key;
-		QTime timer;
 		std::string secretString(secret.data(), secret.size() );
+#if BOTAN_VERSION_CODE >= BOTAN_VERSION_CODE_FOR(2,0,0)
+		// Botan times the derivation itself and hands back the key from
+		// that same run, rather than deriving it all over again.
+		size_t iterations = 0;
+		key = m_s2k->derive_key(keyLength,
+								secretString,
+								(const Botan::byte*)salt.data(),
+								salt.size(),
+								std::chrono::milliseconds(qMax(msecInterval, 0)),
+								iterations);
+		*iterationCount = iterations;
+		return QCA::SymmetricKey(QCA::SecureArray(QByteArray((const char*)key.begin(), key.length())));
+#else
+		QTime timer;
 
 		*iterationCount = 0;
 		timer.start();
@@ -223,6 +237,7 @@ public:
 			++(*iterationCount);
 		}
 		return makeKey(secret, salt, keyLength, *iterationCount);
+#endif
 	}
 
 protected:
@@ -236,19 +251,22 @@ class BotanHKDFContext: public QCA::HKDFContext
 public:
     BotanHKDFContext(const QString &hashName, QCA::Provider *p, const QString &type) : QCA::HKDFContext(p, type)
     {
+	m_hashName = hashName;
 	Botan::HMAC *hashObj;
 	hashObj = new Botan::HMAC(Botan::HashFunction::create_or_throw(hashName.toStdString()).release());
 	m_hkdf = new Botan::HKDF(hashObj);
+	m_hmac = new Botan::HMAC(Botan::HashFunction::create_or_throw(hashName.toStdString()).release());
     }
 
     ~BotanHKDFContext()
     {
 	delete m_hkdf;
+	delete m_hmac;
     }
 
     Context *clone() const
     {
-	return new BotanHKDFContext( *this );
+	return new BotanHKDFContext( m_hashName, provider(), type() );
     }
 
     QCA::SymmetricKey makeKey(const QCA::SecureArray &secret, const QCA::InitializationVector &salt,
@@ -264,8 +282,48 @@ public:
 	return QCA::SymmetricKey(retval);
     }
 
+    QCA::SymmetricKey extract(const QCA::SecureArray &secret, const QCA::InitializationVector &salt)
+    {
+	// m_hmac is rekeyed here, so forget the cached PRK
+	m_prk = QCA::SecureArray();
+	if (salt.isEmpty())
+	    m_hmac->set_key(Botan::secure_vector<uint8_t>(m_hmac->output_length()));
+	else
+	    m_hmac->set_key(reinterpret_cast<const Botan::byte*>(salt.data()), salt.size());
+	m_hmac->update(reinterpret_cast<const Botan::byte*>(secret.data()), secret.size());
+	Botan::secure_vector<uint8_t> prk = m_hmac->final();
+	return QCA::SymmetricKey(QCA::SecureArray(QByteArray(reinterpret_cast<const char*>(prk.data()), prk.size())));
+    }
+
+    QCA::SymmetricKey expand(const QCA::SymmetricKey &prk, const QCA::InitializationVector &info, unsigned int keyLength)
+    {
+	const unsigned int hashLength = m_hmac->output_length();
+	if (keyLength > 255 * hashLength)
+	    return QCA::SymmetricKey();
+
+	// the HMAC stays keyed with the last PRK between calls
+	if (prk != m_prk) {
+	    m_hmac->set_key(reinterpret_cast<const Botan::byte*>(prk.data()), prk.size());
+	    m_prk = prk;
+	}
+
+	QCA::SecureArray out(keyLength);
+	Botan::secure_vector<uint8_t> t;
+	for (unsigned int done = 0, i = 1; done < keyLength; done += hashLength, ++i) {
+	    m_hmac->update(t);
+	    m_hmac->update(reinterpret_cast<const Botan::byte*>(info.data()), info.size());
+	    m_hmac->update(static_cast<uint8_t>(i));
+	    t = m_hmac->final();
+	    memcpy(out.data() + done, t.data(), qMin(hashLength, keyLength - done));
+	}
+	return out;
+    }
+
 protected:
+    QString m_hashName;
     Botan::HKDF* m_hkdf;
+    Botan::MessageAuthenticationCode* m_hmac;
+    QCA::SecureArray m_prk;
 };
 #endif
 
@@ -460,7 +518,10 @@ public:
 	list += "pbkdf1(md2)";
 	list += "pbkdf2(sha1)";
 #if BOTAN_VERSION_CODE >= BOTAN_VERSION_CODE_FOR(2,0,0)
+	list += "hkdf(sha1)";
 	list += "hkdf(sha256)";
+	list += "hkdf(sha384)";
+	list += "hkdf(sha512)";
 #endif
 	list += "aes128-ecb";
 	list += "aes128-cbc";
@@ -528,8 +589,14 @@ public:
 	else if ( type == "pbkdf2(sha1)" )
 	    return new BotanPBKDFContext( QString("PBKDF2(SHA-1)"), this, type );
 #if BOTAN_VERSION_CODE >= BOTAN_VERSION_CODE_FOR(2,0,0)
+	else if ( type == "hkdf(sha1)" )
+	    return new BotanHKDFContext( QString("SHA-1"), this, type );
 	else if ( type == "hkdf(sha256)" )
 	    return new BotanHKDFContext( QString("SHA-256"), this, type );
+	else if ( type == "hkdf(sha384)" )
+	    return new BotanHKDFContext( QString("SHA-384"), this, type );
+	else if ( type == "hkdf(sha512)" )
+	    return new BotanHKDFContext( QString("SHA-512"), this, type );
 #endif
 	else if ( type == "aes128-ecb" )
 	    return new BotanCipherContext( QString("AES-128"), QString("ECB"), QString("NoPadding"), this, type );
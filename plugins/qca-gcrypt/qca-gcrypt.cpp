@@ -448,25 +448,58 @@ public:
 							  unsigned int *iterationCount)
 	{
 		Q_ASSERT(iterationCount != NULL);
-		QCA::SymmetricKey result(keyLength);
 		QTime timer;
-
-		*iterationCount = 0;
 		timer.start();
 
+		// Run PBKDF2 by hand, all the output blocks together, so that
+		// the iterations can be counted while they happen and the key
+		// comes out of the same pass that was timed.
+		gcry_md_hd_t hmac;
+		if (gcry_md_open(&hmac, m_algorithm, GCRY_MD_FLAG_HMAC) != GPG_ERR_NO_ERROR)
+			return QCA::SymmetricKey();
+		if (gcry_md_setkey(hmac, secret.data(), secret.size()) != GPG_ERR_NO_ERROR) {
+			gcry_md_close(hmac);
+			return QCA::SymmetricKey();
+		}
+
+		const int mdLength = gcry_md_get_algo_dlen(m_algorithm);
+		const int blocks = (keyLength + mdLength - 1) / mdLength;
+		QCA::SecureArray u(blocks * mdLength);
+		QCA::SecureArray t(blocks * mdLength);
+		for (int b = 0; b < blocks; ++b) {
+			unsigned char index[4];
+			index[0] = (unsigned char)((b + 1) >> 24);
+			index[1] = (unsigned char)((b + 1) >> 16);
+			index[2] = (unsigned char)((b + 1) >> 8);
+			index[3] = (unsigned char)(b + 1);
+			// reset keeps the key
+			gcry_md_reset(hmac);
+			gcry_md_write(hmac, salt.data(), salt.size());
+			gcry_md_write(hmac, index, 4);
+			memcpy(u.data() + b * mdLength, gcry_md_read(hmac, m_algorithm), mdLength);
+			memcpy(t.data() + b * mdLength, u.data() + b * mdLength, mdLength);
+		}
+
+		// the clock is only read every 256 iterations
+		*iterationCount = 1;
 		while (timer.elapsed() < msecInterval) {
-			gcry_pbkdf2(m_algorithm,
-						secret.data(),
-						secret.size(),
-						salt.data(),
-						salt.size(),
-						1,
-						keyLength,
-						result.data());
-			++(*iterationCount);
+			for (int n = 0; n < 256; ++n) {
+				for (int b = 0; b < blocks; ++b) {
+					char *ub = u.data() + b * mdLength;
+					char *tb = t.data() + b * mdLength;
+					gcry_md_reset(hmac);
+					gcry_md_write(hmac, ub, mdLength);
+					memcpy(ub, gcry_md_read(hmac, m_algorithm), mdLength);
+					for (int i = 0; i < mdLength; ++i)
+						tb[i] ^= ub[i];
+				}
+			}
+			*iterationCount += 256;
 		}
+		gcry_md_close(hmac);
 
-		return makeKey(secret, salt, keyLength, *iterationCount);
+		t.resize(keyLength);
+		return t;
 	}
 
 protected:
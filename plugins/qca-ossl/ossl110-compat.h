@@ -255,6 +255,7 @@ static void HMAC_CTX_free(HMAC_CTX *ctx)
 #define EVP_PKEY_up_ref(pkey) CRYPTO_add(&(pkey)->references, 1, CRYPTO_LOCK_EVP_PKEY)
 #define X509_up_ref(cert) CRYPTO_add(&(cert)->references, 1, CRYPTO_LOCK_X509)
 #define X509_CRL_up_ref(crl) CRYPTO_add(&(crl)->references, 1, CRYPTO_LOCK_X509_CRL)
+#define X509_STORE_up_ref(store) CRYPTO_add(&(store)->references, 1, CRYPTO_LOCK_X509_STORE)
 
 #define EVP_PKEY_id(pky) (pky)->type
 #define EVP_PKEY_get0_DSA(pky) (pky)->pkey.dsa
@@ -270,6 +271,9 @@ static void HMAC_CTX_free(HMAC_CTX *ctx)
 #define X509_REVOKED_get0_serialNumber(rev) (rev)->serialNumber
 #define X509_REVOKED_get0_revocationDate(rev) (rev)->revocationDate
 
+#define X509_STORE_CTX_get0_cert(ctx) (ctx)->cert
+#define X509_STORE_CTX_get0_untrusted(ctx) (ctx)->untrusted
+
 #endif // OPENSSL_VERSION_NUMBER < 0x10100000L
 
 #endif // OSSL110COMPAT_H
@@ -23,7 +23,11 @@
 #include <QtCrypto>
 #include <qcaprovider.h>
 #include <QDebug>
+#include <QMutex>
 #include <QScopedPointer>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
 #include <QTime>
 #include <QtPlugin>
 
@@ -1221,11 +1225,72 @@ protected:
 	EVP_MD_CTX *m_context;
 };
 
+// HMAC of a followed by b, with the key already set in context.  A null
+// key to HMAC_Init_ex() restarts with that key.
+static bool pbkdf2_hmac(HMAC_CTX *context, const unsigned char *a, int aLength,
+						const unsigned char *b, int bLength, unsigned char *out)
+{
+	return HMAC_Init_ex(context, 0, 0, 0, 0)
+		&& HMAC_Update(context, a, aLength)
+		&& (bLength == 0 || HMAC_Update(context, b, bLength))
+		&& HMAC_Final(context, out, 0);
+}
+
+// a thread is only worth starting for this many block iterations
+#define PBKDF2_PARALLEL_MIN_WORK 4096
+
+// Computes PBKDF2 output blocks first + 1 to first + count, so that the
+// blocks of a long key can be spread over several threads.
+class opensslPbkdf2Blocks : public QRunnable
+{
+public:
+	const EVP_MD *algorithm;
+	const SecureArray *secret;
+	const InitializationVector *salt;
+	unsigned int iterationCount;
+	int first, count;
+	char *out;
+	bool ok;
+
+	opensslPbkdf2Blocks() : ok(false)
+	{
+		setAutoDelete(false);
+	}
+
+	virtual void run()
+	{
+		const int mdLength = EVP_MD_size(algorithm);
+		SecureArray u(mdLength);
+		unsigned char *ub = (unsigned char*)u.data();
+		HMAC_CTX *context = HMAC_CTX_new();
+		bool good = context && HMAC_Init_ex(context, secret->data(), secret->size(), algorithm, 0);
+		for (int b = first; good && b < first + count; ++b) {
+			char *tb = out + (b - first) * mdLength;
+			unsigned char index[4];
+			index[0] = (unsigned char)((b + 1) >> 24);
+			index[1] = (unsigned char)((b + 1) >> 16);
+			index[2] = (unsigned char)((b + 1) >> 8);
+			index[3] = (unsigned char)(b + 1);
+			good = pbkdf2_hmac(context, (const unsigned char*)salt->data(), salt->size(), index, 4, ub);
+			memcpy(tb, ub, mdLength);
+			for (unsigned int n = 1; good && n < iterationCount; ++n) {
+				good = pbkdf2_hmac(context, ub, mdLength, 0, 0, ub);
+				for (int i = 0; i < mdLength; ++i)
+					tb[i] ^= ub[i];
+			}
+		}
+		if (context)
+			HMAC_CTX_free(context);
+		ok = good;
+	}
+};
+
 class opensslPbkdf2Context : public KDFContext
 {
 public:
-	opensslPbkdf2Context(Provider *p, const QString &type) : KDFContext(p, type)
+	opensslPbkdf2Context(const EVP_MD *algorithm, Provider *p, const QString &type) : KDFContext(p, type)
 	{
+		m_algorithm = algorithm;
 	}
 
 	Provider::Context *clone() const
@@ -1236,13 +1301,54 @@ public:
 	SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt,
 						 unsigned int keyLength, unsigned int iterationCount)
 	{
-		SecureArray out(keyLength);
-		PKCS5_PBKDF2_HMAC_SHA1( (char*)secret.data(), secret.size(),
-								(unsigned char*)salt.data(), salt.size(),
-								iterationCount, keyLength, (unsigned char*)out.data() );
+		// the output blocks of a long key are independent, so they can
+		// be computed on several threads
+		const int mdLength = EVP_MD_size(m_algorithm);
+		const int blocks = (keyLength + mdLength - 1) / mdLength;
+		const int threads = qMin(QThread::idealThreadCount(), blocks);
+		if (threads < 2 || (quint64)iterationCount * blocks < PBKDF2_PARALLEL_MIN_WORK)
+			return derive(secret, salt, keyLength, iterationCount);
+
+		SecureArray out(blocks * mdLength);
+		const int share = (blocks + threads - 1) / threads;
+		QList<opensslPbkdf2Blocks*> jobs;
+		QThreadPool pool;
+		pool.setMaxThreadCount(threads);
+		for (int first = 0; first < blocks; first += share) {
+			opensslPbkdf2Blocks *job = new opensslPbkdf2Blocks;
+			job->algorithm = m_algorithm;
+			job->secret = &secret;
+			job->salt = &salt;
+			job->iterationCount = qMax(iterationCount, 1u);
+			job->first = first;
+			job->count = qMin(share, blocks - first);
+			job->out = out.data() + first * mdLength;
+			jobs += job;
+			pool.start(job);
+		}
+		pool.waitForDone();
+		bool ok = true;
+		foreach(opensslPbkdf2Blocks *job, jobs) {
+			if (!job->ok)
+				ok = false;
+		}
+		qDeleteAll(jobs);
+
+		if (!ok)
+			return SymmetricKey();
+		out.resize(keyLength);
 		return out;
 	}
 
+	QList<SymmetricKey> makeKeys(const QList<KeyDerivationFunction::Job> &jobs)
+	{
+		// called on a worker thread already, so no threads of our own
+		QList<SymmetricKey> keys;
+		foreach(const KeyDerivationFunction::Job &job, jobs)
+			keys += derive(job.secret, job.salt, job.keyLength, job.iterationCount);
+		return keys;
+	}
+
 	SymmetricKey makeKey(const SecureArray &secret,
 						 const InitializationVector &salt,
 						 unsigned int keyLength,
@@ -1251,41 +1357,165 @@ public:
 	{
 		Q_ASSERT(iterationCount != NULL);
 		QTime timer;
-		SecureArray out(keyLength);
-
-		*iterationCount = 0;
 		timer.start();
 
-		// PBKDF2 needs an iterationCount itself, unless PBKDF1.
-		// So we need to calculate first the number of iterations for
-		// That time interval, then feed the iterationCounts to PBKDF2
-		while (timer.elapsed() < msecInterval) {
-			PKCS5_PBKDF2_HMAC_SHA1((char*)secret.data(),
-								   secret.size(),
-								   (unsigned char*)salt.data(),
-								   salt.size(),
-								   1,
-								   keyLength,
-								   (unsigned char*)out.data());
-			++(*iterationCount);
+		// Run PBKDF2 by hand, all the output blocks together, so that
+		// the iterations can be counted while they happen and the key
+		// comes out of the same pass that was timed.
+		const int mdLength = EVP_MD_size(m_algorithm);
+		const int blocks = (keyLength + mdLength - 1) / mdLength;
+		SecureArray u(blocks * mdLength);
+		SecureArray t(blocks * mdLength);
+
+		HMAC_CTX *context = HMAC_CTX_new();
+		bool ok = context && HMAC_Init_ex(context, secret.data(), secret.size(), m_algorithm, 0);
+		for (int b = 0; ok && b < blocks; ++b) {
+			unsigned char *ub = (unsigned char*)u.data() + b * mdLength;
+			unsigned char index[4];
+			index[0] = (unsigned char)((b + 1) >> 24);
+			index[1] = (unsigned char)((b + 1) >> 16);
+			index[2] = (unsigned char)((b + 1) >> 8);
+			index[3] = (unsigned char)(b + 1);
+			ok = pbkdf2_hmac(context, (const unsigned char*)salt.data(), salt.size(), index, 4, ub);
+			memcpy(t.data() + b * mdLength, ub, mdLength);
+		}
+
+		// the clock is only read every 256 iterations
+		*iterationCount = 1;
+		while (ok && timer.elapsed() < msecInterval) {
+			for (int n = 0; ok && n < 256; ++n) {
+				for (int b = 0; ok && b < blocks; ++b) {
+					unsigned char *ub = (unsigned char*)u.data() + b * mdLength;
+					char *tb = t.data() + b * mdLength;
+					ok = pbkdf2_hmac(context, ub, mdLength, 0, 0, ub);
+					for (int i = 0; i < mdLength; ++i)
+						tb[i] ^= ub[i];
+				}
+			}
+			*iterationCount += 256;
 		}
+		if (context)
+			HMAC_CTX_free(context);
+
+		if (!ok)
+			return SymmetricKey();
+		t.resize(keyLength);
+		return t;
+	}
 
-		// Now we can directely call makeKey base function,
-		// as we now have the iterationCount
-		out = makeKey(secret, salt, keyLength, *iterationCount);
+protected:
+	const EVP_MD *m_algorithm;
 
+	SymmetricKey derive(const SecureArray &secret, const InitializationVector &salt,
+						unsigned int keyLength, unsigned int iterationCount) const
+	{
+		SecureArray out(keyLength);
+		if (!PKCS5_PBKDF2_HMAC( (char*)secret.data(), secret.size(),
+								(unsigned char*)salt.data(), salt.size(),
+								iterationCount, m_algorithm, keyLength, (unsigned char*)out.data() ))
+			return SymmetricKey();
 		return out;
 	}
+};
 
-protected:
+#if defined(OSSL_110) && !defined(OPENSSL_NO_SCRYPT)
+// same limits as the default provider: scrypt uses 128 * r * (N + p)
+// bytes, the timed makeKey() keeps V below half of that
+#define SCRYPT_MAX_MEMORY (Q_UINT64_C(2) << 30)
+#define SCRYPT_TIMED_MEMORY (Q_UINT64_C(1) << 30)
+
+class opensslScryptContext : public KDFContext
+{
+public:
+	opensslScryptContext(Provider *p, const QString &type) : KDFContext(p, type)
+	{
+	}
+
+	Provider::Context *clone() const
+	{
+		return new opensslScryptContext( *this );
+	}
+
+	// the iteration count is N
+	SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt,
+						 unsigned int keyLength, unsigned int iterationCount)
+	{
+		KeyDerivationFunction::Parameters parameters;
+		parameters.memoryCost = iterationCount;
+		return makeKeyWithParameters(secret, salt, keyLength, parameters);
+	}
+
+	SymmetricKey makeKey(const SecureArray &secret,
+						 const InitializationVector &salt,
+						 unsigned int keyLength,
+						 int msecInterval,
+						 unsigned int *iterationCount)
+	{
+		Q_ASSERT(iterationCount != NULL);
+		QTime timer;
+		timer.start();
+
+		// time a small N, then scale it by the largest power of 2 that
+		// fits the rest of the interval
+		unsigned int cost = 1024;
+		*iterationCount = cost;
+		SymmetricKey key = makeKey(secret, salt, keyLength, cost);
+		int once = qMax(timer.elapsed(), 1);
+		int factor = (msecInterval - once) / once;
+		if (key.isEmpty() || factor < 2)
+			return key;
+
+		while (factor >= 2 && 128 * 8 * 2 * (quint64)cost <= SCRYPT_TIMED_MEMORY) {
+			cost *= 2;
+			factor /= 2;
+		}
+		*iterationCount = cost;
+		return makeKey(secret, salt, keyLength, cost);
+	}
+
+	SymmetricKey makeKeyWithParameters(const SecureArray &secret, const InitializationVector &salt,
+									   unsigned int keyLength, const KeyDerivationFunction::Parameters &parameters)
+	{
+		// same defaults as the default provider, OpenSSL runs the lanes
+		// one after the other
+		uint64_t N = parameters.memoryCost ? parameters.memoryCost : 32768;
+		uint64_t r = parameters.blockSize ? parameters.blockSize : 8;
+		uint64_t p = parameters.lanes ? parameters.lanes : 1;
+		SecureArray out(keyLength);
+		// OpenSSL also counts two spare blocks of V
+		if (!EVP_PBE_scrypt(secret.data(), secret.size(),
+							(const unsigned char*)salt.data(), salt.size(),
+							N, r, p, SCRYPT_MAX_MEMORY + 256 * r,
+							(unsigned char*)out.data(), out.size()))
+			return SymmetricKey();
+		return out;
+	}
 };
+#endif
 
 #ifdef OSSL_110
 class opensslHkdfContext : public HKDFContext
 {
 public:
-	opensslHkdfContext(Provider *p, const QString &type) : HKDFContext(p, type)
+	opensslHkdfContext(const EVP_MD *algorithm, Provider *p, const QString &type) : HKDFContext(p, type)
 	{
+		m_algorithm = algorithm;
+		m_context = HMAC_CTX_new();
+	}
+
+	opensslHkdfContext(const opensslHkdfContext &other)
+		: HKDFContext(other)
+	{
+		m_algorithm = other.m_algorithm;
+		m_context = HMAC_CTX_new();
+		m_prk = other.m_prk;
+		if (!m_prk.isEmpty())
+			HMAC_CTX_copy(m_context, other.m_context);
+	}
+
+	~opensslHkdfContext()
+	{
+		HMAC_CTX_free(m_context);
 	}
 
 	Provider::Context *clone() const
@@ -1299,7 +1529,7 @@ public:
 		SecureArray out(keyLength);
 		EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
 		EVP_PKEY_derive_init(pctx);
-		EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256());
+		EVP_PKEY_CTX_set_hkdf_md(pctx, m_algorithm);
 		EVP_PKEY_CTX_set1_hkdf_salt(pctx, salt.data(), int(salt.size()));
 		EVP_PKEY_CTX_set1_hkdf_key(pctx, secret.data(), int(secret.size()));
 		EVP_PKEY_CTX_add1_hkdf_info(pctx, info.data(), int(info.size()));
@@ -1308,6 +1538,61 @@ public:
 		EVP_PKEY_CTX_free(pctx);
 		return out;
 	}
+
+	SymmetricKey extract(const SecureArray &secret, const InitializationVector &salt)
+	{
+		// an absent salt is HashLen zeros
+		SecureArray key = salt.isEmpty() ? SecureArray(EVP_MD_size(m_algorithm), 0) : SecureArray(salt);
+		SecureArray prk(EVP_MD_size(m_algorithm));
+		unsigned int prkLength = prk.size();
+		if (!HMAC(m_algorithm, key.data(), key.size(),
+				  (const unsigned char *)secret.data(), secret.size(),
+				  (unsigned char *)prk.data(), &prkLength))
+			return SymmetricKey();
+		return prk;
+	}
+
+	SymmetricKey expand(const SymmetricKey &prk, const InitializationVector &info, unsigned int keyLength)
+	{
+		int hashLength = EVP_MD_size(m_algorithm);
+		if (!m_context || keyLength > 255u * hashLength)
+			return SymmetricKey();
+
+		// the keyed HMAC state of the last PRK is kept, so deriving several
+		// keys from one PRK only restarts it for each block
+		if (prk != m_prk) {
+			m_prk = SecureArray();
+			if (!HMAC_Init_ex(m_context, prk.data(), prk.size(), m_algorithm, NULL))
+				return SymmetricKey();
+			m_prk = prk;
+		}
+
+		SecureArray out(keyLength);
+		unsigned char t[EVP_MAX_MD_SIZE];
+		unsigned int tLength = 0;
+		for (unsigned int done = 0, i = 1; done < keyLength; done += tLength, ++i) {
+			unsigned char counter = i;
+			if (!HMAC_Init_ex(m_context, NULL, 0, NULL, NULL)
+				|| !HMAC_Update(m_context, t, tLength)
+				|| !HMAC_Update(m_context, (const unsigned char *)info.data(), info.size())
+				|| !HMAC_Update(m_context, &counter, 1)
+				|| !HMAC_Final(m_context, t, &tLength)
+				|| tLength == 0) {
+				// the kept state can't be trusted any more
+				m_prk = SecureArray();
+				OPENSSL_cleanse(t, sizeof(t));
+				return SymmetricKey();
+			}
+			memcpy(out.data() + done, t, qMin(tLength, keyLength - done));
+		}
+		OPENSSL_cleanse(t, sizeof(t));
+		return out;
+	}
+
+protected:
+	const EVP_MD *m_algorithm;
+	HMAC_CTX *m_context;
+	SecureArray m_prk;
 };
 #endif
 
@@ -1373,6 +1658,75 @@ protected:
 	const EVP_MD *m_algorithm;
 };
 
+#ifdef HAVE_OPENSSL_POLY1305
+class opensslPoly1305Context : public MACContext
+{
+public:
+	opensslPoly1305Context(Provider *p) : MACContext(p, "poly1305")
+	{
+		m_context = EVP_MD_CTX_new();
+		m_ok = false;
+	}
+
+	opensslPoly1305Context(const opensslPoly1305Context &other)
+	    : MACContext(other)
+	{
+		m_context = EVP_MD_CTX_new();
+		m_ok = other.m_ok && EVP_MD_CTX_copy_ex(m_context, other.m_context);
+	}
+
+	~opensslPoly1305Context()
+	{
+		EVP_MD_CTX_free(m_context);
+	}
+
+	void setup(const SymmetricKey &key)
+	{
+		m_ok = false;
+		EVP_MD_CTX_reset(m_context);
+		if (key.size() != 32)
+			return;
+		EVP_PKEY *pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_POLY1305, 0, (const unsigned char *)key.data(), key.size());
+		if (!pkey)
+			return;
+		m_ok = EVP_DigestSignInit(m_context, 0, 0, 0, pkey) == 1;
+		// the context holds its own reference
+		EVP_PKEY_free(pkey);
+	}
+
+	KeyLength keyLength() const
+	{
+		return KeyLength(32, 32, 1);
+	}
+
+	void update(const MemoryRegion &a)
+	{
+		if (m_ok)
+			EVP_DigestSignUpdate(m_context, a.data(), a.size());
+	}
+
+	void final(MemoryRegion *out)
+	{
+		SecureArray sa(16, 0);
+		size_t len = sa.size();
+		if (!m_ok || EVP_DigestSignFinal(m_context, (unsigned char *)sa.data(), &len) != 1) {
+			*out = MemoryRegion();
+			return;
+		}
+		*out = sa;
+	}
+
+	Provider::Context *clone() const
+	{
+		return new opensslPoly1305Context(*this);
+	}
+
+protected:
+	EVP_MD_CTX *m_context;
+	bool m_ok;
+};
+#endif
+
 //----------------------------------------------------------------------------
 // EVPKey
 //----------------------------------------------------------------------------
@@ -3489,20 +3843,31 @@ class MyCertContext;
 static bool sameChain(STACK_OF(X509) *ossl, const QList<const MyCertContext*> &qca);
 
 // TODO: support read/write of multiple info values with the same name
+Q_GLOBAL_STATIC(QMutex, cert_props_mutex)
+
 class MyCertContext : public CertContext
 {
 public:
 	X509Item item;
-	CertContextProps _props;
+
+	// decoded on the first call to props(), since most certificates
+	//   loaded in bulk only ever have their DER or validity looked at
+	mutable CertContextProps _props;
+	mutable QAtomicInt propsReady;
 
 	MyCertContext(Provider *p) : CertContext(p)
 	{
 		//printf("[%p] ** created\n", this);
 	}
 
-	MyCertContext(const MyCertContext &from) : CertContext(from), item(from.item), _props(from._props)
+	MyCertContext(const MyCertContext &from) : CertContext(from), item(from.item)
 	{
 		//printf("[%p] ** created as copy (from [%p])\n", this, &from);
+		if(from.propsReady.loadAcquire())
+		{
+			_props = from._props;
+			propsReady.store(1);
+		}
 	}
 
 	~MyCertContext()
@@ -3525,34 +3890,34 @@ public:
 		return item.toPEM();
 	}
 
-	virtual ConvertResult fromDER(const QByteArray &a)
+	void resetProps()
 	{
+		propsReady.store(0);
 		_props = CertContextProps();
-		ConvertResult r = item.fromDER(a, X509Item::TypeCert);
-		if(r == ConvertGood)
-			make_props();
-		return r;
+	}
+
+	virtual ConvertResult fromDER(const QByteArray &a)
+	{
+		resetProps();
+		return item.fromDER(a, X509Item::TypeCert);
 	}
 
 	virtual ConvertResult fromPEM(const QString &s)
 	{
-		_props = CertContextProps();
-		ConvertResult r = item.fromPEM(s, X509Item::TypeCert);
-		if(r == ConvertGood)
-			make_props();
-		return r;
+		resetProps();
+		return item.fromPEM(s, X509Item::TypeCert);
 	}
 
 	void fromX509(X509 *x)
 	{
+		resetProps();
 		X509_up_ref(x);
 		item.cert = x;
-		make_props();
 	}
 
 	virtual bool createSelfSigned(const CertificateOptions &opts, const PKeyContext &priv)
 	{
-		_props = CertContextProps();
+		resetProps();
 		item.reset();
 
 		CertificateInfo info = opts.info();
@@ -3654,19 +4019,52 @@ public:
 		X509_sign(x, pk, md);
 
 		item.cert = x;
-		make_props();
 		return true;
 	}
 
 	virtual const CertContextProps *props() const
 	{
 		//printf("[%p] grabbing props\n", this);
+		if(!propsReady.loadAcquire())
+		{
+			QMutexLocker locker(cert_props_mutex());
+			if(!propsReady.load())
+			{
+				if(item.cert)
+					make_props();
+				propsReady.storeRelease(1);
+			}
+		}
 		return &_props;
 	}
 
+	virtual BigInteger serialNumber() const
+	{
+		BigInteger serial;
+		ASN1_INTEGER *ai = X509_get_serialNumber(item.cert);
+		if(ai)
+		{
+			char *rep = i2s_ASN1_INTEGER(NULL, ai);
+			QString str = rep;
+			OPENSSL_free(rep);
+			serial.fromString(str);
+		}
+		return serial;
+	}
+
+	virtual QDateTime notValidBefore() const
+	{
+		return ASN1_UTCTIME_QDateTime(X509_get_notBefore(item.cert), NULL);
+	}
+
+	virtual QDateTime notValidAfter() const
+	{
+		return ASN1_UTCTIME_QDateTime(X509_get_notAfter(item.cert), NULL);
+	}
+
 	virtual bool compare(const CertContext *other) const
 	{
-		const CertContextProps *a = &_props;
+		const CertContextProps *a = props();
 		const CertContextProps *b = other->props();
 
 		PublicKey akey, bkey;
@@ -3746,24 +4144,16 @@ public:
 
 	virtual Validity validate_chain(const QList<CertContext*> &chain, const QList<CertContext*> &trusted, const QList<CRLContext *> &crls, UsageMode u, ValidateFlags vf) const;
 
-	void make_props()
+	void make_props() const
 	{
 		X509 *x = item.cert;
 		CertContextProps p;
 
 		p.version = X509_get_version(x);
 
-		ASN1_INTEGER *ai = X509_get_serialNumber(x);
-		if(ai)
-		{
-			char *rep = i2s_ASN1_INTEGER(NULL, ai);
-			QString str = rep;
-			OPENSSL_free(rep);
-			p.serial.fromString(str);
-		}
-
-		p.start = ASN1_UTCTIME_QDateTime(X509_get_notBefore(x), NULL);
-		p.end = ASN1_UTCTIME_QDateTime(X509_get_notAfter(x), NULL);
+		p.serial = serialNumber();
+		p.start = notValidBefore();
+		p.end = notValidAfter();
 
 		CertificateInfo subject, issuer;
 
@@ -3891,9 +4281,9 @@ public:
 		// FIXME: super hack
 		CertificateOptions opts;
 		opts.setInfo(subject);
-		p.subject = opts.infoOrdered();
+		p.subject = internCertificateInfo(opts.infoOrdered());
 		opts.setInfo(issuer);
-		p.issuer = opts.infoOrdered();
+		p.issuer = internCertificateInfo(opts.infoOrdered());
 
 		_props = p;
 		//printf("[%p] made props: [%s]\n", this, _props.subject[CommonName].toLatin1().data());
@@ -4595,7 +4985,7 @@ public:
 		// FIXME: super hack
 		CertificateOptions opts;
 		opts.setInfo(issuer);
-		p.issuer = opts.infoOrdered();
+		p.issuer = internCertificateInfo(opts.infoOrdered());
 
 		_props = p;
 	}
@@ -4682,7 +5072,7 @@ public:
 
 static bool usage_check(const MyCertContext &cc, UsageMode u)
 {
-	if (cc._props.constraints.isEmpty() ) {
+	if (cc.props()->constraints.isEmpty() ) {
 		// then any usage is OK
 		return true;
 	}
@@ -4693,33 +5083,44 @@ static bool usage_check(const MyCertContext &cc, UsageMode u)
 		return true;
 		break;
 	case UsageTLSServer :
-		return cc._props.constraints.contains(ServerAuth);
+		return cc.props()->constraints.contains(ServerAuth);
 		break;
 	case UsageTLSClient :
-		return cc._props.constraints.contains(ClientAuth);
+		return cc.props()->constraints.contains(ClientAuth);
 		break;
 	case UsageCodeSigning :
-		return cc._props.constraints.contains(CodeSigning);
+		return cc.props()->constraints.contains(CodeSigning);
 		break;
 	case UsageEmailProtection :
-		return cc._props.constraints.contains(EmailProtection);
+		return cc.props()->constraints.contains(EmailProtection);
 		break;
 	case UsageTimeStamping :
-		return cc._props.constraints.contains(TimeStamping);
+		return cc.props()->constraints.contains(TimeStamping);
 		break;
 	case UsageCRLSigning :
-		return cc._props.constraints.contains(CRLSign);
+		return cc.props()->constraints.contains(CRLSign);
 		break;
 	default:
 		return true;
 	}
 }
 
-Validity MyCertContext::validate(const QList<CertContext*> &trusted, const QList<CertContext*> &untrusted, const QList<CRLContext*> &crls, UsageMode u, ValidateFlags vf) const
+// ValidateAll checks every condition, otherwise only the conditions whose
+//   flags are set are checked.  openssl doesn't check the CRLs unless told
+//   to, and isn't told to, so ValidateRevoked has no effect here.
+static bool validate_checks(ValidateFlags vf, ValidateFlags flag)
 {
-	// TODO
-	Q_UNUSED(vf);
+	return vf == ValidateAll || (vf & flag);
+}
 
+static void set_validate_flags(X509_STORE_CTX *ctx, ValidateFlags vf)
+{
+	if(!validate_checks(vf, ValidateExpired))
+		X509_STORE_CTX_set_flags(ctx, X509_V_FLAG_NO_CHECK_TIME);
+}
+
+Validity MyCertContext::validate(const QList<CertContext*> &trusted, const QList<CertContext*> &untrusted, const QList<CRLContext*> &crls, UsageMode u, ValidateFlags vf) const
+{
 	STACK_OF(X509) *trusted_list = sk_X509_new_null();
 	STACK_OF(X509) *untrusted_list = sk_X509_new_null();
 	QList<X509_CRL*> crl_list;
@@ -4764,6 +5165,8 @@ Validity MyCertContext::validate(const QList<CertContext*> &trusted, const QList
 	// this initializes the trusted certs
 	X509_STORE_CTX_trusted_stack(ctx, trusted_list);
 
+	set_validate_flags(ctx, vf);
+
 	// verify!
 	int ret = X509_verify_cert(ctx);
 	int err = -1;
@@ -4782,7 +5185,7 @@ Validity MyCertContext::validate(const QList<CertContext*> &trusted, const QList
 	if(!ret)
 		return convert_verify_error(err);
 
-	if(!usage_check(*cc, u))
+	if(validate_checks(vf, ValidatePolicy) && !usage_check(*cc, u))
 		return ErrorInvalidPurpose;
 
 	return ValidityGood;
@@ -4790,9 +5193,6 @@ Validity MyCertContext::validate(const QList<CertContext*> &trusted, const QList
 
 Validity MyCertContext::validate_chain(const QList<CertContext*> &chain, const QList<CertContext*> &trusted, const QList<CRLContext*> &crls, UsageMode u, ValidateFlags vf) const
 {
-	// TODO
-	Q_UNUSED(vf);
-
 	STACK_OF(X509) *trusted_list = sk_X509_new_null();
 	STACK_OF(X509) *untrusted_list = sk_X509_new_null();
 	QList<X509_CRL*> crl_list;
@@ -4837,6 +5237,8 @@ Validity MyCertContext::validate_chain(const QList<CertContext*> &chain, const Q
 	// this initializes the trusted certs
 	X509_STORE_CTX_trusted_stack(ctx, trusted_list);
 
+	set_validate_flags(ctx, vf);
+
 	// verify!
 	int ret = X509_verify_cert(ctx);
 	int err = -1;
@@ -4871,12 +5273,165 @@ Validity MyCertContext::validate_chain(const QList<CertContext*> &chain, const Q
 	if(!ret)
 		return convert_verify_error(err);
 
-	if(!usage_check(*cc, u))
+	if(validate_checks(vf, ValidatePolicy) && !usage_check(*cc, u))
 		return ErrorInvalidPurpose;
 
 	return ValidityGood;
 }
 
+// the trusted certs and crls live in one X509_STORE for the life of the
+//   context.  openssl locks the store for lookups, and each validation
+//   has its own X509_STORE_CTX, so the const functions are safe to call
+//   from several threads at once
+class MyTrustStoreContext : public TrustStoreContext
+{
+	Q_OBJECT
+public:
+	X509_STORE *store;
+
+	MyTrustStoreContext(Provider *p) : TrustStoreContext(p)
+	{
+		store = 0;
+	}
+
+	MyTrustStoreContext(const MyTrustStoreContext &from) : TrustStoreContext(from)
+	{
+		store = from.store;
+		if(store)
+			X509_STORE_up_ref(store);
+	}
+
+	~MyTrustStoreContext()
+	{
+		if(store)
+			X509_STORE_free(store);
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new MyTrustStoreContext(*this);
+	}
+
+	virtual bool setup(const QList<CertContext*> &trusted, const QList<CRLContext*> &crls)
+	{
+		if(store)
+			X509_STORE_free(store);
+		store = X509_STORE_new();
+		if(!store)
+			return false;
+
+		int n;
+		for(n = 0; n < trusted.count(); ++n)
+		{
+			const MyCertContext *cc = static_cast<const MyCertContext *>(trusted[n]);
+			X509_STORE_add_cert(store, cc->item.cert);
+		}
+		for(n = 0; n < crls.count(); ++n)
+		{
+			const MyCRLContext *cc = static_cast<const MyCRLContext *>(crls[n]);
+			X509_STORE_add_crl(store, cc->item.crl);
+		}
+
+		// adding a duplicate leaves an error behind
+		ERR_clear_error();
+		return true;
+	}
+
+	virtual Validity validate(const CertContext *cert, const QList<CertContext*> &untrusted, const QList<CRLContext*> &crls, UsageMode u, ValidateFlags vf, QList<CertContext*> *chain) const
+	{
+		const MyCertContext *cc = static_cast<const MyCertContext *>(cert);
+		Validity v = verify(cc->item.cert, untrusted, 0, crls, 0, vf, chain);
+		if(v != ValidityGood)
+			return v;
+
+		if(validate_checks(vf, ValidatePolicy) && !usage_check(*cc, u))
+			return ErrorInvalidPurpose;
+
+		return ValidityGood;
+	}
+
+	virtual Validity validate_chain(const QList<CertContext*> &chain, const QList<CRLContext*> &crls, UsageMode u, ValidateFlags vf) const
+	{
+		// see MyCertContext::validate_chain() about the order
+		QList<const MyCertContext*> expected;
+		for(int n = 0; n < chain.count(); ++n)
+			expected += static_cast<const MyCertContext *>(chain[n]);
+
+		const MyCertContext *cc = expected[0];
+		Validity v = verify(cc->item.cert, chain, 1, crls, &expected, vf, 0);
+		if(v != ValidityGood)
+			return v;
+
+		if(validate_checks(vf, ValidatePolicy) && !usage_check(*cc, u))
+			return ErrorInvalidPurpose;
+
+		return ValidityGood;
+	}
+
+private:
+	// untrusted certs are taken from the given list, starting at first.
+	//   the chain openssl built goes to chain_out, if given.  if it isn't
+	//   the expected one, the given chain wasn't checked, so it fails.
+	Validity verify(X509 *x, const QList<CertContext*> &untrusted, int first, const QList<CRLContext*> &crls, const QList<const MyCertContext*> *expected, ValidateFlags vf, QList<CertContext*> *chain_out) const
+	{
+		STACK_OF(X509) *untrusted_list = sk_X509_new_null();
+		STACK_OF(X509_CRL) *crl_list = 0;
+
+		int n;
+		for(n = first; n < untrusted.count(); ++n)
+		{
+			const MyCertContext *cc = static_cast<const MyCertContext *>(untrusted[n]);
+			X509_up_ref(cc->item.cert);
+			sk_X509_push(untrusted_list, cc->item.cert);
+		}
+		if(!crls.isEmpty())
+		{
+			crl_list = sk_X509_CRL_new_null();
+			for(n = 0; n < crls.count(); ++n)
+			{
+				const MyCRLContext *cc = static_cast<const MyCRLContext *>(crls[n]);
+				X509_CRL_up_ref(cc->item.crl);
+				sk_X509_CRL_push(crl_list, cc->item.crl);
+			}
+		}
+
+		// the stored trusted certs and crls are found through the store,
+		//   the rest are given to this context only
+		X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+		X509_STORE_CTX_init(ctx, store, x, untrusted_list);
+		if(crl_list)
+			X509_STORE_CTX_set0_crls(ctx, crl_list);
+		set_validate_flags(ctx, vf);
+
+		Validity v = ValidityGood;
+		if(X509_verify_cert(ctx) <= 0)
+			v = convert_verify_error(X509_STORE_CTX_get_error(ctx));
+		else if(expected)
+		{
+			STACK_OF(X509) *xchain = X509_STORE_CTX_get_chain(ctx);
+			if(!xchain || !sameChain(xchain, *expected))
+				v = ErrorValidityUnknown;
+		}
+		if(chain_out)
+		{
+			STACK_OF(X509) *xchain = X509_STORE_CTX_get_chain(ctx);
+			for(n = 0; xchain && n < sk_X509_num(xchain); ++n)
+			{
+				MyCertContext *cc = new MyCertContext(provider());
+				cc->fromX509(sk_X509_value(xchain, n));
+				*chain_out += cc;
+			}
+		}
+
+		X509_STORE_CTX_free(ctx);
+		sk_X509_pop_free(untrusted_list, X509_free);
+		if(crl_list)
+			sk_X509_CRL_pop_free(crl_list, X509_CRL_free);
+
+		return v;
+	}
+};
+
 class MyPKCS12Context : public PKCS12Context
 {
 public:
@@ -5635,6 +6190,71 @@ public:
 		return 1;
 	}
 
+	static Certificate certFromX509(X509 *x, Provider *p)
+	{
+		MyCertContext *cc = new MyCertContext(p);
+		cc->fromX509(x);
+		Certificate cert;
+		cert.change(cc);
+		return cert;
+	}
+
+	// With a trust store file, the trusted certificates go into the
+	//   store as the peer's certificates lead to them, rather than all
+	//   of them when the context is made
+	void addTrustedIssuers(const QList<Certificate> &peer)
+	{
+		X509_STORE *store = SSL_CTX_get_cert_store(context);
+		QList<Certificate> pending = peer;
+		QSet<QByteArray> seen;
+		while(!pending.isEmpty())
+		{
+			QList<Certificate> found = trusted.issuersOf(pending.takeFirst());
+			for(int n = 0; n < found.count(); ++n)
+			{
+				Certificate c = found[n];
+				QByteArray fingerprint = c.fingerprint();
+				if(seen.contains(fingerprint))
+					continue;
+				seen += fingerprint;
+
+				if(c.provider() != provider())
+					c = Certificate::fromDER(c.toDER(), 0, provider()->name());
+				if(c.isNull())
+					continue;
+				const MyCertContext *cc = static_cast<const MyCertContext *>(c.context());
+				X509_STORE_add_cert(store, cc->item.cert);
+				if(!c.isSelfSigned())
+					pending += c;
+			}
+		}
+
+		// openssl may complain about certificates added before
+		ERR_clear_error();
+	}
+
+	// openssl checks the peer's certificates, after the trusted ones of
+	//   a trust store file that they lead to are added
+	static int ssl_cert_verify_callback(X509_STORE_CTX *x509_ctx, void *arg)
+	{
+		MyTLSContext *self = static_cast<MyTLSContext *>(arg);
+		if(!self->trusted.trustStoreFile().isNull())
+		{
+			X509 *x = X509_STORE_CTX_get0_cert(x509_ctx);
+			QList<Certificate> certs;
+			certs += certFromX509(x, self->provider());
+			STACK_OF(X509) *x_chain = X509_STORE_CTX_get0_untrusted(x509_ctx);
+			for(int n = 0; x_chain && n < sk_X509_num(x_chain); ++n)
+			{
+				X509 *ux = sk_X509_value(x_chain, n);
+				if(ux != x)
+					certs += certFromX509(ux, self->provider());
+			}
+			self->addTrustedIssuers(certs);
+		}
+		return X509_verify_cert(x509_ctx);
+	}
+
 	virtual QStringList supportedCipherSuites(const TLS::Version &version) const
 	{
 		OpenSSL_add_ssl_algorithms();
@@ -6117,11 +6737,17 @@ public:
 		if(!context)
 			return false;
 
+		SSL_CTX_set_cert_verify_callback(context, ssl_cert_verify_callback, this);
+
 		// setup the cert store
 		{
 			X509_STORE *store = SSL_CTX_get_cert_store(context);
-			QList<Certificate> cert_list = trusted.certificates();
+			QList<Certificate> cert_list;
 			QList<CRL> crl_list = trusted.crls();
+			// those of a trust store file are added when the peer
+			//   needs them, see addTrustedIssuers()
+			if(trusted.trustStoreFile().isNull())
+				cert_list = trusted.certificates();
 			int n;
 			for(n = 0; n < cert_list.count(); ++n)
 			{
@@ -7028,26 +7654,31 @@ public:
 			// this is really a two key version of triple DES.
 			m_cryptoAlgorithm = EVP_des_ede();
 		}
+		InitializationVector ivec = iv;
+		if (m_type == "chacha20" && iv.size() == 12) {
+			// EVP wants the 32 bit block counter in front of the nonce
+			ivec = InitializationVector(SecureArray(4, 0) + iv);
+		}
 		if (Encode == m_direction) {
 			EVP_EncryptInit_ex(m_context, m_cryptoAlgorithm, 0, 0, 0);
 			EVP_CIPHER_CTX_set_key_length(m_context, key.size());
-			if (m_type.endsWith("gcm") || m_type.endsWith("ccm")) {
-				int parameter = m_type.endsWith("gcm") ? EVP_CTRL_GCM_SET_IVLEN : EVP_CTRL_CCM_SET_IVLEN;
-				EVP_CIPHER_CTX_ctrl(m_context, parameter, iv.size(), NULL);
+			if (isAead()) {
+				int parameter = m_type.endsWith("ccm") ? EVP_CTRL_CCM_SET_IVLEN : EVP_CTRL_GCM_SET_IVLEN;
+				EVP_CIPHER_CTX_ctrl(m_context, parameter, ivec.size(), NULL);
 			}
 			EVP_EncryptInit_ex(m_context, 0, 0,
 							   (const unsigned char*)(key.data()),
-							   (const unsigned char*)(iv.data()));
+							   (const unsigned char*)(ivec.data()));
 		} else {
 			EVP_DecryptInit_ex(m_context, m_cryptoAlgorithm, 0, 0, 0);
 			EVP_CIPHER_CTX_set_key_length(m_context, key.size());
-			if (m_type.endsWith("gcm") || m_type.endsWith("ccm")) {
-				int parameter = m_type.endsWith("gcm") ? EVP_CTRL_GCM_SET_IVLEN : EVP_CTRL_CCM_SET_IVLEN;
-				EVP_CIPHER_CTX_ctrl(m_context, parameter, iv.size(), NULL);
+			if (isAead()) {
+				int parameter = m_type.endsWith("ccm") ? EVP_CTRL_CCM_SET_IVLEN : EVP_CTRL_GCM_SET_IVLEN;
+				EVP_CIPHER_CTX_ctrl(m_context, parameter, ivec.size(), NULL);
 			}
 			EVP_DecryptInit_ex(m_context, 0, 0,
 							   (const unsigned char*)(key.data()),
-							   (const unsigned char*)(iv.data()));
+							   (const unsigned char*)(ivec.data()));
 		}
 
 		EVP_CIPHER_CTX_set_padding(m_context, m_pad);
@@ -7108,15 +7739,15 @@ public:
 										 &resultLength)) {
 				return false;
 			}
-			if (m_tag.size() && (m_type.endsWith("gcm") || m_type.endsWith("ccm"))) {
-				int parameter = m_type.endsWith("gcm") ? EVP_CTRL_GCM_GET_TAG : EVP_CTRL_CCM_GET_TAG;
+			if (m_tag.size() && isAead()) {
+				int parameter = m_type.endsWith("ccm") ? EVP_CTRL_CCM_GET_TAG : EVP_CTRL_GCM_GET_TAG;
 				if (0 == EVP_CIPHER_CTX_ctrl(m_context, parameter, m_tag.size(), (unsigned char*)m_tag.data())) {
 					return false;
 				}
 			}
 		} else {
-			if (m_tag.size() && (m_type.endsWith("gcm") || m_type.endsWith("ccm"))) {
-				int parameter = m_type.endsWith("gcm") ? EVP_CTRL_GCM_SET_TAG : EVP_CTRL_CCM_SET_TAG;
+			if (m_tag.size() && isAead()) {
+				int parameter = m_type.endsWith("ccm") ? EVP_CTRL_CCM_SET_TAG : EVP_CTRL_GCM_SET_TAG;
 				if (0 == EVP_CIPHER_CTX_ctrl(m_context, parameter, m_tag.size(), m_tag.data())) {
 					return false;
 				}
@@ -7131,6 +7762,36 @@ public:
 		return true;
 	}
 
+	// The key is only set once for the whole batch, each record just
+	// supplies a new IV, so the key schedule is reused.  CCM needs the
+	// message length up front and the padding modes change the length,
+	// those go through the generic loop.
+	bool processBatch(Direction dir, const SymmetricKey &key, const QVector<Cipher::Record> &records, QList<int> *failed)
+	{
+		if (m_pad || m_type.endsWith("ccm"))
+			return CipherContext::processBatch(dir, key, records, failed);
+
+		int enc = (Encode == dir) ? 1 : 0;
+		m_direction = dir;
+		if ( ( m_cryptoAlgorithm == EVP_des_ede3() ) && (key.size() == 16) )
+			m_cryptoAlgorithm = EVP_des_ede();
+		bool keyed = EVP_CipherInit_ex(m_context, m_cryptoAlgorithm, 0, 0, 0, enc)
+			&& EVP_CIPHER_CTX_set_key_length(m_context, key.size())
+			&& EVP_CipherInit_ex(m_context, 0, 0, (const unsigned char*)key.data(), 0, enc);
+		EVP_CIPHER_CTX_set_padding(m_context, 0);
+		int ivLength = EVP_CIPHER_CTX_iv_length(m_context);
+
+		bool all = true;
+		for (int n = 0; n < records.count(); ++n) {
+			const Cipher::Record &r = records[n];
+			if (!keyed || !batchRecord(enc, ivLength, r)) {
+				failed->append(n);
+				all = false;
+			}
+		}
+		return all;
+	}
+
 	// Change cipher names
 	KeyLength keyLength() const
 	{
@@ -7149,6 +7810,8 @@ public:
 			return KeyLength( 1, 32, 1);
 		} else if (m_type.left(9) == "tripledes") {
 			return KeyLength( 16, 24, 1);
+		} else if (m_type.left(8) == "chacha20") {
+			return KeyLength( 32, 32, 1);
 		} else {
 			return KeyLength( 0, 1, 1);
 		}
@@ -7156,6 +7819,61 @@ public:
 
 
 protected:
+	// the GCM controls are the generic AEAD ones, which chacha20-poly1305
+	// uses as well
+	bool isAead() const
+	{
+		return m_type.endsWith("gcm") || m_type.endsWith("ccm") || m_type == "chacha20-poly1305";
+	}
+
+	bool batchRecord(int enc, int ivLength, const Cipher::Record &r)
+	{
+		if (r.size < 0 || r.aadSize < 0 || r.tagSize < 0)
+			return false;
+		if (isAead() ? (r.tagSize == 0 || r.tagSize > 16) : (r.aadSize != 0 || r.tagSize != 0))
+			return false;
+
+		unsigned char counterNonce[16];
+		const unsigned char *iv = (const unsigned char*)r.nonce;
+		if (isAead()) {
+			if (r.nonceSize <= 0 || 0 == EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_SET_IVLEN, r.nonceSize, NULL))
+				return false;
+		} else if (m_type == "chacha20" && r.nonceSize == 12) {
+			// EVP wants the 32 bit block counter in front of the nonce
+			memset(counterNonce, 0, 4);
+			memcpy(counterNonce + 4, r.nonce, 12);
+			iv = counterNonce;
+		} else if (r.nonceSize != ivLength) {
+			return false;
+		}
+		if (0 == EVP_CipherInit_ex(m_context, 0, 0, 0, iv, enc))
+			return false;
+
+		int resultLength;
+		if (r.aadSize > 0 && 0 == EVP_CipherUpdate(m_context, NULL, &resultLength, (const unsigned char*)r.aad, r.aadSize))
+			return false;
+		if (!enc && isAead() && 0 == EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_SET_TAG, r.tagSize, r.tag))
+			return false;
+
+		// OpenSSL asserts if there is nothing to encrypt
+		int done = 0;
+		if (r.size > 0) {
+			if (0 == EVP_CipherUpdate(m_context, (unsigned char*)r.out, &done, (const unsigned char*)r.in, r.size))
+				return false;
+		}
+		if (done != r.size)
+			return false;
+
+		// nothing is held back without padding, so final has no output
+		unsigned char last[EVP_MAX_BLOCK_LENGTH];
+		if (0 == EVP_CipherFinal_ex(m_context, last, &resultLength) || resultLength != 0)
+			return false;
+
+		if (enc && isAead() && 0 == EVP_CIPHER_CTX_ctrl(m_context, EVP_CTRL_GCM_GET_TAG, r.tagSize, r.tag))
+			return false;
+		return true;
+	}
+
 	EVP_CIPHER_CTX *m_context;
 	const EVP_CIPHER *m_cryptoAlgorithm;
 	Direction m_direction;
@@ -7258,6 +7976,10 @@ static QStringList all_cipher_types()
 	list += "cast5-ecb";
 	list += "cast5-cbc";
 	list += "cast5-cbc-pkcs7";
+#ifdef HAVE_OPENSSL_CHACHA20_POLY1305
+	list += "chacha20";
+	list += "chacha20-poly1305";
+#endif
 	list += "cast5-cfb";
 	list += "cast5-ofb";
 	return list;
@@ -7281,6 +8003,9 @@ static QStringList all_mac_types()
 	list += "hmac(sha512)";
 #endif
 	list += "hmac(ripemd160)";
+#ifdef HAVE_OPENSSL_POLY1305
+	list += "poly1305";
+#endif
 	return list;
 }
 
@@ -7412,8 +8137,20 @@ public:
 #endif
 		list += "pbkdf1(sha1)";
 		list += "pbkdf2(sha1)";
+#ifdef SHA256_DIGEST_LENGTH
+		list += "pbkdf2(sha256)";
+#endif
+#ifdef SHA512_DIGEST_LENGTH
+		list += "pbkdf2(sha512)";
+#endif
 #ifdef OSSL_110
+		list += "hkdf(sha1)";
 		list += "hkdf(sha256)";
+		list += "hkdf(sha384)";
+		list += "hkdf(sha512)";
+#endif
+#if defined(OSSL_110) && !defined(OPENSSL_NO_SCRYPT)
+		list += "scrypt";
 #endif
 		list += "pkey";
 		list += "dlgroup";
@@ -7424,6 +8161,7 @@ public:
 		list += "csr";
 		list += "crl";
 		list += "certcollection";
+		list += "truststore";
 		list += "pkcs12";
 		list += "tls";
 		list += "cms";
@@ -7484,10 +8222,28 @@ public:
 			return new opensslPbkdf1Context( EVP_md2(), this, type );
 #endif
 		else if ( type == "pbkdf2(sha1)" )
-			return new opensslPbkdf2Context( this, type );
+			return new opensslPbkdf2Context( EVP_sha1(), this, type );
+#ifdef SHA256_DIGEST_LENGTH
+		else if ( type == "pbkdf2(sha256)" )
+			return new opensslPbkdf2Context( EVP_sha256(), this, type );
+#endif
+#ifdef SHA512_DIGEST_LENGTH
+		else if ( type == "pbkdf2(sha512)" )
+			return new opensslPbkdf2Context( EVP_sha512(), this, type );
+#endif
 #ifdef OSSL_110
+		else if ( type == "hkdf(sha1)" )
+			return new opensslHkdfContext( EVP_sha1(), this, type );
 		else if ( type == "hkdf(sha256)" )
-			return new opensslHkdfContext( this, type );
+			return new opensslHkdfContext( EVP_sha256(), this, type );
+		else if ( type == "hkdf(sha384)" )
+			return new opensslHkdfContext( EVP_sha384(), this, type );
+		else if ( type == "hkdf(sha512)" )
+			return new opensslHkdfContext( EVP_sha512(), this, type );
+#endif
+#if defined(OSSL_110) && !defined(OPENSSL_NO_SCRYPT)
+		else if ( type == "scrypt" )
+			return new opensslScryptContext( this, type );
 #endif
 		else if ( type == "hmac(md5)" )
 			return new opensslHMACContext( EVP_md5(), this, type );
@@ -7511,6 +8267,10 @@ public:
 #endif
 		else if ( type == "hmac(ripemd160)" )
 			return new opensslHMACContext( EVP_ripemd160(), this, type );
+#ifdef HAVE_OPENSSL_POLY1305
+		else if ( type == "poly1305" )
+			return new opensslPoly1305Context( this );
+#endif
 		else if ( type == "aes128-ecb" )
 			return new opensslCipherContext( EVP_aes_128_ecb(), 0, this, type);
 		else if ( type == "aes128-cfb" )
@@ -7613,6 +8373,12 @@ public:
 			return new opensslCipherContext( EVP_cast5_cfb(), 0, this, type);
 		else if ( type == "cast5-ofb" )
 			return new opensslCipherContext( EVP_cast5_ofb(), 0, this, type);
+#ifdef HAVE_OPENSSL_CHACHA20_POLY1305
+		else if ( type == "chacha20" )
+			return new opensslCipherContext( EVP_chacha20(), 0, this, type);
+		else if ( type == "chacha20-poly1305" )
+			return new opensslCipherContext( EVP_chacha20_poly1305(), 0, this, type);
+#endif
 		else if ( type == "pkey" )
 			return new MyPKeyContext( this );
 		else if ( type == "dlgroup" )
@@ -7631,6 +8397,8 @@ public:
 			return new MyCRLContext( this );
 		else if ( type == "certcollection" )
 			return new MyCertCollectionContext( this );
+		else if ( type == "truststore" )
+			return new MyTrustStoreContext( this );
 		else if ( type == "pkcs12" )
 			return new MyPKCS12Context( this );
 		else if ( type == "tls" )
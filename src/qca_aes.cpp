@@ -0,0 +1,877 @@
+/*
+ * qca_aes.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_aes.h"
+
+#include "qca_cpu.h"
+
+#include <string.h>
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+//----------------------------------------------------------------------------
+// Portable implementation
+//----------------------------------------------------------------------------
+
+// The S-box is the multiplicative inverse in GF(2^8) followed by an affine
+// map.  SubBytes works on 64 bytes (four blocks) at a time: the bytes are
+// transposed into eight 64 bit planes, one per bit position, and all of the
+// arithmetic is done with bitwise operations on the planes, so there are no
+// table lookups that depend on the data or the key.
+
+static inline quint64 load_le64(const unsigned char *p)
+{
+	return (quint64)p[0] | ((quint64)p[1] << 8) | ((quint64)p[2] << 16) | ((quint64)p[3] << 24) |
+		((quint64)p[4] << 32) | ((quint64)p[5] << 40) | ((quint64)p[6] << 48) | ((quint64)p[7] << 56);
+}
+
+static inline void store_le64(unsigned char *p, quint64 v)
+{
+	for(int n = 0; n < 8; ++n)
+	{
+		p[n] = (unsigned char)v;
+		v >>= 8;
+	}
+}
+
+// transpose the 8x8 bit matrix with row i in byte i
+static inline quint64 transpose8(quint64 x)
+{
+	quint64 t;
+	t = (x ^ (x >> 7)) & Q_UINT64_C(0x00AA00AA00AA00AA);
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & Q_UINT64_C(0x0000CCCC0000CCCC);
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & Q_UINT64_C(0x00000000F0F0F0F0);
+	x = x ^ t ^ (t << 28);
+	return x;
+}
+
+static void bs_load(const unsigned char *s, quint64 *p)
+{
+	quint64 t[8];
+	for(int k = 0; k < 8; ++k)
+		t[k] = transpose8(load_le64(s + 8 * k));
+	for(int b = 0; b < 8; ++b)
+	{
+		quint64 v = 0;
+		for(int k = 0; k < 8; ++k)
+			v |= ((t[k] >> (8 * b)) & 0xff) << (8 * k);
+		p[b] = v;
+	}
+}
+
+static void bs_store(const quint64 *p, unsigned char *s)
+{
+	for(int k = 0; k < 8; ++k)
+	{
+		quint64 v = 0;
+		for(int b = 0; b < 8; ++b)
+			v |= ((p[b] >> (8 * k)) & 0xff) << (8 * b);
+		store_le64(s + 8 * k, transpose8(v));
+	}
+}
+
+// The inverse is computed in the isomorphic tower field GF((2^4)^2), with
+// GF(2^4) = GF(2)[x]/(x^4 + x + 1) and GF((2^4)^2) = GF(2^4)[y]/(y^2 + y + 8),
+// which takes far fewer operations than x^254 in GF(2^8).  An element is
+// h y + l, with l in planes 0-3 and h in planes 4-7.
+
+static inline void gf16_mul(quint64 *r, const quint64 *a, const quint64 *b)
+{
+	quint64 t0 = a[0] & b[0];
+	quint64 t1 = (a[0] & b[1]) ^ (a[1] & b[0]);
+	quint64 t2 = (a[0] & b[2]) ^ (a[1] & b[1]) ^ (a[2] & b[0]);
+	quint64 t3 = (a[0] & b[3]) ^ (a[1] & b[2]) ^ (a[2] & b[1]) ^ (a[3] & b[0]);
+	quint64 t4 = (a[1] & b[3]) ^ (a[2] & b[2]) ^ (a[3] & b[1]);
+	quint64 t5 = (a[2] & b[3]) ^ (a[3] & b[2]);
+	quint64 t6 = a[3] & b[3];
+	r[0] = t0 ^ t4;
+	r[1] = t1 ^ t4 ^ t5;
+	r[2] = t2 ^ t5 ^ t6;
+	r[3] = t3 ^ t6;
+}
+
+static inline void gf16_sqr(quint64 *r, const quint64 *a)
+{
+	quint64 a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+	r[0] = a0 ^ a2;
+	r[1] = a2;
+	r[2] = a1 ^ a3;
+	r[3] = a3;
+}
+
+// x^14
+static inline void gf16_invert(quint64 *r, const quint64 *a)
+{
+	quint64 x2[4], x3[4], t[4];
+	gf16_sqr(x2, a);
+	gf16_mul(x3, x2, a);
+	gf16_sqr(t, x3);
+	gf16_sqr(t, t);
+	gf16_mul(r, t, x2);
+}
+
+// 1 / (h y + l) = (h y + h + l) / (8 h^2 + h l + l^2), and 0 maps to 0
+static void bs_tower_invert(quint64 *p)
+{
+	const quint64 *l = p;
+	const quint64 *h = p + 4;
+	quint64 d[4], t[4], s[4];
+
+	gf16_mul(d, h, l);
+	gf16_sqr(t, l);
+	// 8 h^2
+	d[0] ^= t[0] ^ h[2];
+	d[1] ^= t[1] ^ h[1] ^ h[2] ^ h[3];
+	d[2] ^= t[2] ^ h[1];
+	d[3] ^= t[3] ^ h[0] ^ h[2] ^ h[3];
+	gf16_invert(t, d);
+
+	for(int i = 0; i < 4; ++i)
+		s[i] = h[i] ^ l[i];
+	gf16_mul(p + 4, h, t);
+	gf16_mul(p, s, t);
+}
+
+// The rest of the round works on the planes as well.  Bit 16 * k + i of a
+// plane belongs to byte i of block k, and byte i of a block is row i % 4 of
+// column i / 4, so ShiftRows rotates each 16 bit lane and MixColumns
+// rotates each nibble.
+
+// ShiftRows, row r of each lane rotates right by 4 * r bits
+static void bs_shift_rows(quint64 *p)
+{
+	for(int b = 0; b < 8; ++b)
+	{
+		quint64 x = p[b];
+		quint64 t1 = x & Q_UINT64_C(0x2222222222222222);
+		quint64 t2 = x & Q_UINT64_C(0x4444444444444444);
+		quint64 t3 = x & Q_UINT64_C(0x8888888888888888);
+		p[b] = (x & Q_UINT64_C(0x1111111111111111)) |
+			((t1 >> 4) & Q_UINT64_C(0x0222022202220222)) | ((t1 << 12) & Q_UINT64_C(0x2000200020002000)) |
+			((t2 >> 8) & Q_UINT64_C(0x0044004400440044)) | ((t2 << 8) & Q_UINT64_C(0x4400440044004400)) |
+			((t3 >> 12) & Q_UINT64_C(0x0008000800080008)) | ((t3 << 4) & Q_UINT64_C(0x8880888088808880));
+	}
+}
+
+static void bs_inv_shift_rows(quint64 *p)
+{
+	for(int b = 0; b < 8; ++b)
+	{
+		quint64 x = p[b];
+		quint64 t1 = x & Q_UINT64_C(0x2222222222222222);
+		quint64 t2 = x & Q_UINT64_C(0x4444444444444444);
+		quint64 t3 = x & Q_UINT64_C(0x8888888888888888);
+		p[b] = (x & Q_UINT64_C(0x1111111111111111)) |
+			((t1 << 4) & Q_UINT64_C(0x2220222022202220)) | ((t1 >> 12) & Q_UINT64_C(0x0002000200020002)) |
+			((t2 << 8) & Q_UINT64_C(0x4400440044004400)) | ((t2 >> 8) & Q_UINT64_C(0x0044004400440044)) |
+			((t3 << 12) & Q_UINT64_C(0x8000800080008000)) | ((t3 >> 4) & Q_UINT64_C(0x0888088808880888));
+	}
+}
+
+// next row of the same column
+static inline quint64 rot1(quint64 x)
+{
+	return ((x >> 1) & Q_UINT64_C(0x7777777777777777)) | ((x << 3) & Q_UINT64_C(0x8888888888888888));
+}
+
+static inline quint64 rot2(quint64 x)
+{
+	return ((x >> 2) & Q_UINT64_C(0x3333333333333333)) | ((x << 2) & Q_UINT64_C(0xCCCCCCCCCCCCCCCC));
+}
+
+// multiplication by x, the planes shift up one bit position
+static inline void bs_xtime(quint64 *r, const quint64 *a)
+{
+	quint64 hi = a[7];
+	r[7] = a[6];
+	r[6] = a[5];
+	r[5] = a[4];
+	r[4] = a[3] ^ hi;
+	r[3] = a[2] ^ hi;
+	r[2] = a[1];
+	r[1] = a[0] ^ hi;
+	r[0] = hi;
+}
+
+// out_i = 2 a_i + 3 a_i+1 + a_i+2 + a_i+3
+static void bs_mix_columns(quint64 *p)
+{
+	quint64 u[8], x[8];
+	for(int b = 0; b < 8; ++b)
+		u[b] = p[b] ^ rot1(p[b]);
+	bs_xtime(x, u);
+	for(int b = 0; b < 8; ++b)
+		p[b] = x[b] ^ u[b] ^ p[b] ^ rot2(u[b]);
+}
+
+static void bs_inv_mix_columns(quint64 *p)
+{
+	quint64 u[8], x[8];
+	for(int b = 0; b < 8; ++b)
+		u[b] = p[b] ^ rot2(p[b]);
+	bs_xtime(x, u);
+	bs_xtime(u, x);
+	for(int b = 0; b < 8; ++b)
+		p[b] ^= u[b];
+	bs_mix_columns(p);
+}
+
+// The basis changes into and out of the tower field are merged with the
+// affine maps of the S-box and its inverse.
+
+static void bs_sub_bytes(quint64 *p)
+{
+	quint64 x0 = p[0], x1 = p[1], x2 = p[2], x3 = p[3];
+	quint64 x4 = p[4], x5 = p[5], x6 = p[6], x7 = p[7];
+	quint64 t[8];
+	t[0] = x0 ^ x5 ^ x7;
+	t[1] = x2;
+	t[2] = x2 ^ x3 ^ x4 ^ x5 ^ x6 ^ x7;
+	t[3] = x3 ^ x4;
+	t[4] = x4 ^ x5 ^ x6;
+	t[5] = x1 ^ x4 ^ x6 ^ x7;
+	t[6] = x2 ^ x3 ^ x5 ^ x7;
+	t[7] = x5 ^ x7;
+
+	bs_tower_invert(t);
+
+	// affine map, constant 0x63
+	p[0] = ~(t[0] ^ t[2] ^ t[6]);
+	p[1] = ~(t[0] ^ t[1] ^ t[2] ^ t[3] ^ t[4] ^ t[5]);
+	p[2] = t[0] ^ t[3] ^ t[5] ^ t[6];
+	p[3] = t[0] ^ t[2] ^ t[5];
+	p[4] = t[0] ^ t[1] ^ t[3] ^ t[4] ^ t[5];
+	p[5] = ~(t[1] ^ t[2] ^ t[3] ^ t[5] ^ t[6] ^ t[7]);
+	p[6] = ~(t[4] ^ t[6] ^ t[7]);
+	p[7] = t[1] ^ t[2];
+}
+
+static void bs_inv_sub_bytes(quint64 *p)
+{
+	quint64 y0 = p[0], y1 = p[1], y2 = p[2], y3 = p[3];
+	quint64 y4 = p[4], y5 = p[5], y6 = p[6], y7 = p[7];
+	quint64 t[8];
+
+	// inverse affine map, constant 0x47 after the basis change
+	t[0] = ~(y1 ^ y5 ^ y6);
+	t[1] = ~(y1 ^ y4 ^ y7);
+	t[2] = ~(y1 ^ y4);
+	t[3] = y0 ^ y1 ^ y2 ^ y3 ^ y5 ^ y6;
+	t[4] = y0 ^ y1 ^ y2 ^ y4 ^ y5 ^ y6 ^ y7;
+	t[5] = y3 ^ y4 ^ y5 ^ y6;
+	t[6] = ~(y0 ^ y4 ^ y5 ^ y6);
+	t[7] = y1 ^ y2 ^ y6 ^ y7;
+
+	bs_tower_invert(t);
+
+	p[0] = t[0] ^ t[7];
+	p[1] = t[4] ^ t[5] ^ t[7];
+	p[2] = t[1];
+	p[3] = t[1] ^ t[6] ^ t[7];
+	p[4] = t[1] ^ t[3] ^ t[6] ^ t[7];
+	p[5] = t[2] ^ t[4] ^ t[6];
+	p[6] = t[1] ^ t[2] ^ t[3] ^ t[7];
+	p[7] = t[2] ^ t[4] ^ t[6] ^ t[7];
+}
+
+static inline void bs_add_round_key(quint64 *p, const quint64 *k)
+{
+	for(int b = 0; b < 8; ++b)
+		p[b] ^= k[b];
+}
+
+static void sub_bytes(unsigned char *s)
+{
+	quint64 p[8];
+	bs_load(s, p);
+	bs_sub_bytes(p);
+	bs_store(p, s);
+}
+
+// up to four blocks at once, bk holds the bitsliced round keys
+static void portable_encrypt4(const quint64 *bk, int nr, unsigned char *s)
+{
+	quint64 p[8];
+	bs_load(s, p);
+	bs_add_round_key(p, bk);
+	for(int round = 1; round <= nr; ++round)
+	{
+		bs_sub_bytes(p);
+		bs_shift_rows(p);
+		if(round != nr)
+			bs_mix_columns(p);
+		bs_add_round_key(p, bk + 8 * round);
+	}
+	bs_store(p, s);
+}
+
+static void portable_decrypt4(const quint64 *bk, int nr, unsigned char *s)
+{
+	quint64 p[8];
+	bs_load(s, p);
+	bs_add_round_key(p, bk + 8 * nr);
+	for(int round = nr - 1; round >= 0; --round)
+	{
+		bs_inv_shift_rows(p);
+		bs_inv_sub_bytes(p);
+		bs_add_round_key(p, bk + 8 * round);
+		if(round != 0)
+			bs_inv_mix_columns(p);
+	}
+	bs_store(p, s);
+}
+
+// out = E(in) ^ x, or just E(in) if x is null
+static void portable_encrypt(const quint64 *bk, int nr, const unsigned char *in, unsigned char *out, int blocks, const unsigned char *x)
+{
+	unsigned char s[64];
+	while(blocks > 0)
+	{
+		int n = qMin(blocks, 4);
+		memset(s, 0, 64);
+		memcpy(s, in, 16 * n);
+		portable_encrypt4(bk, nr, s);
+		if(x)
+		{
+			for(int i = 0; i < 16 * n; ++i)
+				out[i] = s[i] ^ x[i];
+			x += 16 * n;
+		}
+		else
+			memcpy(out, s, 16 * n);
+		in += 16 * n;
+		out += 16 * n;
+		blocks -= n;
+	}
+	memset(s, 0, 64);
+}
+
+static void portable_decrypt(const quint64 *bk, int nr, const unsigned char *in, unsigned char *out, int blocks)
+{
+	unsigned char s[64];
+	while(blocks > 0)
+	{
+		int n = qMin(blocks, 4);
+		memset(s, 0, 64);
+		memcpy(s, in, 16 * n);
+		portable_decrypt4(bk, nr, s);
+		memcpy(out, s, 16 * n);
+		in += 16 * n;
+		out += 16 * n;
+		blocks -= n;
+	}
+	memset(s, 0, 64);
+}
+
+static void expand_key(const unsigned char *key, int len, unsigned char *ek)
+{
+	static const unsigned char rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+	int nk = len / 4;
+	int nr = nk + 6;
+	memcpy(ek, key, len);
+	unsigned char s[64];
+	for(int i = nk; i < 4 * (nr + 1); ++i)
+	{
+		unsigned char t[4];
+		memcpy(t, ek + 4 * (i - 1), 4);
+		if(i % nk == 0 || (nk > 6 && i % nk == 4))
+		{
+			memset(s, 0, 64);
+			if(i % nk == 0)
+			{
+				s[0] = t[1];
+				s[1] = t[2];
+				s[2] = t[3];
+				s[3] = t[0];
+			}
+			else
+				memcpy(s, t, 4);
+			sub_bytes(s);
+			memcpy(t, s, 4);
+			if(i % nk == 0)
+				t[0] ^= rcon[i / nk - 1];
+		}
+		for(int n = 0; n < 4; ++n)
+			ek[4 * i + n] = ek[4 * (i - nk) + n] ^ t[n];
+	}
+	memset(s, 0, 64);
+}
+
+// each round key replicated for the four blocks
+static void slice_round_keys(const unsigned char *ek, int nr, quint64 *bk)
+{
+	unsigned char s[64];
+	for(int round = 0; round <= nr; ++round)
+	{
+		for(int k = 0; k < 4; ++k)
+			memcpy(s + 16 * k, ek + 16 * round, 16);
+		bs_load(s, bk + 8 * round);
+	}
+	memset(s, 0, 64);
+}
+
+//----------------------------------------------------------------------------
+// AES-NI
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_SIMD)
+
+QCA_TARGET("aes,sse2")
+static void aesni_encrypt(const unsigned char *ek, int nr, const unsigned char *in, unsigned char *out, int blocks, const unsigned char *x)
+{
+	__m128i rk[15];
+	for(int i = 0; i <= nr; ++i)
+		rk[i] = _mm_loadu_si128((const __m128i *)(ek + 16 * i));
+
+	while(blocks >= 8)
+	{
+		__m128i b[8];
+		for(int j = 0; j < 8; ++j)
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16 * j)), rk[0]);
+		for(int i = 1; i < nr; ++i)
+		{
+			for(int j = 0; j < 8; ++j)
+				b[j] = _mm_aesenc_si128(b[j], rk[i]);
+		}
+		for(int j = 0; j < 8; ++j)
+		{
+			b[j] = _mm_aesenclast_si128(b[j], rk[nr]);
+			if(x)
+				b[j] = _mm_xor_si128(b[j], _mm_loadu_si128((const __m128i *)(x + 16 * j)));
+			_mm_storeu_si128((__m128i *)(out + 16 * j), b[j]);
+		}
+		in += 128;
+		out += 128;
+		if(x)
+			x += 128;
+		blocks -= 8;
+	}
+
+	for(; blocks > 0; --blocks)
+	{
+		__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), rk[0]);
+		for(int i = 1; i < nr; ++i)
+			b = _mm_aesenc_si128(b, rk[i]);
+		b = _mm_aesenclast_si128(b, rk[nr]);
+		if(x)
+		{
+			b = _mm_xor_si128(b, _mm_loadu_si128((const __m128i *)x));
+			x += 16;
+		}
+		_mm_storeu_si128((__m128i *)out, b);
+		in += 16;
+		out += 16;
+	}
+}
+
+// the previous ciphertext block is xored in when prev is not null, which
+// is CBC decryption
+QCA_TARGET("aes,sse2")
+static void aesni_decrypt(const unsigned char *dk, int nr, const unsigned char *in, unsigned char *out, int blocks, unsigned char *prev)
+{
+	__m128i rk[15];
+	for(int i = 0; i <= nr; ++i)
+		rk[i] = _mm_loadu_si128((const __m128i *)(dk + 16 * i));
+	__m128i iv = prev ? _mm_loadu_si128((const __m128i *)prev) : _mm_setzero_si128();
+
+	while(blocks >= 8)
+	{
+		__m128i c[8], b[8];
+		for(int j = 0; j < 8; ++j)
+		{
+			c[j] = _mm_loadu_si128((const __m128i *)(in + 16 * j));
+			b[j] = _mm_xor_si128(c[j], rk[0]);
+		}
+		for(int i = 1; i < nr; ++i)
+		{
+			for(int j = 0; j < 8; ++j)
+				b[j] = _mm_aesdec_si128(b[j], rk[i]);
+		}
+		for(int j = 0; j < 8; ++j)
+		{
+			b[j] = _mm_aesdeclast_si128(b[j], rk[nr]);
+			if(prev)
+			{
+				b[j] = _mm_xor_si128(b[j], iv);
+				iv = c[j];
+			}
+			_mm_storeu_si128((__m128i *)(out + 16 * j), b[j]);
+		}
+		in += 128;
+		out += 128;
+		blocks -= 8;
+	}
+
+	for(; blocks > 0; --blocks)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i *)in);
+		__m128i b = _mm_xor_si128(c, rk[0]);
+		for(int i = 1; i < nr; ++i)
+			b = _mm_aesdec_si128(b, rk[i]);
+		b = _mm_aesdeclast_si128(b, rk[nr]);
+		if(prev)
+		{
+			b = _mm_xor_si128(b, iv);
+			iv = c;
+		}
+		_mm_storeu_si128((__m128i *)out, b);
+		in += 16;
+		out += 16;
+	}
+
+	if(prev)
+		_mm_storeu_si128((__m128i *)prev, iv);
+}
+
+QCA_TARGET("aes,sse2")
+static void aesni_encrypt_cbc(const unsigned char *ek, int nr, unsigned char *ivp, const unsigned char *in, unsigned char *out, int blocks)
+{
+	__m128i rk[15];
+	for(int i = 0; i <= nr; ++i)
+		rk[i] = _mm_loadu_si128((const __m128i *)(ek + 16 * i));
+	__m128i iv = _mm_loadu_si128((const __m128i *)ivp);
+
+	for(; blocks > 0; --blocks)
+	{
+		__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), iv);
+		b = _mm_xor_si128(b, rk[0]);
+		for(int i = 1; i < nr; ++i)
+			b = _mm_aesenc_si128(b, rk[i]);
+		iv = _mm_aesenclast_si128(b, rk[nr]);
+		_mm_storeu_si128((__m128i *)out, iv);
+		in += 16;
+		out += 16;
+	}
+
+	_mm_storeu_si128((__m128i *)ivp, iv);
+}
+
+QCA_TARGET("aes,sse2")
+static void aesni_decrypt_keys(const unsigned char *ek, int nr, unsigned char *dk)
+{
+	memcpy(dk, ek + 16 * nr, 16);
+	for(int i = 1; i < nr; ++i)
+	{
+		__m128i k = _mm_loadu_si128((const __m128i *)(ek + 16 * (nr - i)));
+		_mm_storeu_si128((__m128i *)(dk + 16 * i), _mm_aesimc_si128(k));
+	}
+	memcpy(dk + 16 * nr, ek, 16);
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// VAES, two blocks per 256 bit register
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_VAES)
+
+QCA_TARGET("vaes,avx2,aes")
+static void vaes_encrypt(const unsigned char *ek, int nr, const unsigned char *in, unsigned char *out, int blocks, const unsigned char *x)
+{
+	__m256i rk[15];
+	for(int i = 0; i <= nr; ++i)
+		rk[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(ek + 16 * i)));
+
+	while(blocks >= 16)
+	{
+		__m256i b[8];
+		for(int j = 0; j < 8; ++j)
+			b[j] = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in + 32 * j)), rk[0]);
+		for(int i = 1; i < nr; ++i)
+		{
+			for(int j = 0; j < 8; ++j)
+				b[j] = _mm256_aesenc_epi128(b[j], rk[i]);
+		}
+		for(int j = 0; j < 8; ++j)
+		{
+			b[j] = _mm256_aesenclast_epi128(b[j], rk[nr]);
+			if(x)
+				b[j] = _mm256_xor_si256(b[j], _mm256_loadu_si256((const __m256i *)(x + 32 * j)));
+			_mm256_storeu_si256((__m256i *)(out + 32 * j), b[j]);
+		}
+		in += 256;
+		out += 256;
+		if(x)
+			x += 256;
+		blocks -= 16;
+	}
+
+	_mm256_zeroupper();
+	if(blocks > 0)
+		aesni_encrypt(ek, nr, in, out, blocks, x);
+}
+
+QCA_TARGET("vaes,avx2,aes")
+static void vaes_decrypt(const unsigned char *dk, int nr, const unsigned char *in, unsigned char *out, int blocks, unsigned char *prev)
+{
+	__m256i rk[15];
+	for(int i = 0; i <= nr; ++i)
+		rk[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(dk + 16 * i)));
+
+	while(blocks >= 16)
+	{
+		__m256i b[8], p[8];
+		// load everything before storing, in and out may be the same
+		for(int j = 0; j < 8; ++j)
+			b[j] = _mm256_loadu_si256((const __m256i *)(in + 32 * j));
+		if(prev)
+		{
+			p[0] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)prev)),
+				_mm_loadu_si128((const __m128i *)in), 1);
+			for(int j = 1; j < 8; ++j)
+				p[j] = _mm256_loadu_si256((const __m256i *)(in + 32 * j - 16));
+			memcpy(prev, in + 240, 16);
+		}
+		for(int j = 0; j < 8; ++j)
+			b[j] = _mm256_xor_si256(b[j], rk[0]);
+		for(int i = 1; i < nr; ++i)
+		{
+			for(int j = 0; j < 8; ++j)
+				b[j] = _mm256_aesdec_epi128(b[j], rk[i]);
+		}
+		for(int j = 0; j < 8; ++j)
+		{
+			b[j] = _mm256_aesdeclast_epi128(b[j], rk[nr]);
+			if(prev)
+				b[j] = _mm256_xor_si256(b[j], p[j]);
+			_mm256_storeu_si256((__m256i *)(out + 32 * j), b[j]);
+		}
+		in += 256;
+		out += 256;
+		blocks -= 16;
+	}
+
+	_mm256_zeroupper();
+	if(blocks > 0)
+		aesni_decrypt(dk, nr, in, out, blocks, prev);
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// AesCipher
+//----------------------------------------------------------------------------
+AesCipher::AesCipher()
+{
+	impl = Portable;
+	nr = 0;
+	memset(ek, 0, sizeof(ek));
+	memset(dk, 0, sizeof(dk));
+	memset(bk, 0, sizeof(bk));
+}
+
+AesCipher::~AesCipher()
+{
+	// don't let the compiler drop the wipe of the key schedule
+	volatile unsigned char *p = ek;
+	for(unsigned int n = 0; n < sizeof(ek); ++n)
+		p[n] = 0;
+	p = dk;
+	for(unsigned int n = 0; n < sizeof(dk); ++n)
+		p[n] = 0;
+	volatile quint64 *q = bk;
+	for(unsigned int n = 0; n < sizeof(bk) / sizeof(bk[0]); ++n)
+		q[n] = 0;
+}
+
+bool AesCipher::setKey(const unsigned char *key, int len)
+{
+	if(len != 16 && len != 24 && len != 32)
+		return false;
+
+	nr = len / 4 + 6;
+	expand_key(key, len, ek);
+
+	impl = Portable;
+	slice_round_keys(ek, nr, bk);
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAESNI | CpuSSE2))
+	{
+		impl = AESNI;
+		aesni_decrypt_keys(ek, nr, dk);
+	}
+#endif
+#if defined(QCA_X86_VAES)
+	if(impl == AESNI && hasCpuFeatures(CpuVAES))
+		impl = VAES;
+#endif
+	return true;
+}
+
+void AesCipher::encrypt(const unsigned char *in, unsigned char *out, int blocks) const
+{
+	switch(impl)
+	{
+#if defined(QCA_X86_VAES)
+	case VAES:
+		vaes_encrypt(ek, nr, in, out, blocks, 0);
+		break;
+#endif
+#if defined(QCA_X86_SIMD)
+	case AESNI:
+		aesni_encrypt(ek, nr, in, out, blocks, 0);
+		break;
+#endif
+	default:
+		portable_encrypt(bk, nr, in, out, blocks, 0);
+		break;
+	}
+}
+
+void AesCipher::decrypt(const unsigned char *in, unsigned char *out, int blocks) const
+{
+	switch(impl)
+	{
+#if defined(QCA_X86_VAES)
+	case VAES:
+		vaes_decrypt(dk, nr, in, out, blocks, 0);
+		break;
+#endif
+#if defined(QCA_X86_SIMD)
+	case AESNI:
+		aesni_decrypt(dk, nr, in, out, blocks, 0);
+		break;
+#endif
+	default:
+		portable_decrypt(bk, nr, in, out, blocks);
+		break;
+	}
+}
+
+void AesCipher::encryptCbc(unsigned char *iv, const unsigned char *in, unsigned char *out, int blocks) const
+{
+#if defined(QCA_X86_SIMD)
+	if(impl != Portable)
+	{
+		aesni_encrypt_cbc(ek, nr, iv, in, out, blocks);
+		return;
+	}
+#endif
+	unsigned char b[16];
+	for(; blocks > 0; --blocks)
+	{
+		for(int n = 0; n < 16; ++n)
+			b[n] = in[n] ^ iv[n];
+		portable_encrypt(bk, nr, b, iv, 1, 0);
+		memcpy(out, iv, 16);
+		in += 16;
+		out += 16;
+	}
+	memset(b, 0, 16);
+}
+
+void AesCipher::decryptCbc(unsigned char *iv, const unsigned char *in, unsigned char *out, int blocks) const
+{
+	switch(impl)
+	{
+#if defined(QCA_X86_VAES)
+	case VAES:
+		vaes_decrypt(dk, nr, in, out, blocks, iv);
+		return;
+#endif
+#if defined(QCA_X86_SIMD)
+	case AESNI:
+		aesni_decrypt(dk, nr, in, out, blocks, iv);
+		return;
+#endif
+	default:
+		break;
+	}
+
+	unsigned char c[64];
+	unsigned char p[64];
+	while(blocks > 0)
+	{
+		int n = qMin(blocks, 4);
+		memcpy(c, in, 16 * n);
+		portable_decrypt(bk, nr, c, p, n);
+		for(int i = 0; i < 16; ++i)
+			out[i] = p[i] ^ iv[i];
+		for(int i = 16; i < 16 * n; ++i)
+			out[i] = p[i] ^ c[i - 16];
+		memcpy(iv, c + 16 * (n - 1), 16);
+		in += 16 * n;
+		out += 16 * n;
+		blocks -= n;
+	}
+	memset(p, 0, 64);
+}
+
+void AesCipher::ctr(unsigned char *counter, bool inc32, const unsigned char *in, unsigned char *out, int blocks) const
+{
+	// counter blocks are produced in batches and encrypted with the
+	// input xored in on the way out
+	unsigned char buf[16 * 32];
+	while(blocks > 0)
+	{
+		int n = qMin(blocks, 32);
+		for(int b = 0; b < n; ++b)
+		{
+			memcpy(buf + 16 * b, counter, 16);
+			int stop = inc32 ? 12 : 0;
+			for(int i = 15; i >= stop; --i)
+			{
+				if(++counter[i] != 0)
+					break;
+			}
+		}
+
+		switch(impl)
+		{
+#if defined(QCA_X86_VAES)
+		case VAES:
+			vaes_encrypt(ek, nr, buf, out, n, in);
+			break;
+#endif
+#if defined(QCA_X86_SIMD)
+		case AESNI:
+			aesni_encrypt(ek, nr, buf, out, n, in);
+			break;
+#endif
+		default:
+			portable_encrypt(bk, nr, buf, out, n, in);
+			break;
+		}
+
+		in += 16 * n;
+		out += 16 * n;
+		blocks -= n;
+	}
+}
+
+const char *AesCipher::implementation() const
+{
+	switch(impl)
+	{
+	case VAES:
+		return "vaes";
+	case AESNI:
+		return "aesni";
+	default:
+		return "portable";
+	}
+}
+
+}
@@ -0,0 +1,72 @@
+/*
+ * qca_aes.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_AES_H
+#define QCA_AES_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// AES block cipher (FIPS 197) with the bulk operations needed for ECB, CBC,
+// CTR and GCM.  Uses VAES or AES-NI when the processor has them, otherwise a
+// portable implementation that computes the S-box arithmetically on
+// bitsliced data instead of looking it up, so it runs in constant time.
+//
+// All operations work on whole 16 byte blocks and may be done in place.
+class AesCipher
+{
+public:
+	AesCipher();
+	~AesCipher();
+
+	// key must be 16, 24 or 32 bytes
+	bool setKey(const unsigned char *key, int len);
+
+	void encrypt(const unsigned char *in, unsigned char *out, int blocks) const;
+	void decrypt(const unsigned char *in, unsigned char *out, int blocks) const;
+
+	// iv is updated to the last ciphertext block
+	void encryptCbc(unsigned char *iv, const unsigned char *in, unsigned char *out, int blocks) const;
+	void decryptCbc(unsigned char *iv, const unsigned char *in, unsigned char *out, int blocks) const;
+
+	// out = in ^ E(counter), in ^ E(counter + 1), ...  The counter is
+	// advanced past the blocks used, as a 128 bit big endian integer, or
+	// only in its low 32 bits (GCM) if inc32 is set.
+	void ctr(unsigned char *counter, bool inc32, const unsigned char *in, unsigned char *out, int blocks) const;
+
+	// name of the implementation in use, for diagnostics
+	const char *implementation() const;
+
+private:
+	enum Impl { Portable, AESNI, VAES };
+
+	Impl impl;
+	int nr;
+	unsigned char ek[16 * 15];
+	unsigned char dk[16 * 15];
+	quint64 bk[8 * 15];
+};
+
+}
+
+#endif
@@ -0,0 +1,743 @@
+/*
+ * qca_argon2.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_argon2.h"
+
+#include "qca_cpu.h"
+
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+static inline quint32 load_le32(const unsigned char *p)
+{
+	return (quint32)p[0] | ((quint32)p[1] << 8) | ((quint32)p[2] << 16) | ((quint32)p[3] << 24);
+}
+
+static inline void store_le32(unsigned char *p, quint32 v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+static inline quint64 load_le64(const unsigned char *p)
+{
+	return (quint64)load_le32(p) | ((quint64)load_le32(p + 4) << 32);
+}
+
+static inline void store_le64(unsigned char *p, quint64 v)
+{
+	store_le32(p, (quint32)v);
+	store_le32(p + 4, (quint32)(v >> 32));
+}
+
+static inline quint64 rotr64(quint64 x, int n)
+{
+	return (x >> n) | (x << (64 - n));
+}
+
+static void wipe(void *p, size_t len)
+{
+	volatile unsigned char *q = (volatile unsigned char *)p;
+	while(len--)
+		*q++ = 0;
+}
+
+//----------------------------------------------------------------------------
+// BLAKE2b
+//----------------------------------------------------------------------------
+// BLAKE2b (RFC 7693) without a key, the hash Argon2 is built on
+class Blake2b
+{
+public:
+	explicit Blake2b(int outLen);
+	~Blake2b();
+
+	void update(const unsigned char *data, int len);
+	void final(unsigned char *digest);
+
+private:
+	quint64 h[8];
+	unsigned char buf[128];
+	int used;
+	quint64 total;
+	int outLen;
+
+	void compress(const unsigned char *block, bool last);
+};
+
+static const quint64 blake2b_iv[8] =
+{
+	Q_UINT64_C(0x6a09e667f3bcc908), Q_UINT64_C(0xbb67ae8584caa73b),
+	Q_UINT64_C(0x3c6ef372fe94f82b), Q_UINT64_C(0xa54ff53a5f1d36f1),
+	Q_UINT64_C(0x510e527fade682d1), Q_UINT64_C(0x9b05688c2b3e6c1f),
+	Q_UINT64_C(0x1f83d9abfb41bd6b), Q_UINT64_C(0x5be0cd19137e2179)
+};
+
+static const unsigned char blake2b_sigma[12][16] =
+{
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+	{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+	{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+	{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+	{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+	{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+	{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+	{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+	{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+Blake2b::Blake2b(int _outLen)
+{
+	outLen = _outLen;
+	memcpy(h, blake2b_iv, sizeof(h));
+	h[0] ^= Q_UINT64_C(0x01010000) ^ (quint64)outLen;
+	used = 0;
+	total = 0;
+}
+
+Blake2b::~Blake2b()
+{
+	wipe(h, sizeof(h));
+	wipe(buf, sizeof(buf));
+}
+
+#define BLAKE2B_G(a, b, c, d, x, y) \
+	a = a + b + (x); d = rotr64(d ^ a, 32); \
+	c = c + d; b = rotr64(b ^ c, 24); \
+	a = a + b + (y); d = rotr64(d ^ a, 16); \
+	c = c + d; b = rotr64(b ^ c, 63);
+
+void Blake2b::compress(const unsigned char *block, bool last)
+{
+	quint64 m[16], v[16];
+	for(int n = 0; n < 16; ++n)
+		m[n] = load_le64(block + 8 * n);
+	for(int n = 0; n < 8; ++n)
+	{
+		v[n] = h[n];
+		v[n + 8] = blake2b_iv[n];
+	}
+	v[12] ^= total;
+	if(last)
+		v[14] = ~v[14];
+
+	for(int i = 0; i < 12; ++i)
+	{
+		const unsigned char *s = blake2b_sigma[i];
+		BLAKE2B_G(v[0], v[4], v[ 8], v[12], m[s[ 0]], m[s[ 1]])
+		BLAKE2B_G(v[1], v[5], v[ 9], v[13], m[s[ 2]], m[s[ 3]])
+		BLAKE2B_G(v[2], v[6], v[10], v[14], m[s[ 4]], m[s[ 5]])
+		BLAKE2B_G(v[3], v[7], v[11], v[15], m[s[ 6]], m[s[ 7]])
+		BLAKE2B_G(v[0], v[5], v[10], v[15], m[s[ 8]], m[s[ 9]])
+		BLAKE2B_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]])
+		BLAKE2B_G(v[2], v[7], v[ 8], v[13], m[s[12]], m[s[13]])
+		BLAKE2B_G(v[3], v[4], v[ 9], v[14], m[s[14]], m[s[15]])
+	}
+
+	for(int n = 0; n < 8; ++n)
+		h[n] ^= v[n] ^ v[n + 8];
+	wipe(m, sizeof(m));
+	wipe(v, sizeof(v));
+}
+
+#undef BLAKE2B_G
+
+void Blake2b::update(const unsigned char *data, int len)
+{
+	// the last block is compressed differently, so a full buffer is only
+	//   compressed once more data follows
+	while(len > 0)
+	{
+		if(used == 128)
+		{
+			total += 128;
+			compress(buf, false);
+			used = 0;
+		}
+		int n = qMin(128 - used, len);
+		memcpy(buf + used, data, n);
+		used += n;
+		data += n;
+		len -= n;
+	}
+}
+
+void Blake2b::final(unsigned char *digest)
+{
+	total += used;
+	memset(buf + used, 0, 128 - used);
+	compress(buf, true);
+
+	unsigned char out[64];
+	for(int n = 0; n < 8; ++n)
+		store_le64(out + 8 * n, h[n]);
+	memcpy(digest, out, outLen);
+	wipe(out, sizeof(out));
+}
+
+// H' of RFC 9106, BLAKE2b stretched to any output length
+static void blake2b_long(unsigned char *out, int outLen, const unsigned char *in, int inLen)
+{
+	unsigned char length[4];
+	store_le32(length, (quint32)outLen);
+	if(outLen <= 64)
+	{
+		Blake2b h(outLen);
+		h.update(length, 4);
+		h.update(in, inLen);
+		h.final(out);
+		return;
+	}
+
+	// the first 32 bytes of each 64 byte hash in the chain, and all of
+	//   the last one
+	unsigned char v[64];
+	Blake2b first(64);
+	first.update(length, 4);
+	first.update(in, inLen);
+	first.final(v);
+	memcpy(out, v, 32);
+	out += 32;
+	int left = outLen - 32;
+	while(left > 64)
+	{
+		Blake2b h(64);
+		h.update(v, 64);
+		h.final(v);
+		memcpy(out, v, 32);
+		out += 32;
+		left -= 32;
+	}
+	Blake2b last(left);
+	last.update(v, 64);
+	last.final(out);
+	wipe(v, sizeof(v));
+}
+
+//----------------------------------------------------------------------------
+// Compression function
+//----------------------------------------------------------------------------
+class Argon2Block
+{
+public:
+	quint64 v[128];
+};
+
+typedef void (*Argon2FillFn)(const Argon2Block *prev, const Argon2Block *ref, Argon2Block *next, bool withXor);
+
+// next = G(prev, ref), or next ^= G(prev, ref) on the later passes.  G
+//   applies the BlaMka permutation P to the rows of R = prev ^ ref, taken
+//   as 8x8 16 byte registers, then to its columns, and adds R back.
+
+static inline quint64 blamka(quint64 x, quint64 y)
+{
+	return x + y + 2 * (quint64)(quint32)x * (quint32)y;
+}
+
+#define ARGON2_G(a, b, c, d) \
+	a = blamka(a, b); d = rotr64(d ^ a, 32); \
+	c = blamka(c, d); b = rotr64(b ^ c, 24); \
+	a = blamka(a, b); d = rotr64(d ^ a, 16); \
+	c = blamka(c, d); b = rotr64(b ^ c, 63);
+
+#define ARGON2_P(v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15) \
+	ARGON2_G(v0, v4, v8, v12) ARGON2_G(v1, v5, v9, v13) \
+	ARGON2_G(v2, v6, v10, v14) ARGON2_G(v3, v7, v11, v15) \
+	ARGON2_G(v0, v5, v10, v15) ARGON2_G(v1, v6, v11, v12) \
+	ARGON2_G(v2, v7, v8, v13) ARGON2_G(v3, v4, v9, v14)
+
+static void fill_block_portable(const Argon2Block *prev, const Argon2Block *ref, Argon2Block *next, bool withXor)
+{
+	quint64 r[128], z[128];
+	for(int n = 0; n < 128; ++n)
+	{
+		r[n] = prev->v[n] ^ ref->v[n];
+		z[n] = r[n];
+	}
+
+	for(int i = 0; i < 8; ++i)
+	{
+		quint64 *q = z + 16 * i;
+		ARGON2_P(q[0], q[1], q[2], q[3], q[4], q[5], q[6], q[7],
+			q[8], q[9], q[10], q[11], q[12], q[13], q[14], q[15])
+	}
+	for(int i = 0; i < 8; ++i)
+	{
+		quint64 *q = z + 2 * i;
+		ARGON2_P(q[0], q[1], q[16], q[17], q[32], q[33], q[48], q[49],
+			q[64], q[65], q[80], q[81], q[96], q[97], q[112], q[113])
+	}
+
+	for(int n = 0; n < 128; ++n)
+		next->v[n] = (withXor ? next->v[n] : 0) ^ z[n] ^ r[n];
+}
+
+#undef ARGON2_P
+#undef ARGON2_G
+
+#if defined(QCA_X86_SIMD)
+
+// SSE2, 8 registers per P
+#define ARGON2_SSE_BLAMKA(x, y) \
+	_mm_add_epi64(_mm_add_epi64(x, y), _mm_add_epi64(_mm_mul_epu32(x, y), _mm_mul_epu32(x, y)))
+#define ARGON2_SSE_ROR32(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1))
+#define ARGON2_SSE_ROR(x, n) _mm_or_si128(_mm_srli_epi64(x, n), _mm_slli_epi64(x, 64 - (n)))
+#define ARGON2_SSE_ROR63(x) _mm_xor_si128(_mm_srli_epi64(x, 63), _mm_add_epi64(x, x))
+
+#define ARGON2_SSE_G1(A0, B0, C0, D0, A1, B1, C1, D1) \
+	A0 = ARGON2_SSE_BLAMKA(A0, B0); A1 = ARGON2_SSE_BLAMKA(A1, B1); \
+	D0 = ARGON2_SSE_ROR32(_mm_xor_si128(D0, A0)); D1 = ARGON2_SSE_ROR32(_mm_xor_si128(D1, A1)); \
+	C0 = ARGON2_SSE_BLAMKA(C0, D0); C1 = ARGON2_SSE_BLAMKA(C1, D1); \
+	B0 = ARGON2_SSE_ROR(_mm_xor_si128(B0, C0), 24); B1 = ARGON2_SSE_ROR(_mm_xor_si128(B1, C1), 24);
+
+#define ARGON2_SSE_G2(A0, B0, C0, D0, A1, B1, C1, D1) \
+	A0 = ARGON2_SSE_BLAMKA(A0, B0); A1 = ARGON2_SSE_BLAMKA(A1, B1); \
+	D0 = ARGON2_SSE_ROR(_mm_xor_si128(D0, A0), 16); D1 = ARGON2_SSE_ROR(_mm_xor_si128(D1, A1), 16); \
+	C0 = ARGON2_SSE_BLAMKA(C0, D0); C1 = ARGON2_SSE_BLAMKA(C1, D1); \
+	B0 = ARGON2_SSE_ROR63(_mm_xor_si128(B0, C0)); B1 = ARGON2_SSE_ROR63(_mm_xor_si128(B1, C1));
+
+// rotates the rows of B, C and D by one, two and three words
+#define ARGON2_SSE_DIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1) \
+	{ \
+		__m128i t0 = D0, t1 = B0; \
+		D0 = C0; C0 = C1; C1 = D0; \
+		D0 = _mm_unpackhi_epi64(D1, _mm_unpacklo_epi64(t0, t0)); \
+		D1 = _mm_unpackhi_epi64(t0, _mm_unpacklo_epi64(D1, D1)); \
+		B0 = _mm_unpackhi_epi64(B0, _mm_unpacklo_epi64(B1, B1)); \
+		B1 = _mm_unpackhi_epi64(B1, _mm_unpacklo_epi64(t1, t1)); \
+	}
+
+#define ARGON2_SSE_UNDIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1) \
+	{ \
+		__m128i t0 = C0, t1; \
+		C0 = C1; C1 = t0; \
+		t0 = B0; t1 = D0; \
+		B0 = _mm_unpackhi_epi64(B1, _mm_unpacklo_epi64(B0, B0)); \
+		B1 = _mm_unpackhi_epi64(t0, _mm_unpacklo_epi64(B1, B1)); \
+		D0 = _mm_unpackhi_epi64(D0, _mm_unpacklo_epi64(D1, D1)); \
+		D1 = _mm_unpackhi_epi64(D1, _mm_unpacklo_epi64(t1, t1)); \
+	}
+
+#define ARGON2_SSE_P(A0, A1, B0, B1, C0, C1, D0, D1) \
+	{ \
+		ARGON2_SSE_G1(A0, B0, C0, D0, A1, B1, C1, D1) \
+		ARGON2_SSE_G2(A0, B0, C0, D0, A1, B1, C1, D1) \
+		ARGON2_SSE_DIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1) \
+		ARGON2_SSE_G1(A0, B0, C0, D0, A1, B1, C1, D1) \
+		ARGON2_SSE_G2(A0, B0, C0, D0, A1, B1, C1, D1) \
+		ARGON2_SSE_UNDIAGONALIZE(A0, B0, C0, D0, A1, B1, C1, D1) \
+	}
+
+QCA_TARGET("sse2")
+static void fill_block_sse2(const Argon2Block *prev, const Argon2Block *ref, Argon2Block *next, bool withXor)
+{
+	__m128i r[64], z[64];
+	for(int n = 0; n < 64; ++n)
+	{
+		r[n] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(prev->v + 2 * n)),
+			_mm_loadu_si128((const __m128i *)(ref->v + 2 * n)));
+		z[n] = r[n];
+	}
+
+	for(int i = 0; i < 8; ++i)
+		ARGON2_SSE_P(z[8 * i + 0], z[8 * i + 1], z[8 * i + 2], z[8 * i + 3],
+			z[8 * i + 4], z[8 * i + 5], z[8 * i + 6], z[8 * i + 7])
+	for(int i = 0; i < 8; ++i)
+		ARGON2_SSE_P(z[8 * 0 + i], z[8 * 1 + i], z[8 * 2 + i], z[8 * 3 + i],
+			z[8 * 4 + i], z[8 * 5 + i], z[8 * 6 + i], z[8 * 7 + i])
+
+	for(int n = 0; n < 64; ++n)
+	{
+		__m128i out = _mm_xor_si128(z[n], r[n]);
+		if(withXor)
+			out = _mm_xor_si128(out, _mm_loadu_si128((const __m128i *)(next->v + 2 * n)));
+		_mm_storeu_si128((__m128i *)(next->v + 2 * n), out);
+	}
+}
+
+#undef ARGON2_SSE_P
+#undef ARGON2_SSE_UNDIAGONALIZE
+#undef ARGON2_SSE_DIAGONALIZE
+#undef ARGON2_SSE_G2
+#undef ARGON2_SSE_G1
+#undef ARGON2_SSE_ROR63
+#undef ARGON2_SSE_ROR
+#undef ARGON2_SSE_ROR32
+#undef ARGON2_SSE_BLAMKA
+
+// AVX2, one P in 4 registers of 4 words, with the diagonal step done by
+//   permuting the words of B, C and D
+#define ARGON2_AVX_BLAMKA(x, y) \
+	_mm256_add_epi64(_mm256_add_epi64(x, y), _mm256_add_epi64(_mm256_mul_epu32(x, y), _mm256_mul_epu32(x, y)))
+
+#define ARGON2_AVX_G(A, B, C, D) \
+	A = ARGON2_AVX_BLAMKA(A, B); \
+	D = _mm256_shuffle_epi32(_mm256_xor_si256(D, A), _MM_SHUFFLE(2, 3, 0, 1)); \
+	C = ARGON2_AVX_BLAMKA(C, D); \
+	B = _mm256_shuffle_epi8(_mm256_xor_si256(B, C), ror24); \
+	A = ARGON2_AVX_BLAMKA(A, B); \
+	D = _mm256_shuffle_epi8(_mm256_xor_si256(D, A), ror16); \
+	C = ARGON2_AVX_BLAMKA(C, D); \
+	B = _mm256_xor_si256(B, C); \
+	B = _mm256_xor_si256(_mm256_srli_epi64(B, 63), _mm256_add_epi64(B, B));
+
+#define ARGON2_AVX_P(A, B, C, D) \
+	ARGON2_AVX_G(A, B, C, D) \
+	B = _mm256_permute4x64_epi64(B, _MM_SHUFFLE(0, 3, 2, 1)); \
+	C = _mm256_permute4x64_epi64(C, _MM_SHUFFLE(1, 0, 3, 2)); \
+	D = _mm256_permute4x64_epi64(D, _MM_SHUFFLE(2, 1, 0, 3)); \
+	ARGON2_AVX_G(A, B, C, D) \
+	B = _mm256_permute4x64_epi64(B, _MM_SHUFFLE(2, 1, 0, 3)); \
+	C = _mm256_permute4x64_epi64(C, _MM_SHUFFLE(1, 0, 3, 2)); \
+	D = _mm256_permute4x64_epi64(D, _MM_SHUFFLE(0, 3, 2, 1));
+
+#define ARGON2_AVX_PAIR(lo, hi) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1)
+
+#define ARGON2_AVX_SPLIT(v, lo, hi) \
+	lo = _mm256_castsi256_si128(v); \
+	hi = _mm256_extracti128_si256(v, 1);
+
+QCA_TARGET("avx2")
+static void fill_block_avx2(const Argon2Block *prev, const Argon2Block *ref, Argon2Block *next, bool withXor)
+{
+	const __m256i ror24 = _mm256_setr_epi8(
+		3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+		3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+	const __m256i ror16 = _mm256_setr_epi8(
+		2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+		2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+
+	// z is kept as 16 byte registers, so that rows and columns can both
+	//   be gathered from it
+	__m256i r[32];
+	__m128i z[64];
+	for(int n = 0; n < 32; ++n)
+	{
+		r[n] = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(prev->v + 4 * n)),
+			_mm256_loadu_si256((const __m256i *)(ref->v + 4 * n)));
+		_mm256_storeu_si256((__m256i *)(z + 2 * n), r[n]);
+	}
+
+	for(int i = 0; i < 8; ++i)
+	{
+		__m128i *q = z + 8 * i;
+		__m256i A = _mm256_loadu_si256((const __m256i *)(q + 0));
+		__m256i B = _mm256_loadu_si256((const __m256i *)(q + 2));
+		__m256i C = _mm256_loadu_si256((const __m256i *)(q + 4));
+		__m256i D = _mm256_loadu_si256((const __m256i *)(q + 6));
+		ARGON2_AVX_P(A, B, C, D)
+		_mm256_storeu_si256((__m256i *)(q + 0), A);
+		_mm256_storeu_si256((__m256i *)(q + 2), B);
+		_mm256_storeu_si256((__m256i *)(q + 4), C);
+		_mm256_storeu_si256((__m256i *)(q + 6), D);
+	}
+	for(int i = 0; i < 8; ++i)
+	{
+		__m128i *q = z + i;
+		__m256i A = ARGON2_AVX_PAIR(q[0], q[8]);
+		__m256i B = ARGON2_AVX_PAIR(q[16], q[24]);
+		__m256i C = ARGON2_AVX_PAIR(q[32], q[40]);
+		__m256i D = ARGON2_AVX_PAIR(q[48], q[56]);
+		ARGON2_AVX_P(A, B, C, D)
+		ARGON2_AVX_SPLIT(A, q[0], q[8])
+		ARGON2_AVX_SPLIT(B, q[16], q[24])
+		ARGON2_AVX_SPLIT(C, q[32], q[40])
+		ARGON2_AVX_SPLIT(D, q[48], q[56])
+	}
+
+	for(int n = 0; n < 32; ++n)
+	{
+		__m256i out = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(z + 2 * n)), r[n]);
+		if(withXor)
+			out = _mm256_xor_si256(out, _mm256_loadu_si256((const __m256i *)(next->v + 4 * n)));
+		_mm256_storeu_si256((__m256i *)(next->v + 4 * n), out);
+	}
+}
+
+#undef ARGON2_AVX_SPLIT
+#undef ARGON2_AVX_PAIR
+#undef ARGON2_AVX_P
+#undef ARGON2_AVX_G
+#undef ARGON2_AVX_BLAMKA
+
+#endif
+
+//----------------------------------------------------------------------------
+// Argon2id
+//----------------------------------------------------------------------------
+class Argon2Instance
+{
+public:
+	Argon2Block *memory;
+	quint32 passes, lanes;
+	quint32 laneLength, segmentLength;
+	Argon2FillFn fill;
+};
+
+// the next 128 pseudo-random values for data-independent addressing
+static void next_addresses(const Argon2Instance *inst, Argon2Block *address, Argon2Block *input, const Argon2Block *zero)
+{
+	++input->v[6];
+	inst->fill(zero, input, address, false);
+	inst->fill(zero, address, address, false);
+}
+
+// position of the reference block within its lane
+static quint32 index_alpha(const Argon2Instance *inst, quint32 pass, quint32 slice,
+	quint32 index, quint32 rand, bool sameLane)
+{
+	const quint32 segmentLength = inst->segmentLength;
+	const quint32 laneLength = inst->laneLength;
+
+	// the blocks that may be referenced: everything finished so far, less
+	//   the previous block, which is an input anyway
+	quint32 area;
+	if(pass == 0)
+	{
+		if(slice == 0)
+			area = index - 1;
+		else if(sameLane)
+			area = slice * segmentLength + index - 1;
+		else
+			area = slice * segmentLength - (index == 0 ? 1 : 0);
+	}
+	else
+	{
+		if(sameLane)
+			area = laneLength - segmentLength + index - 1;
+		else
+			area = laneLength - segmentLength - (index == 0 ? 1 : 0);
+	}
+
+	// biased towards recent blocks
+	quint64 x = rand;
+	x = (x * x) >> 32;
+	quint64 relative = area - 1 - (((quint64)area * x) >> 32);
+
+	quint32 start = 0;
+	if(pass != 0 && slice != 3)
+		start = (slice + 1) * segmentLength;
+	return (quint32)((start + relative) % laneLength);
+}
+
+static void fill_segment(const Argon2Instance *inst, quint32 pass, quint32 lane, quint32 slice)
+{
+	// Argon2id addresses independently of the data for the first half of
+	//   the first pass, as Argon2i does
+	const bool independent = (pass == 0 && slice < 2);
+	const quint32 laneLength = inst->laneLength;
+	Argon2Block zero, input, address;
+	if(independent)
+	{
+		memset(&zero, 0, sizeof(zero));
+		memset(&input, 0, sizeof(input));
+		input.v[0] = pass;
+		input.v[1] = lane;
+		input.v[2] = slice;
+		input.v[3] = (quint64)inst->lanes * laneLength;
+		input.v[4] = inst->passes;
+		input.v[5] = 2;
+	}
+
+	quint32 start = 0;
+	if(pass == 0 && slice == 0)
+	{
+		// the first two blocks of each lane come from H0
+		start = 2;
+		if(independent)
+			next_addresses(inst, &address, &input, &zero);
+	}
+
+	quint64 curr = (quint64)lane * laneLength + slice * inst->segmentLength + start;
+	quint64 prev = (curr % laneLength == 0) ? curr + laneLength - 1 : curr - 1;
+	for(quint32 i = start; i < inst->segmentLength; ++i, ++curr, ++prev)
+	{
+		if(curr % laneLength == 1)
+			prev = curr - 1;
+
+		quint64 rand;
+		if(independent)
+		{
+			if(i % 128 == 0)
+				next_addresses(inst, &address, &input, &zero);
+			rand = address.v[i % 128];
+		}
+		else
+			rand = inst->memory[prev].v[0];
+
+		quint32 refLane = (quint32)((rand >> 32) % inst->lanes);
+		if(pass == 0 && slice == 0)
+			refLane = lane;
+		quint32 refIndex = index_alpha(inst, pass, slice, i, (quint32)rand, refLane == lane);
+		inst->fill(&inst->memory[prev], &inst->memory[(quint64)refLane * laneLength + refIndex],
+			&inst->memory[curr], pass != 0);
+	}
+
+	if(independent)
+		wipe(&address, sizeof(address));
+}
+
+class Argon2Segment : public QRunnable
+{
+public:
+	const Argon2Instance *inst;
+	quint32 pass, lane, slice;
+
+	virtual void run()
+	{
+		fill_segment(inst, pass, lane, slice);
+	}
+};
+
+bool argon2id(const unsigned char *password, int passwordLen,
+	const unsigned char *salt, int saltLen,
+	const unsigned char *secret, int secretLen,
+	const unsigned char *ad, int adLen,
+	quint32 memoryKiB, quint32 passes, quint32 lanes, int threads,
+	unsigned char *out, int outLen)
+{
+	if(outLen < 4 || saltLen < 8 || passwordLen < 0 || secretLen < 0 || adLen < 0)
+		return false;
+	if(passes < 1 || lanes < 1 || lanes > 0xffffff || memoryKiB / 8 < lanes)
+		return false;
+
+	// m is rounded down to a multiple of 4 * p: each lane has 4 segments,
+	//   one per slice
+	Argon2Instance inst;
+	inst.passes = passes;
+	inst.lanes = lanes;
+	inst.segmentLength = memoryKiB / (4 * lanes);
+	inst.laneLength = 4 * inst.segmentLength;
+	quint64 bytes = (quint64)lanes * inst.laneLength * sizeof(Argon2Block);
+	if(bytes != (size_t)bytes)
+		return false;
+	inst.memory = (Argon2Block *)malloc((size_t)bytes);
+	if(!inst.memory)
+		return false;
+
+	inst.fill = fill_block_portable;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAVX2))
+		inst.fill = fill_block_avx2;
+	else if(hasCpuFeatures(CpuSSE2))
+		inst.fill = fill_block_sse2;
+#endif
+
+	// H0, then the first two blocks of every lane
+	unsigned char word[4];
+	unsigned char seed[72];
+	Blake2b h0(64);
+	const quint32 params[6] = { lanes, (quint32)outLen, memoryKiB, passes, 0x13, 2 };
+	for(int n = 0; n < 6; ++n)
+	{
+		store_le32(word, params[n]);
+		h0.update(word, 4);
+	}
+	const unsigned char *inputs[4] = { password, salt, secret, ad };
+	const int lengths[4] = { passwordLen, saltLen, secretLen, adLen };
+	for(int n = 0; n < 4; ++n)
+	{
+		store_le32(word, (quint32)lengths[n]);
+		h0.update(word, 4);
+		h0.update(inputs[n], lengths[n]);
+	}
+	h0.final(seed);
+
+	unsigned char block[1024];
+	for(quint32 l = 0; l < lanes; ++l)
+	{
+		for(quint32 b = 0; b < 2; ++b)
+		{
+			store_le32(seed + 64, b);
+			store_le32(seed + 68, l);
+			blake2b_long(block, 1024, seed, 72);
+			Argon2Block *dest = &inst.memory[(quint64)l * inst.laneLength + b];
+			for(int n = 0; n < 128; ++n)
+				dest->v[n] = load_le64(block + 8 * n);
+		}
+	}
+
+	// the segments of one slice are independent, the slices are the
+	//   points where the lanes synchronize
+	if(threads <= 0)
+		threads = QThread::idealThreadCount();
+	threads = (int)qMin((quint32)qMax(threads, 1), lanes);
+	QThreadPool pool;
+	pool.setMaxThreadCount(threads);
+	for(quint32 pass = 0; pass < passes; ++pass)
+	{
+		for(quint32 slice = 0; slice < 4; ++slice)
+		{
+			if(threads < 2)
+			{
+				for(quint32 l = 0; l < lanes; ++l)
+					fill_segment(&inst, pass, l, slice);
+				continue;
+			}
+			for(quint32 l = 0; l < lanes; ++l)
+			{
+				Argon2Segment *segment = new Argon2Segment;
+				segment->inst = &inst;
+				segment->pass = pass;
+				segment->lane = l;
+				segment->slice = slice;
+				pool.start(segment);
+			}
+			pool.waitForDone();
+		}
+	}
+
+	// the tag is H' of the last blocks of all the lanes xored together
+	Argon2Block c = inst.memory[inst.laneLength - 1];
+	for(quint32 l = 1; l < lanes; ++l)
+	{
+		const Argon2Block *last = &inst.memory[(quint64)l * inst.laneLength + inst.laneLength - 1];
+		for(int n = 0; n < 128; ++n)
+			c.v[n] ^= last->v[n];
+	}
+	for(int n = 0; n < 128; ++n)
+		store_le64(block + 8 * n, c.v[n]);
+	blake2b_long(out, outLen, block, 1024);
+
+	wipe(inst.memory, (size_t)bytes);
+	free(inst.memory);
+	wipe(&c, sizeof(c));
+	wipe(block, sizeof(block));
+	wipe(seed, sizeof(seed));
+	return true;
+}
+
+}
@@ -0,0 +1,45 @@
+/*
+ * qca_argon2.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_ARGON2_H
+#define QCA_ARGON2_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// Argon2id as in RFC 9106 (version 0x13).  memoryKiB, passes and lanes are
+//   m, t and p, secret and ad the optional K and X.  The lanes of each
+//   slice are filled on up to 'threads' threads (0 for one per lane, at
+//   most QThread::idealThreadCount()), and the compression function uses
+//   AVX2 or SSE2 when the CPU has them.  Returns false for parameters
+//   outside the limits of the RFC, or if the memory can't be allocated.
+bool argon2id(const unsigned char *password, int passwordLen,
+	const unsigned char *salt, int saltLen,
+	const unsigned char *secret, int secretLen,
+	const unsigned char *ad, int adLen,
+	quint32 memoryKiB, quint32 passes, quint32 lanes, int threads,
+	unsigned char *out, int outLen);
+
+}
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * qca_base64.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_base64.h"
+
+#include "qca_cpu.h"
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+static const char b64_alphabet[] =
+	"ABCDEFGH"
+	"IJKLMNOP"
+	"QRSTUVWX"
+	"YZabcdef"
+	"ghijklmn"
+	"opqrstuv"
+	"wxyz0123"
+	"456789+/";
+
+// -1 specifies invalid
+// 64 specifies padding
+// everything else specifies data
+static const signed char b64_values[256] =
+{
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63,
+	52,53,54,55,56,57,58,59,60,61,-1,-1,-1,64,-1,-1,
+	-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
+	15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1,
+	-1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
+	41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+//----------------------------------------------------------------------------
+// Portable
+//----------------------------------------------------------------------------
+static void encode_portable(const unsigned char *in, int groups, char *out)
+{
+	for(int n = 0; n < groups; ++n)
+	{
+		quint32 v = ((quint32)in[0] << 16) | ((quint32)in[1] << 8) | in[2];
+		out[0] = b64_alphabet[v >> 18];
+		out[1] = b64_alphabet[(v >> 12) & 0x3f];
+		out[2] = b64_alphabet[(v >> 6) & 0x3f];
+		out[3] = b64_alphabet[v & 0x3f];
+		in += 3;
+		out += 4;
+	}
+}
+
+static bool decode_portable(const char *in, int quads, unsigned char *out, int *pad)
+{
+	int a, b, c, d;
+	c = d = 0;
+
+	for(int n = 0; n < quads; ++n)
+	{
+		a = b64_values[(unsigned char)in[0]];
+		b = b64_values[(unsigned char)in[1]];
+		c = b64_values[(unsigned char)in[2]];
+		d = b64_values[(unsigned char)in[3]];
+		if((a == 64 || b == 64) || (a < 0 || b < 0 || c < 0 || d < 0))
+			return false;
+		out[0] = ((a & 0x3F) << 2) | ((b >> 4) & 0x03);
+		out[1] = ((b & 0x0F) << 4) | ((c >> 2) & 0x0F);
+		out[2] = ((c & 0x03) << 6) | ((d >> 0) & 0x3F);
+		in += 4;
+		out += 3;
+	}
+
+	if(c & 64)
+		*pad = 2;
+	else if(d & 64)
+		*pad = 1;
+	else
+		*pad = 0;
+	return true;
+}
+
+// The vector kernels follow Muła and Lemire, "Faster Base64 Encoding and
+// Decoding Using AVX2 Instructions".  Encoding spreads each 3 bytes over a
+// 32 bit lane and uses multiplies to move the four 6 bit fields into
+// separate bytes, which a nibble lookup then turns into characters.
+// Decoding checks the characters with two nibble lookups, translates them
+// into 6 bit values, and packs them with multiply-adds.  The kernels only
+// take quads without padding; the portable code finishes anything else,
+// including reporting where a bad character is.
+
+//----------------------------------------------------------------------------
+// SSSE3, 12 bytes <-> 16 characters
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_SIMD)
+
+QCA_TARGET("ssse3")
+static inline __m128i b64_encode_sse(__m128i in)
+{
+	const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m128i lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	__m128i t = _mm_shuffle_epi8(in, shuffle);
+	__m128i hi = _mm_mulhi_epu16(_mm_and_si128(t, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+	__m128i lo = _mm_mullo_epi16(_mm_and_si128(t, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+	__m128i idx = _mm_or_si128(hi, lo);
+
+	// 0 for A-Z, 1 for a-z, 2-11 for 0-9, 12 for + and 13 for /
+	__m128i off = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	off = _mm_or_si128(off, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+	return _mm_add_epi8(_mm_shuffle_epi8(lut, off), idx);
+}
+
+// Returns the 6 bit values of 16 characters, or sets *bad if any of them is
+// outside the alphabet (including '=').
+QCA_TARGET("ssse3")
+static inline __m128i b64_decode_sse(__m128i in, __m128i *bad)
+{
+	const __m128i shift_lut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	// bit h of entry l is set if character 16 * h + l is in the alphabet
+	const __m128i mask_lut = _mm_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+		(char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+	const __m128i bit_lut = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+		0, 0, 0, 0, 0, 0, 0, 0);
+
+	__m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+	__m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+	__m128i valid = _mm_and_si128(_mm_shuffle_epi8(mask_lut, lo), _mm_shuffle_epi8(bit_lut, hi));
+	*bad = _mm_or_si128(*bad, _mm_cmpeq_epi8(valid, _mm_setzero_si128()));
+
+	// '+' and '/' share the high nibble, '/' needs 16 rather than 19
+	__m128i shift = _mm_shuffle_epi8(shift_lut, hi);
+	shift = _mm_add_epi8(shift, _mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), _mm_set1_epi8(-3)));
+	return _mm_add_epi8(in, shift);
+}
+
+// 16 values of 6 bits -> 12 bytes at the start of the register
+QCA_TARGET("ssse3")
+static inline __m128i b64_pack_sse(__m128i v)
+{
+	v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+// Returns the number of groups encoded, a multiple of 4.  Each step reads
+// 16 bytes.
+QCA_TARGET("ssse3")
+static int encode_ssse3(const unsigned char *in, int groups, char *out, int inAvail)
+{
+	int n = 0;
+	for(; n + 4 <= groups && 3 * n + 16 <= inAvail; n += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + 3 * n));
+		_mm_storeu_si128((__m128i *)(out + 4 * n), b64_encode_sse(v));
+	}
+	return n;
+}
+
+// Returns the number of quads decoded, a multiple of 4, stopping at the
+// first block with a character outside the alphabet.  Each step writes 16
+// bytes.
+QCA_TARGET("ssse3")
+static int decode_ssse3(const char *in, int quads, unsigned char *out, int outAvail)
+{
+	int n = 0;
+	for(; n + 4 <= quads && 3 * n + 16 <= outAvail; n += 4)
+	{
+		__m128i bad = _mm_setzero_si128();
+		__m128i v = b64_decode_sse(_mm_loadu_si128((const __m128i *)(in + 4 * n)), &bad);
+		if(_mm_movemask_epi8(bad))
+			break;
+		_mm_storeu_si128((__m128i *)(out + 3 * n), b64_pack_sse(v));
+	}
+	return n;
+}
+
+//----------------------------------------------------------------------------
+// AVX2, 24 bytes <-> 32 characters
+//----------------------------------------------------------------------------
+QCA_TARGET("avx2")
+static inline __m256i b64_encode_avx2(__m256i in)
+{
+	const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+		1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	__m256i t = _mm256_shuffle_epi8(in, shuffle);
+	__m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(t, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+	__m256i lo = _mm256_mullo_epi16(_mm256_and_si256(t, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+	__m256i idx = _mm256_or_si256(hi, lo);
+
+	__m256i off = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+	off = _mm256_or_si256(off, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+	return _mm256_add_epi8(_mm256_shuffle_epi8(lut, off), idx);
+}
+
+QCA_TARGET("avx2")
+static inline __m256i b64_decode_avx2(__m256i in, __m256i *bad)
+{
+	const __m256i shift_lut = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_lut = _mm256_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+		(char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+		(char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+		(char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+	const __m256i bit_lut = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+		0, 0, 0, 0, 0, 0, 0, 0);
+
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+	__m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+	__m256i valid = _mm256_and_si256(_mm256_shuffle_epi8(mask_lut, lo), _mm256_shuffle_epi8(bit_lut, hi));
+	*bad = _mm256_or_si256(*bad, _mm256_cmpeq_epi8(valid, _mm256_setzero_si256()));
+
+	__m256i shift = _mm256_shuffle_epi8(shift_lut, hi);
+	shift = _mm256_add_epi8(shift, _mm256_and_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')), _mm256_set1_epi8(-3)));
+	return _mm256_add_epi8(in, shift);
+}
+
+// 32 values of 6 bits -> 24 bytes at the start of the register
+QCA_TARGET("avx2")
+static inline __m256i b64_pack_avx2(__m256i v)
+{
+	v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+	v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+	v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+
+// As encode_ssse3(), a multiple of 8 groups.  The high half is loaded 12
+// bytes in, so each step reads 28 bytes.
+QCA_TARGET("avx2")
+static int encode_avx2(const unsigned char *in, int groups, char *out, int inAvail)
+{
+	int n = 0;
+	for(; n + 8 <= groups && 3 * n + 28 <= inAvail; n += 8)
+	{
+		const unsigned char *p = in + 3 * n;
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+			_mm_loadu_si128((const __m128i *)(p + 12)), 1);
+		_mm256_storeu_si256((__m256i *)(out + 4 * n), b64_encode_avx2(v));
+	}
+	return n;
+}
+
+// As decode_ssse3(), a multiple of 8 quads, each step writing 32 bytes.
+QCA_TARGET("avx2")
+static int decode_avx2(const char *in, int quads, unsigned char *out, int outAvail)
+{
+	int n = 0;
+	for(; n + 8 <= quads && 3 * n + 32 <= outAvail; n += 8)
+	{
+		__m256i bad = _mm256_setzero_si256();
+		__m256i v = b64_decode_avx2(_mm256_loadu_si256((const __m256i *)(in + 4 * n)), &bad);
+		if(_mm256_movemask_epi8(bad))
+			break;
+		_mm256_storeu_si256((__m256i *)(out + 3 * n), b64_pack_avx2(v));
+	}
+	return n;
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// Base64
+//----------------------------------------------------------------------------
+void base64Encode(const unsigned char *in, int groups, char *out, int inAvail)
+{
+	int n = 0;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAVX2))
+		n = encode_avx2(in, groups, out, inAvail);
+	if(hasCpuFeatures(CpuSSSE3))
+		n += encode_ssse3(in + 3 * n, groups - n, out + 4 * n, inAvail - 3 * n);
+#else
+	Q_UNUSED(inAvail);
+#endif
+	encode_portable(in + 3 * n, groups - n, out + 4 * n);
+}
+
+void base64EncodeTail(const unsigned char *in, int len, char *out)
+{
+	quint32 v = (quint32)in[0] << 16;
+	if(len > 1)
+		v |= (quint32)in[1] << 8;
+	out[0] = b64_alphabet[v >> 18];
+	out[1] = b64_alphabet[(v >> 12) & 0x3f];
+	out[2] = len > 1 ? b64_alphabet[(v >> 6) & 0x3f] : '=';
+	out[3] = '=';
+}
+
+bool base64Decode(const char *in, int quads, unsigned char *out, int outAvail, int *pad)
+{
+	int n = 0;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAVX2))
+		n = decode_avx2(in, quads, out, outAvail);
+	if(hasCpuFeatures(CpuSSSE3))
+		n += decode_ssse3(in + 4 * n, quads - n, out + 3 * n, outAvail - 3 * n);
+#else
+	Q_UNUSED(outAvail);
+#endif
+	return decode_portable(in + 4 * n, quads - n, out + 3 * n, pad);
+}
+
+}
@@ -0,0 +1,52 @@
+/*
+ * qca_base64.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_BASE64_H
+#define QCA_BASE64_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// Base64 with the RFC 4648 alphabet.  Both directions use AVX2 or SSSE3
+// when the CPU has them.
+
+// Encodes groups * 3 bytes of in as groups * 4 characters of out, without
+// padding.  in may be read up to inAvail bytes (at least groups * 3), which
+// lets the vector code go further when more input follows.
+void base64Encode(const unsigned char *in, int groups, char *out, int inAvail);
+
+// Encodes the last 1 or 2 bytes of a stream as 4 characters with '='
+// padding.
+void base64EncodeTail(const unsigned char *in, int len, char *out);
+
+// Decodes quads * 4 characters of in as quads * 3 bytes of out, which may
+// be written up to outAvail bytes (at least quads * 3).  Returns false if a
+// character is outside the alphabet, or if '=' is in the first two
+// positions of a quad.  '=' in the last two positions decodes as zero bits,
+// and *pad is set to the number of bytes of the last quad that are padding
+// (0, 1 or 2).
+bool base64Decode(const char *in, int quads, unsigned char *out, int outAvail, int *pad);
+
+}
+
+#endif
@@ -22,10 +22,26 @@
 #include "qca_basic.h"
 
 #include "qcaprovider.h"
+#include "qca_ghash.h"
 
+#include <QAtomicInt>
 #include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QThreadStorage>
 #include <QtGlobal>
 
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+# include <pthread.h>
+# include <sys/mman.h>
+#endif
+#ifdef Q_OS_WIN
+# include <windows.h>
+#endif
+
 namespace QCA {
 
 // from qca_core.cpp
@@ -145,21 +161,241 @@ SecureArray Random::nextBytes(int size)
 	return static_cast<RandomContext *>(context())->nextBytes(size);
 }
 
+// Small requests are served from a per-thread reservoir, refilled from
+//   the global random object in batches that start at
+//   RANDOM_RESERVOIR_MIN bytes and double up to RANDOM_RESERVOIR_MAX.
+//   Requests of RANDOM_RESERVOIR_MAX bytes or more go to the global random
+//   object directly.
+#define RANDOM_RESERVOIR_MIN 4096
+#define RANDOM_RESERVOIR_MAX 16384
+
+// Bumped when the bytes already in the reservoirs must not be handed out
+//   any more: when the global random object is replaced, and in the child
+//   after a fork, which would otherwise repeat the parent's values.
+static QAtomicInt g_random_generation(0);
+
+static int random_generation()
+{
+#if QT_VERSION >= 0x050000
+	return g_random_generation.loadAcquire();
+#else
+	return g_random_generation;
+#endif
+}
+
+// called by qca_core.cpp with global_random_mutex() held
+void invalidate_random_reservoirs()
+{
+	g_random_generation.ref();
+}
+
+#ifdef Q_OS_UNIX
+static void random_reservoir_atfork_child()
+{
+	g_random_generation.ref();
+}
+#endif
+
+static void wipe_random(unsigned char *p, int size)
+{
+	volatile unsigned char *v = p;
+	while(size--)
+		*v++ = 0;
+}
+
+// The bytes wait in pages of their own, kept out of swap where the system
+//   allows it, like the memory of a SecureArray.  A SecureArray can't hold
+//   them: the thread may end after QCA::deinit() has shut down the
+//   allocator behind it.
+static unsigned char *alloc_random_pages(bool *mapped)
+{
+	*mapped = false;
+#if defined(Q_OS_UNIX)
+	void *p = mmap(0, RANDOM_RESERVOIR_MAX, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if(p != MAP_FAILED)
+	{
+		mlock((char *)p, RANDOM_RESERVOIR_MAX);
+		*mapped = true;
+		return (unsigned char *)p;
+	}
+#elif defined(Q_OS_WIN)
+	void *p = VirtualAlloc(0, RANDOM_RESERVOIR_MAX, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if(p)
+	{
+		VirtualLock(p, RANDOM_RESERVOIR_MAX);
+		*mapped = true;
+		return (unsigned char *)p;
+	}
+#endif
+	return new unsigned char[RANDOM_RESERVOIR_MAX];
+}
+
+static void free_random_pages(unsigned char *p, bool mapped)
+{
+	wipe_random(p, RANDOM_RESERVOIR_MAX);
+	if(!mapped)
+	{
+		delete[] p;
+		return;
+	}
+#if defined(Q_OS_UNIX)
+	munmap((char *)p, RANDOM_RESERVOIR_MAX);
+#elif defined(Q_OS_WIN)
+	VirtualFree(p, 0, MEM_RELEASE);
+#endif
+}
+
+class RandomReservoir
+{
+public:
+	RandomReservoir() : pos(0), end(0), batch(RANDOM_RESERVOIR_MIN), generation(-1)
+	{
+		buf = alloc_random_pages(&mapped);
+	}
+
+	~RandomReservoir()
+	{
+		free_random_pages(buf, mapped);
+	}
+
+	void take(unsigned char *out, int size)
+	{
+		int gen = random_generation();
+		if(gen != generation)
+		{
+			wipe_random(buf + pos, end - pos);
+			pos = end = 0;
+			batch = RANDOM_RESERVOIR_MIN;
+			generation = gen;
+		}
+
+		while(size > 0)
+		{
+			if(pos == end && !refill())
+				return;
+			int n = qMin(size, end - pos);
+			memcpy(out, buf + pos, n);
+			// don't keep bytes that were handed out
+			wipe_random(buf + pos, n);
+			pos += n;
+			out += n;
+			size -= n;
+		}
+	}
+
+private:
+	unsigned char *buf;
+	bool mapped;
+	int pos, end;
+	int batch;
+	int generation;
+
+	bool refill()
+	{
+		SecureArray a;
+		{
+			QMutexLocker locker(global_random_mutex());
+#ifdef Q_OS_UNIX
+			static bool atfork_registered = false;
+			if(!atfork_registered)
+			{
+				pthread_atfork(0, 0, random_reservoir_atfork_child);
+				atfork_registered = true;
+			}
+#endif
+			a = global_random()->nextBytes(batch);
+			// the generation only changes under the lock, so these
+			// bytes belong to it
+			generation = random_generation();
+		}
+		if(a.isEmpty())
+			return false;
+
+		memcpy(buf, a.data(), a.size());
+		pos = 0;
+		end = a.size();
+		if(batch < RANDOM_RESERVOIR_MAX)
+			batch *= 2;
+		return true;
+	}
+};
+
+Q_GLOBAL_STATIC(QThreadStorage<RandomReservoir *>, random_reservoirs)
+
+static RandomReservoir *random_reservoir()
+{
+	QThreadStorage<RandomReservoir *> *storage = random_reservoirs();
+	if(!storage->hasLocalData())
+		storage->setLocalData(new RandomReservoir);
+	return storage->localData();
+}
+
 uchar Random::randomChar()
 {
-	QMutexLocker locker(global_random_mutex());
-	return global_random()->nextByte();
+	uchar x = 0;
+	random_reservoir()->take(&x, sizeof(x));
+	return x;
 }
 
 int Random::randomInt()
 {
-	QMutexLocker locker(global_random_mutex());
-	SecureArray a = global_random()->nextBytes(sizeof(int));
-	int x;
-	memcpy(&x, a.data(), a.size());
+	int x = 0;
+	random_reservoir()->take(reinterpret_cast<unsigned char *>(&x), sizeof(x));
+	return x;
+}
+
+quint32 Random::randomUInt32()
+{
+	quint32 x = 0;
+	random_reservoir()->take(reinterpret_cast<unsigned char *>(&x), sizeof(x));
+	return x;
+}
+
+quint64 Random::randomUInt64()
+{
+	quint64 x = 0;
+	random_reservoir()->take(reinterpret_cast<unsigned char *>(&x), sizeof(x));
 	return x;
 }
 
+quint32 Random::randomBounded(quint32 bound)
+{
+	if(bound == 0)
+		return 0;
+
+	// Lemire's multiply and reject: the high half of x * bound is in
+	//   [0, bound), and low halves below 2^32 mod bound are rejected so
+	//   that each result has the same number of values of x
+	quint64 m = quint64(randomUInt32()) * bound;
+	quint32 low = quint32(m);
+	if(low < bound)
+	{
+		quint32 threshold = quint32(0 - bound) % bound;
+		while(low < threshold)
+		{
+			m = quint64(randomUInt32()) * bound;
+			low = quint32(m);
+		}
+	}
+	return quint32(m >> 32);
+}
+
+void Random::fill(char *data, int size)
+{
+	if(size <= 0)
+		return;
+
+	if(size >= RANDOM_RESERVOIR_MAX)
+	{
+		QMutexLocker locker(global_random_mutex());
+		SecureArray a = global_random()->nextBytes(size);
+		memcpy(data, a.data(), qMin(size, a.size()));
+		return;
+	}
+
+	random_reservoir()->take(reinterpret_cast<unsigned char *>(data), size);
+}
+
 SecureArray Random::randomArray(int size)
 {
 	QMutexLocker locker(global_random_mutex());
@@ -253,6 +489,12 @@ QString Hash::hashToString(const MemoryRegion &a)
 //----------------------------------------------------------------------------
 // Cipher
 //----------------------------------------------------------------------------
+// stream ciphers and AEAD constructions that are named without a mode
+static bool is_modeless_cipher(const QString &type)
+{
+	return type == "chacha20" || type == "chacha20-poly1305";
+}
+
 class Cipher::Private
 {
 public:
@@ -264,6 +506,10 @@ public:
 	InitializationVector iv;
 	AuthTag tag;
 
+	// tag of the last processParallel() call, when it did not run
+	// through the context
+	AuthTag parallelTag;
+
 	bool ok, done;
 };
 
@@ -355,12 +601,15 @@ int Cipher::blockSize() const
 
 AuthTag Cipher::tag() const
 {
+	if(!d->parallelTag.isEmpty())
+		return d->parallelTag;
 	return static_cast<const CipherContext *>(context())->tag();
 }
 
 void Cipher::clear()
 {
 	d->done = false;
+	d->parallelTag = AuthTag();
 	static_cast<CipherContext *>(context())->setup(d->dir, d->key, d->iv, d->tag);
 }
 
@@ -402,8 +651,386 @@ void Cipher::setup(Direction dir, const SymmetricKey &key, const InitializationV
 	clear();
 }
 
+// segments smaller than this are not worth a thread of their own
+#define PARALLEL_MIN_SEGMENT (64 * 1024)
+
+// workers feed their provider context in chunks of this size, so large
+// segments are not duplicated in secure memory
+#define PARALLEL_CHUNK (256 * 1024)
+
+// add n to the big endian integer of len bytes at p
+static void counter_add(unsigned char *p, int len, quint64 n)
+{
+	for(int i = len - 1; i >= 0 && n; --i)
+	{
+		n += p[i];
+		p[i] = (unsigned char)n;
+		n >>= 8;
+	}
+}
+
+static quint32 counter32(const unsigned char *p)
+{
+	return ((quint32)p[12] << 24) | ((quint32)p[13] << 16) | ((quint32)p[14] << 8) | (quint32)p[15];
+}
+
+static void set_counter32(unsigned char *p, quint32 v)
+{
+	p[12] = (unsigned char)(v >> 24);
+	p[13] = (unsigned char)(v >> 16);
+	p[14] = (unsigned char)(v >> 8);
+	p[15] = (unsigned char)v;
+}
+
+class ParallelCipherRun
+{
+public:
+	Cipher *cipher;
+	int offset, size;
+};
+
+class ParallelCipherSegment : public QRunnable
+{
+public:
+	QList<ParallelCipherRun> runs;
+	const char *in;
+	char *out;
+	const GHash *ghash;
+	bool hashInput;
+	unsigned char y[16];
+	bool ok;
+
+	ParallelCipherSegment() : in(0), out(0), ghash(0), hashInput(false), ok(false)
+	{
+		setAutoDelete(false);
+		memset(y, 0, 16);
+	}
+
+	~ParallelCipherSegment()
+	{
+		foreach(const ParallelCipherRun &r, runs)
+			delete r.cipher;
+	}
+
+	virtual void run()
+	{
+		foreach(const ParallelCipherRun &r, runs)
+		{
+			int done = 0;
+			for(int at = 0; at < r.size; at += PARALLEL_CHUNK)
+			{
+				SecureArray chunk(QByteArray::fromRawData(in + r.offset + at, qMin(PARALLEL_CHUNK, r.size - at)));
+				MemoryRegion result = r.cipher->update(chunk);
+				if(!r.cipher->ok() || done + result.size() > r.size)
+					return;
+				memcpy(out + r.offset + done, result.data(), result.size());
+				done += result.size();
+			}
+			MemoryRegion result = r.cipher->final();
+			if(!r.cipher->ok() || done + result.size() != r.size)
+				return;
+			memcpy(out + r.offset + done, result.data(), result.size());
+
+			// gcm hashes the ciphertext
+			if(ghash)
+				ghash->update(y, (const unsigned char *)(hashInput ? in : out) + r.offset, r.size);
+		}
+		ok = true;
+	}
+};
+
+MemoryRegion Cipher::processParallel(const MemoryRegion &a, int threads)
+{
+	if(threads <= 0)
+		threads = QThread::idealThreadCount();
+
+	int segments = qMin(threads, a.size() / PARALLEL_MIN_SEGMENT);
+	if(segments < 2 || !provider() || is_modeless_cipher(d->type))
+		return process(a);
+
+	// providers may report a block size of 1 for the stream modes, the
+	// segments are aligned to the block of the underlying cipher instead
+	int bs = blockSize();
+	QString providerName = provider()->name();
+	Mode runMode;
+	bool gcm = false;
+	switch(d->mode)
+	{
+	case CTR:
+		bs = d->iv.size();
+		if(bs <= 0)
+			return process(a);
+		runMode = CTR;
+		break;
+	case GCM:
+		bs = 16;
+		// without a tag to check, nothing decoded could be trusted
+		if(d->dir == Decode && d->tag.isEmpty())
+		{
+			clear();
+			d->done = true;
+			d->ok = false;
+			return MemoryRegion();
+		}
+		if(d->tag.size() > 16 || d->iv.isEmpty())
+			return process(a);
+		if(!isSupported(QStringList() << withAlgorithms(d->type, CTR, NoPadding) << withAlgorithms(d->type, ECB, NoPadding), providerName))
+			return process(a);
+		runMode = CTR;
+		gcm = true;
+		break;
+	case ECB:
+		if(padding() != NoPadding || bs <= 0 || a.size() % bs != 0)
+			return process(a);
+		runMode = ECB;
+		break;
+	case CBC:
+		if(padding() != NoPadding || d->dir != Decode || bs <= 0 || a.size() % bs != 0)
+			return process(a);
+		runMode = CBC;
+		break;
+	default:
+		return process(a);
+	}
+
+	clear();
+	d->done = true;
+
+	// for gcm, the keystream starts at inc32(J0) and is produced by the
+	// ctr variant of the cipher, H and the tag mask by the ecb variant
+	unsigned char j0[16];
+	unsigned char ekj0[16];
+	GHash gh;
+	if(gcm)
+	{
+		Cipher ecb(d->type, ECB, NoPadding, Encode, d->key, InitializationVector(), providerName);
+		if(ecb.blockSize() != 16)
+			return process(a);
+		SecureArray zero(16);
+		MemoryRegion h = ecb.update(zero);
+		if(!ecb.ok() || h.size() != 16)
+		{
+			d->ok = false;
+			return MemoryRegion();
+		}
+		gh.setKey((const unsigned char *)h.data());
+
+		if(d->iv.size() == 12)
+		{
+			memcpy(j0, d->iv.data(), 12);
+			set_counter32(j0, 1);
+		}
+		else
+		{
+			unsigned char lengths[16];
+			memset(lengths, 0, 16);
+			counter_add(lengths, 16, (quint64)d->iv.size() * 8);
+			memset(j0, 0, 16);
+			gh.update(j0, (const unsigned char *)d->iv.data(), d->iv.size());
+			gh.update(j0, lengths, 16);
+		}
+
+		MemoryRegion mask = ecb.update(SecureArray(QByteArray((const char *)j0, 16)));
+		if(!ecb.ok() || mask.size() != 16)
+		{
+			d->ok = false;
+			return MemoryRegion();
+		}
+		memcpy(ekj0, mask.data(), 16);
+	}
+
+	bool secure = a.isSecure();
+	SecureArray secureOut;
+	QByteArray plainOut;
+	char *out;
+	if(secure)
+	{
+		secureOut.resize(a.size());
+		out = secureOut.data();
+	}
+	else
+	{
+		plainOut.resize(a.size());
+		out = plainOut.data();
+	}
+
+	// segments are a whole number of blocks, except possibly the last
+	int segmentSize = (a.size() + segments - 1) / segments;
+	segmentSize = ((segmentSize + bs - 1) / bs) * bs;
+
+	QList<ParallelCipherSegment *> jobs;
+	for(int offset = 0; offset < a.size(); offset += segmentSize)
+	{
+		ParallelCipherSegment *job = new ParallelCipherSegment;
+		job->in = a.data();
+		job->out = out;
+		int size = qMin(segmentSize, a.size() - offset);
+		quint64 block = offset / bs;
+
+		if(gcm)
+		{
+			job->ghash = &gh;
+			job->hashInput = (d->dir == Decode);
+
+			// the counter only increments in its low 32 bits, so
+			// split the segment where that part wraps around
+			unsigned char ctr[16];
+			memcpy(ctr, j0, 16);
+			set_counter32(ctr, counter32(j0) + 1 + (quint32)block);
+			quint64 untilWrap = Q_UINT64_C(0x100000000) - counter32(ctr);
+			int first = size;
+			if((quint64)(size + 15) / 16 > untilWrap)
+				first = (int)(untilWrap * 16);
+
+			ParallelCipherRun r;
+			r.cipher = new Cipher(d->type, CTR, NoPadding, Encode, d->key, InitializationVector(QByteArray((const char *)ctr, 16)), providerName);
+			r.offset = offset;
+			r.size = first;
+			job->runs += r;
+			if(first < size)
+			{
+				set_counter32(ctr, 0);
+				r.cipher = new Cipher(d->type, CTR, NoPadding, Encode, d->key, InitializationVector(QByteArray((const char *)ctr, 16)), providerName);
+				r.offset = offset + first;
+				r.size = size - first;
+				job->runs += r;
+			}
+		}
+		else
+		{
+			InitializationVector iv = d->iv;
+			if(runMode == CTR)
+			{
+				QByteArray ctr = d->iv.toByteArray();
+				counter_add((unsigned char *)ctr.data(), ctr.size(), block);
+				iv = InitializationVector(ctr);
+			}
+			else if(runMode == CBC && offset > 0)
+				iv = InitializationVector(QByteArray(a.data() + offset - bs, bs));
+
+			ParallelCipherRun r;
+			r.cipher = new Cipher(d->type, runMode, NoPadding, d->dir, d->key, iv, providerName);
+			r.offset = offset;
+			r.size = size;
+			job->runs += r;
+		}
+
+		jobs += job;
+	}
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(threads);
+	foreach(ParallelCipherSegment *job, jobs)
+		pool.start(job);
+	pool.waitForDone();
+
+	d->ok = true;
+	foreach(ParallelCipherSegment *job, jobs)
+	{
+		if(!job->ok)
+			d->ok = false;
+	}
+
+	if(d->ok && gcm)
+	{
+		// Y = (..(Y_1 * H^n_2 + Y_2) * H^n_3 + ..) + Y_k, where n_i is
+		// the number of blocks hashed by segment i
+		unsigned char hn[16];
+		unsigned char y[16];
+		gh.power(hn, (quint64)(segmentSize / 16));
+		memset(y, 0, 16);
+		for(int n = 0; n < jobs.count(); ++n)
+		{
+			if(n == jobs.count() - 1)
+			{
+				int last = a.size() - n * segmentSize;
+				gh.power(hn, (quint64)(last + 15) / 16);
+			}
+			GHash::multiply(y, y, hn);
+			for(int i = 0; i < 16; ++i)
+				y[i] ^= jobs[n]->y[i];
+		}
+
+		unsigned char lengths[16];
+		memset(lengths, 0, 16);
+		counter_add(lengths, 16, (quint64)a.size() * 8);
+		gh.update(y, lengths, 16);
+		for(int i = 0; i < 16; ++i)
+			y[i] ^= ekj0[i];
+
+		int tagSize = d->tag.size();
+		if(d->dir == Encode)
+		{
+			if(tagSize > 0)
+				d->parallelTag = AuthTag(QByteArray((const char *)y, tagSize));
+		}
+		else if(tagSize == 0)
+			d->ok = false;
+		else
+		{
+			const unsigned char *expected = (const unsigned char *)d->tag.constData();
+			unsigned char diff = 0;
+			for(int i = 0; i < tagSize; ++i)
+				diff |= y[i] ^ expected[i];
+			if(diff)
+				d->ok = false;
+		}
+	}
+
+	qDeleteAll(jobs);
+
+	if(!d->ok)
+		return MemoryRegion();
+	if(secure)
+		return secureOut;
+	else
+		return plainOut;
+}
+
+bool Cipher::encryptBatch(const QVector<Record> &records)
+{
+	if(d->key.isEmpty())
+		return records.isEmpty();
+
+	QList<int> failed;
+	bool ok = static_cast<CipherContext *>(context())->processBatch(Encode, d->key, records, &failed);
+	clear();
+	return ok;
+}
+
+bool Cipher::decryptBatch(const QVector<Record> &records, QList<int> *failed)
+{
+	QList<int> bad;
+	bool ok;
+	if(d->key.isEmpty())
+	{
+		for(int n = 0; n < records.count(); ++n)
+			bad += n;
+		ok = records.isEmpty();
+	}
+	else
+	{
+		ok = static_cast<CipherContext *>(context())->processBatch(Decode, d->key, records, &bad);
+		clear();
+
+		// plaintext that failed its check must not be left behind
+		foreach(int n, bad)
+		{
+			const Record &r = records[n];
+			if(r.out && r.size > 0)
+				memset(r.out, 0, r.size);
+		}
+	}
+	if(failed)
+		*failed = bad;
+	return ok;
+}
+
 QString Cipher::withAlgorithms(const QString &cipherType, Mode modeType, Padding paddingType)
 {
+	if(is_modeless_cipher(cipherType))
+		return cipherType;
+
 	QString mode;
 	switch(modeType) {
 	case CBC:
@@ -586,6 +1213,69 @@ SymmetricKey KeyDerivationFunction::makeKey(const SecureArray &secret,
 														 iterationCount);
 }
 
+SymmetricKey KeyDerivationFunction::makeKey(const SecureArray &secret, const InitializationVector &salt, unsigned int keyLength, const Parameters &parameters)
+{
+	return static_cast<KDFContext *>(context())->makeKeyWithParameters(secret, salt, keyLength, parameters);
+}
+
+class KeyDerivationShare : public QRunnable
+{
+public:
+	KDFContext *context;
+	QList<KeyDerivationFunction::Job> jobs;
+	QList<SymmetricKey> keys;
+
+	KeyDerivationShare() : context(0)
+	{
+		setAutoDelete(false);
+	}
+
+	~KeyDerivationShare()
+	{
+		delete context;
+	}
+
+	virtual void run()
+	{
+		keys = context->makeKeys(jobs);
+	}
+};
+
+QList<SymmetricKey> KeyDerivationFunction::makeKeys(const QList<Job> &jobs, int threads)
+{
+	if(threads <= 0)
+		threads = QThread::idealThreadCount();
+
+	KDFContext *c = static_cast<KDFContext *>(context());
+	int workers = qMin(threads, jobs.count());
+	if(workers < 2)
+		return c->makeKeys(jobs);
+
+	// each worker gets a contiguous share of the jobs and a context of
+	// its own, which it reuses for all of them
+	int shareSize = (jobs.count() + workers - 1) / workers;
+	QList<KeyDerivationShare *> shares;
+	for(int first = 0; first < jobs.count(); first += shareSize)
+	{
+		KeyDerivationShare *share = new KeyDerivationShare;
+		share->context = static_cast<KDFContext *>(c->clone());
+		share->jobs = jobs.mid(first, shareSize);
+		shares += share;
+	}
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(workers);
+	foreach(KeyDerivationShare *share, shares)
+		pool.start(share);
+	pool.waitForDone();
+
+	QList<SymmetricKey> keys;
+	foreach(KeyDerivationShare *share, shares)
+		keys += share->keys;
+	qDeleteAll(shares);
+	return keys;
+}
+
 QString KeyDerivationFunction::withAlgorithm(const QString &kdfType, const QString &algType)
 {
 	return (kdfType + '(' + algType + ')');
@@ -622,4 +1312,679 @@ SymmetricKey HKDF::makeKey(const SecureArray &secret, const InitializationVector
 														  keyLength);
 }
 
+SymmetricKey HKDF::extract(const SecureArray &secret, const InitializationVector &salt)
+{
+	return static_cast<HKDFContext *>(context())->extract(secret, salt);
+}
+
+SymmetricKey HKDF::expand(const SymmetricKey &prk, const InitializationVector &info, unsigned int keyLength)
+{
+	return static_cast<HKDFContext *>(context())->expand(prk, info, keyLength);
+}
+
+
+//----------------------------------------------------------------------------
+// CipherDevice
+//----------------------------------------------------------------------------
+static bool isSingleDirection(QIODevice::OpenMode mode)
+{
+	bool r = (mode & QIODevice::ReadOnly);
+	bool w = (mode & QIODevice::WriteOnly);
+	return (r != w);
+}
+
+class CipherDevice::Private
+{
+public:
+	Filter *filter;
+	QIODevice *dev;
+	int maxBuf;
+
+	// reading: 'in' is reused for every read from the device, and 'out'
+	//   holds filtered data not yet handed to the caller
+	// writing: 'out' holds filtered data the device has not accepted yet
+	QByteArray in;
+	QByteArray out;
+	int outPos;
+	bool devFinished;
+	bool done;
+	bool failed;
+	QString error;
+
+	Private(Filter *_filter, QIODevice *_dev)
+	:filter(_filter), dev(_dev), maxBuf(65536)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		out.clear();
+		outPos = 0;
+		devFinished = false;
+		done = false;
+		failed = false;
+		error.clear();
+	}
+
+	int pending() const
+	{
+		return out.size() - outPos;
+	}
+
+	void setOutput(const MemoryRegion &a)
+	{
+		out = a.toByteArray();
+		outPos = 0;
+	}
+
+	bool devAtEnd() const
+	{
+		return devFinished || (!dev->isSequential() && dev->atEnd());
+	}
+
+	// returns false if the device has nothing to give right now
+	bool fill()
+	{
+		if(in.size() != maxBuf)
+			in.resize(maxBuf);
+
+		qint64 n = dev->read(in.data(), in.size());
+		if(n > 0)
+		{
+			setOutput(filter->update(QByteArray::fromRawData(in.constData(), (int)n)));
+			if(!filter->ok())
+				failed = true;
+			return true;
+		}
+
+		// a read error is not the end of the data, so there is no
+		//   final block
+		if(n < 0)
+		{
+			failed = true;
+			error = QStringLiteral("Unable to read from the underlying device");
+			return true;
+		}
+
+		if(devAtEnd())
+		{
+			setOutput(filter->final());
+			done = true;
+			if(!filter->ok())
+				failed = true;
+			return true;
+		}
+
+		return false;
+	}
+
+	// returns false on a write error
+	bool flush()
+	{
+		while(pending() > 0)
+		{
+			qint64 n = dev->write(out.constData() + outPos, pending());
+			if(n < 0)
+				return false;
+			if(n == 0)
+				break;
+			outPos += (int)n;
+		}
+		return true;
+	}
+};
+
+CipherDevice::CipherDevice(Filter *filter, QIODevice *device, QObject *parent)
+:QIODevice(parent)
+{
+	d = new Private(filter, device);
+	connect(device, SIGNAL(readyRead()), SIGNAL(readyRead()));
+	connect(device, SIGNAL(readChannelFinished()), SLOT(device_readChannelFinished()));
+	connect(device, SIGNAL(bytesWritten(qint64)), SLOT(device_bytesWritten(qint64)));
+}
+
+CipherDevice::~CipherDevice()
+{
+	close();
+	delete d;
+}
+
+Filter *CipherDevice::filter() const
+{
+	return d->filter;
+}
+
+QIODevice *CipherDevice::device() const
+{
+	return d->dev;
+}
+
+void CipherDevice::setMaximumBufferSize(int size)
+{
+	d->maxBuf = qMax(size, 1);
+}
+
+int CipherDevice::maximumBufferSize() const
+{
+	return d->maxBuf;
+}
+
+bool CipherDevice::ok() const
+{
+	return !d->failed && d->filter->ok();
+}
+
+bool CipherDevice::open(OpenMode mode)
+{
+	if(!isSingleDirection(mode))
+	{
+		setErrorString(QStringLiteral("CipherDevice can only be opened for reading or for writing"));
+		return false;
+	}
+	if(!d->dev->isOpen())
+	{
+		setErrorString(QStringLiteral("Underlying device is not open"));
+		return false;
+	}
+
+	d->reset();
+	return QIODevice::open(mode | Unbuffered);
+}
+
+void CipherDevice::close()
+{
+	if(!isOpen())
+		return;
+
+	if(isWritable() && !d->done && !d->failed)
+	{
+		d->done = true;
+
+		// keep whatever is still queued, and add the final block
+		QByteArray rest = d->out.mid(d->outPos);
+		rest += d->filter->final().toByteArray();
+		d->out = rest;
+		d->outPos = 0;
+		if(!d->filter->ok())
+			d->failed = true;
+
+		while(!d->failed && d->pending() > 0)
+		{
+			int before = d->outPos;
+			if(!d->flush())
+				d->failed = true;
+			else if(d->outPos == before && !d->dev->waitForBytesWritten(30000))
+				d->failed = true;
+		}
+		if(d->failed)
+			setErrorString(QStringLiteral("Unable to write the final block"));
+	}
+
+	d->in.clear();
+	d->out.clear();
+	d->outPos = 0;
+	QIODevice::close();
+}
+
+bool CipherDevice::isSequential() const
+{
+	return true;
+}
+
+bool CipherDevice::atEnd() const
+{
+	if(!isReadable())
+		return QIODevice::atEnd();
+	return (d->done || d->failed) && d->pending() == 0;
+}
+
+qint64 CipherDevice::bytesAvailable() const
+{
+	qint64 n = QIODevice::bytesAvailable();
+	if(isReadable())
+	{
+		n += d->pending();
+		if(!d->done)
+			n += d->dev->bytesAvailable();
+	}
+	return n;
+}
+
+qint64 CipherDevice::bytesToWrite() const
+{
+	qint64 n = QIODevice::bytesToWrite();
+	if(isWritable())
+		n += d->pending() + d->dev->bytesToWrite();
+	return n;
+}
+
+bool CipherDevice::waitForReadyRead(int msecs)
+{
+	if(d->pending() > 0 || d->done)
+		return true;
+	return d->dev->waitForReadyRead(msecs);
+}
+
+bool CipherDevice::waitForBytesWritten(int msecs)
+{
+	if(!d->flush())
+		return false;
+	return d->dev->waitForBytesWritten(msecs);
+}
+
+qint64 CipherDevice::readData(char *data, qint64 maxSize)
+{
+	while(true)
+	{
+		if(d->pending() > 0)
+		{
+			int n = (int)qMin(maxSize, (qint64)d->pending());
+			memcpy(data, d->out.constData() + d->outPos, n);
+			d->outPos += n;
+			return n;
+		}
+
+		if(d->failed)
+		{
+			setErrorString(d->error.isEmpty() ? QStringLiteral("Filter failed") : d->error);
+			return -1;
+		}
+
+		if(d->done || !d->fill())
+			return 0;
+	}
+}
+
+qint64 CipherDevice::writeData(const char *data, qint64 maxSize)
+{
+	if(d->failed || d->done)
+		return -1;
+
+	if(!d->flush())
+	{
+		d->failed = true;
+		setErrorString(QStringLiteral("Unable to write to the underlying device"));
+		return -1;
+	}
+
+	// backpressure: nothing more until the device catches up
+	if(d->pending() > 0 || d->dev->bytesToWrite() >= d->maxBuf)
+		return 0;
+
+	int n = (int)qMin(maxSize, (qint64)d->maxBuf);
+	d->setOutput(d->filter->update(QByteArray::fromRawData(data, n)));
+	if(!d->filter->ok())
+	{
+		d->failed = true;
+		setErrorString(QStringLiteral("Filter failed"));
+		return -1;
+	}
+
+	// the input is consumed even if the device takes only part of the
+	//   output, the rest goes out on the next write or bytesWritten()
+	if(!d->flush())
+	{
+		d->failed = true;
+		setErrorString(QStringLiteral("Unable to write to the underlying device"));
+		return -1;
+	}
+	return n;
+}
+
+void CipherDevice::device_readChannelFinished()
+{
+	d->devFinished = true;
+	if(isReadable())
+		emit readyRead();
+}
+
+void CipherDevice::device_bytesWritten(qint64 bytes)
+{
+	if(isWritable() && !d->flush())
+		d->failed = true;
+	emit bytesWritten(bytes);
+}
+
+//----------------------------------------------------------------------------
+// HashingDevice
+//----------------------------------------------------------------------------
+class HashingDevice::Private
+{
+public:
+	BufferedComputation *computation;
+	QIODevice *dev;
+	int maxBuf;
+
+	Private(BufferedComputation *_computation, QIODevice *_dev)
+	:computation(_computation), dev(_dev), maxBuf(65536)
+	{
+	}
+};
+
+HashingDevice::HashingDevice(BufferedComputation *computation, QIODevice *device, QObject *parent)
+:QIODevice(parent)
+{
+	d = new Private(computation, device);
+	connect(device, SIGNAL(readyRead()), SIGNAL(readyRead()));
+	connect(device, SIGNAL(readChannelFinished()), SIGNAL(readChannelFinished()));
+	connect(device, SIGNAL(bytesWritten(qint64)), SIGNAL(bytesWritten(qint64)));
+}
+
+HashingDevice::~HashingDevice()
+{
+	delete d;
+}
+
+BufferedComputation *HashingDevice::computation() const
+{
+	return d->computation;
+}
+
+QIODevice *HashingDevice::device() const
+{
+	return d->dev;
+}
+
+void HashingDevice::setMaximumBufferSize(int size)
+{
+	d->maxBuf = qMax(size, 1);
+}
+
+int HashingDevice::maximumBufferSize() const
+{
+	return d->maxBuf;
+}
+
+bool HashingDevice::open(OpenMode mode)
+{
+	if(!isSingleDirection(mode))
+	{
+		setErrorString(QStringLiteral("HashingDevice can only be opened for reading or for writing"));
+		return false;
+	}
+	if(!d->dev->isOpen())
+	{
+		setErrorString(QStringLiteral("Underlying device is not open"));
+		return false;
+	}
+
+	return QIODevice::open(mode | Unbuffered);
+}
+
+bool HashingDevice::isSequential() const
+{
+	return true;
+}
+
+bool HashingDevice::atEnd() const
+{
+	if(!isReadable())
+		return QIODevice::atEnd();
+	return d->dev->atEnd();
+}
+
+qint64 HashingDevice::bytesAvailable() const
+{
+	qint64 n = QIODevice::bytesAvailable();
+	if(isReadable())
+		n += d->dev->bytesAvailable();
+	return n;
+}
+
+qint64 HashingDevice::bytesToWrite() const
+{
+	qint64 n = QIODevice::bytesToWrite();
+	if(isWritable())
+		n += d->dev->bytesToWrite();
+	return n;
+}
+
+bool HashingDevice::waitForReadyRead(int msecs)
+{
+	return d->dev->waitForReadyRead(msecs);
+}
+
+bool HashingDevice::waitForBytesWritten(int msecs)
+{
+	return d->dev->waitForBytesWritten(msecs);
+}
+
+qint64 HashingDevice::readData(char *data, qint64 maxSize)
+{
+	qint64 n = d->dev->read(data, maxSize);
+	if(n > 0)
+		d->computation->update(QByteArray::fromRawData(data, (int)n));
+	return n;
+}
+
+qint64 HashingDevice::writeData(const char *data, qint64 maxSize)
+{
+	if(d->dev->bytesToWrite() >= d->maxBuf)
+		return 0;
+
+	qint64 n = d->dev->write(data, qMin(maxSize, (qint64)d->maxBuf));
+	if(n > 0)
+		d->computation->update(QByteArray::fromRawData(data, (int)n));
+	return n;
+}
+
+
+//----------------------------------------------------------------------------
+// Pipeline
+//----------------------------------------------------------------------------
+class Pipeline::Private
+{
+public:
+	class Stage
+	{
+	public:
+		Filter *filter;
+		BufferedComputation *computation;
+	};
+
+	QList<Stage> stages;
+	int blockSize;
+	bool failed;
+
+	// output of the last stage, collected until it is returned
+	QByteArray out;
+	SecureArray secureOut;
+	bool secure;
+
+	Private() : blockSize(16384), failed(false), secure(false)
+	{
+	}
+
+	static MemoryRegion join(const MemoryRegion &a, const MemoryRegion &b)
+	{
+		if(a.isEmpty())
+			return b;
+		if(b.isEmpty())
+			return a;
+		if(a.isSecure() || b.isSecure())
+			return SecureArray(a) + SecureArray(b);
+		return a.toByteArray() + b.toByteArray();
+	}
+
+	void collect(const MemoryRegion &a)
+	{
+		if(a.isEmpty())
+			return;
+		if(a.isSecure() && !secure)
+		{
+			secureOut = SecureArray(out);
+			out.clear();
+			secure = true;
+		}
+		if(secure)
+			secureOut += SecureArray(a);
+		else
+			out.append(a.constData(), a.size());
+	}
+
+	MemoryRegion take()
+	{
+		MemoryRegion r;
+		if(secure)
+			r = secureOut;
+		else if(!out.isEmpty())
+			r = out;
+		out.clear();
+		secureOut.clear();
+		secure = false;
+		return r;
+	}
+
+	// move one block through all the stages, finalizing each filter
+	//   along the way if 'finish' is set
+	bool run(const MemoryRegion &block, bool finish)
+	{
+		MemoryRegion cur = block;
+		for(int n = 0; n < stages.count(); ++n)
+		{
+			const Stage &s = stages[n];
+			if(s.computation)
+			{
+				if(!cur.isEmpty())
+					s.computation->update(cur);
+				continue;
+			}
+
+			MemoryRegion next;
+			if(!cur.isEmpty())
+				next = s.filter->update(cur);
+			if(!s.filter->ok())
+				return false;
+			if(finish)
+			{
+				MemoryRegion fin = s.filter->final();
+				if(!s.filter->ok())
+					return false;
+				next = join(next, fin);
+			}
+			cur = next;
+		}
+		collect(cur);
+		return true;
+	}
+};
+
+Pipeline::Pipeline()
+{
+	d = new Private;
+}
+
+Pipeline::~Pipeline()
+{
+	delete d;
+}
+
+Pipeline & Pipeline::append(Filter *filter)
+{
+	Private::Stage s;
+	s.filter = filter;
+	s.computation = 0;
+	d->stages += s;
+	return *this;
+}
+
+Pipeline & Pipeline::append(BufferedComputation *computation)
+{
+	Private::Stage s;
+	s.filter = 0;
+	s.computation = computation;
+	d->stages += s;
+	return *this;
+}
+
+int Pipeline::count() const
+{
+	return d->stages.count();
+}
+
+void Pipeline::setBlockSize(int size)
+{
+	d->blockSize = qMax(size, 1);
+}
+
+int Pipeline::blockSize() const
+{
+	return d->blockSize;
+}
+
+void Pipeline::clear()
+{
+	foreach(const Private::Stage &s, d->stages)
+	{
+		if(s.filter)
+			s.filter->clear();
+		else
+			s.computation->clear();
+	}
+	d->failed = false;
+	d->take();
+}
+
+MemoryRegion Pipeline::update(const MemoryRegion &a)
+{
+	if(d->failed)
+		return MemoryRegion();
+
+	if(a.size() <= d->blockSize)
+	{
+		if(!d->run(a, false))
+			d->failed = true;
+	}
+	else
+	{
+		for(int at = 0; at < a.size() && !d->failed; at += d->blockSize)
+		{
+			int size = qMin(d->blockSize, a.size() - at);
+			MemoryRegion block;
+			if(a.isSecure())
+			{
+				SecureArray buf(size);
+				memcpy(buf.data(), a.constData() + at, size);
+				block = buf;
+			}
+			else
+				block = QByteArray::fromRawData(a.constData() + at, size);
+
+			if(!d->run(block, false))
+				d->failed = true;
+		}
+	}
+
+	if(d->failed)
+	{
+		d->take();
+		return MemoryRegion();
+	}
+	return d->take();
+}
+
+MemoryRegion Pipeline::final()
+{
+	if(d->failed || !d->run(MemoryRegion(), true))
+	{
+		d->failed = true;
+		d->take();
+		return MemoryRegion();
+	}
+	return d->take();
+}
+
+bool Pipeline::ok() const
+{
+	if(d->failed)
+		return false;
+	foreach(const Private::Stage &s, d->stages)
+	{
+		if(s.filter && !s.filter->ok())
+			return false;
+	}
+	return true;
+}
+
 }
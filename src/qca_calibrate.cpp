@@ -0,0 +1,205 @@
+/*
+ * qca_calibrate.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_calibrate.h"
+
+#include "qcaprovider.h"
+#include <QElapsedTimer>
+#include <QRegExp>
+
+namespace QCA {
+
+// representative message sizes: a packet header, a small record, a bulk chunk
+static const int bench_sizes[] = { 64, 1024, 16384 };
+
+// minimum measuring time per size
+static const qint64 bench_nsecs = 2000000;
+
+bool isMeasurable(const QString &type)
+{
+	static const char *hashes =
+		"md2|md4|md5|sha0|sha1|sha224|sha256|sha384|sha512|ripemd160|whirlpool"
+		"|sha3_\\d+|blake2[bs]_\\d+|keccak_\\d+";
+	static const char *modes = "ecb|cbc|cfb|ofb|ctr|gcm|ccm";
+
+	if(type == "poly1305" || type == "chacha20" || type == "chacha20-poly1305")
+		return true;
+	if(QRegExp(QString("(hmac|cmac)\\(.+\\)")).exactMatch(type))
+		return true;
+	if(QRegExp(QString("[a-z0-9]+-(%1)(-pkcs7)?").arg(modes)).exactMatch(type))
+		return true;
+	return QRegExp(QString(hashes)).exactMatch(type);
+}
+
+static bool is_aead(const QString &type)
+{
+	return type.endsWith("-gcm") || type.endsWith("-ccm") || type == "chacha20-poly1305";
+}
+
+// the iv length the mode takes.  this can't come from blockSize(), which
+//   isn't known before setup() and is 1 for the stream modes
+static int bench_iv_length(const QString &type)
+{
+	if(is_aead(type) || type == "chacha20")
+		return 12;
+	if(type.contains("-ecb"))
+		return 0;
+
+	// 64-bit block ciphers
+	if(type.startsWith("des-") || type.startsWith("tripledes-") || type.startsWith("blowfish-") || type.startsWith("cast5-"))
+		return 8;
+	return 16;
+}
+
+static int bench_key_length(const KeyLength &len)
+{
+	return qBound(len.minimum(), 32, len.maximum());
+}
+
+// runs op on data until enough time has passed and returns the
+//   nanoseconds per byte, or -1 on error
+template<typename Op>
+static double time_op(Op &op, const SecureArray &data)
+{
+	// warm up caches and any lazy initialization in the provider
+	if(!op(data))
+		return -1;
+
+	QElapsedTimer timer;
+	timer.start();
+	qint64 runs = 0;
+	qint64 elapsed;
+	do
+	{
+		if(!op(data))
+			return -1;
+		++runs;
+		elapsed = timer.nsecsElapsed();
+	} while(elapsed < bench_nsecs || runs < 4);
+
+	return double(elapsed) / (double(runs) * data.size());
+}
+
+class HashOp
+{
+public:
+	HashContext *c;
+
+	bool operator()(const SecureArray &data)
+	{
+		c->clear();
+		c->update(data);
+		return !c->final().isEmpty();
+	}
+};
+
+class MACOp
+{
+public:
+	MACContext *c;
+	SymmetricKey key;
+
+	bool operator()(const SecureArray &data)
+	{
+		MemoryRegion out;
+		c->setup(key);
+		c->update(data);
+		c->final(&out);
+		return !out.isEmpty();
+	}
+};
+
+class CipherOp
+{
+public:
+	CipherContext *c;
+	SymmetricKey key;
+	InitializationVector iv;
+	AuthTag tag;
+
+	// a provider that fails here is left out of the ranking, rather
+	//   than being timed at how quickly it fails
+	bool operator()(const SecureArray &data)
+	{
+		SecureArray out, last;
+		c->setup(Encode, key, iv, tag);
+		if(!c->update(data, &out) || !c->final(&last))
+			return false;
+		return out.size() + last.size() >= data.size();
+	}
+};
+
+template<typename Op>
+static double measure_sizes(Op &op)
+{
+	double total = 0;
+	const int count = sizeof(bench_sizes) / sizeof(bench_sizes[0]);
+	for(int n = 0; n < count; ++n)
+	{
+		SecureArray data(bench_sizes[n], 0x5a);
+		double t = time_op(op, data);
+		if(t < 0)
+			return -1;
+		total += t;
+	}
+	return total / count;
+}
+
+double measureProvider(Provider *p, const QString &type)
+{
+	if(!p || !p->features().contains(type))
+		return -1;
+
+	Provider::Context *c = p->createContext(type);
+	if(!c)
+		return -1;
+
+	double result = -1;
+	if(HashContext *hc = qobject_cast<HashContext*>(c))
+	{
+		HashOp op;
+		op.c = hc;
+		result = measure_sizes(op);
+	}
+	else if(MACContext *mc = qobject_cast<MACContext*>(c))
+	{
+		MACOp op;
+		op.c = mc;
+		op.key = SymmetricKey(SecureArray(bench_key_length(mc->keyLength()), 0x11));
+		result = measure_sizes(op);
+	}
+	else if(CipherContext *cc = qobject_cast<CipherContext*>(c))
+	{
+		CipherOp op;
+		op.c = cc;
+		op.key = SymmetricKey(SecureArray(bench_key_length(cc->keyLength()), 0x11));
+		int ivLength = bench_iv_length(type);
+		if(ivLength > 0)
+			op.iv = InitializationVector(SecureArray(ivLength, 0x22));
+		if(is_aead(type))
+			op.tag = AuthTag(16);
+		result = measure_sizes(op);
+	}
+
+	delete c;
+	return result;
+}
+
+}
@@ -0,0 +1,41 @@
+/*
+ * qca_calibrate.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_CALIBRATE_H
+#define QCA_CALIBRATE_H
+
+// NOTE: this API is private to QCA
+
+#include "qca_core.h"
+
+namespace QCA {
+
+// True if type names a hash, cipher or MAC, judging by its name only so
+// that no provider has to create a context for things like key stores.
+bool isMeasurable(const QString &type);
+
+// Average cost of the hash, cipher or MAC feature type in provider p, in
+// nanoseconds per byte over a mix of short and long messages (including
+// the per message setup), or -1 if the feature can't be measured.
+double measureProvider(Provider *p, const QString &type);
+
+}
+
+#endif
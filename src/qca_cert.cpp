@@ -24,11 +24,23 @@
 #include "qca_publickey.h"
 #include "qcaprovider.h"
 
+#include "qca_base64.h"
+#include "qca_certder.h"
+
+#include <QAtomicInt>
 #include <QTextStream>
 #include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
 #include <QUrl>
+#include <QVector>
 
+#include <algorithm>
 #include <stdlib.h>
+#include <string.h>
 
 namespace QCA {
 
@@ -428,6 +440,120 @@ CertificateInfoOrdered orderedDNOnly(const CertificateInfoOrdered &in)
 	return out;
 }
 
+// Names seen before, so that certificates from the same issuer share one
+//   copy of its name, its map and the types in it.  Entries nothing else
+//   holds on to are dropped as the table grows.
+class CertInfoInterned
+{
+public:
+	CertificateInfoOrdered ordered;
+	CertificateInfo map;
+	bool mapReady;
+
+	CertInfoInterned() : mapReady(false) {}
+};
+
+class CertInfoInternTable
+{
+public:
+	QMutex m;
+	QHash<QString, CertificateInfoType> types;
+	QHash<QString, CertInfoInterned> names;
+	int pruneAt;
+
+	CertInfoInternTable() : pruneAt(1024) {}
+
+	static QString typeKey(const CertificateInfoType &type)
+	{
+		return QString::number((int)type.section()) + ':' + type.id();
+	}
+
+	static QString nameKey(const CertificateInfoOrdered &in)
+	{
+		QString key;
+		foreach(const CertificateInfoPair &i, in)
+		{
+			QString value = i.value();
+			key += typeKey(i.type()) + '=' + QString::number(value.size()) + ':' + value;
+		}
+		return key;
+	}
+
+	// call with the lock held
+	CertificateInfoType type(const CertificateInfoType &t)
+	{
+		QString key = typeKey(t);
+		QHash<QString, CertificateInfoType>::const_iterator it = types.constFind(key);
+		if(it != types.constEnd())
+			return it.value();
+
+		// unusual oids aren't worth keeping without bound
+		if(types.count() < 1024)
+			types.insert(key, t);
+		return t;
+	}
+
+	// call with the lock held
+	CertInfoInterned *entry(const QString &key, const CertificateInfoOrdered &in)
+	{
+		QHash<QString, CertInfoInterned>::iterator it = names.find(key);
+		if(it != names.end())
+			return &it.value();
+
+		if(names.count() >= pruneAt)
+			prune();
+
+		CertInfoInterned e;
+		foreach(const CertificateInfoPair &i, in)
+			e.ordered += CertificateInfoPair(type(i.type()), i.value());
+		return &names.insert(key, e).value();
+	}
+
+	void prune()
+	{
+		QHash<QString, CertInfoInterned>::iterator it = names.begin();
+		while(it != names.end())
+		{
+			if(it.value().ordered.isDetached() && (!it.value().mapReady || it.value().map.isDetached()))
+				it = names.erase(it);
+			else
+				++it;
+		}
+		pruneAt = qMax(1024, names.count() * 2);
+	}
+};
+
+Q_GLOBAL_STATIC(CertInfoInternTable, cert_intern_table)
+
+CertificateInfoOrdered internCertificateInfo(const CertificateInfoOrdered &in)
+{
+	if(in.isEmpty())
+		return in;
+
+	QString key = CertInfoInternTable::nameKey(in);
+	CertInfoInternTable *t = cert_intern_table();
+	QMutexLocker locker(&t->m);
+	return t->entry(key, in)->ordered;
+}
+
+// orderedToMap(), shared by everything with the same name
+static CertificateInfo internedInfoMap(const CertificateInfoOrdered &in)
+{
+	if(in.isEmpty())
+		return CertificateInfo();
+
+	QString key = CertInfoInternTable::nameKey(in);
+	CertInfoInternTable *t = cert_intern_table();
+	QMutexLocker locker(&t->m);
+	CertInfoInterned *e = t->entry(key, in);
+	if(!e->mapReady)
+	{
+		e->map = orderedToMap(e->ordered);
+		e->mapReady = true;
+	}
+	return e->map;
+}
+
 static QString baseCertName(const CertificateInfo &info)
 {
 	QString str = info.value(CommonName);
@@ -1403,26 +1529,228 @@ static bool cert_match_ipaddress(const QString &certname, const QByteArray &ipad
 	return true;
 }
 
+// what certificates are looked up by, see qca_certder.h
+class CertIndexKeys
+{
+public:
+	bool valid; // false if the DER couldn't be walked
+	quint64 subject, issuer;
+	quint64 subjectKeyId, authorityKeyId; // 0 if missing
+	QByteArray fingerprint; // empty only for a null certificate
+
+	CertIndexKeys() : valid(false), subject(0), issuer(0), subjectKeyId(0), authorityKeyId(0) {}
+};
+
+Q_GLOBAL_STATIC(QMutex, cert_keys_mutex)
+
 class Certificate::Private : public QSharedData
 {
 public:
-	CertificateInfo subjectInfoMap, issuerInfoMap;
+	// computed on first use.  the subject and issuer maps are the ones
+	//   of the intern table, see internedInfoMap(), so that the table
+	//   is only looked up once per certificate
+	mutable QAtomicInt keysReady;
+	mutable CertIndexKeys keys;
+	mutable QAtomicInt mapsReady;
+	mutable CertificateInfo subjectMap, issuerMap;
+
+	Private() : keysReady(0), mapsReady(0)
+	{
+	}
+
+	Private(const Private &from) : QSharedData(from), keysReady(0), mapsReady(0)
+	{
+	}
+
+	void makeInfoMaps(const Certificate &q) const
+	{
+		if(mapsReady.loadAcquire())
+			return;
+
+		// looked up without the lock, at worst twice
+		CertificateInfo subject, issuer;
+		if(!q.isNull())
+		{
+			const CertContextProps *props = static_cast<const CertContext *>(q.context())->props();
+			subject = internedInfoMap(props->subject);
+			issuer = internedInfoMap(props->issuer);
+		}
+
+		QMutexLocker locker(cert_keys_mutex());
+		if(!mapsReady.load())
+		{
+			subjectMap = subject;
+			issuerMap = issuer;
+			mapsReady.storeRelease(1);
+		}
+	}
+
+	const CertIndexKeys &indexKeys(const Certificate &q) const
+	{
+		if(keysReady.loadAcquire())
+			return keys;
+
+		// worked out without the lock, at worst twice
+		CertIndexKeys k;
+		if(!q.isNull())
+		{
+			QByteArray der = q.toDER();
+			CertDerInfo info;
+			if(certDerInfo(der, &info))
+			{
+				k.valid = true;
+				k.subject = certNameHash(der, info.subject);
+				k.issuer = certNameHash(der, info.issuer);
+				if(!info.subjectKeyId.isEmpty())
+					k.subjectKeyId = certKeyIdHash(der, info.subjectKeyId);
+				if(!info.authorityKeyId.isEmpty())
+					k.authorityKeyId = certKeyIdHash(der, info.authorityKeyId);
+			}
+			k.fingerprint = certFingerprint(der);
+		}
+
+		QMutexLocker locker(cert_keys_mutex());
+		if(!keysReady.load())
+		{
+			keys = k;
+			keysReady.storeRelease(1);
+		}
+		return keys;
+	}
 
 	void update(CertContext *c)
 	{
-		if(c)
+		Q_UNUSED(c);
+		keysReady.store(0);
+		keys = CertIndexKeys();
+		mapsReady.store(0);
+		subjectMap = CertificateInfo();
+		issuerMap = CertificateInfo();
+	}
+};
+
+//----------------------------------------------------------------------------
+// CertIssuerIndex
+//----------------------------------------------------------------------------
+// Positions of certificates by subject name, subject key id and
+//   fingerprint, so that the possible issuers of a certificate are found
+//   without asking the provider about every one of them.
+class CertIssuerIndex
+{
+public:
+	static const CertIndexKeys &keysOf(const Certificate &cert)
+	{
+		return cert.d->indexKeys(cert);
+	}
+
+	void clear()
+	{
+		bySubject.clear();
+		byKeyId.clear();
+		byFingerprint.clear();
+		unindexed.clear();
+	}
+
+	void add(const Certificate &cert, int pos)
+	{
+		const CertIndexKeys &k = keysOf(cert);
+		if(!k.valid)
 		{
-			subjectInfoMap = orderedToMap(c->props()->subject);
-			issuerInfoMap = orderedToMap(c->props()->issuer);
+			unindexed += pos;
+			return;
 		}
-		else
+		bySubject[k.subject] += pos;
+		if(k.subjectKeyId)
+			byKeyId[k.subjectKeyId] += pos;
+		if(!byFingerprint.contains(k.fingerprint))
+			byFingerprint.insert(k.fingerprint, pos);
+	}
+
+	// the positions that may hold an issuer of cert, in order
+	QList<int> candidates(const Certificate &cert, int count) const
+	{
+		QList<int> out;
+		const CertIndexKeys &k = keysOf(cert);
+		if(!k.valid)
 		{
-			subjectInfoMap = CertificateInfo();
-			issuerInfoMap = CertificateInfo();
+			for(int n = 0; n < count; ++n)
+				out += n;
+			return out;
 		}
+
+		out = bySubject.value(k.issuer);
+		if(k.authorityKeyId)
+			out += byKeyId.value(k.authorityKeyId);
+		out += unindexed;
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+		return out;
+	}
+
+	int find(const QByteArray &fingerprint) const
+	{
+		return byFingerprint.value(fingerprint, -1);
+	}
+
+private:
+	QHash<quint64, QList<int> > bySubject, byKeyId;
+	QHash<QByteArray, int> byFingerprint;
+	QList<int> unindexed;
+};
+
+//----------------------------------------------------------------------------
+// ValidationCache
+//----------------------------------------------------------------------------
+// Validation results by the fingerprints of the certificates and CRLs
+//   they were worked out from, the generation of the trusted collection,
+//   the usage and the flags.  Only used while enabled.
+class ValidationCache
+{
+public:
+	enum { MaxEntries = 8192 };
+
+	QAtomicInt enabled;
+	QAtomicInt ttl; // seconds
+
+	ValidationCache() : ttl(300), hitCount(0), missCount(0)
+	{
 	}
+
+	// what is being validated goes in the first byte, so that a leaf with
+	//   a pool of issuers doesn't meet a chain of the same certificates.
+	//   the provider that validates follows it, since providers need not
+	//   agree.
+	static QByteArray key(char kind, const QString &provider, const QList<Certificate> &certs, const CertificateCollection &trusted, const QList<CRL> &crls, UsageMode u, ValidateFlags vf);
+
+	bool find(const QByteArray &key, Validity *result);
+	void insert(const QByteArray &key, Validity result, const QList<Certificate> &chain, const QList<CRL> &crls);
+	void clear();
+
+	quint64 hits();
+	quint64 misses();
+
+private:
+	class Entry
+	{
+	public:
+		Validity result;
+		qint64 expires;
+	};
+
+	QMutex m;
+	QHash<QByteArray, Entry> entries;
+	quint64 hitCount, missCount;
 };
 
+Q_GLOBAL_STATIC(ValidationCache, validation_cache)
+
+// the cache if it is enabled, otherwise 0
+static ValidationCache *active_validation_cache()
+{
+	ValidationCache *cache = validation_cache();
+	return (cache && cache->enabled.loadAcquire()) ? cache : 0;
+}
+
 Certificate::Certificate()
 :d(new Private)
 {
@@ -1467,17 +1795,18 @@ bool Certificate::isNull() const
 
 QDateTime Certificate::notValidBefore() const
 {
-	return static_cast<const CertContext *>(context())->props()->start;
+	return static_cast<const CertContext *>(context())->notValidBefore();
 }
 
 QDateTime Certificate::notValidAfter() const
 {
-	return static_cast<const CertContext *>(context())->props()->end;
+	return static_cast<const CertContext *>(context())->notValidAfter();
 }
 
 CertificateInfo Certificate::subjectInfo() const
 {
-	return d->subjectInfoMap;
+	d->makeInfoMaps(*this);
+	return d->subjectMap;
 }
 
 CertificateInfoOrdered Certificate::subjectInfoOrdered() const
@@ -1487,7 +1816,8 @@ CertificateInfoOrdered Certificate::subjectInfoOrdered() const
 
 CertificateInfo Certificate::issuerInfo() const
 {
-	return d->issuerInfoMap;
+	d->makeInfoMaps(*this);
+	return d->issuerMap;
 }
 
 CertificateInfoOrdered Certificate::issuerInfoOrdered() const
@@ -1522,12 +1852,28 @@ QStringList Certificate::ocspLocations() const
 
 QString Certificate::commonName() const
 {
-	return d->subjectInfoMap.value(CommonName);
+	d->makeInfoMaps(*this);
+	return d->subjectMap.value(CommonName);
 }
 
 BigInteger Certificate::serialNumber() const
 {
-	return static_cast<const CertContext *>(context())->props()->serial;
+	return static_cast<const CertContext *>(context())->serialNumber();
+}
+
+quint64 Certificate::subjectNameHash() const
+{
+	return CertIssuerIndex::keysOf(*this).subject;
+}
+
+quint64 Certificate::issuerNameHash() const
+{
+	return CertIssuerIndex::keysOf(*this).issuer;
+}
+
+QByteArray Certificate::fingerprint() const
+{
+	return CertIssuerIndex::keysOf(*this).fingerprint;
 }
 
 PublicKey Certificate::subjectPublicKey() const
@@ -1576,14 +1922,83 @@ QByteArray Certificate::issuerKeyId() const
 
 Validity Certificate::validate(const CertificateCollection &trusted, const CertificateCollection &untrusted, UsageMode u, ValidateFlags vf) const
 {
-	QList<Certificate> issuers = trusted.certificates() + untrusted.certificates();
+	ValidationCache *cache = active_validation_cache();
+	QByteArray key;
+	Validity result;
+	if(cache && !isNull())
+	{
+		key = ValidationCache::key('v', provider()->name(), QList<Certificate>() << *this << untrusted.certificates(), trusted, untrusted.crls(), u, vf);
+		if(cache->find(key, &result))
+			return result;
+	}
+
+	// the certificates of a trust store file are looked up only when
+	//   the others run out
+	QList<Certificate> issuers = trusted.d->certs + untrusted.certificates();
 	CertificateChain chain;
 	chain += *this;
+	chain = chain.complete(trusted.d->roots, issuers, &result);
+	if(result == ValidityGood)
+		result = provider_chain_validate(chain, trusted, untrusted.crls(), u, vf);
+
+	if(!key.isEmpty())
+		cache->insert(key, result, chain, trusted.crls() + untrusted.crls());
+	return result;
+}
+
+Validity Certificate::validate(const TrustStore &trusted, const CertificateCollection &untrusted, UsageMode u, ValidateFlags vf) const
+{
+	const TrustStoreContext *store = static_cast<const TrustStoreContext *>(trusted.context());
+	if(!store || isNull() || provider() != store->provider())
+		return validate(trusted.collection(), untrusted, u, vf);
+
+	// same key as validating against the collection the store was made
+	//   from, since the answer is the same
+	ValidationCache *cache = active_validation_cache();
+	QByteArray key;
 	Validity result;
-	chain = chain.complete(issuers, &result);
-	if(result != ValidityGood)
-		return result;
-	return chain.validate(trusted, untrusted.crls(), u, vf);
+	if(cache)
+	{
+		key = ValidationCache::key('v', provider()->name(), QList<Certificate>() << *this << untrusted.certificates(), trusted.collection(), untrusted.crls(), u, vf);
+		if(cache->find(key, &result))
+			return result;
+	}
+
+	QList<CertContext*> untrusted_list;
+	QList<CRLContext*> crl_list;
+
+	QList<Certificate> untrusted_certs = untrusted.certificates();
+	QList<CRL> crls = untrusted.crls();
+
+	for(int n = 0; n < untrusted_certs.count(); ++n)
+	{
+		CertContext *c = static_cast<CertContext *>(untrusted_certs[n].context());
+		untrusted_list += c;
+	}
+	for(int n = 0; n < crls.count(); ++n)
+	{
+		CRLContext *c = static_cast<CRLContext *>(crls[n].context());
+		crl_list += c;
+	}
+
+	// the chain the provider used tells when a cached result runs out
+	QList<CertContext*> used;
+	result = store->validate(static_cast<const CertContext *>(context()), untrusted_list, crl_list, u, vf, key.isEmpty() ? 0 : &used);
+
+	if(!key.isEmpty())
+	{
+		CertificateChain chain;
+		for(int n = 0; n < used.count(); ++n)
+		{
+			Certificate c;
+			c.change(used[n]);
+			chain += c;
+		}
+		if(chain.isEmpty())
+			chain += *this;
+		cache->insert(key, result, chain, trusted.collection().crls() + untrusted.crls());
+	}
+	return result;
 }
 
 QByteArray Certificate::toDER() const
@@ -1719,8 +2134,23 @@ bool Certificate::operator==(const Certificate &otherCert) const
 	else if(otherCert.isNull())
 		return false;
 
-	const CertContext *other = static_cast<const CertContext *>(otherCert.context());
-	return static_cast<const CertContext *>(context())->compare(other);
+	if(d == otherCert.d)
+		return true;
+	return fingerprint() == otherCert.fingerprint();
+}
+
+// the fingerprint is a SHA-256 digest, any part of it makes a good hash
+static uint fingerprintHash(const QByteArray &fingerprint)
+{
+	if(fingerprint.size() < 4)
+		return 0;
+	const unsigned char *p = (const unsigned char *)fingerprint.constData();
+	return ((uint)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+uint qHash(const Certificate &cert)
+{
+	return fingerprintHash(cert.fingerprint());
 }
 
 void Certificate::change(CertContext *c)
@@ -1730,15 +2160,54 @@ void Certificate::change(CertContext *c)
 }
 
 Validity Certificate::chain_validate(const CertificateChain &chain, const CertificateCollection &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const
+{
+	ValidationCache *cache = active_validation_cache();
+	if(!cache || isNull())
+		return provider_chain_validate(chain, trusted, untrusted_crls, u, vf);
+
+	QByteArray key = ValidationCache::key('c', provider()->name(), chain, trusted, untrusted_crls, u, vf);
+	Validity result;
+	if(cache->find(key, &result))
+		return result;
+
+	result = provider_chain_validate(chain, trusted, untrusted_crls, u, vf);
+	cache->insert(key, result, chain, trusted.crls() + untrusted_crls);
+	return result;
+}
+
+Validity Certificate::provider_chain_validate(const CertificateChain &chain, const CertificateCollection &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const
 {
 	QList<CertContext*> chain_list;
 	QList<CertContext*> trusted_list;
 	QList<CRLContext*> crl_list;
 
 	QList<Certificate> chain_certs = chain;
-	QList<Certificate> trusted_certs = trusted.certificates();
+	QList<Certificate> trusted_certs;
 	QList<CRL> crls = trusted.crls() + untrusted_crls;
 
+	if(trusted.d->roots.isNull())
+		trusted_certs = trusted.certificates();
+	else
+	{
+		// of a trust store file, only the certificates that issued one
+		//   of the chain are needed
+		trusted_certs = trusted.d->certs;
+		QSet<QByteArray> seen;
+		for(int n = 0; n < chain_certs.count(); ++n)
+		{
+			QList<Certificate> found = trusted.d->roots.issuersOf(chain_certs[n]);
+			for(int i = 0; i < found.count(); ++i)
+			{
+				QByteArray fingerprint = found[i].fingerprint();
+				if(!seen.contains(fingerprint))
+				{
+					seen += fingerprint;
+					trusted_certs += found[i];
+				}
+			}
+		}
+	}
+
 	for(int n = 0; n < chain_certs.count(); ++n)
 	{
 		CertContext *c = static_cast<CertContext *>(chain_certs[n].context());
@@ -1758,44 +2227,103 @@ Validity Certificate::chain_validate(const CertificateChain &chain, const Certif
 	return static_cast<const CertContext *>(context())->validate_chain(chain_list, trusted_list, crl_list, u, vf);
 }
 
+Validity Certificate::chain_validate(const CertificateChain &chain, const TrustStore &trusted, const QList<CRL> &untrusted_crls, UsageMode u, ValidateFlags vf) const
+{
+	const TrustStoreContext *store = static_cast<const TrustStoreContext *>(trusted.context());
+	if(!store || isNull() || provider() != store->provider())
+		return chain_validate(chain, trusted.collection(), untrusted_crls, u, vf);
+
+	ValidationCache *cache = active_validation_cache();
+	QByteArray key;
+	Validity result;
+	if(cache)
+	{
+		key = ValidationCache::key('c', provider()->name(), chain, trusted.collection(), untrusted_crls, u, vf);
+		if(cache->find(key, &result))
+			return result;
+	}
+
+	QList<CertContext*> chain_list;
+	QList<CRLContext*> crl_list;
+
+	QList<Certificate> chain_certs = chain;
+
+	for(int n = 0; n < chain_certs.count(); ++n)
+	{
+		CertContext *c = static_cast<CertContext *>(chain_certs[n].context());
+		chain_list += c;
+	}
+	for(int n = 0; n < untrusted_crls.count(); ++n)
+	{
+		CRLContext *c = static_cast<CRLContext *>(untrusted_crls[n].context());
+		crl_list += c;
+	}
+
+	result = store->validate_chain(chain_list, crl_list, u, vf);
+
+	if(!key.isEmpty())
+		cache->insert(key, result, chain, trusted.collection().crls() + untrusted_crls);
+	return result;
+}
+
 CertificateChain Certificate::chain_complete(const CertificateChain &chain, const QList<Certificate> &issuers, Validity *result) const
+{
+	return chain_complete(chain, issuers, TrustStoreFile(), result);
+}
+
+CertificateChain Certificate::chain_complete(const CertificateChain &chain, const QList<Certificate> &issuers, const TrustStoreFile &roots, Validity *result) const
 {
 	CertificateChain out;
 	QList<Certificate> pool = issuers + chain.mid(1);
+	CertIssuerIndex index;
+	for(int n = 0; n < pool.count(); ++n)
+		index.add(pool[n], n);
+	QVector<bool> taken(pool.count(), false);
+
+	// certificates with the same DER are the same certificate
+	QSet<QByteArray> inChain;
 	out += chain.first();
+	inChain += CertIssuerIndex::keysOf(chain.first()).fingerprint;
 	if(result)
 		*result = ValidityGood;
 	while(!out.last().isSelfSigned())
 	{
-		// try to get next in chain
-		int at = -1;
-		for(int n = 0; n < pool.count(); ++n)
+		// try to get next in chain, the first one of the pool that
+		//   issued it
+		Certificate next;
+		QList<int> candidates = index.candidates(out.last(), pool.count());
+		for(int n = 0; n < candidates.count(); ++n)
 		{
-			//QString str = QString("[%1] issued by [%2] ? ").arg(out.last().commonName()).arg(pool[n].commonName());
-			if(pool[n].isIssuerOf(out.last()))
+			int at = candidates[n];
+			if(!taken[at] && pool[at].isIssuerOf(out.last()))
 			{
-				//printf("%s  yes\n", qPrintable(str));
-				at = n;
+				// take it out of the pool
+				taken[at] = true;
+				next = pool[at];
 				break;
 			}
-			//printf("%s  no\n", qPrintable(str));
 		}
-		if(at == -1)
+		if(next.isNull() && !roots.isNull())
+		{
+			QList<Certificate> found = roots.issuersOf(out.last());
+			if(!found.isEmpty())
+				next = found.first();
+		}
+		if(next.isNull())
 		{
 			if(result)
 				*result = ErrorInvalidCA;
 			break;
 		}
 
-		// take it out of the pool
-		Certificate next = pool.takeAt(at);
-
 		// make sure it isn't in the chain already (avoid loops)
-		if(out.contains(next))
+		const CertIndexKeys &k = CertIssuerIndex::keysOf(next);
+		if(inChain.contains(k.fingerprint))
 			break;
 
 		// append to the chain
 		out += next;
+		inChain += k.fingerprint;
 	}
 	return out;
 }
@@ -2117,10 +2645,42 @@ class CRL::Private : public QSharedData
 public:
 	CertificateInfo issuerInfoMap;
 
+	// SHA-256 of the DER, worked out on first use
+	mutable QAtomicInt fingerprintReady;
+	mutable QByteArray fingerprint;
+
+	Private() : fingerprintReady(0)
+	{
+	}
+
+	Private(const Private &from) : QSharedData(from), issuerInfoMap(from.issuerInfoMap), fingerprintReady(0)
+	{
+	}
+
+	const QByteArray &derFingerprint(const CRL &q) const
+	{
+		if(fingerprintReady.loadAcquire())
+			return fingerprint;
+
+		QByteArray f;
+		if(!q.isNull())
+			f = certFingerprint(q.toDER());
+
+		QMutexLocker locker(cert_keys_mutex());
+		if(!fingerprintReady.load())
+		{
+			fingerprint = f;
+			fingerprintReady.storeRelease(1);
+		}
+		return fingerprint;
+	}
+
 	void update(CRLContext *c)
 	{
+		fingerprintReady.store(0);
+		fingerprint.clear();
 		if(c)
-			issuerInfoMap = orderedToMap(c->props()->issuer);
+			issuerInfoMap = internedInfoMap(c->props()->issuer);
 		else
 			issuerInfoMap = CertificateInfo();
 	}
@@ -2192,6 +2752,11 @@ QByteArray CRL::issuerKeyId() const
 	return static_cast<const CRLContext *>(context())->props()->issuerId;
 }
 
+QByteArray CRL::fingerprint() const
+{
+	return d->derFingerprint(*this);
+}
+
 QByteArray CRL::toDER() const
 {
 	return static_cast<const CRLContext *>(context())->toDER();
@@ -2214,8 +2779,14 @@ bool CRL::operator==(const CRL &otherCrl) const
 	else if(otherCrl.isNull())
 		return false;
 
-	const CRLContext *other = static_cast<const CRLContext *>(otherCrl.context());
-	return static_cast<const CRLContext *>(context())->compare(other);
+	if(d == otherCrl.d)
+		return true;
+	return fingerprint() == otherCrl.fingerprint();
+}
+
+uint qHash(const CRL &crl)
+{
+	return fingerprintHash(crl.fingerprint());
 }
 
 CRL CRL::fromDER(const QByteArray &a, ConvertResult *result, const QString &provider)
@@ -2274,55 +2845,225 @@ void CRL::change(CRLContext *c)
 //----------------------------------------------------------------------------
 // CRL / X509 CRL
 // CERTIFICATE / X509 CERTIFICATE
-static QString readNextPem(QTextStream *ts, bool *isCRL)
+// A PEM block of a flat file.  Blocks in the plain form (one of the labels
+//   above, nothing but Base64 in the body) are decoded to DER here, the
+//   rest are kept as text for the provider's PEM reader.
+class PemBundleItem
 {
+public:
+	bool isCRL;
+	QByteArray der;
 	QString pem;
-	bool crl = false;
-	bool found = false;
-	bool done = false;
-	while(!ts->atEnd())
+	Provider::Context *c;
+
+	PemBundleItem() : isCRL(false), c(0) {}
+};
+
+// finds the next line that starts with marker
+static const char *find_pem_marker(const char *data, const char *p, const char *end, const char *marker, int len)
+{
+	// Base64 has no '-', so this mostly skips whole blocks at a time
+	while(end - p >= len)
 	{
-		QString line = ts->readLine();
-		if(!found)
-		{
-			if(line.startsWith("-----BEGIN "))
-			{
-				if(line.contains("CERTIFICATE"))
-				{
-					found = true;
-					pem += line + '\n';
-					crl = false;
-				}
-				else if(line.contains("CRL"))
-				{
-					found = true;
-					pem += line + '\n';
-					crl = true;
-				}
-			}
-		}
+		p = (const char *)memchr(p, '-', end - p - len + 1);
+		if(!p)
+			break;
+		if((p == data || p[-1] == '\n') && memcmp(p, marker, len) == 0)
+			return p;
+		++p;
+	}
+	return 0;
+}
+
+static const char *pem_line_end(const char *p, const char *end)
+{
+	const char *eol = (const char *)memchr(p, '\n', end - p);
+	return eol ? eol : end;
+}
+
+static QByteArray pem_line(const char *p, const char *eol)
+{
+	if(eol > p && eol[-1] == '\r')
+		--eol;
+	return QByteArray(p, eol - p);
+}
+
+static bool pem_body_to_der(const char *in, const char *end, QByteArray *der)
+{
+	QByteArray b64;
+	b64.resize(end - in);
+	char *out = b64.data();
+	while(in < end)
+	{
+		const char *eol = pem_line_end(in, end);
+		int len = eol - in;
+		if(len > 0 && in[len - 1] == '\r')
+			--len;
+		memcpy(out, in, len);
+		out += len;
+		in = eol + 1;
+	}
+
+	// '=' is only accepted at the very end, anything else unusual goes
+	//   to the provider
+	int len = out - b64.data();
+	if(len == 0 || len % 4 != 0 || memchr(b64.constData(), '=', len - 2))
+		return false;
+	int pad;
+	der->resize(len / 4 * 3);
+	if(!base64Decode(b64.constData(), len / 4, (unsigned char *)der->data(), der->size(), &pad))
+		return false;
+	der->resize(der->size() - pad);
+	return true;
+}
+
+// Finds the blocks the way a line by line reader would: a block starts
+//   at a "-----BEGIN " line mentioning CERTIFICATE or CRL and ends at the
+//   next "-----END " line.  A block without its end is dropped along with
+//   the rest of the file.
+static QVector<PemBundleItem> scan_pem_bundle(const char *data, qint64 size)
+{
+	static const char *der_labels[] = { "CERTIFICATE", "X509 CERTIFICATE", "X509 CRL", 0 };
+
+	QVector<PemBundleItem> items;
+	const char *end = data + size;
+	const char *p = data;
+	while(1)
+	{
+		const char *begin = find_pem_marker(data, p, end, "-----BEGIN ", 11);
+		if(!begin)
+			break;
+		const char *beginEol = pem_line_end(begin, end);
+		QByteArray beginLine = pem_line(begin, beginEol);
+
+		PemBundleItem item;
+		if(beginLine.contains("CERTIFICATE"))
+			item.isCRL = false;
+		else if(beginLine.contains("CRL"))
+			item.isCRL = true;
 		else
 		{
-			pem += line + '\n';
-			if(line.startsWith("-----END "))
+			p = beginEol;
+			continue;
+		}
+
+		const char *body = beginEol < end ? beginEol + 1 : end;
+		const char *endMarker = find_pem_marker(data, body, end, "-----END ", 9);
+		if(!endMarker)
+			break;
+		const char *endEol = pem_line_end(endMarker, end);
+		QByteArray endLine = pem_line(endMarker, endEol);
+
+		bool plain = false;
+		for(int n = 0; der_labels[n]; ++n)
+		{
+			QByteArray label = der_labels[n];
+			if(beginLine == "-----BEGIN " + label + "-----" && endLine == "-----END " + label + "-----")
 			{
-				done = true;
+				plain = true;
 				break;
 			}
 		}
+		if(!plain || !pem_body_to_der(body, endMarker, &item.der))
+		{
+			item.der.clear();
+			item.pem = QString::fromLatin1(begin, endEol - begin) + '\n';
+		}
+		items += item;
+		p = endEol;
+	}
+	return items;
+}
+
+static void convert_pem_item(PemBundleItem *item, const Provider::Context *certProto, const Provider::Context *crlProto)
+{
+	const Provider::Context *proto = item->isCRL ? crlProto : certProto;
+	if(!proto)
+		return;
+
+	ConvertResult r;
+	if(item->isCRL)
+	{
+		CRLContext *cc = static_cast<CRLContext *>(proto->clone());
+		r = item->der.isEmpty() ? cc->fromPEM(item->pem) : cc->fromDER(item->der);
+		item->c = cc;
+	}
+	else
+	{
+		CertContext *cc = static_cast<CertContext *>(proto->clone());
+		r = item->der.isEmpty() ? cc->fromPEM(item->pem) : cc->fromDER(item->der);
+		item->c = cc;
+	}
+	if(r != ConvertGood)
+	{
+		delete item->c;
+		item->c = 0;
 	}
-	if(!done)
-                return QString();
-	if(isCRL)
-		*isCRL = crl;
-	return pem;
 }
 
+class PemBundleParser : public QRunnable
+{
+public:
+	PemBundleItem *items;
+	int count;
+	const Provider::Context *certProto, *crlProto;
+	QThread *target;
+
+	virtual void run()
+	{
+		for(int n = 0; n < count; ++n)
+		{
+			convert_pem_item(&items[n], certProto, crlProto);
+
+			// the contexts are handed back to the caller's thread
+			if(items[n].c)
+				items[n].c->moveToThread(target);
+		}
+	}
+};
+
+// below this many blocks the threads cost more than they save
+#define PEM_BUNDLE_PARALLEL_MIN 256
+
+static QAtomicInt collection_generation_counter;
+
 class CertificateCollection::Private : public QSharedData
 {
 public:
 	QList<Certificate> certs;
 	QList<CRL> crls;
+
+	// more certificates, decoded as they are looked up
+	TrustStoreFile roots;
+
+	// a new one for each change, so that equal generations mean equal
+	//   contents
+	int generation;
+
+	// certificates are only ever appended, so the index catches up on
+	//   the ones added since it was last used
+	mutable QMutex m;
+	mutable CertIssuerIndex index;
+	mutable int indexed;
+
+	Private() : generation(nextGeneration()), indexed(0)
+	{
+	}
+
+	Private(const Private &from) : QSharedData(from), certs(from.certs), crls(from.crls), roots(from.roots), generation(nextGeneration()), indexed(0)
+	{
+	}
+
+	static int nextGeneration()
+	{
+		return collection_generation_counter.fetchAndAddRelaxed(1) + 1;
+	}
+
+	void updateIndex() const
+	{
+		for(; indexed < certs.count(); ++indexed)
+			index.add(certs[indexed], indexed);
+	}
 };
 
 CertificateCollection::CertificateCollection()
@@ -2348,16 +3089,25 @@ CertificateCollection & CertificateCollection::operator=(const CertificateCollec
 void CertificateCollection::addCertificate(const Certificate &cert)
 {
 	d->certs.append(cert);
+	d->generation = Private::nextGeneration();
 }
 
 void CertificateCollection::addCRL(const CRL &crl)
 {
 	d->crls.append(crl);
+	d->generation = Private::nextGeneration();
 }
 
 QList<Certificate> CertificateCollection::certificates() const
 {
-	return d->certs;
+	QList<Certificate> out = d->certs;
+	for(int n = 0; n < d->roots.count(); ++n)
+	{
+		Certificate c = d->roots.certificate(n);
+		if(!c.isNull())
+			out += c;
+	}
+	return out;
 }
 
 QList<CRL> CertificateCollection::crls() const
@@ -2365,10 +3115,67 @@ QList<CRL> CertificateCollection::crls() const
 	return d->crls;
 }
 
+QList<Certificate> CertificateCollection::issuersOf(const Certificate &cert) const
+{
+	QList<Certificate> out;
+	if(cert.isNull())
+		return out;
+
+	QList<int> candidates;
+	{
+		QMutexLocker locker(&d->m);
+		d->updateIndex();
+		candidates = d->index.candidates(cert, d->certs.count());
+	}
+	for(int n = 0; n < candidates.count(); ++n)
+	{
+		const Certificate &c = d->certs[candidates[n]];
+		if(c.isIssuerOf(cert))
+			out += c;
+	}
+	if(!d->roots.isNull())
+		out += d->roots.issuersOf(cert);
+	return out;
+}
+
+Certificate CertificateCollection::findFingerprint(const QByteArray &fingerprint) const
+{
+	{
+		QMutexLocker locker(&d->m);
+		d->updateIndex();
+		int at = d->index.find(fingerprint);
+		if(at != -1)
+			return d->certs[at];
+	}
+	if(!d->roots.isNull())
+		return d->roots.findFingerprint(fingerprint);
+	return Certificate();
+}
+
+TrustStoreFile CertificateCollection::trustStoreFile() const
+{
+	return d->roots;
+}
+
 void CertificateCollection::append(const CertificateCollection &other)
 {
 	d->certs += other.d->certs;
 	d->crls += other.d->crls;
+
+	// a collection reads from one file at most, so the certificates of
+	//   another one are decoded
+	if(d->roots.isNull())
+		d->roots = other.d->roots;
+	else
+	{
+		for(int n = 0; n < other.d->roots.count(); ++n)
+		{
+			Certificate c = other.d->roots.certificate(n);
+			if(!c.isNull())
+				d->certs += c;
+		}
+	}
+	d->generation = Private::nextGeneration();
 }
 
 CertificateCollection CertificateCollection::operator+(const CertificateCollection &other) const
@@ -2396,9 +3203,10 @@ bool CertificateCollection::toFlatTextFile(const QString &fileName)
 		return false;
 
 	QTextStream ts(&f);
+	QList<Certificate> certs = certificates();
 	int n;
-	for(n = 0; n < d->certs.count(); ++n)
-		ts << d->certs[n].toPEM();
+	for(n = 0; n < certs.count(); ++n)
+		ts << certs[n].toPEM();
 	for(n = 0; n < d->crls.count(); ++n)
 		ts << d->crls[n].toPEM();
 	return true;
@@ -2410,10 +3218,11 @@ bool CertificateCollection::toPKCS7File(const QString &fileName, const QString &
 
 	QList<CertContext*> cert_list;
 	QList<CRLContext*> crl_list;
+	QList<Certificate> certs = certificates();
 	int n;
-	for(n = 0; n < d->certs.count(); ++n)
+	for(n = 0; n < certs.count(); ++n)
 	{
-		CertContext *c = static_cast<CertContext *>(d->certs[n].context());
+		CertContext *c = static_cast<CertContext *>(certs[n].context());
 		cert_list += c;
 	}
 	for(n = 0; n < d->crls.count(); ++n)
@@ -2438,25 +3247,78 @@ CertificateCollection CertificateCollection::fromFlatTextFile(const QString &fil
 		return CertificateCollection();
 	}
 
+	// map the file when possible, bundles can be large
+	QByteArray buf;
+	const char *data = 0;
+	qint64 size = f.size();
+	if(size > 0)
+		data = (const char *)f.map(0, size);
+	if(!data)
+	{
+		buf = f.readAll();
+		data = buf.constData();
+		size = buf.size();
+	}
+
+	QVector<PemBundleItem> items = scan_pem_bundle(data, size);
+	f.close();
+
 	CertificateCollection certs;
-	QTextStream ts(&f);
-	while(1)
+	if(items.isEmpty())
 	{
-		bool isCRL = false;
-		QString pem = readNextPem(&ts, &isCRL);
-		if(pem.isNull())
-			break;
-		if(isCRL)
+		if(result)
+			*result = ConvertGood;
+		return certs;
+	}
+
+	// look up the provider once, each block then gets a clone
+	Provider::Context *certProto = getContext("cert", provider);
+	Provider::Context *crlProto = getContext("crl", provider);
+
+	int threads = QThread::idealThreadCount();
+	if(threads > 1 && items.count() >= PEM_BUNDLE_PARALLEL_MIN)
+	{
+		threads = qMin(threads, items.count() / (PEM_BUNDLE_PARALLEL_MIN / 4));
+		QThreadPool pool;
+		pool.setMaxThreadCount(threads);
+		int at = 0;
+		for(int n = 0; n < threads; ++n)
 		{
-			CRL c = CRL::fromPEM(pem, 0, provider);
-			if(!c.isNull())
-				certs.addCRL(c);
+			PemBundleParser *parser = new PemBundleParser;
+			parser->items = items.data() + at;
+			parser->count = (items.count() - at) / (threads - n);
+			parser->certProto = certProto;
+			parser->crlProto = crlProto;
+			parser->target = QThread::currentThread();
+			at += parser->count;
+			pool.start(parser);
+		}
+		pool.waitForDone();
+	}
+	else
+	{
+		for(int n = 0; n < items.count(); ++n)
+			convert_pem_item(&items[n], certProto, crlProto);
+	}
+	delete certProto;
+	delete crlProto;
+
+	// added in file order
+	for(int n = 0; n < items.count(); ++n)
+	{
+		if(!items[n].c)
+			continue;
+		if(items[n].isCRL)
+		{
+			CRL c;
+			c.change(static_cast<CRLContext *>(items[n].c));
+			certs.addCRL(c);
 		}
 		else
 		{
-			Certificate c = Certificate::fromPEM(pem, 0, provider);
-			if(!c.isNull())
-				certs.addCertificate(c);
+			Certificate c;
+			c.change(static_cast<CertContext *>(items[n].c));
+			certs.addCertificate(c);
 		}
 	}
 
@@ -2505,6 +3367,629 @@ CertificateCollection CertificateCollection::fromPKCS7File(const QString &fileNa
 	return certs;
 }
 
+//----------------------------------------------------------------------------
+// TrustStoreFile
+//----------------------------------------------------------------------------
+// The file is little endian, in this order:
+//
+//   header, 24 bytes:
+//     "QCATRUST", version (u32, 1), certificate count (u32), key id
+//     count (u32), reserved (u32)
+//   certificates, 64 bytes each, sorted by subject hash:
+//     subject name hash (u64), subject key id hash (u64, 0 if none),
+//     DER offset from the start of the file (u32), DER length (u32),
+//     SHA-256 of the DER (32 bytes), reserved (8 bytes)
+//   key ids, 16 bytes each, sorted by hash:
+//     subject key id hash (u64), certificate index (u32), reserved (u32)
+//   the DER of the certificates
+//
+// The hashes are the first 64 bits of SHA-256, see qca_certder.h.
+
+#define TRUSTSTORE_MAGIC "QCATRUST"
+#define TRUSTSTORE_VERSION 1
+#define TRUSTSTORE_HEADER_SIZE 24
+#define TRUSTSTORE_ENTRY_SIZE 64
+#define TRUSTSTORE_KEYID_SIZE 16
+
+static quint32 load_le32(const unsigned char *p)
+{
+	return (quint32)p[0] | ((quint32)p[1] << 8) | ((quint32)p[2] << 16) | ((quint32)p[3] << 24);
+}
+
+static quint64 load_le64(const unsigned char *p)
+{
+	return (quint64)load_le32(p) | ((quint64)load_le32(p + 4) << 32);
+}
+
+static void append_le32(QByteArray *out, quint32 v)
+{
+	for(int n = 0; n < 4; ++n)
+		out->append((char)(v >> (8 * n)));
+}
+
+static void append_le64(QByteArray *out, quint64 v)
+{
+	append_le32(out, (quint32)v);
+	append_le32(out, (quint32)(v >> 32));
+}
+
+class TrustStoreFile::Private : public QSharedData
+{
+public:
+	QFile *file;
+	QByteArray data;
+	const unsigned char *entries, *keyIds;
+	int count, keyIdCount;
+	QString provider;
+
+	mutable QMutex m;
+	mutable QVector<Certificate> certs;
+	mutable QVector<bool> decoded;
+
+	Private() : file(0), entries(0), keyIds(0), count(0), keyIdCount(0)
+	{
+	}
+
+	Private(const Private &from) : QSharedData(from), file(0), provider(from.provider)
+	{
+		setData(QByteArray(from.data.constData(), from.data.size()));
+	}
+
+	~Private()
+	{
+		// the data may point into the mapping
+		data.clear();
+		delete file;
+	}
+
+	bool setData(const QByteArray &_data)
+	{
+		data = _data;
+		entries = keyIds = 0;
+		count = keyIdCount = 0;
+
+		const unsigned char *p = (const unsigned char *)data.constData();
+		if(data.size() < TRUSTSTORE_HEADER_SIZE || memcmp(p, TRUSTSTORE_MAGIC, 8) != 0 || load_le32(p + 8) != TRUSTSTORE_VERSION)
+			return false;
+		quint32 c = load_le32(p + 12);
+		quint32 k = load_le32(p + 16);
+		if((quint64)TRUSTSTORE_HEADER_SIZE + (quint64)c * TRUSTSTORE_ENTRY_SIZE + (quint64)k * TRUSTSTORE_KEYID_SIZE > (quint64)data.size())
+			return false;
+
+		// the tables fit in the file, so both counts fit in an int
+		count = c;
+		keyIdCount = k;
+		entries = p + TRUSTSTORE_HEADER_SIZE;
+		keyIds = entries + count * TRUSTSTORE_ENTRY_SIZE;
+		certs.resize(count);
+		decoded.fill(false, count);
+		return true;
+	}
+
+	const unsigned char *entry(int index) const
+	{
+		return entries + index * TRUSTSTORE_ENTRY_SIZE;
+	}
+
+	QByteArray der(int index) const
+	{
+		if(index < 0 || index >= count)
+			return QByteArray();
+		const unsigned char *e = entry(index);
+		quint32 offset = load_le32(e + 16);
+		quint32 length = load_le32(e + 20);
+		if((quint64)offset + length > (quint64)data.size())
+			return QByteArray();
+		return data.mid(offset, length);
+	}
+
+	Certificate certificate(int index) const
+	{
+		if(index < 0 || index >= count)
+			return Certificate();
+		QMutexLocker locker(&m);
+		if(!decoded[index])
+		{
+			QByteArray a = der(index);
+			if(!a.isEmpty())
+				certs[index] = Certificate::fromDER(a, 0, provider);
+			decoded[index] = true;
+		}
+		return certs[index];
+	}
+
+	// the first of the sorted records of size 'size' starting at 'table'
+	//   whose hash is at least 'hash'
+	static int lowerBound(const unsigned char *table, int count, int size, quint64 hash)
+	{
+		int lo = 0, hi = count;
+		while(lo < hi)
+		{
+			int mid = (lo + hi) / 2;
+			if(load_le64(table + mid * size) < hash)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+};
+
+TrustStoreFile::TrustStoreFile()
+:d(new Private)
+{
+}
+
+TrustStoreFile::TrustStoreFile(const TrustStoreFile &from)
+:d(from.d)
+{
+}
+
+TrustStoreFile::~TrustStoreFile()
+{
+}
+
+TrustStoreFile & TrustStoreFile::operator=(const TrustStoreFile &from)
+{
+	d = from.d;
+	return *this;
+}
+
+bool TrustStoreFile::isNull() const
+{
+	return d->data.isEmpty();
+}
+
+int TrustStoreFile::count() const
+{
+	return d->count;
+}
+
+QByteArray TrustStoreFile::certificateDER(int index) const
+{
+	return d->der(index);
+}
+
+Certificate TrustStoreFile::certificate(int index) const
+{
+	if(index < 0 || index >= d->count)
+		return Certificate();
+	return d->certificate(index);
+}
+
+QList<Certificate> TrustStoreFile::issuersOf(const Certificate &cert) const
+{
+	QList<Certificate> out;
+	if(cert.isNull() || d->count == 0)
+		return out;
+
+	const CertIndexKeys &k = CertIssuerIndex::keysOf(cert);
+	if(!k.valid)
+		return out;
+
+	QList<int> candidates;
+	quint64 hash = k.issuer;
+	for(int n = Private::lowerBound(d->entries, d->count, TRUSTSTORE_ENTRY_SIZE, hash); n < d->count && load_le64(d->entry(n)) == hash; ++n)
+		candidates += n;
+
+	if(k.authorityKeyId)
+	{
+		hash = k.authorityKeyId;
+		for(int n = Private::lowerBound(d->keyIds, d->keyIdCount, TRUSTSTORE_KEYID_SIZE, hash); n < d->keyIdCount; ++n)
+		{
+			const unsigned char *k = d->keyIds + n * TRUSTSTORE_KEYID_SIZE;
+			if(load_le64(k) != hash)
+				break;
+			// the index comes from the file, so it is checked unsigned
+			quint32 index = load_le32(k + 8);
+			if(index < (quint32)d->count && !candidates.contains((int)index))
+				candidates += (int)index;
+		}
+	}
+
+	// the hashes only narrow it down
+	for(int n = 0; n < candidates.count(); ++n)
+	{
+		Certificate c = d->certificate(candidates[n]);
+		if(!c.isNull() && c.isIssuerOf(cert))
+			out += c;
+	}
+	return out;
+}
+
+Certificate TrustStoreFile::findFingerprint(const QByteArray &fingerprint) const
+{
+	if(fingerprint.size() != 32)
+		return Certificate();
+	for(int n = 0; n < d->count; ++n)
+	{
+		if(memcmp(d->entry(n) + 24, fingerprint.constData(), 32) == 0)
+			return d->certificate(n);
+	}
+	return Certificate();
+}
+
+CertificateCollection TrustStoreFile::toCertificateCollection() const
+{
+	CertificateCollection col;
+	if(!isNull())
+		col.d->roots = *this;
+	return col;
+}
+
+TrustStoreFile TrustStoreFile::fromFile(const QString &fileName, ConvertResult *result, const QString &provider)
+{
+	TrustStoreFile store;
+	QFile *f = new QFile(fileName);
+	if(!f->open(QFile::ReadOnly))
+	{
+		delete f;
+		if(result)
+			*result = ErrorFile;
+		return store;
+	}
+
+	Private *p = store.d.data();
+	p->provider = provider;
+	qint64 size = f->size();
+	uchar *mapped = size > 0 ? f->map(0, size) : 0;
+	bool ok;
+	if(mapped)
+	{
+		p->file = f;
+		ok = p->setData(QByteArray::fromRawData((const char *)mapped, size));
+	}
+	else
+	{
+		ok = p->setData(f->readAll());
+		delete f;
+	}
+
+	if(!ok)
+	{
+		store = TrustStoreFile();
+		if(result)
+			*result = ErrorDecode;
+		return store;
+	}
+	if(result)
+		*result = ConvertGood;
+	return store;
+}
+
+class TrustStoreFileItem
+{
+public:
+	QByteArray der;
+	quint64 subjectHash, keyIdHash;
+	int index;
+
+	bool operator<(const TrustStoreFileItem &other) const
+	{
+		if(subjectHash != other.subjectHash)
+			return subjectHash < other.subjectHash;
+		return index < other.index;
+	}
+};
+
+static bool keyid_less_than(const TrustStoreFileItem *a, const TrustStoreFileItem *b)
+{
+	if(a->keyIdHash != b->keyIdHash)
+		return a->keyIdHash < b->keyIdHash;
+	return a->index < b->index;
+}
+
+bool TrustStoreFile::toFile(const QString &fileName, const QList<QByteArray> &certs)
+{
+	QVector<TrustStoreFileItem> items(certs.count());
+	for(int n = 0; n < certs.count(); ++n)
+	{
+		CertDerInfo info;
+		if(!certDerInfo(certs[n], &info))
+			return false;
+		TrustStoreFileItem &i = items[n];
+		i.der = certs[n];
+		i.subjectHash = certNameHash(i.der, info.subject);
+		i.keyIdHash = info.subjectKeyId.isEmpty() ? 0 : certKeyIdHash(i.der, info.subjectKeyId);
+		i.index = n;
+	}
+	std::sort(items.begin(), items.end());
+
+	QList<const TrustStoreFileItem *> keyIds;
+	for(int n = 0; n < items.count(); ++n)
+	{
+		// from here on, index is the position in the file
+		items[n].index = n;
+		if(items[n].keyIdHash)
+			keyIds += &items[n];
+	}
+	std::sort(keyIds.begin(), keyIds.end(), keyid_less_than);
+
+	QByteArray out;
+	out += TRUSTSTORE_MAGIC;
+	append_le32(&out, TRUSTSTORE_VERSION);
+	append_le32(&out, items.count());
+	append_le32(&out, keyIds.count());
+	append_le32(&out, 0);
+
+	quint32 offset = TRUSTSTORE_HEADER_SIZE + items.count() * TRUSTSTORE_ENTRY_SIZE + keyIds.count() * TRUSTSTORE_KEYID_SIZE;
+	for(int n = 0; n < items.count(); ++n)
+	{
+		const TrustStoreFileItem &i = items[n];
+		append_le64(&out, i.subjectHash);
+		append_le64(&out, i.keyIdHash);
+		append_le32(&out, offset);
+		append_le32(&out, i.der.size());
+		out += certFingerprint(i.der);
+		out += QByteArray(8, 0);
+		offset += i.der.size();
+	}
+	for(int n = 0; n < keyIds.count(); ++n)
+	{
+		append_le64(&out, keyIds[n]->keyIdHash);
+		append_le32(&out, keyIds[n]->index);
+		append_le32(&out, 0);
+	}
+	for(int n = 0; n < items.count(); ++n)
+		out += items[n].der;
+
+	return arrayToFile(fileName, out);
+}
+
+bool TrustStoreFile::toFile(const QString &fileName, const QList<Certificate> &certs)
+{
+	QList<QByteArray> der;
+	for(int n = 0; n < certs.count(); ++n)
+		der += certs[n].toDER();
+	return toFile(fileName, der);
+}
+
+bool TrustStoreFile::isTrustStoreFile(const QString &fileName)
+{
+	QFile f(fileName);
+	if(!f.open(QFile::ReadOnly))
+		return false;
+	return f.read(8) == TRUSTSTORE_MAGIC;
+}
+
+//----------------------------------------------------------------------------
+// TrustStore
+//----------------------------------------------------------------------------
+class TrustStore::Private : public QSharedData
+{
+public:
+	CertificateCollection trusted;
+};
+
+TrustStore::TrustStore()
+:d(new Private)
+{
+}
+
+TrustStore::TrustStore(const CertificateCollection &trusted, const QString &provider)
+:d(new Private)
+{
+	d->trusted = trusted;
+
+	QList<Certificate> certs = trusted.certificates();
+	QList<CRL> crls = trusted.crls();
+	if(certs.isEmpty())
+		return;
+
+	// the store takes the provider's own objects, so everything has to
+	//   come from the same one
+	Provider *p = certs.first().provider();
+	if(!p || (!provider.isEmpty() && p->name() != provider))
+		return;
+
+	QList<CertContext*> cert_list;
+	QList<CRLContext*> crl_list;
+	for(int n = 0; n < certs.count(); ++n)
+	{
+		if(certs[n].isNull() || certs[n].provider() != p)
+			return;
+		cert_list += static_cast<CertContext *>(certs[n].context());
+	}
+	for(int n = 0; n < crls.count(); ++n)
+	{
+		if(crls[n].isNull() || crls[n].provider() != p)
+			return;
+		crl_list += static_cast<CRLContext *>(crls[n].context());
+	}
+
+	TrustStoreContext *c = static_cast<TrustStoreContext *>(getContext("truststore", p));
+	if(!c)
+		return;
+	if(c->setup(cert_list, crl_list))
+		change(c);
+	else
+		delete c;
+}
+
+TrustStore::TrustStore(const TrustStore &from)
+:Algorithm(from), d(from.d)
+{
+}
+
+TrustStore::~TrustStore()
+{
+}
+
+TrustStore & TrustStore::operator=(const TrustStore &from)
+{
+	Algorithm::operator=(from);
+	d = from.d;
+	return *this;
+}
+
+CertificateCollection TrustStore::collection() const
+{
+	return d->trusted;
+}
+
+//----------------------------------------------------------------------------
+// ValidationCache
+//----------------------------------------------------------------------------
+QByteArray ValidationCache::key(char kind, const QString &provider, const QList<Certificate> &certs, const CertificateCollection &trusted, const QList<CRL> &crls, UsageMode u, ValidateFlags vf)
+{
+	QByteArray name = provider.toUtf8();
+	QByteArray out;
+	out.reserve(20 + name.size() + (certs.count() + crls.count()) * 32);
+	out += kind;
+	append_le32(&out, (quint32)name.size());
+	out += name;
+	append_le32(&out, (quint32)u);
+	append_le32(&out, (quint32)vf);
+	append_le32(&out, (quint32)trusted.d->generation);
+
+	append_le32(&out, (quint32)certs.count());
+	for(int n = 0; n < certs.count(); ++n)
+		out += CertIssuerIndex::keysOf(certs[n]).fingerprint;
+	append_le32(&out, (quint32)crls.count());
+	for(int n = 0; n < crls.count(); ++n)
+		out += crls[n].d->derFingerprint(crls[n]);
+	return out;
+}
+
+bool ValidationCache::find(const QByteArray &key, Validity *result)
+{
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	QMutexLocker locker(&m);
+	QHash<QByteArray, Entry>::iterator it = entries.find(key);
+	if(it != entries.end())
+	{
+		if(it->expires > now)
+		{
+			++hitCount;
+			*result = it->result;
+			return true;
+		}
+		entries.erase(it);
+	}
+	++missCount;
+	return false;
+}
+
+static void earliest(qint64 *expires, qint64 now, const QDateTime &t)
+{
+	if(!t.isValid())
+		return;
+	qint64 at = t.toMSecsSinceEpoch();
+	if(at > now && at < *expires)
+		*expires = at;
+}
+
+void ValidationCache::insert(const QByteArray &key, Validity result, const QList<Certificate> &chain, const QList<CRL> &crls)
+{
+	// the result holds until something in it starts, ends or is due to
+	//   be replaced
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 expires = now + (qint64)ttl.load() * 1000;
+	for(int n = 0; n < chain.count(); ++n)
+	{
+		if(chain[n].isNull())
+			continue;
+		earliest(&expires, now, chain[n].notValidBefore());
+		earliest(&expires, now, chain[n].notValidAfter());
+	}
+	for(int n = 0; n < crls.count(); ++n)
+	{
+		if(!crls[n].isNull())
+			earliest(&expires, now, crls[n].nextUpdate());
+	}
+	if(expires <= now)
+		return;
+
+	Entry e;
+	e.result = result;
+	e.expires = expires;
+
+	QMutexLocker locker(&m);
+	if(entries.count() >= MaxEntries)
+	{
+		QHash<QByteArray, Entry>::iterator it = entries.begin();
+		while(it != entries.end())
+		{
+			if(it->expires <= now)
+				it = entries.erase(it);
+			else
+				++it;
+		}
+
+		// still full, so start over rather than track use
+		if(entries.count() >= MaxEntries)
+			entries.clear();
+	}
+	entries.insert(key, e);
+}
+
+void ValidationCache::clear()
+{
+	QMutexLocker locker(&m);
+	entries.clear();
+	hitCount = 0;
+	missCount = 0;
+}
+
+quint64 ValidationCache::hits()
+{
+	QMutexLocker locker(&m);
+	return hitCount;
+}
+
+quint64 ValidationCache::misses()
+{
+	QMutexLocker locker(&m);
+	return missCount;
+}
+
+void setValidationCacheEnabled(bool enabled)
+{
+	ValidationCache *cache = validation_cache();
+	if(!cache)
+		return;
+	if(!enabled)
+		cache->clear();
+	cache->enabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool validationCacheEnabled()
+{
+	return active_validation_cache() != 0;
+}
+
+void setValidationCacheTimeToLive(int seconds)
+{
+	ValidationCache *cache = validation_cache();
+	if(cache)
+		cache->ttl.store(qMax(seconds, 0));
+}
+
+int validationCacheTimeToLive()
+{
+	ValidationCache *cache = validation_cache();
+	return cache ? cache->ttl.load() : 0;
+}
+
+quint64 validationCacheHits()
+{
+	ValidationCache *cache = validation_cache();
+	return cache ? cache->hits() : 0;
+}
+
+quint64 validationCacheMisses()
+{
+	ValidationCache *cache = validation_cache();
+	return cache ? cache->misses() : 0;
+}
+
+void clearValidationCache()
+{
+	ValidationCache *cache = validation_cache();
+	if(cache)
+		cache->clear();
+}
+
 //----------------------------------------------------------------------------
 // CertificateAuthority
 //----------------------------------------------------------------------------
@@ -2982,6 +4467,217 @@ KeyBundle KeyLoader::keyBundle() const
 	return d->out.keyBundle;
 }
 
+//----------------------------------------------------------------------------
+// CertificateValidator
+//----------------------------------------------------------------------------
+class CertificateValidator::Private : public QObject
+{
+	Q_OBJECT
+public:
+	// takes the next certificate until there are none left, so that a
+	//   slow one doesn't hold up a share of the others
+	class Worker : public QRunnable
+	{
+	public:
+		Private *d;
+
+		Worker(Private *_d) : d(_d)
+		{
+		}
+
+		virtual void run()
+		{
+			while(!d->cancel.loadAcquire())
+			{
+				int n = d->next.fetchAndAddRelaxed(1);
+				if(n >= d->certs.count())
+					break;
+				d->out[n] = d->certs.at(n).validate(d->trusted, d->untrusted, d->u, d->vf);
+				d->reportResult(n);
+			}
+			d->reportResult(-1);
+		}
+	};
+
+	CertificateValidator *q;
+
+	bool active;
+	QThreadPool pool;
+
+	// read by the workers while active
+	QList<Certificate> certs;
+	TrustStore trusted;
+	CertificateCollection untrusted;
+	UsageMode u;
+	ValidateFlags vf;
+	QVector<Validity> results;
+	Validity *out;
+	QAtomicInt next, cancel;
+
+	// what the workers have done that isn't reported yet, and the
+	//   results that are
+	QMutex m;
+	QList<int> ready;
+	int running;
+	bool posted;
+	QVector<Validity> delivered;
+
+	Private(CertificateValidator *_q) : QObject(_q), q(_q)
+	{
+		qRegisterMetaType<Validity>("QCA::Validity");
+
+		active = false;
+		out = 0;
+		running = 0;
+		posted = false;
+	}
+
+	~Private()
+	{
+		stop();
+	}
+
+	void stop()
+	{
+		cancel.storeRelease(1);
+		pool.waitForDone();
+	}
+
+	void start()
+	{
+		results = QVector<Validity>(certs.count(), ErrorValidityUnknown);
+		out = results.data();
+		next.store(0);
+		cancel.store(0);
+		{
+			QMutexLocker locker(&m);
+			ready.clear();
+			posted = false;
+			delivered = results;
+		}
+		active = true;
+
+		running = qMin(pool.maxThreadCount(), certs.count());
+		if(running < 1)
+		{
+			running = 0;
+			QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+			return;
+		}
+		for(int n = 0; n < running; ++n)
+			pool.start(new Worker(this));
+	}
+
+	// called by the workers, -1 when one of them is done
+	void reportResult(int n)
+	{
+		QMutexLocker locker(&m);
+		if(n == -1)
+			--running;
+		else
+			ready += n;
+		if(!posted)
+		{
+			posted = true;
+			QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+		}
+	}
+
+public slots:
+	void deliver()
+	{
+		QList<int> list;
+		bool done;
+		{
+			QMutexLocker locker(&m);
+			list = ready;
+			ready.clear();
+			posted = false;
+			done = (running == 0);
+
+			// a worker is done with an entry once it is in ready
+			if(active)
+			{
+				for(int n = 0; n < list.count(); ++n)
+					delivered[list[n]] = results[list[n]];
+			}
+		}
+
+		if(!active)
+			return;
+		for(int n = 0; n < list.count(); ++n)
+			emit q->validated(list[n], results[list[n]]);
+		if(done)
+		{
+			active = false;
+			emit q->finished();
+		}
+	}
+};
+
+CertificateValidator::CertificateValidator(QObject *parent)
+:QObject(parent)
+{
+	d = new Private(this);
+}
+
+CertificateValidator::~CertificateValidator()
+{
+	delete d;
+}
+
+void CertificateValidator::setMaxThreadCount(int count)
+{
+	d->pool.setMaxThreadCount(qMax(count, 1));
+}
+
+int CertificateValidator::maxThreadCount() const
+{
+	return d->pool.maxThreadCount();
+}
+
+void CertificateValidator::start(const QList<Certificate> &certs, const TrustStore &trusted, const CertificateCollection &untrusted, UsageMode u, ValidateFlags vf)
+{
+	Q_ASSERT(!d->active);
+	if(d->active)
+		return;
+
+	d->certs = certs;
+	d->trusted = trusted;
+	d->untrusted = untrusted;
+	d->u = u;
+	d->vf = vf;
+	d->start();
+}
+
+bool CertificateValidator::isActive() const
+{
+	return d->active;
+}
+
+void CertificateValidator::waitForFinished()
+{
+	if(!d->active)
+		return;
+	d->pool.waitForDone();
+	d->deliver();
+}
+
+QList<Validity> CertificateValidator::results() const
+{
+	// the workers may still be writing to d->results
+	QMutexLocker locker(&d->m);
+	return d->delivered.toList();
+}
+
+QList<Validity> validateMany(const QList<Certificate> &certs, const CertificateCollection &trusted, const CertificateCollection &untrusted, UsageMode u, ValidateFlags vf)
+{
+	CertificateValidator validator;
+	validator.start(certs, TrustStore(trusted), untrusted, u, vf);
+	validator.waitForFinished();
+	return validator.results();
+}
+
 }
 
 #include "qca_cert.moc"
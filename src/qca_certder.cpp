@@ -0,0 +1,332 @@
+/*
+ * qca_certder.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_certder.h"
+
+#include "qca_sha2.h"
+
+#include <QString>
+
+#include <string.h>
+
+namespace QCA {
+
+//----------------------------------------------------------------------------
+// DER walking
+//----------------------------------------------------------------------------
+class DerReader
+{
+public:
+	const unsigned char *base, *p, *end;
+
+	DerReader(const unsigned char *_base, const unsigned char *_p, const unsigned char *_end) : base(_base), p(_p), end(_end) {}
+
+	bool atEnd() const { return p >= end; }
+
+	int peek() const { return p < end ? *p : -1; }
+
+	// reads one element, leaving contents at its contents and start at
+	//   its tag
+	bool next(int *tag, DerReader *contents, const unsigned char **start = 0)
+	{
+		const unsigned char *at = p;
+		if(end - at < 2)
+			return false;
+		int t = *(at++);
+
+		// high tag numbers don't appear in certificates
+		if((t & 0x1f) == 0x1f)
+			return false;
+
+		quint32 len = *(at++);
+		if(len & 0x80)
+		{
+			int n = len & 0x7f;
+			if(n == 0 || n > 4 || end - at < n)
+				return false;
+			len = 0;
+			for(int i = 0; i < n; ++i)
+				len = (len << 8) | *(at++);
+		}
+		if(len > (quint32)(end - at))
+			return false;
+
+		if(start)
+			*start = p;
+		*tag = t;
+		*contents = DerReader(base, at, at + len);
+		p = at + len;
+		return true;
+	}
+
+	bool expect(int tag, DerReader *contents, const unsigned char **start = 0)
+	{
+		int t;
+		return next(&t, contents, start) && t == tag;
+	}
+
+	CertDerField field() const
+	{
+		CertDerField f;
+		f.offset = p - base;
+		f.length = end - p;
+		return f;
+	}
+
+	CertDerField fieldFrom(const unsigned char *start) const
+	{
+		CertDerField f;
+		f.offset = start - base;
+		f.length = p - start;
+		return f;
+	}
+};
+
+static const unsigned char oid_subjectKeyId[] = { 0x55, 0x1d, 0x0e };
+static const unsigned char oid_authorityKeyId[] = { 0x55, 0x1d, 0x23 };
+
+static bool is_oid(const DerReader &oid, const unsigned char *value, int len)
+{
+	return oid.end - oid.p == len && memcmp(oid.p, value, len) == 0;
+}
+
+static bool read_extensions(DerReader exts, CertDerInfo *info)
+{
+	DerReader list(exts.base, 0, 0);
+	if(!exts.expect(0x30, &list))
+		return false;
+	while(!list.atEnd())
+	{
+		DerReader ext(list.base, 0, 0), oid(list.base, 0, 0), value(list.base, 0, 0);
+		if(!list.expect(0x30, &ext) || !ext.expect(0x06, &oid))
+			return false;
+		int tag;
+		if(!ext.next(&tag, &value))
+			return false;
+		if(tag == 0x01) // critical
+		{
+			if(!ext.next(&tag, &value))
+				return false;
+		}
+		if(tag != 0x04)
+			return false;
+
+		if(is_oid(oid, oid_subjectKeyId, sizeof(oid_subjectKeyId)))
+		{
+			DerReader keyId(value.base, 0, 0);
+			if(value.expect(0x04, &keyId))
+				info->subjectKeyId = keyId.field();
+		}
+		else if(is_oid(oid, oid_authorityKeyId, sizeof(oid_authorityKeyId)))
+		{
+			DerReader aki(value.base, 0, 0), keyId(value.base, 0, 0);
+			if(value.expect(0x30, &aki) && aki.peek() == 0x80 && aki.expect(0x80, &keyId))
+				info->authorityKeyId = keyId.field();
+		}
+	}
+	return true;
+}
+
+bool certDerInfo(const QByteArray &der, CertDerInfo *info)
+{
+	const unsigned char *base = (const unsigned char *)der.constData();
+	DerReader in(base, base, base + der.size());
+	DerReader cert(base, 0, 0), tbs(base, 0, 0), x(base, 0, 0);
+	const unsigned char *start;
+	int tag;
+
+	*info = CertDerInfo();
+	if(!in.expect(0x30, &cert) || !cert.expect(0x30, &tbs))
+		return false;
+
+	// version
+	if(tbs.peek() == 0xa0 && !tbs.next(&tag, &x))
+		return false;
+
+	if(!tbs.expect(0x02, &x))
+		return false;
+	info->serial = x.field();
+
+	// signature algorithm
+	if(!tbs.expect(0x30, &x))
+		return false;
+
+	if(!tbs.expect(0x30, &x, &start))
+		return false;
+	info->issuer = tbs.fieldFrom(start);
+
+	DerReader validity(base, 0, 0);
+	if(!tbs.expect(0x30, &validity))
+		return false;
+	if(!validity.next(&tag, &x, &start))
+		return false;
+	info->notBefore = validity.fieldFrom(start);
+	if(!validity.next(&tag, &x, &start))
+		return false;
+	info->notAfter = validity.fieldFrom(start);
+
+	if(!tbs.expect(0x30, &x, &start))
+		return false;
+	info->subject = tbs.fieldFrom(start);
+
+	// public key
+	if(!tbs.expect(0x30, &x))
+		return false;
+
+	while(!tbs.atEnd())
+	{
+		if(!tbs.next(&tag, &x))
+			return false;
+		if(tag == 0xa3 && !read_extensions(x, info))
+			return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Hashes
+//----------------------------------------------------------------------------
+static quint64 first64(const unsigned char *digest)
+{
+	quint64 v = 0;
+	for(int n = 0; n < 8; ++n)
+		v = (v << 8) | digest[n];
+	return v;
+}
+
+static void update_len(Sha256 *h, int len)
+{
+	unsigned char buf[4];
+	buf[0] = len >> 24;
+	buf[1] = len >> 16;
+	buf[2] = len >> 8;
+	buf[3] = len;
+	h->update(buf, 4);
+}
+
+// the value of a string type as text, false if it isn't one
+static bool der_string(int tag, const DerReader &value, QString *s)
+{
+	const unsigned char *p = value.p;
+	int len = value.end - value.p;
+	switch(tag)
+	{
+		case 0x0c: // UTF8String
+			*s = QString::fromUtf8((const char *)p, len);
+			return true;
+		case 0x13: // PrintableString
+		case 0x14: // TeletexString
+		case 0x16: // IA5String
+		case 0x1a: // VisibleString
+			*s = QString::fromLatin1((const char *)p, len);
+			return true;
+		case 0x1e: // BMPString
+			for(int n = 0; n + 1 < len; n += 2)
+				*s += QChar((ushort)((p[n] << 8) | p[n + 1]));
+			return true;
+		case 0x1c: // UniversalString
+			for(int n = 0; n + 3 < len; n += 4)
+			{
+				uint c = ((uint)p[n] << 24) | (p[n + 1] << 16) | (p[n + 2] << 8) | p[n + 3];
+				*s += QString::fromUcs4(&c, 1);
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool hash_name(Sha256 *h, DerReader name)
+{
+	DerReader rdns(name.base, 0, 0);
+	if(!name.expect(0x30, &rdns))
+		return false;
+	while(!rdns.atEnd())
+	{
+		DerReader rdn(rdns.base, 0, 0);
+		if(!rdns.expect(0x31, &rdn))
+			return false;
+		static const unsigned char set = 0x31;
+		h->update(&set, 1);
+		while(!rdn.atEnd())
+		{
+			DerReader ava(rdn.base, 0, 0), oid(rdn.base, 0, 0), value(rdn.base, 0, 0);
+			int tag;
+			if(!rdn.expect(0x30, &ava) || !ava.expect(0x06, &oid) || !ava.next(&tag, &value))
+				return false;
+			update_len(h, oid.end - oid.p);
+			h->update(oid.p, oid.end - oid.p);
+
+			QString s;
+			if(der_string(tag, value, &s))
+			{
+				QByteArray canon = s.simplified().toLower().toUtf8();
+				static const unsigned char utf8 = 0x0c;
+				h->update(&utf8, 1);
+				update_len(h, canon.size());
+				h->update((const unsigned char *)canon.constData(), canon.size());
+			}
+			else
+			{
+				unsigned char t = tag;
+				h->update(&t, 1);
+				update_len(h, value.end - value.p);
+				h->update(value.p, value.end - value.p);
+			}
+		}
+	}
+	return true;
+}
+
+quint64 certNameHash(const QByteArray &der, const CertDerField &name)
+{
+	const unsigned char *base = (const unsigned char *)der.constData();
+	unsigned char digest[Sha256::DigestSize];
+	Sha256 h;
+	if(!hash_name(&h, DerReader(base, base + name.offset, base + name.offset + name.length)))
+	{
+		// not a Name we understand, so only the same bytes match
+		h.clear();
+		h.update(base + name.offset, name.length);
+	}
+	h.final(digest);
+	return first64(digest);
+}
+
+quint64 certKeyIdHash(const QByteArray &der, const CertDerField &keyId)
+{
+	unsigned char digest[Sha256::DigestSize];
+	Sha256 h;
+	h.update((const unsigned char *)der.constData() + keyId.offset, keyId.length);
+	h.final(digest);
+	quint64 v = first64(digest);
+	return v ? v : 1;
+}
+
+QByteArray certFingerprint(const QByteArray &der)
+{
+	QByteArray out(Sha256::DigestSize, 0);
+	Sha256 h;
+	h.update((const unsigned char *)der.constData(), der.size());
+	h.final((unsigned char *)out.data());
+	return out;
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+ * qca_certder.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_CERTDER_H
+#define QCA_CERTDER_H
+
+// NOTE: this API is private to QCA
+
+#include <QByteArray>
+
+namespace QCA {
+
+// Where things are in the DER of an X.509 certificate, found without a
+// provider.  This only walks the outer structure, it doesn't check
+// anything the provider would.
+class CertDerField
+{
+public:
+	int offset, length;
+
+	CertDerField() : offset(0), length(0) {}
+
+	bool isEmpty() const { return length == 0; }
+	QByteArray from(const QByteArray &der) const { return der.mid(offset, length); }
+};
+
+class CertDerInfo
+{
+public:
+	CertDerField serial;            // INTEGER contents
+	CertDerField issuer, subject;   // the whole Name
+	CertDerField notBefore, notAfter; // the whole Time
+	CertDerField subjectKeyId;      // SKI contents
+	CertDerField authorityKeyId;    // AKI keyIdentifier contents
+};
+
+bool certDerInfo(const QByteArray &der, CertDerInfo *info);
+
+// Hash of a Name in a canonical form: string values are compared without
+// regard to case or runs of whitespace, as certificate path building does.
+// Two names that match always hash the same, the reverse needs checking.
+quint64 certNameHash(const QByteArray &der, const CertDerField &name);
+
+// Hash of a key identifier, never 0
+quint64 certKeyIdHash(const QByteArray &der, const CertDerField &keyId);
+
+// SHA-256 of the whole DER
+QByteArray certFingerprint(const QByteArray &der);
+
+}
+
+#endif
@@ -0,0 +1,595 @@
+/*
+ * qca_chacha.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_chacha.h"
+
+#include "qca_cpu.h"
+
+#include <string.h>
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+static inline quint32 load_le32(const unsigned char *p)
+{
+	return (quint32)p[0] | ((quint32)p[1] << 8) | ((quint32)p[2] << 16) | ((quint32)p[3] << 24);
+}
+
+static inline void store_le32(unsigned char *p, quint32 v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+//----------------------------------------------------------------------------
+// Portable ChaCha20
+//----------------------------------------------------------------------------
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define CHACHA_QR(a, b, c, d) \
+	a += b; d ^= a; d = CHACHA_ROTL(d, 16); \
+	c += d; b ^= c; b = CHACHA_ROTL(b, 12); \
+	a += b; d ^= a; d = CHACHA_ROTL(d, 8); \
+	c += d; b ^= c; b = CHACHA_ROTL(b, 7);
+
+// one block at a time, the counter in st[12] is advanced
+static void chacha_portable(quint32 *st, const unsigned char *in, unsigned char *out, int blocks)
+{
+	for(int b = 0; b < blocks; ++b)
+	{
+		quint32 x[16];
+		for(int i = 0; i < 16; ++i)
+			x[i] = st[i];
+		for(int i = 0; i < 10; ++i)
+		{
+			CHACHA_QR(x[0], x[4], x[8], x[12])
+			CHACHA_QR(x[1], x[5], x[9], x[13])
+			CHACHA_QR(x[2], x[6], x[10], x[14])
+			CHACHA_QR(x[3], x[7], x[11], x[15])
+			CHACHA_QR(x[0], x[5], x[10], x[15])
+			CHACHA_QR(x[1], x[6], x[11], x[12])
+			CHACHA_QR(x[2], x[7], x[8], x[13])
+			CHACHA_QR(x[3], x[4], x[9], x[14])
+		}
+		for(int i = 0; i < 16; ++i)
+			store_le32(out + 4 * i, load_le32(in + 4 * i) ^ (x[i] + st[i]));
+		++st[12];
+		in += 64;
+		out += 64;
+	}
+}
+
+// The vector kernels keep word i of several blocks in one register, block
+// k in lane k with counter st[12] + k, and transpose at the end.
+
+//----------------------------------------------------------------------------
+// SSE2, 4 blocks
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_SIMD)
+
+#define CHACHA_ROTL128(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define CHACHA_QR128(a, b, c, d) \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_ROTL128(d, 16); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL128(b, 12); \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_ROTL128(d, 8); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL128(b, 7);
+
+QCA_TARGET("sse2")
+static void chacha_sse2(quint32 *st, const unsigned char *in, unsigned char *out, int blocks)
+{
+	for(; blocks >= 4; blocks -= 4)
+	{
+		__m128i x[16], s[16];
+		for(int i = 0; i < 16; ++i)
+			s[i] = _mm_set1_epi32((int)st[i]);
+		s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+		for(int i = 0; i < 16; ++i)
+			x[i] = s[i];
+
+		for(int i = 0; i < 10; ++i)
+		{
+			CHACHA_QR128(x[0], x[4], x[8], x[12])
+			CHACHA_QR128(x[1], x[5], x[9], x[13])
+			CHACHA_QR128(x[2], x[6], x[10], x[14])
+			CHACHA_QR128(x[3], x[7], x[11], x[15])
+			CHACHA_QR128(x[0], x[5], x[10], x[15])
+			CHACHA_QR128(x[1], x[6], x[11], x[12])
+			CHACHA_QR128(x[2], x[7], x[8], x[13])
+			CHACHA_QR128(x[3], x[4], x[9], x[14])
+		}
+
+		for(int g = 0; g < 4; ++g)
+		{
+			__m128i a = _mm_add_epi32(x[4 * g], s[4 * g]);
+			__m128i b = _mm_add_epi32(x[4 * g + 1], s[4 * g + 1]);
+			__m128i c = _mm_add_epi32(x[4 * g + 2], s[4 * g + 2]);
+			__m128i d = _mm_add_epi32(x[4 * g + 3], s[4 * g + 3]);
+			__m128i t0 = _mm_unpacklo_epi32(a, b);
+			__m128i t1 = _mm_unpacklo_epi32(c, d);
+			__m128i t2 = _mm_unpackhi_epi32(a, b);
+			__m128i t3 = _mm_unpackhi_epi32(c, d);
+			__m128i k[4];
+			k[0] = _mm_unpacklo_epi64(t0, t1);
+			k[1] = _mm_unpackhi_epi64(t0, t1);
+			k[2] = _mm_unpacklo_epi64(t2, t3);
+			k[3] = _mm_unpackhi_epi64(t2, t3);
+			for(int n = 0; n < 4; ++n)
+			{
+				const __m128i *src = (const __m128i *)(in + 64 * n + 16 * g);
+				__m128i *dst = (__m128i *)(out + 64 * n + 16 * g);
+				_mm_storeu_si128(dst, _mm_xor_si128(_mm_loadu_si128(src), k[n]));
+			}
+		}
+
+		st[12] += 4;
+		in += 256;
+		out += 256;
+	}
+}
+
+//----------------------------------------------------------------------------
+// AVX2, 8 blocks
+//----------------------------------------------------------------------------
+#define CHACHA_ROTL256(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+// rotations by 16 and 8 are byte shuffles
+#define CHACHA_QR256(a, b, c, d) \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CHACHA_ROTL256(b, 12); \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CHACHA_ROTL256(b, 7);
+
+QCA_TARGET("avx2")
+static void chacha_avx2(quint32 *st, const unsigned char *in, unsigned char *out, int blocks)
+{
+	const __m256i rot16 = _mm256_set_epi8(
+		13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+		13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+	const __m256i rot8 = _mm256_set_epi8(
+		14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+		14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+
+	for(; blocks >= 8; blocks -= 8)
+	{
+		__m256i x[16], s[16];
+		for(int i = 0; i < 16; ++i)
+			s[i] = _mm256_set1_epi32((int)st[i]);
+		s[12] = _mm256_add_epi32(s[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+		for(int i = 0; i < 16; ++i)
+			x[i] = s[i];
+
+		for(int i = 0; i < 10; ++i)
+		{
+			CHACHA_QR256(x[0], x[4], x[8], x[12])
+			CHACHA_QR256(x[1], x[5], x[9], x[13])
+			CHACHA_QR256(x[2], x[6], x[10], x[14])
+			CHACHA_QR256(x[3], x[7], x[11], x[15])
+			CHACHA_QR256(x[0], x[5], x[10], x[15])
+			CHACHA_QR256(x[1], x[6], x[11], x[12])
+			CHACHA_QR256(x[2], x[7], x[8], x[13])
+			CHACHA_QR256(x[3], x[4], x[9], x[14])
+		}
+
+		for(int i = 0; i < 16; ++i)
+			x[i] = _mm256_add_epi32(x[i], s[i]);
+
+		// words 8 * g ... 8 * g + 7 of each block
+		for(int g = 0; g < 2; ++g)
+		{
+			const __m256i *a = x + 8 * g;
+			__m256i t0 = _mm256_unpacklo_epi32(a[0], a[1]);
+			__m256i t1 = _mm256_unpackhi_epi32(a[0], a[1]);
+			__m256i t2 = _mm256_unpacklo_epi32(a[2], a[3]);
+			__m256i t3 = _mm256_unpackhi_epi32(a[2], a[3]);
+			__m256i t4 = _mm256_unpacklo_epi32(a[4], a[5]);
+			__m256i t5 = _mm256_unpackhi_epi32(a[4], a[5]);
+			__m256i t6 = _mm256_unpacklo_epi32(a[6], a[7]);
+			__m256i t7 = _mm256_unpackhi_epi32(a[6], a[7]);
+			__m256i u[8];
+			u[0] = _mm256_unpacklo_epi64(t0, t2);
+			u[1] = _mm256_unpackhi_epi64(t0, t2);
+			u[2] = _mm256_unpacklo_epi64(t1, t3);
+			u[3] = _mm256_unpackhi_epi64(t1, t3);
+			u[4] = _mm256_unpacklo_epi64(t4, t6);
+			u[5] = _mm256_unpackhi_epi64(t4, t6);
+			u[6] = _mm256_unpacklo_epi64(t5, t7);
+			u[7] = _mm256_unpackhi_epi64(t5, t7);
+			for(int n = 0; n < 4; ++n)
+			{
+				__m256i lo = _mm256_permute2x128_si256(u[n], u[n + 4], 0x20);
+				__m256i hi = _mm256_permute2x128_si256(u[n], u[n + 4], 0x31);
+				const unsigned char *src = in + 64 * n + 32 * g;
+				unsigned char *dst = out + 64 * n + 32 * g;
+				_mm256_storeu_si256((__m256i *)dst, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)src), lo));
+				_mm256_storeu_si256((__m256i *)(dst + 256), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + 256)), hi));
+			}
+		}
+
+		st[12] += 8;
+		in += 512;
+		out += 512;
+	}
+}
+
+//----------------------------------------------------------------------------
+// AVX-512, 16 blocks
+//----------------------------------------------------------------------------
+#define CHACHA_ROTL512(v, n) _mm512_rol_epi32(v, n)
+
+#define CHACHA_QR512(a, b, c, d) \
+	a = _mm512_add_epi32(a, b); d = _mm512_xor_si512(d, a); d = CHACHA_ROTL512(d, 16); \
+	c = _mm512_add_epi32(c, d); b = _mm512_xor_si512(b, c); b = CHACHA_ROTL512(b, 12); \
+	a = _mm512_add_epi32(a, b); d = _mm512_xor_si512(d, a); d = CHACHA_ROTL512(d, 8); \
+	c = _mm512_add_epi32(c, d); b = _mm512_xor_si512(b, c); b = CHACHA_ROTL512(b, 7);
+
+QCA_TARGET("avx512f")
+static void chacha_avx512(quint32 *st, const unsigned char *in, unsigned char *out, int blocks)
+{
+	for(; blocks >= 16; blocks -= 16)
+	{
+		__m512i x[16], s[16];
+		for(int i = 0; i < 16; ++i)
+			s[i] = _mm512_set1_epi32((int)st[i]);
+		s[12] = _mm512_add_epi32(s[12], _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+		for(int i = 0; i < 16; ++i)
+			x[i] = s[i];
+
+		for(int i = 0; i < 10; ++i)
+		{
+			CHACHA_QR512(x[0], x[4], x[8], x[12])
+			CHACHA_QR512(x[1], x[5], x[9], x[13])
+			CHACHA_QR512(x[2], x[6], x[10], x[14])
+			CHACHA_QR512(x[3], x[7], x[11], x[15])
+			CHACHA_QR512(x[0], x[5], x[10], x[15])
+			CHACHA_QR512(x[1], x[6], x[11], x[12])
+			CHACHA_QR512(x[2], x[7], x[8], x[13])
+			CHACHA_QR512(x[3], x[4], x[9], x[14])
+		}
+
+		for(int i = 0; i < 16; ++i)
+			x[i] = _mm512_add_epi32(x[i], s[i]);
+
+		// 4x4 transposes within each 128 bit lane, then of the lanes
+		__m512i t[16], u[16];
+		for(int i = 0; i < 8; ++i)
+		{
+			t[2 * i] = _mm512_unpacklo_epi32(x[2 * i], x[2 * i + 1]);
+			t[2 * i + 1] = _mm512_unpackhi_epi32(x[2 * i], x[2 * i + 1]);
+		}
+		for(int i = 0; i < 4; ++i)
+		{
+			u[4 * i] = _mm512_unpacklo_epi64(t[4 * i], t[4 * i + 2]);
+			u[4 * i + 1] = _mm512_unpackhi_epi64(t[4 * i], t[4 * i + 2]);
+			u[4 * i + 2] = _mm512_unpacklo_epi64(t[4 * i + 1], t[4 * i + 3]);
+			u[4 * i + 3] = _mm512_unpackhi_epi64(t[4 * i + 1], t[4 * i + 3]);
+		}
+		for(int r = 0; r < 4; ++r)
+		{
+			__m512i v0 = _mm512_shuffle_i32x4(u[r], u[4 + r], 0x88);
+			__m512i v1 = _mm512_shuffle_i32x4(u[r], u[4 + r], 0xdd);
+			__m512i v2 = _mm512_shuffle_i32x4(u[8 + r], u[12 + r], 0x88);
+			__m512i v3 = _mm512_shuffle_i32x4(u[8 + r], u[12 + r], 0xdd);
+			__m512i k[4];
+			k[0] = _mm512_shuffle_i32x4(v0, v2, 0x88);
+			k[1] = _mm512_shuffle_i32x4(v1, v3, 0x88);
+			k[2] = _mm512_shuffle_i32x4(v0, v2, 0xdd);
+			k[3] = _mm512_shuffle_i32x4(v1, v3, 0xdd);
+			for(int l = 0; l < 4; ++l)
+			{
+				int b = 4 * l + r;
+				__m512i m = _mm512_loadu_si512((const void *)(in + 64 * b));
+				_mm512_storeu_si512((void *)(out + 64 * b), _mm512_xor_si512(m, k[l]));
+			}
+		}
+
+		st[12] += 16;
+		in += 1024;
+		out += 1024;
+	}
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// ChaCha20
+//----------------------------------------------------------------------------
+ChaCha20::ChaCha20()
+{
+	impl = Portable;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuSSE2))
+		impl = SSE2;
+	if(hasCpuFeatures(CpuAVX2))
+		impl = AVX2;
+	if(hasCpuFeatures(CpuAVX512))
+		impl = AVX512;
+#endif
+	memset(state, 0, sizeof(state));
+	memset(ks, 0, sizeof(ks));
+	used = 64;
+}
+
+ChaCha20::~ChaCha20()
+{
+	volatile quint32 *p = state;
+	for(int n = 0; n < 16; ++n)
+		p[n] = 0;
+	volatile unsigned char *q = ks;
+	for(int n = 0; n < 64; ++n)
+		q[n] = 0;
+}
+
+void ChaCha20::setKey(const unsigned char *key)
+{
+	// "expand 32-byte k"
+	state[0] = 0x61707865;
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+	for(int n = 0; n < 8; ++n)
+		state[4 + n] = load_le32(key + 4 * n);
+	used = 64;
+}
+
+void ChaCha20::setNonce(const unsigned char *nonce, quint32 counter)
+{
+	state[12] = counter;
+	for(int n = 0; n < 3; ++n)
+		state[13 + n] = load_le32(nonce + 4 * n);
+	used = 64;
+}
+
+void ChaCha20::crypt(const unsigned char *in, unsigned char *out, int len)
+{
+	while(len > 0 && used < 64)
+	{
+		*(out++) = *(in++) ^ ks[used++];
+		--len;
+	}
+
+	int blocks = len / 64;
+	while(blocks > 0)
+	{
+		// the kernels only count in state[12], so stop where it wraps
+		//   and carry into state[13] the way OpenSSL does
+		quint64 untilWrap = Q_UINT64_C(0x100000000) - state[12];
+		int n = ((quint64)blocks > untilWrap) ? (int)untilWrap : blocks;
+		cryptBlocks(in, out, n);
+		if(state[12] == 0)
+			++state[13];
+		in += 64 * n;
+		out += 64 * n;
+		len -= 64 * n;
+		blocks -= n;
+	}
+
+	if(len > 0)
+	{
+		memset(ks, 0, 64);
+		chacha_portable(state, ks, ks, 1);
+		if(state[12] == 0)
+			++state[13];
+		used = 0;
+		while(len > 0)
+		{
+			*(out++) = *(in++) ^ ks[used++];
+			--len;
+		}
+	}
+}
+
+void ChaCha20::cryptBlocks(const unsigned char *in, unsigned char *out, int blocks)
+{
+	int done = 0;
+	switch(impl)
+	{
+#if defined(QCA_X86_SIMD)
+		case AVX512:
+			done = blocks & ~15;
+			chacha_avx512(state, in, out, done);
+			// fall through
+		case AVX2:
+			chacha_avx2(state, in + 64 * done, out + 64 * done, (blocks - done) & ~7);
+			done += (blocks - done) & ~7;
+			// fall through
+		case SSE2:
+			chacha_sse2(state, in + 64 * done, out + 64 * done, (blocks - done) & ~3);
+			done += (blocks - done) & ~3;
+			break;
+#endif
+		default:
+			break;
+	}
+	chacha_portable(state, in + 64 * done, out + 64 * done, blocks - done);
+}
+
+const char *ChaCha20::implementation() const
+{
+	switch(impl)
+	{
+		case AVX512:
+			return "avx512";
+		case AVX2:
+			return "avx2";
+		case SSE2:
+			return "sse2";
+		default:
+			return "portable";
+	}
+}
+
+//----------------------------------------------------------------------------
+// Poly1305
+//----------------------------------------------------------------------------
+
+// h is kept in five 26 bit limbs, so the products fit in 64 bits.  The
+// final reduction is done with masks rather than branches.
+Poly1305::Poly1305()
+{
+	memset(r, 0, sizeof(r));
+	memset(h, 0, sizeof(h));
+	memset(pad, 0, sizeof(pad));
+	memset(buf, 0, sizeof(buf));
+	used = 0;
+}
+
+Poly1305::~Poly1305()
+{
+	volatile quint32 *p = r;
+	for(int n = 0; n < 5; ++n)
+		p[n] = 0;
+	p = pad;
+	for(int n = 0; n < 4; ++n)
+		p[n] = 0;
+}
+
+void Poly1305::setKey(const unsigned char *key)
+{
+	// r is clamped
+	r[0] = load_le32(key) & 0x3ffffff;
+	r[1] = (load_le32(key + 3) >> 2) & 0x3ffff03;
+	r[2] = (load_le32(key + 6) >> 4) & 0x3ffc0ff;
+	r[3] = (load_le32(key + 9) >> 6) & 0x3f03fff;
+	r[4] = (load_le32(key + 12) >> 8) & 0x00fffff;
+	for(int n = 0; n < 4; ++n)
+		pad[n] = load_le32(key + 16 + 4 * n);
+	memset(h, 0, sizeof(h));
+	used = 0;
+}
+
+void Poly1305::blocks(const unsigned char *m, int len, quint32 hibit)
+{
+	const quint32 r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4];
+	const quint32 s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+	quint32 h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+	while(len >= 16)
+	{
+		h0 += load_le32(m) & 0x3ffffff;
+		h1 += (load_le32(m + 3) >> 2) & 0x3ffffff;
+		h2 += (load_le32(m + 6) >> 4) & 0x3ffffff;
+		h3 += (load_le32(m + 9) >> 6) & 0x3ffffff;
+		h4 += (load_le32(m + 12) >> 8) | hibit;
+
+		quint64 d0 = (quint64)h0 * r0 + (quint64)h1 * s4 + (quint64)h2 * s3 + (quint64)h3 * s2 + (quint64)h4 * s1;
+		quint64 d1 = (quint64)h0 * r1 + (quint64)h1 * r0 + (quint64)h2 * s4 + (quint64)h3 * s3 + (quint64)h4 * s2;
+		quint64 d2 = (quint64)h0 * r2 + (quint64)h1 * r1 + (quint64)h2 * r0 + (quint64)h3 * s4 + (quint64)h4 * s3;
+		quint64 d3 = (quint64)h0 * r3 + (quint64)h1 * r2 + (quint64)h2 * r1 + (quint64)h3 * r0 + (quint64)h4 * s4;
+		quint64 d4 = (quint64)h0 * r4 + (quint64)h1 * r3 + (quint64)h2 * r2 + (quint64)h3 * r1 + (quint64)h4 * r0;
+
+		quint32 c;
+		c = (quint32)(d0 >> 26); h0 = (quint32)d0 & 0x3ffffff;
+		d1 += c; c = (quint32)(d1 >> 26); h1 = (quint32)d1 & 0x3ffffff;
+		d2 += c; c = (quint32)(d2 >> 26); h2 = (quint32)d2 & 0x3ffffff;
+		d3 += c; c = (quint32)(d3 >> 26); h3 = (quint32)d3 & 0x3ffffff;
+		d4 += c; c = (quint32)(d4 >> 26); h4 = (quint32)d4 & 0x3ffffff;
+		h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+		h1 += c;
+
+		m += 16;
+		len -= 16;
+	}
+
+	h[0] = h0;
+	h[1] = h1;
+	h[2] = h2;
+	h[3] = h3;
+	h[4] = h4;
+}
+
+void Poly1305::update(const unsigned char *data, int len)
+{
+	if(used > 0)
+	{
+		int take = qMin(16 - used, len);
+		memcpy(buf + used, data, take);
+		used += take;
+		data += take;
+		len -= take;
+		if(used < 16)
+			return;
+		blocks(buf, 16, 1 << 24);
+		used = 0;
+	}
+
+	int whole = len & ~15;
+	if(whole > 0)
+		blocks(data, whole, 1 << 24);
+	memcpy(buf, data + whole, len - whole);
+	used = len - whole;
+}
+
+void Poly1305::final(unsigned char *mac)
+{
+	// a partial block gets a 1 byte after the data instead of the high bit
+	if(used > 0)
+	{
+		buf[used] = 1;
+		for(int n = used + 1; n < 16; ++n)
+			buf[n] = 0;
+		blocks(buf, 16, 0);
+		used = 0;
+	}
+
+	quint32 h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+	quint32 c;
+	c = h1 >> 26; h1 &= 0x3ffffff;
+	h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+	h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+	h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+	h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+	h1 += c;
+
+	// g = h + 5 - 2^130, which is used if it doesn't go negative
+	quint32 g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+	quint32 g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+	quint32 g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+	quint32 g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+	quint32 g4 = h4 + c - (1 << 26);
+
+	quint32 mask = (g4 >> 31) - 1;
+	h0 = (h0 & ~mask) | (g0 & mask);
+	h1 = (h1 & ~mask) | (g1 & mask);
+	h2 = (h2 & ~mask) | (g2 & mask);
+	h3 = (h3 & ~mask) | (g3 & mask);
+	h4 = (h4 & ~mask) | (g4 & mask);
+
+	// h mod 2^128, then add the pad
+	quint32 w0 = h0 | (h1 << 26);
+	quint32 w1 = (h1 >> 6) | (h2 << 20);
+	quint32 w2 = (h2 >> 12) | (h3 << 14);
+	quint32 w3 = (h3 >> 18) | (h4 << 8);
+
+	quint64 f;
+	f = (quint64)w0 + pad[0]; store_le32(mac, (quint32)f);
+	f = (quint64)w1 + pad[1] + (f >> 32); store_le32(mac + 4, (quint32)f);
+	f = (quint64)w2 + pad[2] + (f >> 32); store_le32(mac + 8, (quint32)f);
+	f = (quint64)w3 + pad[3] + (f >> 32); store_le32(mac + 12, (quint32)f);
+
+	memset(h, 0, sizeof(h));
+}
+
+}
@@ -0,0 +1,89 @@
+/*
+ * qca_chacha.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_CHACHA_H
+#define QCA_CHACHA_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// ChaCha20 stream cipher as in RFC 8439: 256 bit key, 96 bit nonce and a
+// 32 bit block counter.  Depending on the CPU, 16 (AVX-512), 8 (AVX2) or
+// 4 (SSE2) blocks are computed side by side.
+class ChaCha20
+{
+public:
+	ChaCha20();
+	~ChaCha20();
+
+	// key is 32 bytes
+	void setKey(const unsigned char *key);
+
+	// nonce is 12 bytes, this also discards any buffered keystream
+	void setNonce(const unsigned char *nonce, quint32 counter);
+
+	// out = in ^ keystream, continuing from where the last call stopped.
+	// when the 32-bit block counter wraps, it carries into the first
+	// nonce word
+	void crypt(const unsigned char *in, unsigned char *out, int len);
+
+	// name of the implementation in use, for diagnostics
+	const char *implementation() const;
+
+private:
+	enum Impl { Portable, SSE2, AVX2, AVX512 };
+
+	Impl impl;
+	quint32 state[16];
+	unsigned char ks[64];
+	int used;
+
+	// whole blocks, without the counter wrapping part way
+	void cryptBlocks(const unsigned char *in, unsigned char *out, int blocks);
+};
+
+// Poly1305 one-time authenticator (RFC 8439), 32 byte key and 16 byte tag
+class Poly1305
+{
+public:
+	Poly1305();
+	~Poly1305();
+
+	// starts a new message
+	void setKey(const unsigned char *key);
+	void update(const unsigned char *data, int len);
+	void final(unsigned char *mac);
+
+private:
+	quint32 r[5];
+	quint32 h[5];
+	quint32 pad[4];
+	unsigned char buf[16];
+	int used;
+
+	void blocks(const unsigned char *data, int len, quint32 hibit);
+};
+
+}
+
+#endif
@@ -27,16 +27,24 @@
 #include "qca_cert.h"
 #include "qca_keystore.h"
 #include "qcaprovider.h"
+#include "qca_calibrate.h"
+#include "qca_cpu.h"
+#include "qca_hex.h"
 
 // for qAddPostRoutine
 #include <QCoreApplication>
 
+#include <QCryptographicHash>
 #include <QMutex>
+#include <QSet>
 #include <QSettings>
+#include <QSysInfo>
 #include <QVariantMap>
 #include <QWaitCondition>
 #include <QDir>
 
+#include <string.h>
+
 #ifdef Q_OS_UNIX
 # include <unistd.h>
 #endif
@@ -74,6 +82,10 @@ void botan_deinit();
 
 // from qca_default
 Provider *create_default_provider();
+CertificateCollection default_system_store(Provider *defaultProvider);
+
+// from qca_basic
+void invalidate_random_reservoirs();
 
 //----------------------------------------------------------------------------
 // Global
@@ -97,6 +109,14 @@ public:
 	QMap<QString,QVariantMap> config;
 	QMutex config_mutex;
 	QMutex logger_mutex;
+	bool calibrate;
+	QSet<QString> calibrated;
+	QMutex calibrate_mutex;
+	QMutex calibrate_run_mutex;
+	CertificateCollection system_store;
+	bool system_store_valid;
+	int system_store_generation;
+	QMutex system_store_mutex;
 
 	Global()
 	{
@@ -104,16 +124,21 @@ public:
 		secmem = false;
 		loaded = false;
 		first_scan = false;
+		calibrate = (qgetenv("QCA_CALIBRATE_PROVIDERS") == "1");
 		rng = 0;
 		logger = 0;
 		manager = new ProviderManager;
+		system_store_valid = false;
+		system_store_generation = 0;
 	}
 
 	~Global()
 	{
 		KeyStoreManager::shutdown();
+		invalidate_system_store();
 		delete rng;
 		rng = 0;
+		invalidate_random_reservoirs();
 		delete manager;
 		manager = 0;
 		delete logger;
@@ -151,6 +176,26 @@ public:
 		first_scan = true;
 		manager->scan();
 		scan_mutex.unlock();
+
+		// new providers may have turned up, so check the features
+		//   again on next use
+		calibrate_mutex.lock();
+		calibrated.clear();
+		calibrate_mutex.unlock();
+
+		invalidate_system_store();
+	}
+
+	void invalidate_system_store()
+	{
+		// the old snapshot is released outside of the lock
+		CertificateCollection old;
+		system_store_mutex.lock();
+		old = system_store;
+		system_store = CertificateCollection();
+		system_store_valid = false;
+		++system_store_generation;
+		system_store_mutex.unlock();
 	}
 
 	void ksm_scan()
@@ -175,6 +220,7 @@ public:
 	void unloadAllPlugins()
 	{
 		KeyStoreManager::shutdown();
+		invalidate_system_store();
 
 		// if the global_rng was owned by a plugin, then delete it
 		rng_mutex.lock();
@@ -182,10 +228,15 @@ public:
 		{
 			delete rng;
 			rng = 0;
+			invalidate_random_reservoirs();
 		}
 		rng_mutex.unlock();
 
 		manager->unloadAll();
+
+		// a systemStore() call may have loaded the snapshot again
+		//   before the plugins went away
+		invalidate_system_store();
 	}
 };
 
@@ -403,7 +454,10 @@ bool insertProvider(Provider *p, int priority)
 
 	global->ensure_first_scan();
 
-	return global->manager->add(p, priority);
+	bool ok = global->manager->add(p, priority);
+	if(ok)
+		global->invalidate_system_store();
+	return ok;
 }
 
 bool unloadProvider(const QString &name)
@@ -413,7 +467,14 @@ bool unloadProvider(const QString &name)
 
 	global->ensure_first_scan();
 
-	return global->manager->unload(name);
+	// the snapshot may hold certificates from this provider.  it is
+	//   dropped before the unload, so that they are freed while the
+	//   provider is still there, and again after it, in case a
+	//   systemStore() call loaded them in between
+	global->invalidate_system_store();
+	bool ok = global->manager->unload(name);
+	global->invalidate_system_store();
+	return ok;
 }
 
 void setProviderPriority(const QString &name, int priority)
@@ -436,6 +497,171 @@ int providerPriority(const QString &name)
 	return global->manager->getPriority(name);
 }
 
+// identifies the host, its processor and the loaded providers, so saved
+//   calibration results are only reused where they were measured
+static QString calibrationSignature()
+{
+	QStringList parts;
+#if QT_VERSION >= 0x050600
+	parts += QSysInfo::machineHostName();
+	parts += QSysInfo::currentCpuArchitecture();
+#endif
+	parts += QString::number(cpuFeatures(), 16);
+
+	ProviderList list = global->manager->providers();
+	list += global->manager->find("default");
+	QStringList names;
+	foreach(Provider *p, list)
+	{
+		if(p)
+			names += p->name() + ':' + QString::number(p->version(), 16);
+	}
+	names.sort();
+	parts += names;
+
+	return QString::fromLatin1(QCryptographicHash::hash(parts.join("\n").toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+static QString readCalibration(const QString &signature, const QString &type)
+{
+	QSettings settings("Affinix", "QCA2");
+	settings.beginGroup("ProviderCalibration");
+	settings.beginGroup(signature);
+	return settings.value(type).toString();
+}
+
+static void writeCalibration(const QString &signature, const QString &type, const QString &name)
+{
+	QSettings settings("Affinix", "QCA2");
+	settings.beginGroup("ProviderCalibration");
+	settings.beginGroup(signature);
+	settings.setValue(type, name);
+}
+
+// chooses the fastest provider for type, using the saved choice if
+//   allowed and there is one.  nothing is chosen if fewer than two
+//   providers have the feature.
+static void calibrateFeature(const QString &type, const QString &signature, bool useSaved)
+{
+	if(!isMeasurable(type))
+		return;
+
+	ProviderList list = global->manager->providers();
+	list += global->manager->find("default");
+	ProviderList capable;
+	foreach(Provider *p, list)
+	{
+		if(p && p->features().contains(type))
+			capable += p;
+	}
+	if(capable.count() < 2)
+		return;
+
+	if(useSaved)
+	{
+		QString name = readCalibration(signature, type);
+		foreach(Provider *p, capable)
+		{
+			if(p->name() == name)
+			{
+				global->manager->setPreferred(type, name);
+				return;
+			}
+		}
+	}
+
+	Provider *best = 0;
+	double bestCost = 0;
+	foreach(Provider *p, capable)
+	{
+		double cost = measureProvider(p, type);
+		if(cost >= 0 && (!best || cost < bestCost))
+		{
+			best = p;
+			bestCost = cost;
+		}
+	}
+	if(!best)
+		return;
+
+	global->manager->setPreferred(type, best->name());
+	writeCalibration(signature, type, best->name());
+}
+
+// calibrates type on first use, if calibration is enabled
+static void ensureCalibrated(const QString &type)
+{
+	{
+		QMutexLocker locker(&global->calibrate_mutex);
+		if(!global->calibrate || global->calibrated.contains(type))
+			return;
+	}
+
+	// measured one at a time.  the type is only marked once the choice
+	//   is stored, so other callers wait here instead of picking a
+	//   provider while it is being measured
+	QMutexLocker run(&global->calibrate_run_mutex);
+	{
+		QMutexLocker locker(&global->calibrate_mutex);
+		if(global->calibrated.contains(type))
+			return;
+	}
+
+	calibrateFeature(type, calibrationSignature(), true);
+
+	QMutexLocker locker(&global->calibrate_mutex);
+	global->calibrated += type;
+}
+
+void setProviderCalibration(bool enabled)
+{
+	if(!global_check_load())
+		return;
+
+	QMutexLocker locker(&global->calibrate_mutex);
+	global->calibrate = enabled;
+}
+
+bool providerCalibration()
+{
+	if(!global_check_load())
+		return false;
+
+	QMutexLocker locker(&global->calibrate_mutex);
+	return global->calibrate;
+}
+
+void calibrateProviders(const QStringList &features)
+{
+	if(!global_check_load())
+		return;
+
+	global->ensure_first_scan();
+
+	QStringList types = features;
+	if(types.isEmpty())
+		types = global->manager->allFeatures();
+
+	QString signature = calibrationSignature();
+	foreach(const QString &type, types)
+	{
+		QMutexLocker run(&global->calibrate_run_mutex);
+		calibrateFeature(type, signature, false);
+
+		global->calibrate_mutex.lock();
+		global->calibrated += type;
+		global->calibrate_mutex.unlock();
+	}
+}
+
+QMap<QString,QString> calibratedProviders()
+{
+	if(!global_check_load())
+		return QMap<QString,QString>();
+
+	return global->manager->preferred();
+}
+
 Provider *findProvider(const QString &name)
 {
 	if(!global_check_load())
@@ -626,6 +852,9 @@ void setProviderConfig(const QString &name, const QVariantMap &config)
 	Provider *p = findProvider(name);
 	if(p)
 		p->configChanged(config);
+
+	// the default provider's config names the roots file
+	global->invalidate_system_store();
 }
 
 QVariantMap getProviderConfig(const QString &name)
@@ -728,6 +957,7 @@ void setGlobalRandomProvider(const QString &provider)
 	QMutexLocker locker(global_random_mutex());
 	delete global->rng;
 	global->rng = new Random(provider);
+	invalidate_random_reservoirs();
 }
 
 Logger *logger()
@@ -752,8 +982,28 @@ bool haveSystemStore()
 	return false;
 }
 
+void invalidate_system_store()
+{
+	if(global)
+		global->invalidate_system_store();
+}
+
 CertificateCollection systemStore()
 {
+	if(!global_check())
+		return CertificateCollection();
+
+	// the snapshot is implicitly shared, so handing it out is just a
+	//   reference count.  it is dropped when the store's files change
+	//   (see DefaultKeyStoreList) or the providers do
+	int generation;
+	{
+		QMutexLocker locker(&global->system_store_mutex);
+		if(global->system_store_valid)
+			return global->system_store;
+		generation = global->system_store_generation;
+	}
+
 	// ensure the system store is loaded
 	KeyStoreManager::start("default");
 	KeyStoreManager ksm;
@@ -768,6 +1018,14 @@ CertificateCollection systemStore()
 		// system store
 		if(ks.type() == KeyStore::System && ks.holdsTrustedCertificates())
 		{
+			// the default store is read from its files directly, as its
+			//   entries would decode every root of a trust store file
+			if(ks.id() == "qca-default-systemstore")
+			{
+				col = default_system_store(global->manager->find("default"));
+				break;
+			}
+
 			// extract contents
 			QList<KeyStoreEntry> entries = ks.entryList();
 			for(int i = 0; i < entries.count(); ++i)
@@ -780,6 +1038,19 @@ CertificateCollection systemStore()
 			break;
 		}
 	}
+
+	// the lock isn't held while loading, as the keystore thread may be
+	//   invalidating at the same time.  an empty result usually means
+	//   the keystore wasn't ready yet, so it is not kept
+	if(col.trustStoreFile().isNull() && col.certificates().isEmpty() && col.crls().isEmpty())
+		return col;
+
+	QMutexLocker locker(&global->system_store_mutex);
+	if(global->system_store_generation == generation)
+	{
+		global->system_store = col;
+		global->system_store_valid = true;
+	}
 	return col;
 }
 
@@ -803,14 +1074,31 @@ void setAppName(const QString &s)
 	global->app_name = s;
 }
 
+// These two go straight between the QString and the QByteArray, rather
+// than through Hex and a Latin-1 copy of the text.
 QString arrayToHex(const QByteArray &a)
 {
-	return Hex().arrayToString(a);
+	if(a.isEmpty())
+		return QString();
+
+	QString out;
+	out.resize(a.size() * 2);
+	hexEncode((const unsigned char *)a.constData(), a.size(), reinterpret_cast<ushort *>(out.data()));
+	return out;
 }
 
 QByteArray hexToArray(const QString &str)
 {
-	return Hex().stringToArray(str).toByteArray();
+	// like Hex, an odd length or a character that isn't a hex digit gives
+	// an empty array
+	if(str.isEmpty() || str.size() % 2)
+		return QByteArray();
+
+	QByteArray out;
+	out.resize(str.size() / 2);
+	if(!hexDecode(str.utf16(), out.size(), (unsigned char *)out.data()))
+		return QByteArray();
+	return out;
 }
 
 QString arrayToBase64(const QByteArray &a)
@@ -841,6 +1129,8 @@ static Provider *getProviderForType(const QString &type, const QString &provider
 	}
 	if(!p)
 	{
+		ensureCalibrated(type);
+
 		// try using some other provider
 		p = global->manager->findFor(QString(), type);
 
@@ -1018,6 +1308,127 @@ QStringList InfoContext::supportedMACTypes() const
 	return QStringList();
 }
 
+//----------------------------------------------------------------------------
+// CipherContext
+//----------------------------------------------------------------------------
+bool CipherContext::processBatch(Direction dir, const SymmetricKey &key, const QVector<Cipher::Record> &records, QList<int> *failed)
+{
+	bool all = true;
+	for(int n = 0; n < records.count(); ++n)
+	{
+		const Cipher::Record &r = records[n];
+		bool ok = false;
+		if(r.aadSize == 0 && r.size >= 0 && r.tagSize >= 0)
+		{
+			AuthTag tag(r.tagSize);
+			if(dir == Decode && r.tagSize > 0)
+				memcpy(tag.data(), r.tag, r.tagSize);
+			setup(dir, key, InitializationVector(QByteArray(r.nonce, r.nonceSize)), tag);
+
+			SecureArray in(QByteArray::fromRawData(r.in, r.size));
+			SecureArray out, last;
+			if(update(in, &out) && final(&last) && out.size() + last.size() == r.size)
+			{
+				memcpy(r.out, out.data(), out.size());
+				memcpy(r.out + out.size(), last.data(), last.size());
+				ok = true;
+				if(dir == Encode && r.tagSize > 0)
+				{
+					AuthTag result = this->tag();
+					ok = (result.size() == r.tagSize);
+					if(ok)
+						memcpy(r.tag, result.data(), r.tagSize);
+				}
+			}
+		}
+		if(!ok)
+		{
+			failed->append(n);
+			all = false;
+		}
+	}
+	return all;
+}
+
+//----------------------------------------------------------------------------
+// CertContext
+//----------------------------------------------------------------------------
+BigInteger CertContext::serialNumber() const
+{
+	return props()->serial;
+}
+
+QDateTime CertContext::notValidBefore() const
+{
+	return props()->start;
+}
+
+QDateTime CertContext::notValidAfter() const
+{
+	return props()->end;
+}
+
+//----------------------------------------------------------------------------
+// KDFContext
+//----------------------------------------------------------------------------
+SymmetricKey KDFContext::makeKeyWithParameters(const SecureArray &secret, const InitializationVector &salt,
+											   unsigned int keyLength, const KeyDerivationFunction::Parameters &parameters)
+{
+	return makeKey(secret, salt, keyLength, parameters.timeCost);
+}
+
+QList<SymmetricKey> KDFContext::makeKeys(const QList<KeyDerivationFunction::Job> &jobs)
+{
+	QList<SymmetricKey> keys;
+	foreach(const KeyDerivationFunction::Job &job, jobs)
+		keys += makeKey(job.secret, job.salt, job.keyLength, job.iterationCount);
+	return keys;
+}
+
+//----------------------------------------------------------------------------
+// HKDFContext
+//----------------------------------------------------------------------------
+static QString hkdfHmacType(const QString &hkdfType)
+{
+	// "hkdf(sha256)" -> "hmac(sha256)"
+	return QStringLiteral("hmac") + hkdfType.mid(4);
+}
+
+SymmetricKey HKDFContext::extract(const SecureArray &secret, const InitializationVector &salt)
+{
+	// HMAC pads its key with zeros, so a single zero byte is the same key
+	// as the HashLen zeros that stand for an absent salt
+	SymmetricKey key = salt.isEmpty() ? SymmetricKey(SecureArray(1, 0)) : SymmetricKey(salt);
+	if(!isSupported(QStringList(hkdfHmacType(type())), provider()->name()))
+		return SymmetricKey();
+	MessageAuthenticationCode hmac(hkdfHmacType(type()), key, provider()->name());
+	hmac.update(secret);
+	return hmac.final();
+}
+
+SymmetricKey HKDFContext::expand(const SymmetricKey &prk, const InitializationVector &info,
+								 unsigned int keyLength)
+{
+	if(!isSupported(QStringList(hkdfHmacType(type())), provider()->name()))
+		return SymmetricKey();
+	MessageAuthenticationCode hmac(hkdfHmacType(type()), prk, provider()->name());
+	SecureArray out;
+	SecureArray t;
+	for(int i = 1; (unsigned int)out.size() < keyLength; ++i)
+	{
+		if(i > 255)
+			return SymmetricKey();
+		hmac.update(t);
+		hmac.update(info);
+		hmac.update(SecureArray(1, (char)i));
+		t = hmac.final();
+		out += t;
+		hmac.clear();
+	}
+	out.resize(keyLength);
+	return out;
+}
+
 //----------------------------------------------------------------------------
 // PKeyBase
 //----------------------------------------------------------------------------
@@ -1273,6 +1684,10 @@ MemoryRegion Filter::process(const MemoryRegion &a)
 	MemoryRegion fin = final();
 	if(!ok())
 		return MemoryRegion();
+	if(fin.isEmpty())
+		return buf;
+	if(buf.isEmpty())
+		return fin;
 	if(buf.isSecure() || fin.isSecure())
 		return (SecureArray(buf) + SecureArray(fin));
 	else
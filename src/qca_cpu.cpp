@@ -0,0 +1,139 @@
+/*
+ * qca_cpu.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_cpu.h"
+
+#include <QByteArray>
+
+#if defined(QCA_X86_SIMD)
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+#endif
+
+namespace QCA {
+
+#if defined(QCA_X86_SIMD)
+static void cpuid(unsigned int leaf, unsigned int sub, unsigned int *r)
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuidex(regs, (int)leaf, (int)sub);
+	for(int n = 0; n < 4; ++n)
+		r[n] = (unsigned int)regs[n];
+#else
+	__cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static quint64 xgetbv()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((quint64)edx << 32) | eax;
+#endif
+}
+
+static int detect_features()
+{
+	unsigned int r[4];
+	int out = 0;
+
+	cpuid(0, 0, r);
+	unsigned int maxLeaf = r[0];
+	if(maxLeaf < 1)
+		return 0;
+
+	cpuid(1, 0, r);
+	unsigned int ecx1 = r[2];
+	unsigned int edx1 = r[3];
+	if(edx1 & (1u << 26))
+		out |= CpuSSE2;
+	if(ecx1 & (1u << 9))
+		out |= CpuSSSE3;
+	if(ecx1 & (1u << 19))
+		out |= CpuSSE41;
+	if(ecx1 & (1u << 25))
+		out |= CpuAESNI;
+	if(ecx1 & (1u << 1))
+		out |= CpuPCLMUL;
+
+	// the wider registers also need to be saved by the operating system
+	bool ymm = false;
+	bool zmm = false;
+	if((ecx1 & (1u << 27)) && (ecx1 & (1u << 28)))
+	{
+		quint64 xcr0 = xgetbv();
+		ymm = (xcr0 & 0x06) == 0x06;
+		zmm = (xcr0 & 0xe6) == 0xe6;
+	}
+
+	if(maxLeaf >= 7)
+	{
+		cpuid(7, 0, r);
+		unsigned int ebx7 = r[1];
+		unsigned int ecx7 = r[2];
+		if(ebx7 & (1u << 29))
+			out |= CpuSHA;
+		if(ymm && (ebx7 & (1u << 5)))
+		{
+			out |= CpuAVX2;
+			if(ecx7 & (1u << 9))
+				out |= CpuVAES;
+			if(ecx7 & (1u << 10))
+				out |= CpuVPCLMUL;
+			if(zmm && (ebx7 & (1u << 16)) && (ebx7 & (1u << 30)) && (ebx7 & (1u << 31)))
+				out |= CpuAVX512;
+		}
+	}
+
+	return out;
+}
+#elif defined(QCA_ARM_NEON)
+static int detect_features()
+{
+	return CpuNEON;
+}
+#else
+static int detect_features()
+{
+	return 0;
+}
+#endif
+
+static int init_features()
+{
+	if(qgetenv("QCA_NO_SIMD") == "1")
+		return 0;
+	return detect_features();
+}
+
+int cpuFeatures()
+{
+	static const int features = init_features();
+	return features;
+}
+
+}
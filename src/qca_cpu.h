@@ -0,0 +1,78 @@
+/*
+ * qca_cpu.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_CPU_H
+#define QCA_CPU_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+// QCA_X86_SIMD is defined when the compiler can build functions for x86
+// instruction set extensions next to generic code, so the fast paths can
+// be chosen at runtime.  QCA_TARGET() marks such a function.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	((defined(__clang__) && (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8))) || \
+	 (!defined(__clang__) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+# define QCA_X86_SIMD
+# define QCA_TARGET(x) __attribute__((target(x)))
+# if defined(__clang__) || __GNUC__ >= 8
+#  define QCA_X86_VAES
+# endif
+#elif defined(_MSC_VER) && _MSC_VER >= 1910 && (defined(_M_X64) || defined(_M_IX86))
+# define QCA_X86_SIMD
+# define QCA_X86_VAES
+# define QCA_TARGET(x)
+#endif
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+# define QCA_ARM_NEON
+#endif
+
+namespace QCA {
+
+enum CpuFeature
+{
+	CpuSSE2      = 0x0001,
+	CpuSSSE3     = 0x0002,
+	CpuSSE41     = 0x0004,
+	CpuAVX2      = 0x0008,
+	CpuAESNI     = 0x0010,
+	CpuPCLMUL    = 0x0020,
+	CpuVAES      = 0x0040, // 256 bit VAES, implies AVX2
+	CpuVPCLMUL   = 0x0080, // 256 bit VPCLMULQDQ, implies AVX2
+	CpuAVX512    = 0x0100, // F, BW and VL
+	CpuSHA       = 0x0200,
+	CpuNEON      = 0x0400
+};
+
+// Instruction set extensions usable by this process, a combination of
+// CpuFeature values.  Setting QCA_NO_SIMD=1 in the environment restricts
+// QCA to its portable code.
+int cpuFeatures();
+
+inline bool hasCpuFeatures(int features)
+{
+	return (cpuFeatures() & features) == features;
+}
+
+}
+
+#endif
@@ -21,10 +21,20 @@
 
 #include "qca_core.h"
 
+#include <QElapsedTimer>
 #include <QMutex>
 #include "qca_textfilter.h"
 #include "qca_cert.h"
+#include "qca_support.h"
 #include "qcaprovider.h"
+#include "qca_aes.h"
+#include "qca_argon2.h"
+#include "qca_chacha.h"
+#include "qca_ghash.h"
+#include "qca_scrypt.h"
+#include "qca_sha2.h"
+
+#include <string.h>
 
 #ifndef QCA_NO_SYSTEMSTORE
 # include "qca_systemstore.h"
@@ -34,6 +44,9 @@
 
 namespace QCA {
 
+// from qca_core
+void invalidate_system_store();
+
 class DefaultShared
 {
 private:
@@ -786,6 +799,1060 @@ public:
 	}
 };
 
+//----------------------------------------------------------------------------
+// DefaultSHA2Context
+//----------------------------------------------------------------------------
+// H is Sha256 or Sha512
+template<class H>
+class DefaultSHA2Context : public HashContext
+{
+public:
+	DefaultSHA2Context(Provider *p, const QString &type) : HashContext(p, type)
+	{
+		clear();
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultSHA2Context<H>(*this);
+	}
+
+	virtual void clear()
+	{
+		secure = true;
+		m_hash.clear();
+	}
+
+	virtual void update(const MemoryRegion &in)
+	{
+		if(!in.isSecure())
+			secure = false;
+		m_hash.update((const unsigned char *)in.data(), in.size());
+	}
+
+	virtual MemoryRegion final()
+	{
+		if(secure)
+		{
+			SecureArray b(H::DigestSize, 0);
+			m_hash.final((unsigned char *)b.data());
+			return b;
+		}
+		else
+		{
+			QByteArray b(H::DigestSize, 0);
+			m_hash.final((unsigned char *)b.data());
+			return b;
+		}
+	}
+
+private:
+	H m_hash;
+	bool secure;
+};
+
+//----------------------------------------------------------------------------
+// DefaultPbkdf2Context
+//----------------------------------------------------------------------------
+class DefaultPbkdf2Context : public KDFContext
+{
+public:
+	DefaultPbkdf2Context(Provider *p, const QString &type) : KDFContext(p, type)
+	{
+		m_sha512 = (type == "pbkdf2(sha512)");
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultPbkdf2Context(*this);
+	}
+
+	virtual SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt,
+								 unsigned int keyLength, unsigned int iterationCount)
+	{
+		SecureArray out(keyLength);
+		derive(secret, salt, iterationCount, &out);
+		return out;
+	}
+
+	virtual SymmetricKey makeKey(const SecureArray &secret,
+								 const InitializationVector &salt,
+								 unsigned int keyLength,
+								 int msecInterval,
+								 unsigned int *iterationCount)
+	{
+		Q_ASSERT(iterationCount != NULL);
+		SecureArray out(keyLength);
+		if(m_sha512)
+			*iterationCount = pbkdf2Sha512Timed((const unsigned char *)secret.data(), secret.size(),
+												(const unsigned char *)salt.data(), salt.size(),
+												msecInterval, (unsigned char *)out.data(), out.size());
+		else
+			*iterationCount = pbkdf2Sha256Timed((const unsigned char *)secret.data(), secret.size(),
+												(const unsigned char *)salt.data(), salt.size(),
+												msecInterval, (unsigned char *)out.data(), out.size());
+		return out;
+	}
+
+	virtual QList<SymmetricKey> makeKeys(const QList<KeyDerivationFunction::Job> &jobs)
+	{
+		// the blocks of all the keys share the lane kernels, on this
+		// thread as KeyDerivationFunction spreads the work already
+		QList<SymmetricKey> keys;
+		foreach(const KeyDerivationFunction::Job &job, jobs)
+			keys += SymmetricKey(SecureArray(job.keyLength));
+
+		QVector<Pbkdf2Job> batch(jobs.count());
+		for(int n = 0; n < jobs.count(); ++n)
+		{
+			const KeyDerivationFunction::Job &job = jobs[n];
+			batch[n].secret = (const unsigned char *)job.secret.data();
+			batch[n].secretLen = job.secret.size();
+			batch[n].salt = (const unsigned char *)job.salt.data();
+			batch[n].saltLen = job.salt.size();
+			batch[n].iterations = job.iterationCount;
+			batch[n].out = (unsigned char *)keys[n].data();
+			batch[n].outLen = keys[n].size();
+		}
+
+		if(m_sha512)
+			pbkdf2Sha512Many(batch.data(), batch.count(), 1);
+		else
+			pbkdf2Sha256Many(batch.data(), batch.count(), 1);
+		return keys;
+	}
+
+private:
+	bool m_sha512;
+
+	void derive(const SecureArray &secret, const InitializationVector &salt,
+				unsigned int iterationCount, SecureArray *out) const
+	{
+		if(m_sha512)
+			pbkdf2Sha512((const unsigned char *)secret.data(), secret.size(),
+						 (const unsigned char *)salt.data(), salt.size(),
+						 iterationCount, (unsigned char *)out->data(), out->size());
+		else
+			pbkdf2Sha256((const unsigned char *)secret.data(), secret.size(),
+						 (const unsigned char *)salt.data(), salt.size(),
+						 iterationCount, (unsigned char *)out->data(), out->size());
+	}
+};
+
+//----------------------------------------------------------------------------
+// DefaultArgon2Context
+//----------------------------------------------------------------------------
+// RFC 9106 recommends t = 3, p = 4 and 64 MiB where 2 GiB is too much
+#define ARGON2_DEFAULT_MEMORY 65536
+#define ARGON2_DEFAULT_PASSES 3
+#define ARGON2_DEFAULT_LANES 4
+
+class DefaultArgon2Context : public KDFContext
+{
+public:
+	DefaultArgon2Context(Provider *p) : KDFContext(p, "argon2id")
+	{
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultArgon2Context(*this);
+	}
+
+	virtual SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt,
+								 unsigned int keyLength, unsigned int iterationCount)
+	{
+		KeyDerivationFunction::Parameters parameters;
+		parameters.timeCost = iterationCount;
+		return makeKeyWithParameters(secret, salt, keyLength, parameters);
+	}
+
+	virtual SymmetricKey makeKey(const SecureArray &secret,
+								 const InitializationVector &salt,
+								 unsigned int keyLength,
+								 int msecInterval,
+								 unsigned int *iterationCount)
+	{
+		Q_ASSERT(iterationCount != NULL);
+		QElapsedTimer timer;
+		timer.start();
+
+		// the number of passes is hashed into the first block, so it has
+		// to be known up front: time one pass, and spend the rest of the
+		// interval on as many as fit
+		*iterationCount = 1;
+		SymmetricKey key = makeKey(secret, salt, keyLength, 1u);
+		qint64 once = qMax(timer.elapsed(), (qint64)1);
+		qint64 passes = (msecInterval - once) / once;
+		if(key.isEmpty() || passes < 2)
+			return key;
+
+		*iterationCount = (unsigned int)qMin(passes, (qint64)0xffffffff);
+		return makeKey(secret, salt, keyLength, *iterationCount);
+	}
+
+	virtual SymmetricKey makeKeyWithParameters(const SecureArray &secret, const InitializationVector &salt,
+											   unsigned int keyLength, const KeyDerivationFunction::Parameters &parameters)
+	{
+		SecureArray out(keyLength);
+		if(!argon2id((const unsigned char *)secret.data(), secret.size(),
+					 (const unsigned char *)salt.data(), salt.size(),
+					 (const unsigned char *)parameters.secretKey.data(), parameters.secretKey.size(),
+					 (const unsigned char *)parameters.associatedData.data(), parameters.associatedData.size(),
+					 parameters.memoryCost ? parameters.memoryCost : ARGON2_DEFAULT_MEMORY,
+					 parameters.timeCost ? parameters.timeCost : ARGON2_DEFAULT_PASSES,
+					 parameters.lanes ? parameters.lanes : ARGON2_DEFAULT_LANES,
+					 parameters.threads, (unsigned char *)out.data(), out.size()))
+			return SymmetricKey();
+		return out;
+	}
+};
+
+//----------------------------------------------------------------------------
+// DefaultScryptContext
+//----------------------------------------------------------------------------
+// N = 2^15 and r = 8 take 32 MiB
+#define SCRYPT_DEFAULT_COST 32768
+#define SCRYPT_DEFAULT_BLOCK_SIZE 8
+#define SCRYPT_DEFAULT_LANES 1
+// 128 * r * (N + p) bytes, the timed makeKey() keeps V below half of that
+#define SCRYPT_MAX_MEMORY (Q_UINT64_C(2) << 30)
+#define SCRYPT_TIMED_MEMORY (Q_UINT64_C(1) << 30)
+
+class DefaultScryptContext : public KDFContext
+{
+public:
+	DefaultScryptContext(Provider *p) : KDFContext(p, "scrypt")
+	{
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultScryptContext(*this);
+	}
+
+	virtual SymmetricKey makeKey(const SecureArray &secret, const InitializationVector &salt,
+								 unsigned int keyLength, unsigned int iterationCount)
+	{
+		KeyDerivationFunction::Parameters parameters;
+		parameters.memoryCost = iterationCount;
+		return makeKeyWithParameters(secret, salt, keyLength, parameters);
+	}
+
+	virtual SymmetricKey makeKey(const SecureArray &secret,
+								 const InitializationVector &salt,
+								 unsigned int keyLength,
+								 int msecInterval,
+								 unsigned int *iterationCount)
+	{
+		Q_ASSERT(iterationCount != NULL);
+		QElapsedTimer timer;
+		timer.start();
+
+		// N has to be a power of 2: time a small one, and scale it up by
+		// the largest power of 2 that fits the rest of the interval
+		unsigned int cost = 1024;
+		*iterationCount = cost;
+		SymmetricKey key = makeKey(secret, salt, keyLength, cost);
+		qint64 once = qMax(timer.elapsed(), (qint64)1);
+		qint64 factor = (msecInterval - once) / once;
+		if(key.isEmpty() || factor < 2)
+			return key;
+
+		while(factor >= 2 && 128 * SCRYPT_DEFAULT_BLOCK_SIZE * 2 * (quint64)cost <= SCRYPT_TIMED_MEMORY)
+		{
+			cost *= 2;
+			factor /= 2;
+		}
+		*iterationCount = cost;
+		return makeKey(secret, salt, keyLength, cost);
+	}
+
+	virtual SymmetricKey makeKeyWithParameters(const SecureArray &secret, const InitializationVector &salt,
+											   unsigned int keyLength, const KeyDerivationFunction::Parameters &parameters)
+	{
+		quint64 N = parameters.memoryCost ? parameters.memoryCost : SCRYPT_DEFAULT_COST;
+		quint32 r = parameters.blockSize ? parameters.blockSize : SCRYPT_DEFAULT_BLOCK_SIZE;
+		quint32 p = parameters.lanes ? parameters.lanes : SCRYPT_DEFAULT_LANES;
+		if(N + p > SCRYPT_MAX_MEMORY / 128 / r)
+			return SymmetricKey();
+
+		SecureArray out(keyLength);
+		if(!scrypt((const unsigned char *)secret.data(), secret.size(),
+				   (const unsigned char *)salt.data(), salt.size(),
+				   N, r, p, parameters.threads, (unsigned char *)out.data(), out.size()))
+			return SymmetricKey();
+		return out;
+	}
+};
+
+//----------------------------------------------------------------------------
+// DefaultAESContext
+//----------------------------------------------------------------------------
+static QStringList default_cipher_types()
+{
+	QStringList list;
+	const char *names[] = { "aes128", "aes192", "aes256" };
+	for(int n = 0; n < 3; ++n)
+	{
+		QString name = names[n];
+		list += name + "-ecb";
+		list += name + "-cbc";
+		list += name + "-cbc-pkcs7";
+		list += name + "-ctr";
+		list += name + "-gcm";
+	}
+	list += "chacha20";
+	list += "chacha20-poly1305";
+	return list;
+}
+
+static void store_be64(unsigned char *p, quint64 v)
+{
+	for(int n = 7; n >= 0; --n)
+	{
+		p[n] = (unsigned char)v;
+		v >>= 8;
+	}
+}
+
+// compares without branching on the contents
+static bool tag_equal(const unsigned char *a, const unsigned char *b, int len)
+{
+	unsigned char diff = 0;
+	for(int n = 0; n < len; ++n)
+		diff |= a[n] ^ b[n];
+	return diff == 0;
+}
+
+class DefaultAESContext : public CipherContext
+{
+public:
+	enum Mode { ECB, CBC, CTR, GCM };
+
+	DefaultAESContext(Provider *p, const QString &type) : CipherContext(p, type)
+	{
+		m_keySize = type.mid(3, 3).toInt() / 8;
+		if(type.endsWith("-ecb"))
+			m_mode = ECB;
+		else if(type.endsWith("-ctr"))
+			m_mode = CTR;
+		else if(type.endsWith("-gcm"))
+			m_mode = GCM;
+		else
+			m_mode = CBC;
+		m_pad = type.endsWith("-pkcs7");
+		m_dir = Encode;
+		m_ok = false;
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultAESContext(*this);
+	}
+
+	virtual void setup(Direction dir, const SymmetricKey &key, const InitializationVector &iv, const AuthTag &tag)
+	{
+		m_dir = dir;
+		m_tag = tag;
+		m_buf.clear();
+		m_used = 16;
+		m_ghUsed = 0;
+		m_textLen = 0;
+		m_aadLen = 0;
+		memset(m_iv, 0, 16);
+		memset(m_y, 0, 16);
+
+		m_ok = key.size() == m_keySize && m_aes.setKey((const unsigned char *)key.data(), key.size());
+		if(!m_ok)
+			return;
+
+		if(m_mode == CBC || m_mode == CTR)
+		{
+			if(iv.size() != 16)
+			{
+				m_ok = false;
+				return;
+			}
+			memcpy(m_iv, iv.data(), 16);
+		}
+		else if(m_mode == GCM)
+		{
+			if(iv.isEmpty() || m_tag.size() > 16)
+			{
+				m_ok = false;
+				return;
+			}
+
+			unsigned char h[16];
+			memset(h, 0, 16);
+			m_aes.encrypt(h, h, 1);
+			m_ghash.setKey(h);
+			startGcm((const unsigned char *)iv.data(), iv.size());
+		}
+	}
+
+	virtual KeyLength keyLength() const
+	{
+		return KeyLength(m_keySize, m_keySize, 1);
+	}
+
+	virtual int blockSize() const
+	{
+		// the counter modes are stream ciphers
+		return (m_mode == CTR || m_mode == GCM) ? 1 : 16;
+	}
+
+	virtual AuthTag tag() const
+	{
+		return m_tag;
+	}
+
+	virtual bool update(const SecureArray &in, SecureArray *out)
+	{
+		if(!m_ok)
+			return false;
+
+		const unsigned char *src = (const unsigned char *)in.data();
+		int len = in.size();
+
+		if(m_mode == CTR || m_mode == GCM)
+		{
+			out->resize(len);
+			unsigned char *dst = (unsigned char *)out->data();
+			if(m_mode == GCM)
+			{
+				if(m_dir == Decode)
+					ghashUpdate(src, len);
+				m_textLen += len;
+			}
+			stream(src, dst, len);
+			if(m_mode == GCM && m_dir == Encode)
+				ghashUpdate(dst, len);
+			return true;
+		}
+
+		// whole blocks are processed right away, unless decrypting with
+		// padding, where the last block has to wait for final()
+		int total = m_buf.size() + len;
+		int blocks = total / 16;
+		if(m_pad && m_dir == Decode && blocks > 0 && total % 16 == 0)
+			--blocks;
+
+		out->resize(blocks * 16);
+		unsigned char *dst = (unsigned char *)out->data();
+		if(blocks > 0 && !m_buf.isEmpty())
+		{
+			int need = 16 - m_buf.size();
+			buffer(src, need);
+			crypt((const unsigned char *)m_buf.data(), dst, 1);
+			m_buf.clear();
+			src += need;
+			len -= need;
+			dst += 16;
+			--blocks;
+		}
+		crypt(src, dst, blocks);
+		src += blocks * 16;
+		len -= blocks * 16;
+		if(len > 0)
+			buffer(src, len);
+		return true;
+	}
+
+	virtual bool final(SecureArray *out)
+	{
+		out->clear();
+		if(!m_ok)
+			return false;
+
+		if(m_mode == CTR)
+			return true;
+
+		if(m_mode == GCM)
+			return finalGcm();
+
+		if(!m_pad)
+			return m_buf.isEmpty();
+
+		unsigned char block[16];
+		if(m_dir == Encode)
+		{
+			int n = 16 - m_buf.size();
+			memcpy(block, m_buf.data(), m_buf.size());
+			memset(block + m_buf.size(), n, n);
+			m_buf.clear();
+			out->resize(16);
+			crypt(block, (unsigned char *)out->data(), 1);
+			return true;
+		}
+
+		if(m_buf.size() != 16)
+			return false;
+		crypt((const unsigned char *)m_buf.data(), block, 1);
+		m_buf.clear();
+
+		// check the padding without branching on the plaintext
+		unsigned int n = block[15];
+		unsigned int bad = ((n - 1) >> 8) | ((16 - n) >> 8);
+		for(int i = 0; i < 16; ++i)
+		{
+			unsigned int inPad = (((unsigned int)(15 - i) - n) >> 8) & 1;
+			bad |= (block[i] ^ n) & (0u - inPad);
+		}
+		if(bad)
+		{
+			memset(block, 0, 16);
+			return false;
+		}
+		out->resize(16 - n);
+		memcpy(out->data(), block, 16 - n);
+		memset(block, 0, 16);
+		return true;
+	}
+
+	// the key schedule, and H for GCM, are computed once for the batch
+	virtual bool processBatch(Direction dir, const SymmetricKey &key, const QVector<Cipher::Record> &records, QList<int> *failed)
+	{
+		if(m_mode != CTR && m_mode != GCM)
+			return CipherContext::processBatch(dir, key, records, failed);
+
+		m_dir = dir;
+		m_ok = key.size() == m_keySize && m_aes.setKey((const unsigned char *)key.data(), key.size());
+		if(m_ok && m_mode == GCM)
+		{
+			unsigned char h[16];
+			memset(h, 0, 16);
+			m_aes.encrypt(h, h, 1);
+			m_ghash.setKey(h);
+		}
+
+		bool all = true;
+		for(int n = 0; n < records.count(); ++n)
+		{
+			if(!m_ok || !(m_mode == CTR ? batchCtr(records[n]) : batchGcm(records[n])))
+			{
+				failed->append(n);
+				all = false;
+			}
+		}
+
+		// setup() is needed again before update()
+		m_ok = false;
+		return all;
+	}
+
+private:
+	int m_keySize;
+	Mode m_mode;
+	bool m_pad;
+	Direction m_dir;
+	bool m_ok;
+	AuthTag m_tag;
+	AesCipher m_aes;
+	SecureArray m_buf;
+	// CBC chaining value, or the counter
+	unsigned char m_iv[16];
+	// unused keystream
+	unsigned char m_ks[16];
+	int m_used;
+	// GCM state
+	GHash m_ghash;
+	unsigned char m_ej0[16];
+	unsigned char m_y[16];
+	unsigned char m_ghBuf[16];
+	int m_ghUsed;
+	quint64 m_textLen;
+	quint64 m_aadLen;
+
+	void buffer(const unsigned char *in, int len)
+	{
+		int at = m_buf.size();
+		m_buf.resize(at + len);
+		memcpy(m_buf.data() + at, in, len);
+	}
+
+	void crypt(const unsigned char *in, unsigned char *out, int blocks)
+	{
+		if(blocks <= 0)
+			return;
+		if(m_mode == ECB)
+		{
+			if(m_dir == Encode)
+				m_aes.encrypt(in, out, blocks);
+			else
+				m_aes.decrypt(in, out, blocks);
+		}
+		else
+		{
+			if(m_dir == Encode)
+				m_aes.encryptCbc(m_iv, in, out, blocks);
+			else
+				m_aes.decryptCbc(m_iv, in, out, blocks);
+		}
+	}
+
+	void stream(const unsigned char *in, unsigned char *out, int len)
+	{
+		bool inc32 = (m_mode == GCM);
+		while(len > 0 && m_used < 16)
+		{
+			*(out++) = *(in++) ^ m_ks[m_used++];
+			--len;
+		}
+
+		int blocks = len / 16;
+		if(blocks > 0)
+		{
+			m_aes.ctr(m_iv, inc32, in, out, blocks);
+			in += blocks * 16;
+			out += blocks * 16;
+			len -= blocks * 16;
+		}
+
+		if(len > 0)
+		{
+			memset(m_ks, 0, 16);
+			m_aes.ctr(m_iv, inc32, m_ks, m_ks, 1);
+			m_used = 0;
+			while(len > 0)
+			{
+				*(out++) = *(in++) ^ m_ks[m_used++];
+				--len;
+			}
+		}
+	}
+
+	// GHASH over the ciphertext, buffering partial blocks between calls
+	void ghashUpdate(const unsigned char *data, int len)
+	{
+		if(m_ghUsed > 0)
+		{
+			int take = qMin(16 - m_ghUsed, len);
+			memcpy(m_ghBuf + m_ghUsed, data, take);
+			m_ghUsed += take;
+			data += take;
+			len -= take;
+			if(m_ghUsed < 16)
+				return;
+			m_ghash.update(m_y, m_ghBuf, 16);
+			m_ghUsed = 0;
+		}
+
+		int whole = len & ~15;
+		if(whole > 0)
+			m_ghash.update(m_y, data, whole);
+		memcpy(m_ghBuf, data + whole, len - whole);
+		m_ghUsed = len - whole;
+	}
+
+	// J0 is IV || 1 for the usual 96 bit IV, otherwise the GHASH of the
+	// IV and its length.  E(J0) is kept for the tag, the data starts at
+	// J0 + 1.
+	void startGcm(const unsigned char *iv, int len)
+	{
+		m_used = 16;
+		m_ghUsed = 0;
+		m_textLen = 0;
+		m_aadLen = 0;
+		memset(m_iv, 0, 16);
+		memset(m_y, 0, 16);
+
+		if(len == 12)
+		{
+			memcpy(m_iv, iv, 12);
+			m_iv[15] = 1;
+		}
+		else
+		{
+			m_ghash.update(m_iv, iv, len);
+			unsigned char lengths[16];
+			memset(lengths, 0, 16);
+			store_be64(lengths + 8, (quint64)len * 8);
+			m_ghash.update(m_iv, lengths, 16);
+		}
+
+		m_aes.encrypt(m_iv, m_ej0, 1);
+		for(int n = 15; n >= 12; --n)
+		{
+			if(++m_iv[n])
+				break;
+		}
+	}
+
+	// finishes the GHASH with the length block and gives the full tag
+	void gcmTag(unsigned char *s)
+	{
+		if(m_ghUsed > 0)
+			m_ghash.update(m_y, m_ghBuf, m_ghUsed);
+		m_ghUsed = 0;
+
+		unsigned char lengths[16];
+		store_be64(lengths, m_aadLen * 8);
+		store_be64(lengths + 8, m_textLen * 8);
+		m_ghash.update(m_y, lengths, 16);
+
+		for(int n = 0; n < 16; ++n)
+			s[n] = m_y[n] ^ m_ej0[n];
+	}
+
+	bool finalGcm()
+	{
+		unsigned char s[16];
+		gcmTag(s);
+
+		if(m_dir == Encode)
+		{
+			if(!m_tag.isEmpty())
+				memcpy(m_tag.data(), s, m_tag.size());
+			return true;
+		}
+
+		// decrypting without a tag would go unauthenticated
+		if(m_tag.isEmpty() || m_tag.size() > 16)
+			return false;
+		return tag_equal(s, (const unsigned char *)m_tag.data(), m_tag.size());
+	}
+
+	bool batchCtr(const Cipher::Record &r)
+	{
+		if(r.nonceSize != 16 || r.aadSize != 0 || r.tagSize != 0 || r.size < 0)
+			return false;
+		memcpy(m_iv, r.nonce, 16);
+		m_used = 16;
+		stream((const unsigned char *)r.in, (unsigned char *)r.out, r.size);
+		return true;
+	}
+
+	bool batchGcm(const Cipher::Record &r)
+	{
+		if(r.nonceSize <= 0 || r.aadSize < 0 || r.size < 0 || r.tagSize <= 0 || r.tagSize > 16)
+			return false;
+
+		startGcm((const unsigned char *)r.nonce, r.nonceSize);
+		m_ghash.update(m_y, (const unsigned char *)r.aad, r.aadSize);
+		m_aadLen = r.aadSize;
+		m_textLen = r.size;
+
+		// the whole text is here, so the GHASH pads the last block itself
+		if(m_dir == Decode)
+			m_ghash.update(m_y, (const unsigned char *)r.in, r.size);
+		stream((const unsigned char *)r.in, (unsigned char *)r.out, r.size);
+		if(m_dir == Encode)
+			m_ghash.update(m_y, (const unsigned char *)r.out, r.size);
+
+		unsigned char s[16];
+		gcmTag(s);
+		if(m_dir == Encode)
+		{
+			memcpy(r.tag, s, r.tagSize);
+			return true;
+		}
+		return tag_equal(s, (const unsigned char *)r.tag, r.tagSize);
+	}
+};
+
+//----------------------------------------------------------------------------
+// DefaultChaChaContext
+//----------------------------------------------------------------------------
+static void store_le64(unsigned char *p, quint64 v)
+{
+	for(int n = 0; n < 8; ++n)
+	{
+		p[n] = (unsigned char)v;
+		v >>= 8;
+	}
+}
+
+// "chacha20" takes a 12 byte nonce, with the block counter starting at 0,
+// or 16 bytes of little endian counter and nonce as OpenSSL does.
+// "chacha20-poly1305" is the AEAD of RFC 8439 with a 12 byte nonce.
+class DefaultChaChaContext : public CipherContext
+{
+public:
+	DefaultChaChaContext(Provider *p, const QString &type) : CipherContext(p, type)
+	{
+		m_aead = (type == "chacha20-poly1305");
+		m_dir = Encode;
+		m_ok = false;
+		m_textLen = 0;
+		m_aadLen = 0;
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultChaChaContext(*this);
+	}
+
+	virtual void setup(Direction dir, const SymmetricKey &key, const InitializationVector &iv, const AuthTag &tag)
+	{
+		m_dir = dir;
+		m_tag = tag;
+
+		m_ok = key.size() == 32 && m_tag.size() <= 16;
+		if(!m_ok)
+			return;
+
+		m_chacha.setKey((const unsigned char *)key.data());
+		m_ok = start((const unsigned char *)iv.data(), iv.size());
+	}
+
+	virtual KeyLength keyLength() const
+	{
+		return KeyLength(32, 32, 1);
+	}
+
+	virtual int blockSize() const
+	{
+		return 1;
+	}
+
+	virtual AuthTag tag() const
+	{
+		return m_tag;
+	}
+
+	virtual bool update(const SecureArray &in, SecureArray *out)
+	{
+		if(!m_ok)
+			return false;
+
+		out->resize(in.size());
+		crypt((const unsigned char *)in.data(), (unsigned char *)out->data(), in.size());
+		return true;
+	}
+
+	virtual bool final(SecureArray *out)
+	{
+		out->clear();
+		if(!m_ok)
+			return false;
+		if(!m_aead)
+			return true;
+
+		unsigned char mac[16];
+		finish(mac);
+		if(m_dir == Encode)
+		{
+			if(!m_tag.isEmpty())
+				memcpy(m_tag.data(), mac, m_tag.size());
+			return true;
+		}
+
+		// decrypting without a tag would go unauthenticated
+		if(m_tag.isEmpty())
+			return false;
+		return tag_equal(mac, (const unsigned char *)m_tag.data(), m_tag.size());
+	}
+
+	virtual bool processBatch(Direction dir, const SymmetricKey &key, const QVector<Cipher::Record> &records, QList<int> *failed)
+	{
+		m_dir = dir;
+		m_ok = (key.size() == 32);
+		if(m_ok)
+			m_chacha.setKey((const unsigned char *)key.data());
+
+		bool all = true;
+		for(int n = 0; n < records.count(); ++n)
+		{
+			const Cipher::Record &r = records[n];
+			bool ok = m_ok && r.size >= 0 && r.aadSize >= 0;
+			if(ok && m_aead)
+				ok = r.tagSize > 0 && r.tagSize <= 16;
+			else if(ok)
+				ok = r.aadSize == 0 && r.tagSize == 0;
+			if(ok)
+				ok = start((const unsigned char *)r.nonce, r.nonceSize);
+			if(ok)
+			{
+				if(m_aead)
+				{
+					m_poly.update((const unsigned char *)r.aad, r.aadSize);
+					padMac(r.aadSize);
+					m_aadLen = r.aadSize;
+				}
+				crypt((const unsigned char *)r.in, (unsigned char *)r.out, r.size);
+				if(m_aead)
+				{
+					unsigned char mac[16];
+					finish(mac);
+					if(dir == Encode)
+						memcpy(r.tag, mac, r.tagSize);
+					else
+						ok = tag_equal(mac, (const unsigned char *)r.tag, r.tagSize);
+				}
+			}
+			if(!ok)
+			{
+				failed->append(n);
+				all = false;
+			}
+		}
+
+		// setup() is needed again before update()
+		m_ok = false;
+		return all;
+	}
+
+private:
+	bool m_aead;
+	Direction m_dir;
+	bool m_ok;
+	AuthTag m_tag;
+	ChaCha20 m_chacha;
+	Poly1305 m_poly;
+	quint64 m_textLen;
+	quint64 m_aadLen;
+
+	// sets the nonce and, for the AEAD, the one-time Poly1305 key
+	bool start(const unsigned char *nonce, int len)
+	{
+		m_textLen = 0;
+		m_aadLen = 0;
+		if(len != 12 && (m_aead || len != 16))
+			return false;
+
+		quint32 counter = 0;
+		if(len == 16)
+		{
+			counter = (quint32)nonce[0] | ((quint32)nonce[1] << 8) | ((quint32)nonce[2] << 16) | ((quint32)nonce[3] << 24);
+			nonce += 4;
+		}
+		m_chacha.setNonce(nonce, counter);
+
+		if(m_aead)
+		{
+			// the one-time Poly1305 key is the start of block 0, the
+			// data is encrypted from block 1 on
+			unsigned char block[64];
+			memset(block, 0, 64);
+			m_chacha.crypt(block, block, 64);
+			m_poly.setKey(block);
+			memset(block, 0, 64);
+		}
+		return true;
+	}
+
+	void crypt(const unsigned char *in, unsigned char *out, int len)
+	{
+		if(m_aead && m_dir == Decode)
+			m_poly.update(in, len);
+		m_chacha.crypt(in, out, len);
+		if(m_aead && m_dir == Encode)
+			m_poly.update(out, len);
+		m_textLen += len;
+	}
+
+	// zero padding up to a multiple of 16 bytes
+	void padMac(quint64 len)
+	{
+		unsigned char zero[16];
+		memset(zero, 0, 16);
+		int padding = (16 - (int)(len % 16)) % 16;
+		if(padding > 0)
+			m_poly.update(zero, padding);
+	}
+
+	// the ciphertext is followed by its padding and the two lengths
+	void finish(unsigned char *mac)
+	{
+		padMac(m_textLen);
+		unsigned char lengths[16];
+		store_le64(lengths, m_aadLen);
+		store_le64(lengths + 8, m_textLen);
+		m_poly.update(lengths, 16);
+		m_poly.final(mac);
+	}
+};
+
+//----------------------------------------------------------------------------
+// DefaultPoly1305Context
+//----------------------------------------------------------------------------
+// The key must only ever be used for a single message.
+class DefaultPoly1305Context : public MACContext
+{
+public:
+	DefaultPoly1305Context(Provider *p) : MACContext(p, "poly1305")
+	{
+		m_ok = false;
+	}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultPoly1305Context(*this);
+	}
+
+	virtual void setup(const SymmetricKey &key)
+	{
+		m_ok = (key.size() == 32);
+		if(m_ok)
+			m_poly.setKey((const unsigned char *)key.data());
+	}
+
+	virtual KeyLength keyLength() const
+	{
+		return KeyLength(32, 32, 1);
+	}
+
+	virtual void update(const MemoryRegion &in)
+	{
+		if(m_ok)
+			m_poly.update((const unsigned char *)in.data(), in.size());
+	}
+
+	virtual void final(MemoryRegion *out)
+	{
+		if(!m_ok)
+		{
+			*out = MemoryRegion();
+			return;
+		}
+		SecureArray mac(16);
+		m_poly.final((unsigned char *)mac.data());
+		*out = mac;
+	}
+
+private:
+	bool m_ok;
+	Poly1305 m_poly;
+};
+
+//----------------------------------------------------------------------------
+// DefaultInfoContext
+//----------------------------------------------------------------------------
+class DefaultInfoContext : public InfoContext
+{
+public:
+	DefaultInfoContext(Provider *p) : InfoContext(p) {}
+
+	virtual Provider::Context *clone() const
+	{
+		return new DefaultInfoContext(*this);
+	}
+
+	virtual QStringList supportedHashTypes() const
+	{
+		QStringList list;
+		list += "md5";
+		list += "sha1";
+		list += "sha256";
+		list += "sha512";
+		return list;
+	}
+
+	virtual QStringList supportedCipherTypes() const
+	{
+		return default_cipher_types();
+	}
+
+	virtual QStringList supportedMACTypes() const
+	{
+		QStringList list;
+		list += "poly1305";
+		return list;
+	}
+};
+
 //----------------------------------------------------------------------------
 // DefaultKeyStoreEntry
 //----------------------------------------------------------------------------
@@ -1052,19 +2119,63 @@ public:
 //----------------------------------------------------------------------------
 // DefaultKeyStoreList
 //----------------------------------------------------------------------------
+// the certificates of the store.  those of a trust store file are only
+//   decoded when they are asked for
+static CertificateCollection default_store_collection(const DefaultShared *shared)
+{
+	CertificateCollection col;
+#ifndef QCA_NO_SYSTEMSTORE
+	if(shared->use_system())
+		col = qca_get_systemstore(QString());
+#endif
+
+	QString roots = shared->roots_file();
+	if(!roots.isEmpty())
+		col += CertificateCollection::fromFlatTextFile(roots);
+	return col;
+}
+
 class DefaultKeyStoreList : public KeyStoreListContext
 {
 	Q_OBJECT
 public:
 	bool x509_supported;
 	DefaultShared *shared;
+	FileWatch *systemWatch, *rootsWatch;
 
-	DefaultKeyStoreList(Provider *p, DefaultShared *_shared) : KeyStoreListContext(p), shared(_shared)
+	DefaultKeyStoreList(Provider *p, DefaultShared *_shared) : KeyStoreListContext(p), shared(_shared), systemWatch(0), rootsWatch(0)
 	{
 	}
 
 	~DefaultKeyStoreList()
 	{
+		// nothing watches the files anymore
+		invalidate_system_store();
+	}
+
+	// created here rather than in the constructor, so that they live in
+	//   the keystore thread and its event loop
+	void updateWatches()
+	{
+		if(!systemWatch)
+		{
+			systemWatch = new FileWatch(QString(), this);
+			connect(systemWatch, SIGNAL(changed()), SLOT(watch_changed()));
+			rootsWatch = new FileWatch(QString(), this);
+			connect(rootsWatch, SIGNAL(changed()), SLOT(watch_changed()));
+		}
+
+		QString system;
+#ifndef QCA_NO_SYSTEMSTORE
+		if(shared->use_system())
+			system = qca_systemstore_file();
+#endif
+		if(systemWatch->fileName() != system)
+			systemWatch->setFileName(system);
+
+		QString roots = shared->roots_file();
+		if(rootsWatch->fileName() != roots)
+			rootsWatch->setFileName(roots);
 	}
 
 	virtual Provider::Context *clone() const
@@ -1075,6 +2186,7 @@ public:
 	virtual void start()
 	{
 		x509_supported = false;
+		updateWatches();
 
 		QMetaObject::invokeMethod(this, "busyEnd", Qt::QueuedConnection);
 	}
@@ -1087,6 +2199,9 @@ public:
 				x509_supported = true;
 		}
 
+		// the config may have named another file since
+		updateWatches();
+
 		bool have_systemstore = false;
 #ifndef QCA_NO_SYSTEMSTORE
 		if(shared->use_system())
@@ -1130,26 +2245,9 @@ public:
 	{
 		QList<KeyStoreEntryContext*> out;
 
-		QList<Certificate> certs;
-		QList<CRL> crls;
-
-		if(shared->use_system())
-		{
-			CertificateCollection col;
-#ifndef QCA_NO_SYSTEMSTORE
-			col = qca_get_systemstore(QString());
-#endif
-			certs += col.certificates();
-			crls += col.crls();
-		}
-
-		QString roots = shared->roots_file();
-		if(!roots.isEmpty())
-		{
-			CertificateCollection col = CertificateCollection::fromFlatTextFile(roots);
-			certs += col.certificates();
-			crls += col.crls();
-		}
+		CertificateCollection col = default_store_collection(shared);
+		QList<Certificate> certs = col.certificates();
+		QList<CRL> crls = col.crls();
 
 #ifdef FRIENDLY_NAMES
 		QStringList names = makeFriendlyNames(certs);
@@ -1181,6 +2279,13 @@ public:
 	{
 		return DefaultKeyStoreEntry::deserialize(serialized, provider());
 	}
+
+private slots:
+	void watch_changed()
+	{
+		invalidate_system_store();
+		emit updated();
+	}
 };
 
 //----------------------------------------------------------------------------
@@ -1237,7 +2342,16 @@ public:
 		list += "random";
 		list += "md5";
 		list += "sha1";
+		list += "sha256";
+		list += "sha512";
+		list += "pbkdf2(sha256)";
+		list += "pbkdf2(sha512)";
+		list += "argon2id";
+		list += "scrypt";
 		list += "keystorelist";
+		list += "info";
+		list += default_cipher_types();
+		list += "poly1305";
 		return list;
 	}
 
@@ -1249,8 +2363,26 @@ public:
 			return new DefaultMD5Context(this);
 		else if(type == "sha1")
 			return new DefaultSHA1Context(this);
+		else if(type == "sha256")
+			return new DefaultSHA2Context<Sha256>(this, type);
+		else if(type == "sha512")
+			return new DefaultSHA2Context<Sha512>(this, type);
+		else if(type == "pbkdf2(sha256)" || type == "pbkdf2(sha512)")
+			return new DefaultPbkdf2Context(this, type);
+		else if(type == "argon2id")
+			return new DefaultArgon2Context(this);
+		else if(type == "scrypt")
+			return new DefaultScryptContext(this);
 		else if(type == "keystorelist")
 			return new DefaultKeyStoreList(this, &shared);
+		else if(type == "info")
+			return new DefaultInfoContext(this);
+		else if(type == "chacha20" || type == "chacha20-poly1305")
+			return new DefaultChaChaContext(this, type);
+		else if(type == "poly1305")
+			return new DefaultPoly1305Context(this);
+		else if(default_cipher_types().contains(type))
+			return new DefaultAESContext(this, type);
 		else
 			return 0;
 	}
@@ -1320,6 +2452,12 @@ QStringList plugin_priorities(Provider *defaultProvider)
 	return that->shared.plugin_priorities();
 }
 
+CertificateCollection default_system_store(Provider *defaultProvider)
+{
+	DefaultProvider *that = (DefaultProvider *)defaultProvider;
+	return default_store_collection(&that->shared);
+}
+
 #include "qca_default.moc"
 
 }
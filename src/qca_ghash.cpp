@@ -0,0 +1,416 @@
+/*
+ * qca_ghash.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_ghash.h"
+
+#include "qca_cpu.h"
+
+#include <string.h>
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+static inline quint64 load_be64(const unsigned char *p)
+{
+	return ((quint64)p[0] << 56) | ((quint64)p[1] << 48) |
+		((quint64)p[2] << 40) | ((quint64)p[3] << 32) |
+		((quint64)p[4] << 24) | ((quint64)p[5] << 16) |
+		((quint64)p[6] << 8) | (quint64)p[7];
+}
+
+static inline void store_be64(unsigned char *p, quint64 v)
+{
+	for(int n = 7; n >= 0; --n)
+	{
+		p[n] = (unsigned char)v;
+		v >>= 8;
+	}
+}
+
+// carryless 64x64 multiply, low half only.  Integer multiplies with holes
+// of three zero bits between the data bits keep the carries out of the way.
+static inline quint64 bmul64(quint64 x, quint64 y)
+{
+	const quint64 m0 = Q_UINT64_C(0x1111111111111111);
+	const quint64 m1 = Q_UINT64_C(0x2222222222222222);
+	const quint64 m2 = Q_UINT64_C(0x4444444444444444);
+	const quint64 m3 = Q_UINT64_C(0x8888888888888888);
+	quint64 x0 = x & m0, x1 = x & m1, x2 = x & m2, x3 = x & m3;
+	quint64 y0 = y & m0, y1 = y & m1, y2 = y & m2, y3 = y & m3;
+	quint64 z0 = (x0 * y0) ^ (x1 * y3) ^ (x2 * y2) ^ (x3 * y1);
+	quint64 z1 = (x0 * y1) ^ (x1 * y0) ^ (x2 * y3) ^ (x3 * y2);
+	quint64 z2 = (x0 * y2) ^ (x1 * y1) ^ (x2 * y0) ^ (x3 * y3);
+	quint64 z3 = (x0 * y3) ^ (x1 * y2) ^ (x2 * y1) ^ (x3 * y0);
+	return (z0 & m0) | (z1 & m1) | (z2 & m2) | (z3 & m3);
+}
+
+static inline quint64 rev64(quint64 x)
+{
+	x = ((x & Q_UINT64_C(0x5555555555555555)) << 1) | ((x >> 1) & Q_UINT64_C(0x5555555555555555));
+	x = ((x & Q_UINT64_C(0x3333333333333333)) << 2) | ((x >> 2) & Q_UINT64_C(0x3333333333333333));
+	x = ((x & Q_UINT64_C(0x0F0F0F0F0F0F0F0F)) << 4) | ((x >> 4) & Q_UINT64_C(0x0F0F0F0F0F0F0F0F));
+	x = ((x & Q_UINT64_C(0x00FF00FF00FF00FF)) << 8) | ((x >> 8) & Q_UINT64_C(0x00FF00FF00FF00FF));
+	x = ((x & Q_UINT64_C(0x0000FFFF0000FFFF)) << 16) | ((x >> 16) & Q_UINT64_C(0x0000FFFF0000FFFF));
+	return (x << 32) | (x >> 32);
+}
+
+// Karatsuba over the two 64 bit halves, the high half of each product is
+// obtained by multiplying the bit reversed operands.  The 256 bit result is
+// then reduced modulo x^128 + x^7 + x^2 + x + 1.
+static void ghash_portable(unsigned char *y, const unsigned char *h, const unsigned char *data, int len)
+{
+	quint64 y1 = load_be64(y);
+	quint64 y0 = load_be64(y + 8);
+	quint64 h1 = load_be64(h);
+	quint64 h0 = load_be64(h + 8);
+	quint64 h0r = rev64(h0);
+	quint64 h1r = rev64(h1);
+	quint64 h2 = h0 ^ h1;
+	quint64 h2r = h0r ^ h1r;
+
+	while(len > 0)
+	{
+		unsigned char tmp[16];
+		const unsigned char *src;
+		if(len >= 16)
+		{
+			src = data;
+			data += 16;
+			len -= 16;
+		}
+		else
+		{
+			memset(tmp, 0, 16);
+			memcpy(tmp, data, len);
+			src = tmp;
+			len = 0;
+		}
+
+		y1 ^= load_be64(src);
+		y0 ^= load_be64(src + 8);
+
+		quint64 y0r = rev64(y0);
+		quint64 y1r = rev64(y1);
+		quint64 y2 = y0 ^ y1;
+		quint64 y2r = y0r ^ y1r;
+
+		quint64 z0 = bmul64(y0, h0);
+		quint64 z1 = bmul64(y1, h1);
+		quint64 z2 = bmul64(y2, h2);
+		quint64 z0h = bmul64(y0r, h0r);
+		quint64 z1h = bmul64(y1r, h1r);
+		quint64 z2h = bmul64(y2r, h2r);
+		z2 ^= z0 ^ z1;
+		z2h ^= z0h ^ z1h;
+		z0h = rev64(z0h) >> 1;
+		z1h = rev64(z1h) >> 1;
+		z2h = rev64(z2h) >> 1;
+
+		quint64 v0 = z0;
+		quint64 v1 = z0h ^ z2;
+		quint64 v2 = z1 ^ z2h;
+		quint64 v3 = z1h;
+
+		v3 = (v3 << 1) | (v2 >> 63);
+		v2 = (v2 << 1) | (v1 >> 63);
+		v1 = (v1 << 1) | (v0 >> 63);
+		v0 = (v0 << 1);
+
+		v2 ^= v0 ^ (v0 >> 1) ^ (v0 >> 2) ^ (v0 >> 7);
+		v1 ^= (v0 << 63) ^ (v0 << 62) ^ (v0 << 57);
+		v3 ^= v1 ^ (v1 >> 1) ^ (v1 >> 2) ^ (v1 >> 7);
+		v2 ^= (v1 << 63) ^ (v1 << 62) ^ (v1 << 57);
+
+		y0 = v2;
+		y1 = v3;
+	}
+
+	store_be64(y, y1);
+	store_be64(y + 8, y0);
+}
+
+//----------------------------------------------------------------------------
+// PCLMULQDQ
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_SIMD)
+
+// The blocks are byte reversed so that the reflected polynomials fit the
+// carryless multiply.  Products are accumulated unreduced as lo, mid and
+// hi, which lets several blocks share one shift and reduction:
+//   Y = (Y ^ X1) H^n ^ X2 H^(n-1) ^ ... ^ Xn H
+
+QCA_TARGET("pclmul,ssse3")
+static inline __m128i clmul_bswap(__m128i x)
+{
+	return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+QCA_TARGET("pclmul,ssse3")
+static inline void clmul_acc(__m128i a, __m128i b, __m128i &lo, __m128i &mid, __m128i &hi)
+{
+	lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+	hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+	mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x10));
+	mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x01));
+}
+
+// shift the 256 bit product left by one and reduce modulo
+// x^128 + x^7 + x^2 + x + 1
+QCA_TARGET("pclmul,ssse3")
+static inline __m128i clmul_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+	lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+	__m128i t7 = _mm_srli_epi32(lo, 31);
+	__m128i t8 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	__m128i t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	lo = _mm_or_si128(lo, t7);
+	hi = _mm_or_si128(hi, t8);
+	hi = _mm_or_si128(hi, t9);
+
+	t7 = _mm_slli_epi32(lo, 31);
+	t8 = _mm_slli_epi32(lo, 30);
+	t9 = _mm_slli_epi32(lo, 25);
+	t7 = _mm_xor_si128(t7, _mm_xor_si128(t8, t9));
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	lo = _mm_xor_si128(lo, t7);
+
+	__m128i t2 = _mm_srli_epi32(lo, 1);
+	__m128i t4 = _mm_srli_epi32(lo, 2);
+	__m128i t5 = _mm_srli_epi32(lo, 7);
+	t2 = _mm_xor_si128(t2, _mm_xor_si128(t4, _mm_xor_si128(t5, t8)));
+	lo = _mm_xor_si128(lo, t2);
+	return _mm_xor_si128(hi, lo);
+}
+
+// hp holds H^8 ... H^1, so H^k is at hp + 16 * (8 - k)
+QCA_TARGET("pclmul,ssse3")
+static void ghash_pclmul(unsigned char *y, const unsigned char *hp, const unsigned char *data, int len)
+{
+	const __m128i h1 = _mm_loadu_si128((const __m128i *)(hp + 16 * 7));
+	const __m128i h2 = _mm_loadu_si128((const __m128i *)(hp + 16 * 6));
+	const __m128i h3 = _mm_loadu_si128((const __m128i *)(hp + 16 * 5));
+	const __m128i h4 = _mm_loadu_si128((const __m128i *)(hp + 16 * 4));
+	__m128i acc = clmul_bswap(_mm_loadu_si128((const __m128i *)y));
+
+	while(len >= 64)
+	{
+		__m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+		__m128i x0 = clmul_bswap(_mm_loadu_si128((const __m128i *)data));
+		__m128i x1 = clmul_bswap(_mm_loadu_si128((const __m128i *)(data + 16)));
+		__m128i x2 = clmul_bswap(_mm_loadu_si128((const __m128i *)(data + 32)));
+		__m128i x3 = clmul_bswap(_mm_loadu_si128((const __m128i *)(data + 48)));
+		clmul_acc(_mm_xor_si128(acc, x0), h4, lo, mid, hi);
+		clmul_acc(x1, h3, lo, mid, hi);
+		clmul_acc(x2, h2, lo, mid, hi);
+		clmul_acc(x3, h1, lo, mid, hi);
+		acc = clmul_reduce(lo, mid, hi);
+		data += 64;
+		len -= 64;
+	}
+
+	while(len > 0)
+	{
+		__m128i x;
+		if(len >= 16)
+		{
+			x = _mm_loadu_si128((const __m128i *)data);
+			data += 16;
+			len -= 16;
+		}
+		else
+		{
+			unsigned char tmp[16];
+			memset(tmp, 0, 16);
+			memcpy(tmp, data, len);
+			x = _mm_loadu_si128((const __m128i *)tmp);
+			len = 0;
+		}
+		__m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+		clmul_acc(_mm_xor_si128(acc, clmul_bswap(x)), h1, lo, mid, hi);
+		acc = clmul_reduce(lo, mid, hi);
+	}
+
+	_mm_storeu_si128((__m128i *)y, clmul_bswap(acc));
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// VPCLMULQDQ
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_VAES)
+
+// eight blocks per reduction, two per 256 bit register
+QCA_TARGET("vpclmulqdq,pclmul,avx2")
+static void ghash_vpclmul(unsigned char *y, const unsigned char *hp, const unsigned char *data, int len)
+{
+	const __m256i bswap = _mm256_set_epi8(
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m256i h87 = _mm256_loadu_si256((const __m256i *)hp);
+	const __m256i h65 = _mm256_loadu_si256((const __m256i *)(hp + 32));
+	const __m256i h43 = _mm256_loadu_si256((const __m256i *)(hp + 64));
+	const __m256i h21 = _mm256_loadu_si256((const __m256i *)(hp + 96));
+	__m128i acc = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)y), _mm256_castsi256_si128(bswap));
+
+	while(len >= 128)
+	{
+		__m256i x0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)data), bswap);
+		__m256i x1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(data + 32)), bswap);
+		__m256i x2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(data + 64)), bswap);
+		__m256i x3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(data + 96)), bswap);
+		x0 = _mm256_xor_si256(x0, _mm256_inserti128_si256(_mm256_setzero_si256(), acc, 0));
+
+		__m256i lo = _mm256_clmulepi64_epi128(x0, h87, 0x00);
+		__m256i hi = _mm256_clmulepi64_epi128(x0, h87, 0x11);
+		__m256i mid = _mm256_xor_si256(_mm256_clmulepi64_epi128(x0, h87, 0x10), _mm256_clmulepi64_epi128(x0, h87, 0x01));
+		lo = _mm256_xor_si256(lo, _mm256_clmulepi64_epi128(x1, h65, 0x00));
+		hi = _mm256_xor_si256(hi, _mm256_clmulepi64_epi128(x1, h65, 0x11));
+		mid = _mm256_xor_si256(mid, _mm256_xor_si256(_mm256_clmulepi64_epi128(x1, h65, 0x10), _mm256_clmulepi64_epi128(x1, h65, 0x01)));
+		lo = _mm256_xor_si256(lo, _mm256_clmulepi64_epi128(x2, h43, 0x00));
+		hi = _mm256_xor_si256(hi, _mm256_clmulepi64_epi128(x2, h43, 0x11));
+		mid = _mm256_xor_si256(mid, _mm256_xor_si256(_mm256_clmulepi64_epi128(x2, h43, 0x10), _mm256_clmulepi64_epi128(x2, h43, 0x01)));
+		lo = _mm256_xor_si256(lo, _mm256_clmulepi64_epi128(x3, h21, 0x00));
+		hi = _mm256_xor_si256(hi, _mm256_clmulepi64_epi128(x3, h21, 0x11));
+		mid = _mm256_xor_si256(mid, _mm256_xor_si256(_mm256_clmulepi64_epi128(x3, h21, 0x10), _mm256_clmulepi64_epi128(x3, h21, 0x01)));
+
+		acc = clmul_reduce(
+			_mm_xor_si128(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+			_mm_xor_si128(_mm256_castsi256_si128(mid), _mm256_extracti128_si256(mid, 1)),
+			_mm_xor_si128(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)));
+		data += 128;
+		len -= 128;
+	}
+
+	_mm_storeu_si128((__m128i *)y, _mm_shuffle_epi8(acc, _mm256_castsi256_si128(bswap)));
+	if(len > 0)
+		ghash_pclmul(y, hp, data, len);
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// GHash
+//----------------------------------------------------------------------------
+GHash::GHash()
+{
+	unsigned char zero[16];
+	memset(zero, 0, 16);
+	setKey(zero);
+}
+
+GHash::GHash(const unsigned char *_h)
+{
+	setKey(_h);
+}
+
+void GHash::setKey(const unsigned char *_h)
+{
+	memcpy(h, _h, 16);
+
+	impl = Portable;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuPCLMUL | CpuSSSE3))
+		impl = PCLMUL;
+#endif
+#if defined(QCA_X86_VAES)
+	if(impl == PCLMUL && hasCpuFeatures(CpuVPCLMUL))
+		impl = VPCLMUL;
+#endif
+	if(impl == Portable)
+	{
+		memset(hp, 0, sizeof(hp));
+		return;
+	}
+
+	unsigned char x[16];
+	memcpy(x, h, 16);
+	for(int k = 1; k <= 8; ++k)
+	{
+		unsigned char *dst = hp + 16 * (8 - k);
+		for(int n = 0; n < 16; ++n)
+			dst[n] = x[15 - n];
+		multiply(x, x, h);
+	}
+}
+
+void GHash::update(unsigned char *y, const unsigned char *data, int len) const
+{
+	switch(impl)
+	{
+#if defined(QCA_X86_VAES)
+		case VPCLMUL:
+			ghash_vpclmul(y, hp, data, len);
+			return;
+#endif
+#if defined(QCA_X86_SIMD)
+		case PCLMUL:
+			ghash_pclmul(y, hp, data, len);
+			return;
+#endif
+		default:
+			ghash_portable(y, h, data, len);
+			return;
+	}
+}
+
+void GHash::power(unsigned char *out, quint64 n) const
+{
+	// the multiplicative identity is the polynomial 1, which is the
+	// leftmost bit in the reflected representation
+	unsigned char result[16];
+	unsigned char base[16];
+	memset(result, 0, 16);
+	result[0] = 0x80;
+	memcpy(base, h, 16);
+
+	while(n)
+	{
+		if(n & 1)
+			multiply(result, result, base);
+		n >>= 1;
+		if(n)
+			multiply(base, base, base);
+	}
+
+	memcpy(out, result, 16);
+}
+
+void GHash::multiply(unsigned char *out, const unsigned char *a, const unsigned char *b)
+{
+	unsigned char y[16];
+	unsigned char bb[16];
+	memset(y, 0, 16);
+	memcpy(bb, b, 16);
+	ghash_portable(y, bb, a, 16);
+	memcpy(out, y, 16);
+}
+
+}
@@ -0,0 +1,63 @@
+/*
+ * qca_ghash.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_GHASH_H
+#define QCA_GHASH_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// GHASH, the universal hash of GCM (NIST SP 800-38D).  Blocks are in the
+// big endian, bit reflected representation used by the specification.  The
+// portable multiplication does not use any secret dependent table lookups
+// or branches.  update() uses PCLMULQDQ or VPCLMULQDQ when the CPU has
+// them, hashing four or eight blocks per reduction.
+class GHash
+{
+public:
+	GHash();
+	explicit GHash(const unsigned char *h);
+
+	void setKey(const unsigned char *h);
+
+	// y = (y ^ block) * H for each 16 byte block of data, a trailing
+	// partial block is zero padded
+	void update(unsigned char *y, const unsigned char *data, int len) const;
+
+	// out = H^n
+	void power(unsigned char *out, quint64 n) const;
+
+	// out = a * b
+	static void multiply(unsigned char *out, const unsigned char *a, const unsigned char *b);
+
+private:
+	enum Impl { Portable, PCLMUL, VPCLMUL };
+	Impl impl;
+	unsigned char h[16];
+	// H^8 ... H^1, byte reversed for the carryless multiply paths
+	unsigned char hp[16 * 8];
+};
+
+}
+
+#endif
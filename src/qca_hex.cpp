@@ -0,0 +1,328 @@
+/*
+ * qca_hex.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_hex.h"
+
+#include "qca_cpu.h"
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// -1 for characters that are not hex digits
+static const signed char hex_values[256] =
+{
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1,
+	-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+//----------------------------------------------------------------------------
+// Portable
+//----------------------------------------------------------------------------
+template<typename Char>
+static void encode_portable(const unsigned char *in, int len, Char *out)
+{
+	for(int n = 0; n < len; ++n)
+	{
+		out[0] = hex_digits[in[n] >> 4];
+		out[1] = hex_digits[in[n] & 0x0f];
+		out += 2;
+	}
+}
+
+static inline int hex_value(char c)
+{
+	return hex_values[(unsigned char)c];
+}
+
+static inline int hex_value(ushort c)
+{
+	return c < 256 ? hex_values[c] : -1;
+}
+
+template<typename Char>
+static bool decode_portable(const Char *in, int pairs, unsigned char *out)
+{
+	for(int n = 0; n < pairs; ++n)
+	{
+		int hi = hex_value(in[0]);
+		int lo = hex_value(in[1]);
+		if((hi | lo) < 0)
+			return false;
+		out[n] = (unsigned char)((hi << 4) | lo);
+		in += 2;
+	}
+	return true;
+}
+
+// The vector kernels translate nibbles to digits with a pshufb lookup.
+// Decoding checks each character against the ranges 0-9 and a-f (after
+// folding case), and joins pairs of nibbles with a multiply-add.  UTF-16
+// code units are narrowed with unsigned saturation, which maps anything
+// above 0xff to an invalid character.
+
+//----------------------------------------------------------------------------
+// SSSE3, 16 bytes <-> 32 characters
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_SIMD)
+
+QCA_TARGET("ssse3")
+static inline void store_chars(char *p, __m128i c)
+{
+	_mm_storeu_si128((__m128i *)p, c);
+}
+
+QCA_TARGET("ssse3")
+static inline void store_chars(ushort *p, __m128i c)
+{
+	_mm_storeu_si128((__m128i *)p, _mm_unpacklo_epi8(c, _mm_setzero_si128()));
+	_mm_storeu_si128((__m128i *)(p + 8), _mm_unpackhi_epi8(c, _mm_setzero_si128()));
+}
+
+QCA_TARGET("ssse3")
+static inline __m128i load_chars(const char *p)
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+QCA_TARGET("ssse3")
+static inline __m128i load_chars(const ushort *p)
+{
+	return _mm_packus_epi16(_mm_loadu_si128((const __m128i *)p), _mm_loadu_si128((const __m128i *)(p + 8)));
+}
+
+// nibble values -> digits
+QCA_TARGET("ssse3")
+static inline __m128i hex_digits_sse(__m128i v)
+{
+	const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	return _mm_shuffle_epi8(lut, v);
+}
+
+// digits -> nibble values, setting *bad for anything that isn't a digit
+QCA_TARGET("ssse3")
+static inline __m128i hex_values_sse(__m128i c, __m128i *bad)
+{
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_l = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+	*bad = _mm_or_si128(*bad, _mm_cmpeq_epi8(_mm_or_si128(is_d, is_l), _mm_setzero_si128()));
+	return _mm_or_si128(_mm_and_si128(is_d, d), _mm_and_si128(is_l, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+template<typename Char>
+QCA_TARGET("ssse3")
+static int encode_ssse3(const unsigned char *in, int len, Char *out)
+{
+	int n = 0;
+	for(; n + 16 <= len; n += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + n));
+		__m128i hi = hex_digits_sse(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)));
+		__m128i lo = hex_digits_sse(_mm_and_si128(v, _mm_set1_epi8(0x0f)));
+		store_chars(out + 2 * n, _mm_unpacklo_epi8(hi, lo));
+		store_chars(out + 2 * n + 16, _mm_unpackhi_epi8(hi, lo));
+	}
+	return n;
+}
+
+// Returns the number of pairs decoded, stopping at the first block with a
+// character that isn't a digit.
+template<typename Char>
+QCA_TARGET("ssse3")
+static int decode_ssse3(const Char *in, int pairs, unsigned char *out)
+{
+	int n = 0;
+	for(; n + 16 <= pairs; n += 16)
+	{
+		__m128i bad = _mm_setzero_si128();
+		__m128i a = hex_values_sse(load_chars(in + 2 * n), &bad);
+		__m128i b = hex_values_sse(load_chars(in + 2 * n + 16), &bad);
+		if(_mm_movemask_epi8(bad))
+			break;
+		a = _mm_maddubs_epi16(a, _mm_set1_epi16(0x0110));
+		b = _mm_maddubs_epi16(b, _mm_set1_epi16(0x0110));
+		_mm_storeu_si128((__m128i *)(out + n), _mm_packus_epi16(a, b));
+	}
+	return n;
+}
+
+//----------------------------------------------------------------------------
+// AVX2, 32 bytes <-> 64 characters
+//----------------------------------------------------------------------------
+QCA_TARGET("avx2")
+static inline void store_chars(char *p, __m256i c)
+{
+	_mm256_storeu_si256((__m256i *)p, c);
+}
+
+QCA_TARGET("avx2")
+static inline void store_chars(ushort *p, __m256i c)
+{
+	_mm256_storeu_si256((__m256i *)p, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(c)));
+	_mm256_storeu_si256((__m256i *)(p + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(c, 1)));
+}
+
+QCA_TARGET("avx2")
+static inline __m256i load_chars_avx2(const char *p)
+{
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+QCA_TARGET("avx2")
+static inline __m256i load_chars_avx2(const ushort *p)
+{
+	__m256i c = _mm256_packus_epi16(_mm256_loadu_si256((const __m256i *)p),
+		_mm256_loadu_si256((const __m256i *)(p + 16)));
+	return _mm256_permute4x64_epi64(c, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+QCA_TARGET("avx2")
+static inline __m256i hex_digits_avx2(__m256i v)
+{
+	const __m256i lut = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+		'0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	return _mm256_shuffle_epi8(lut, v);
+}
+
+QCA_TARGET("avx2")
+static inline __m256i hex_values_avx2(__m256i c, __m256i *bad)
+{
+	__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	__m256i is_d = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	__m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i is_l = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+	*bad = _mm256_or_si256(*bad, _mm256_cmpeq_epi8(_mm256_or_si256(is_d, is_l), _mm256_setzero_si256()));
+	return _mm256_or_si256(_mm256_and_si256(is_d, d), _mm256_and_si256(is_l, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+}
+
+template<typename Char>
+QCA_TARGET("avx2")
+static int encode_avx2(const unsigned char *in, int len, Char *out)
+{
+	int n = 0;
+	for(; n + 32 <= len; n += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + n));
+		__m256i hi = hex_digits_avx2(_mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f)));
+		__m256i lo = hex_digits_avx2(_mm256_and_si256(v, _mm256_set1_epi8(0x0f)));
+		// the unpacks work within 128 bit lanes
+		__m256i a = _mm256_unpacklo_epi8(hi, lo);
+		__m256i b = _mm256_unpackhi_epi8(hi, lo);
+		store_chars(out + 2 * n, _mm256_permute2x128_si256(a, b, 0x20));
+		store_chars(out + 2 * n + 32, _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	return n;
+}
+
+template<typename Char>
+QCA_TARGET("avx2")
+static int decode_avx2(const Char *in, int pairs, unsigned char *out)
+{
+	int n = 0;
+	for(; n + 32 <= pairs; n += 32)
+	{
+		__m256i bad = _mm256_setzero_si256();
+		__m256i a = hex_values_avx2(load_chars_avx2(in + 2 * n), &bad);
+		__m256i b = hex_values_avx2(load_chars_avx2(in + 2 * n + 32), &bad);
+		if(_mm256_movemask_epi8(bad))
+			break;
+		a = _mm256_maddubs_epi16(a, _mm256_set1_epi16(0x0110));
+		b = _mm256_maddubs_epi16(b, _mm256_set1_epi16(0x0110));
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)(out + n), v);
+	}
+	return n;
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// Hex
+//----------------------------------------------------------------------------
+template<typename Char>
+static void hex_encode(const unsigned char *in, int len, Char *out)
+{
+	int n = 0;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAVX2))
+		n = encode_avx2(in, len, out);
+	if(hasCpuFeatures(CpuSSSE3))
+		n += encode_ssse3(in + n, len - n, out + 2 * n);
+#endif
+	encode_portable(in + n, len - n, out + 2 * n);
+}
+
+template<typename Char>
+static bool hex_decode(const Char *in, int pairs, unsigned char *out)
+{
+	int n = 0;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAVX2))
+		n = decode_avx2(in, pairs, out);
+	if(hasCpuFeatures(CpuSSSE3))
+		n += decode_ssse3(in + 2 * n, pairs - n, out + n);
+#endif
+	return decode_portable(in + 2 * n, pairs - n, out + n);
+}
+
+void hexEncode(const unsigned char *in, int len, char *out)
+{
+	hex_encode(in, len, out);
+}
+
+void hexEncode(const unsigned char *in, int len, ushort *out)
+{
+	hex_encode(in, len, out);
+}
+
+bool hexDecode(const char *in, int pairs, unsigned char *out)
+{
+	return hex_decode(in, pairs, out);
+}
+
+bool hexDecode(const ushort *in, int pairs, unsigned char *out)
+{
+	return hex_decode(in, pairs, out);
+}
+
+}
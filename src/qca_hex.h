@@ -0,0 +1,46 @@
+/*
+ * qca_hex.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_HEX_H
+#define QCA_HEX_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// Hexadecimal text, lowercase when encoding and either case when
+// decoding.  Characters are bytes, or UTF-16 code units so that a QString
+// can be read or filled in place.  Both directions use AVX2 or SSSE3 when
+// the CPU has them.
+
+// Encodes len bytes of in as len * 2 characters of out.
+void hexEncode(const unsigned char *in, int len, char *out);
+void hexEncode(const unsigned char *in, int len, ushort *out);
+
+// Decodes pairs * 2 characters of in as pairs bytes of out.  Returns false
+// if a character is not a hex digit, in which case out is undefined.
+bool hexDecode(const char *in, int pairs, unsigned char *out);
+bool hexDecode(const ushort *in, int pairs, unsigned char *out);
+
+}
+
+#endif
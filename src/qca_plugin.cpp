@@ -609,6 +609,17 @@ Provider *ProviderManager::findFor(const QString &name, const QString &type) con
 {
 	if(name.isEmpty())
 	{
+		// a calibrated choice wins over the priority order
+		preferredMutex.lock();
+		QString pref = preferredMap.value(type);
+		preferredMutex.unlock();
+		if(!pref.isEmpty())
+		{
+			Provider *p = find(pref);
+			if(p && p->features().contains(type))
+				return p;
+		}
+
 		providerMutex.lock();
 		QList<ProviderItem*> list = providerItemList;
 		providerMutex.unlock();
@@ -640,6 +651,21 @@ Provider *ProviderManager::findFor(const QString &name, const QString &type) con
 	}
 }
 
+void ProviderManager::setPreferred(const QString &type, const QString &name)
+{
+	QMutexLocker locker(&preferredMutex);
+	if(name.isEmpty())
+		preferredMap.remove(type);
+	else
+		preferredMap[type] = name;
+}
+
+QMap<QString,QString> ProviderManager::preferred() const
+{
+	QMutexLocker locker(&preferredMutex);
+	return preferredMap;
+}
+
 void ProviderManager::changePriority(const QString &name, int priority)
 {
 	QMutexLocker locker(&providerMutex);
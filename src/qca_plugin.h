@@ -26,6 +26,7 @@
 // NOTE: this API is private to QCA
 
 #include "qca_core.h"
+#include <QMap>
 #include <QMutex>
 
 namespace QCA {
@@ -51,6 +52,11 @@ public:
 	QStringList allFeatures() const;
 	ProviderList providers() const;
 
+	// calibrated choice of provider per feature, consulted by findFor()
+	//   before the priority order when no provider is named
+	void setPreferred(const QString &type, const QString &name);
+	QMap<QString,QString> preferred() const;
+
 	static void mergeFeatures(QStringList *a, const QStringList &b);
 
 	QString diagnosticText() const;
@@ -58,8 +64,9 @@ public:
 	void clearDiagnosticText();
 
 private:
-	mutable QMutex logMutex, providerMutex;
+	mutable QMutex logMutex, providerMutex, preferredMutex;
 	QString dtext;
+	QMap<QString,QString> preferredMap;
 	QList<ProviderItem*> providerItemList;
 	ProviderList providerList;
 	Provider *def;
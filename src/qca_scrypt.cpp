@@ -0,0 +1,357 @@
+/*
+ * qca_scrypt.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_scrypt.h"
+
+#include "qca_cpu.h"
+#include "qca_sha2.h"
+
+#include <QList>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+static inline quint32 load_le32(const unsigned char *p)
+{
+	return (quint32)p[0] | ((quint32)p[1] << 8) | ((quint32)p[2] << 16) | ((quint32)p[3] << 24);
+}
+
+static inline void store_le32(unsigned char *p, quint32 v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+static void wipe(void *p, size_t len)
+{
+	volatile unsigned char *q = (volatile unsigned char *)p;
+	while(len--)
+		*q++ = 0;
+}
+
+//----------------------------------------------------------------------------
+// BlockMix
+//----------------------------------------------------------------------------
+// Y = BlockMix(B) for the 2 * r 64 byte blocks of B, as 32 bit words.  The
+//   even results go to the first half of Y and the odd ones to the second.
+typedef void (*ScryptMixFn)(const quint32 *B, quint32 *Y, quint32 r);
+
+#define SCRYPT_R(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
+
+static void salsa20_8(quint32 *B)
+{
+	quint32 x[16];
+	memcpy(x, B, sizeof(x));
+	for(int i = 0; i < 8; i += 2)
+	{
+		// columns
+		x[ 4] ^= SCRYPT_R(x[ 0] + x[12],  7); x[ 8] ^= SCRYPT_R(x[ 4] + x[ 0],  9);
+		x[12] ^= SCRYPT_R(x[ 8] + x[ 4], 13); x[ 0] ^= SCRYPT_R(x[12] + x[ 8], 18);
+		x[ 9] ^= SCRYPT_R(x[ 5] + x[ 1],  7); x[13] ^= SCRYPT_R(x[ 9] + x[ 5],  9);
+		x[ 1] ^= SCRYPT_R(x[13] + x[ 9], 13); x[ 5] ^= SCRYPT_R(x[ 1] + x[13], 18);
+		x[14] ^= SCRYPT_R(x[10] + x[ 6],  7); x[ 2] ^= SCRYPT_R(x[14] + x[10],  9);
+		x[ 6] ^= SCRYPT_R(x[ 2] + x[14], 13); x[10] ^= SCRYPT_R(x[ 6] + x[ 2], 18);
+		x[ 3] ^= SCRYPT_R(x[15] + x[11],  7); x[ 7] ^= SCRYPT_R(x[ 3] + x[15],  9);
+		x[11] ^= SCRYPT_R(x[ 7] + x[ 3], 13); x[15] ^= SCRYPT_R(x[11] + x[ 7], 18);
+		// rows
+		x[ 1] ^= SCRYPT_R(x[ 0] + x[ 3],  7); x[ 2] ^= SCRYPT_R(x[ 1] + x[ 0],  9);
+		x[ 3] ^= SCRYPT_R(x[ 2] + x[ 1], 13); x[ 0] ^= SCRYPT_R(x[ 3] + x[ 2], 18);
+		x[ 6] ^= SCRYPT_R(x[ 5] + x[ 4],  7); x[ 7] ^= SCRYPT_R(x[ 6] + x[ 5],  9);
+		x[ 4] ^= SCRYPT_R(x[ 7] + x[ 6], 13); x[ 5] ^= SCRYPT_R(x[ 4] + x[ 7], 18);
+		x[11] ^= SCRYPT_R(x[10] + x[ 9],  7); x[ 8] ^= SCRYPT_R(x[11] + x[10],  9);
+		x[ 9] ^= SCRYPT_R(x[ 8] + x[11], 13); x[10] ^= SCRYPT_R(x[ 9] + x[ 8], 18);
+		x[12] ^= SCRYPT_R(x[15] + x[14],  7); x[13] ^= SCRYPT_R(x[12] + x[15],  9);
+		x[14] ^= SCRYPT_R(x[13] + x[12], 13); x[15] ^= SCRYPT_R(x[14] + x[13], 18);
+	}
+	for(int n = 0; n < 16; ++n)
+		B[n] += x[n];
+}
+
+#undef SCRYPT_R
+
+static void blockmix_portable(const quint32 *B, quint32 *Y, quint32 r)
+{
+	quint32 X[16];
+	memcpy(X, B + (2 * r - 1) * 16, sizeof(X));
+	for(quint32 i = 0; i < 2 * r; ++i)
+	{
+		for(int n = 0; n < 16; ++n)
+			X[n] ^= B[16 * i + n];
+		salsa20_8(X);
+		memcpy(Y + (i / 2 + (i & 1) * r) * 16, X, sizeof(X));
+	}
+}
+
+#if defined(QCA_X86_SIMD)
+
+// The SSE2 version keeps each 64 byte block with its words reordered, so
+//   that the diagonals of the Salsa20 matrix are the rows of four
+//   registers (word i of a register holds word 5 * i % 16 of the block
+//   in the first one, and so on).  Only the shuffles between the column
+//   and row rounds are then needed.
+#define SCRYPT_SSE_R(x, t, n) \
+	x = _mm_xor_si128(x, _mm_slli_epi32(t, n)); \
+	x = _mm_xor_si128(x, _mm_srli_epi32(t, 32 - (n)));
+
+QCA_TARGET("sse2")
+static void blockmix_sse2(const quint32 *B, quint32 *Y, quint32 r)
+{
+	const __m128i *b = (const __m128i *)B;
+	__m128i X0 = _mm_loadu_si128(b + (2 * r - 1) * 4 + 0);
+	__m128i X1 = _mm_loadu_si128(b + (2 * r - 1) * 4 + 1);
+	__m128i X2 = _mm_loadu_si128(b + (2 * r - 1) * 4 + 2);
+	__m128i X3 = _mm_loadu_si128(b + (2 * r - 1) * 4 + 3);
+	for(quint32 i = 0; i < 2 * r; ++i)
+	{
+		X0 = _mm_xor_si128(X0, _mm_loadu_si128(b + 4 * i + 0));
+		X1 = _mm_xor_si128(X1, _mm_loadu_si128(b + 4 * i + 1));
+		X2 = _mm_xor_si128(X2, _mm_loadu_si128(b + 4 * i + 2));
+		X3 = _mm_xor_si128(X3, _mm_loadu_si128(b + 4 * i + 3));
+		__m128i Z0 = X0, Z1 = X1, Z2 = X2, Z3 = X3, T;
+		for(int round = 0; round < 8; round += 2)
+		{
+			T = _mm_add_epi32(X0, X3);
+			SCRYPT_SSE_R(X1, T, 7)
+			T = _mm_add_epi32(X1, X0);
+			SCRYPT_SSE_R(X2, T, 9)
+			T = _mm_add_epi32(X2, X1);
+			SCRYPT_SSE_R(X3, T, 13)
+			T = _mm_add_epi32(X3, X2);
+			SCRYPT_SSE_R(X0, T, 18)
+
+			X1 = _mm_shuffle_epi32(X1, 0x93);
+			X2 = _mm_shuffle_epi32(X2, 0x4E);
+			X3 = _mm_shuffle_epi32(X3, 0x39);
+
+			T = _mm_add_epi32(X0, X1);
+			SCRYPT_SSE_R(X3, T, 7)
+			T = _mm_add_epi32(X3, X0);
+			SCRYPT_SSE_R(X2, T, 9)
+			T = _mm_add_epi32(X2, X3);
+			SCRYPT_SSE_R(X1, T, 13)
+			T = _mm_add_epi32(X1, X2);
+			SCRYPT_SSE_R(X0, T, 18)
+
+			X1 = _mm_shuffle_epi32(X1, 0x39);
+			X2 = _mm_shuffle_epi32(X2, 0x4E);
+			X3 = _mm_shuffle_epi32(X3, 0x93);
+		}
+		X0 = _mm_add_epi32(X0, Z0);
+		X1 = _mm_add_epi32(X1, Z1);
+		X2 = _mm_add_epi32(X2, Z2);
+		X3 = _mm_add_epi32(X3, Z3);
+
+		__m128i *y = (__m128i *)(Y + (i / 2 + (i & 1) * r) * 16);
+		_mm_storeu_si128(y + 0, X0);
+		_mm_storeu_si128(y + 1, X1);
+		_mm_storeu_si128(y + 2, X2);
+		_mm_storeu_si128(y + 3, X3);
+	}
+}
+
+#undef SCRYPT_SSE_R
+
+#endif
+
+//----------------------------------------------------------------------------
+// ROMix
+//----------------------------------------------------------------------------
+class ScryptInstance
+{
+public:
+	unsigned char *B;
+	quint64 N;
+	quint32 r;
+	ScryptMixFn mix;
+	// position of each word of a block in the layout of 'mix'
+	int order[16];
+};
+
+// B_i = ROMix(B_i) for i in [first, first + count), with V and the two
+//   working blocks allocated here
+class ScryptSlice : public QRunnable
+{
+public:
+	const ScryptInstance *inst;
+	quint32 first, count;
+	bool ok;
+
+	ScryptSlice() : inst(0), first(0), count(0), ok(false)
+	{
+		setAutoDelete(false);
+	}
+
+	virtual void run()
+	{
+		const quint32 r = inst->r;
+		const quint64 N = inst->N;
+		const size_t words = 32 * (size_t)r;
+		const size_t vBytes = (size_t)N * words * 4;
+		quint32 *V = (quint32 *)malloc(vBytes);
+		quint32 *X = (quint32 *)malloc(2 * words * 4);
+		if(!V || !X)
+		{
+			free(V);
+			free(X);
+			return;
+		}
+		quint32 *Y = X + words;
+
+		// the low half of Integerify() is word 0 of the last block, the
+		//   high half word 1, wherever the layout keeps it
+		const size_t lo = (2 * r - 1) * 16 + inst->order[0];
+		const size_t hi = (2 * r - 1) * 16 + inst->order[1];
+
+		for(quint32 p = first; p < first + count; ++p)
+		{
+			unsigned char *Bp = inst->B + p * words * 4;
+			for(size_t k = 0; k < 2 * r; ++k)
+				for(int n = 0; n < 16; ++n)
+					X[k * 16 + inst->order[n]] = load_le32(Bp + (k * 16 + n) * 4);
+
+			for(quint64 i = 0; i < N; i += 2)
+			{
+				memcpy(V + i * words, X, words * 4);
+				inst->mix(X, Y, r);
+				memcpy(V + (i + 1) * words, Y, words * 4);
+				inst->mix(Y, X, r);
+			}
+			for(quint64 i = 0; i < N; i += 2)
+			{
+				quint64 j = (X[lo] | ((quint64)X[hi] << 32)) & (N - 1);
+				const quint32 *v = V + j * words;
+				for(size_t n = 0; n < words; ++n)
+					X[n] ^= v[n];
+				inst->mix(X, Y, r);
+
+				j = (Y[lo] | ((quint64)Y[hi] << 32)) & (N - 1);
+				v = V + j * words;
+				for(size_t n = 0; n < words; ++n)
+					Y[n] ^= v[n];
+				inst->mix(Y, X, r);
+			}
+
+			for(size_t k = 0; k < 2 * r; ++k)
+				for(int n = 0; n < 16; ++n)
+					store_le32(Bp + (k * 16 + n) * 4, X[k * 16 + inst->order[n]]);
+		}
+
+		wipe(V, vBytes);
+		wipe(X, 2 * words * 4);
+		free(V);
+		free(X);
+		ok = true;
+	}
+};
+
+bool scrypt(const unsigned char *password, int passwordLen,
+	const unsigned char *salt, int saltLen,
+	quint64 N, quint32 r, quint32 p, int threads,
+	unsigned char *out, int outLen)
+{
+	if(passwordLen < 0 || saltLen < 0 || outLen < 0)
+		return false;
+	if(N < 2 || (N & (N - 1)) != 0 || r < 1 || p < 1)
+		return false;
+	// N < 2^(128 * r / 8), and p * r <= (2^30 - 1)
+	if(r < 4 && (N >> (16 * r)) != 0)
+		return false;
+	if((quint64)r * p > (1 << 30) - 1)
+		return false;
+
+	// B has to fit the length PBKDF2 takes, V the address space
+	const quint64 blockBytes = 128 * (quint64)r;
+	if(blockBytes * p > INT_MAX || N > (quint64)(size_t)-1 / blockBytes)
+		return false;
+	const int bLen = (int)(blockBytes * p);
+
+	ScryptInstance inst;
+	inst.N = N;
+	inst.r = r;
+	inst.mix = blockmix_portable;
+	for(int n = 0; n < 16; ++n)
+		inst.order[n] = n;
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuSSE2))
+	{
+		inst.mix = blockmix_sse2;
+		for(int n = 0; n < 16; ++n)
+			inst.order[5 * n % 16] = n;
+	}
+#endif
+
+	inst.B = (unsigned char *)malloc(bLen);
+	if(!inst.B)
+		return false;
+	pbkdf2Sha256(password, passwordLen, salt, saltLen, 1, inst.B, bLen);
+
+	if(threads <= 0)
+		threads = QThread::idealThreadCount();
+	threads = (int)qMin((quint32)qMax(threads, 1), p);
+	const quint32 share = (p + threads - 1) / threads;
+	QList<ScryptSlice *> slices;
+	for(quint32 first = 0; first < p; first += share)
+	{
+		ScryptSlice *slice = new ScryptSlice;
+		slice->inst = &inst;
+		slice->first = first;
+		slice->count = qMin(share, p - first);
+		slices += slice;
+	}
+
+	if(slices.count() == 1)
+		slices[0]->run();
+	else
+	{
+		QThreadPool pool;
+		pool.setMaxThreadCount(threads);
+		foreach(ScryptSlice *slice, slices)
+			pool.start(slice);
+		pool.waitForDone();
+	}
+
+	bool ok = true;
+	foreach(ScryptSlice *slice, slices)
+	{
+		if(!slice->ok)
+			ok = false;
+	}
+	qDeleteAll(slices);
+
+	if(ok)
+		pbkdf2Sha256(password, passwordLen, inst.B, bLen, 1, out, outLen);
+	wipe(inst.B, bLen);
+	free(inst.B);
+	return ok;
+}
+
+}
@@ -0,0 +1,44 @@
+/*
+ * qca_scrypt.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_SCRYPT_H
+#define QCA_SCRYPT_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// scrypt as in RFC 7914.  N is the cost, a power of 2 greater than 1, r the
+//   block size and p the parallelization.  The p ROMix computations run on
+//   up to 'threads' threads (0 for one per computation, at most
+//   QThread::idealThreadCount()), each with its own 128 * r * N bytes of
+//   memory, and Salsa20/8 uses SSE2 when the CPU has it.  Returns false
+//   for parameters outside the limits of the RFC, or if the memory can't
+//   be allocated.
+bool scrypt(const unsigned char *password, int passwordLen,
+	const unsigned char *salt, int saltLen,
+	quint64 N, quint32 r, quint32 p, int threads,
+	unsigned char *out, int outLen);
+
+}
+
+#endif
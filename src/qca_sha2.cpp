@@ -0,0 +1,1110 @@
+/*
+ * qca_sha2.cpp - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "qca_sha2.h"
+
+#include "qca_cpu.h"
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QVarLengthArray>
+
+#include <string.h>
+
+#if defined(QCA_X86_SIMD)
+# include <immintrin.h>
+#endif
+
+namespace QCA {
+
+static inline quint32 load_be32(const unsigned char *p)
+{
+	return ((quint32)p[0] << 24) | ((quint32)p[1] << 16) | ((quint32)p[2] << 8) | (quint32)p[3];
+}
+
+static inline void store_be32(unsigned char *p, quint32 v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static inline quint64 load_be64(const unsigned char *p)
+{
+	return ((quint64)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static inline void store_be64(unsigned char *p, quint64 v)
+{
+	store_be32(p, (quint32)(v >> 32));
+	store_be32(p + 4, (quint32)v);
+}
+
+static void wipe(void *p, int len)
+{
+	volatile unsigned char *q = (volatile unsigned char *)p;
+	for(int n = 0; n < len; ++n)
+		q[n] = 0;
+}
+
+static const quint32 sha256_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const quint32 sha256_iv[8] =
+{
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const quint64 sha512_k[80] =
+{
+	Q_UINT64_C(0x428a2f98d728ae22), Q_UINT64_C(0x7137449123ef65cd),
+	Q_UINT64_C(0xb5c0fbcfec4d3b2f), Q_UINT64_C(0xe9b5dba58189dbbc),
+	Q_UINT64_C(0x3956c25bf348b538), Q_UINT64_C(0x59f111f1b605d019),
+	Q_UINT64_C(0x923f82a4af194f9b), Q_UINT64_C(0xab1c5ed5da6d8118),
+	Q_UINT64_C(0xd807aa98a3030242), Q_UINT64_C(0x12835b0145706fbe),
+	Q_UINT64_C(0x243185be4ee4b28c), Q_UINT64_C(0x550c7dc3d5ffb4e2),
+	Q_UINT64_C(0x72be5d74f27b896f), Q_UINT64_C(0x80deb1fe3b1696b1),
+	Q_UINT64_C(0x9bdc06a725c71235), Q_UINT64_C(0xc19bf174cf692694),
+	Q_UINT64_C(0xe49b69c19ef14ad2), Q_UINT64_C(0xefbe4786384f25e3),
+	Q_UINT64_C(0x0fc19dc68b8cd5b5), Q_UINT64_C(0x240ca1cc77ac9c65),
+	Q_UINT64_C(0x2de92c6f592b0275), Q_UINT64_C(0x4a7484aa6ea6e483),
+	Q_UINT64_C(0x5cb0a9dcbd41fbd4), Q_UINT64_C(0x76f988da831153b5),
+	Q_UINT64_C(0x983e5152ee66dfab), Q_UINT64_C(0xa831c66d2db43210),
+	Q_UINT64_C(0xb00327c898fb213f), Q_UINT64_C(0xbf597fc7beef0ee4),
+	Q_UINT64_C(0xc6e00bf33da88fc2), Q_UINT64_C(0xd5a79147930aa725),
+	Q_UINT64_C(0x06ca6351e003826f), Q_UINT64_C(0x142929670a0e6e70),
+	Q_UINT64_C(0x27b70a8546d22ffc), Q_UINT64_C(0x2e1b21385c26c926),
+	Q_UINT64_C(0x4d2c6dfc5ac42aed), Q_UINT64_C(0x53380d139d95b3df),
+	Q_UINT64_C(0x650a73548baf63de), Q_UINT64_C(0x766a0abb3c77b2a8),
+	Q_UINT64_C(0x81c2c92e47edaee6), Q_UINT64_C(0x92722c851482353b),
+	Q_UINT64_C(0xa2bfe8a14cf10364), Q_UINT64_C(0xa81a664bbc423001),
+	Q_UINT64_C(0xc24b8b70d0f89791), Q_UINT64_C(0xc76c51a30654be30),
+	Q_UINT64_C(0xd192e819d6ef5218), Q_UINT64_C(0xd69906245565a910),
+	Q_UINT64_C(0xf40e35855771202a), Q_UINT64_C(0x106aa07032bbd1b8),
+	Q_UINT64_C(0x19a4c116b8d2d0c8), Q_UINT64_C(0x1e376c085141ab53),
+	Q_UINT64_C(0x2748774cdf8eeb99), Q_UINT64_C(0x34b0bcb5e19b48a8),
+	Q_UINT64_C(0x391c0cb3c5c95a63), Q_UINT64_C(0x4ed8aa4ae3418acb),
+	Q_UINT64_C(0x5b9cca4f7763e373), Q_UINT64_C(0x682e6ff3d6b2b8a3),
+	Q_UINT64_C(0x748f82ee5defb2fc), Q_UINT64_C(0x78a5636f43172f60),
+	Q_UINT64_C(0x84c87814a1f0ab72), Q_UINT64_C(0x8cc702081a6439ec),
+	Q_UINT64_C(0x90befffa23631e28), Q_UINT64_C(0xa4506cebde82bde9),
+	Q_UINT64_C(0xbef9a3f7b2c67915), Q_UINT64_C(0xc67178f2e372532b),
+	Q_UINT64_C(0xca273eceea26619c), Q_UINT64_C(0xd186b8c721c0c207),
+	Q_UINT64_C(0xeada7dd6cde0eb1e), Q_UINT64_C(0xf57d4f7fee6ed178),
+	Q_UINT64_C(0x06f067aa72176fba), Q_UINT64_C(0x0a637dc5a2c898a6),
+	Q_UINT64_C(0x113f9804bef90dae), Q_UINT64_C(0x1b710b35131c471b),
+	Q_UINT64_C(0x28db77f523047d84), Q_UINT64_C(0x32caab7b40c72493),
+	Q_UINT64_C(0x3c9ebe0a15c9bebc), Q_UINT64_C(0x431d67c49c100d4c),
+	Q_UINT64_C(0x4cc5d4becb3e42b6), Q_UINT64_C(0x597f299cfc657e2a),
+	Q_UINT64_C(0x5fcb6fab3ad6faec), Q_UINT64_C(0x6c44198c4a475817)
+};
+
+static const quint64 sha512_iv[8] =
+{
+	Q_UINT64_C(0x6a09e667f3bcc908), Q_UINT64_C(0xbb67ae8584caa73b),
+	Q_UINT64_C(0x3c6ef372fe94f82b), Q_UINT64_C(0xa54ff53a5f1d36f1),
+	Q_UINT64_C(0x510e527fade682d1), Q_UINT64_C(0x9b05688c2b3e6c1f),
+	Q_UINT64_C(0x1f83d9abfb41bd6b), Q_UINT64_C(0x5be0cd19137e2179)
+};
+
+//----------------------------------------------------------------------------
+// Portable compression functions
+//----------------------------------------------------------------------------
+#define SHA2_ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA2_ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define SHA2_CH(e, f, g) ((g) ^ ((e) & ((f) ^ (g))))
+#define SHA2_MAJ(a, b, c) (((a) & (b)) | ((c) & ((a) | (b))))
+
+static void sha256_portable(quint32 *hs, const unsigned char *data, int count)
+{
+	for(; count > 0; --count, data += 64)
+	{
+		quint32 w[64];
+		for(int i = 0; i < 16; ++i)
+			w[i] = load_be32(data + 4 * i);
+		for(int i = 16; i < 64; ++i)
+		{
+			quint32 s0 = SHA2_ROR32(w[i - 15], 7) ^ SHA2_ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			quint32 s1 = SHA2_ROR32(w[i - 2], 17) ^ SHA2_ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		quint32 a = hs[0], b = hs[1], c = hs[2], d = hs[3];
+		quint32 e = hs[4], f = hs[5], g = hs[6], h = hs[7];
+		for(int i = 0; i < 64; ++i)
+		{
+			quint32 t1 = h + (SHA2_ROR32(e, 6) ^ SHA2_ROR32(e, 11) ^ SHA2_ROR32(e, 25)) + SHA2_CH(e, f, g) + sha256_k[i] + w[i];
+			quint32 t2 = (SHA2_ROR32(a, 2) ^ SHA2_ROR32(a, 13) ^ SHA2_ROR32(a, 22)) + SHA2_MAJ(a, b, c);
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		hs[0] += a; hs[1] += b; hs[2] += c; hs[3] += d;
+		hs[4] += e; hs[5] += f; hs[6] += g; hs[7] += h;
+	}
+}
+
+static void sha512_portable(quint64 *hs, const unsigned char *data, int count)
+{
+	for(; count > 0; --count, data += 128)
+	{
+		quint64 w[80];
+		for(int i = 0; i < 16; ++i)
+			w[i] = load_be64(data + 8 * i);
+		for(int i = 16; i < 80; ++i)
+		{
+			quint64 s0 = SHA2_ROR64(w[i - 15], 1) ^ SHA2_ROR64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+			quint64 s1 = SHA2_ROR64(w[i - 2], 19) ^ SHA2_ROR64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		quint64 a = hs[0], b = hs[1], c = hs[2], d = hs[3];
+		quint64 e = hs[4], f = hs[5], g = hs[6], h = hs[7];
+		for(int i = 0; i < 80; ++i)
+		{
+			quint64 t1 = h + (SHA2_ROR64(e, 14) ^ SHA2_ROR64(e, 18) ^ SHA2_ROR64(e, 41)) + SHA2_CH(e, f, g) + sha512_k[i] + w[i];
+			quint64 t2 = (SHA2_ROR64(a, 28) ^ SHA2_ROR64(a, 34) ^ SHA2_ROR64(a, 39)) + SHA2_MAJ(a, b, c);
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		hs[0] += a; hs[1] += b; hs[2] += c; hs[3] += d;
+		hs[4] += e; hs[5] += f; hs[6] += g; hs[7] += h;
+	}
+}
+
+//----------------------------------------------------------------------------
+// SHA extensions
+//----------------------------------------------------------------------------
+#if defined(QCA_X86_SIMD)
+
+// four rounds, scheduling the message words for them first when past the
+//   first 16
+#define SHANI_ROUNDS(g, m0, m1, m2, m3) \
+	if((g) >= 4) \
+		m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4)), m3); \
+	k = _mm_add_epi32(m0, _mm_loadu_si128((const __m128i *)(sha256_k + 4 * (g)))); \
+	cdgh = _mm_sha256rnds2_epu32(cdgh, abef, k); \
+	abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(k, 0x0e));
+
+QCA_TARGET("sha,sse4.1")
+static void sha256_shani(quint32 *hs, const unsigned char *data, int count)
+{
+	const __m128i bswap = _mm_set_epi64x(Q_INT64_C(0x0c0d0e0f08090a0b), Q_INT64_C(0x0405060700010203));
+
+	// the instructions want the state as ABEF and CDGH
+	__m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)hs), 0xb1);
+	__m128i hgfe = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(hs + 4)), 0x1b);
+	__m128i abef = _mm_alignr_epi8(dcba, hgfe, 8);
+	__m128i cdgh = _mm_blend_epi16(hgfe, dcba, 0xf0);
+
+	for(; count > 0; --count, data += 64)
+	{
+		__m128i abef_in = abef;
+		__m128i cdgh_in = cdgh;
+		__m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), bswap);
+		__m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), bswap);
+		__m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), bswap);
+		__m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), bswap);
+		__m128i k;
+
+		for(int g = 0; g < 16; g += 4)
+		{
+			SHANI_ROUNDS(g, m0, m1, m2, m3)
+			SHANI_ROUNDS(g + 1, m1, m2, m3, m0)
+			SHANI_ROUNDS(g + 2, m2, m3, m0, m1)
+			SHANI_ROUNDS(g + 3, m3, m0, m1, m2)
+		}
+
+		abef = _mm_add_epi32(abef, abef_in);
+		cdgh = _mm_add_epi32(cdgh, cdgh_in);
+	}
+
+	__m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+	__m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i *)hs, _mm_blend_epi16(feba, dchg, 0xf0));
+	_mm_storeu_si128((__m128i *)(hs + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// Sha256
+//----------------------------------------------------------------------------
+Sha256::Sha256()
+{
+	clear();
+}
+
+Sha256::~Sha256()
+{
+	wipe(h, sizeof(h));
+	wipe(buf, sizeof(buf));
+}
+
+void Sha256::clear()
+{
+	memcpy(h, sha256_iv, sizeof(h));
+	used = 0;
+	total = 0;
+}
+
+void Sha256::resume(const quint32 *state)
+{
+	memcpy(h, state, sizeof(h));
+	used = 0;
+	total = BlockSize;
+}
+
+void Sha256::compress(quint32 *hs, const unsigned char *blocks, int count)
+{
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuSHA | CpuSSE41))
+	{
+		sha256_shani(hs, blocks, count);
+		return;
+	}
+#endif
+	sha256_portable(hs, blocks, count);
+}
+
+void Sha256::update(const unsigned char *data, int len)
+{
+	total += len;
+	if(used > 0)
+	{
+		int n = qMin(len, 64 - used);
+		memcpy(buf + used, data, n);
+		used += n;
+		data += n;
+		len -= n;
+		if(used < 64)
+			return;
+		compress(h, buf, 1);
+		used = 0;
+	}
+	if(len >= 64)
+	{
+		compress(h, data, len / 64);
+		data += len & ~63;
+		len &= 63;
+	}
+	memcpy(buf, data, len);
+	used = len;
+}
+
+void Sha256::final(unsigned char *digest)
+{
+	quint64 bits = total * 8;
+	buf[used++] = 0x80;
+	if(used > 56)
+	{
+		memset(buf + used, 0, 64 - used);
+		compress(h, buf, 1);
+		used = 0;
+	}
+	memset(buf + used, 0, 56 - used);
+	store_be64(buf + 56, bits);
+	compress(h, buf, 1);
+	for(int n = 0; n < 8; ++n)
+		store_be32(digest + 4 * n, h[n]);
+	clear();
+}
+
+//----------------------------------------------------------------------------
+// Sha512
+//----------------------------------------------------------------------------
+Sha512::Sha512()
+{
+	clear();
+}
+
+Sha512::~Sha512()
+{
+	wipe(h, sizeof(h));
+	wipe(buf, sizeof(buf));
+}
+
+void Sha512::clear()
+{
+	memcpy(h, sha512_iv, sizeof(h));
+	used = 0;
+	total = 0;
+}
+
+void Sha512::resume(const quint64 *state)
+{
+	memcpy(h, state, sizeof(h));
+	used = 0;
+	total = BlockSize;
+}
+
+void Sha512::compress(quint64 *hs, const unsigned char *blocks, int count)
+{
+	sha512_portable(hs, blocks, count);
+}
+
+void Sha512::update(const unsigned char *data, int len)
+{
+	total += len;
+	if(used > 0)
+	{
+		int n = qMin(len, 128 - used);
+		memcpy(buf + used, data, n);
+		used += n;
+		data += n;
+		len -= n;
+		if(used < 128)
+			return;
+		compress(h, buf, 1);
+		used = 0;
+	}
+	if(len >= 128)
+	{
+		compress(h, data, len / 128);
+		data += len & ~127;
+		len &= 127;
+	}
+	memcpy(buf, data, len);
+	used = len;
+}
+
+void Sha512::final(unsigned char *digest)
+{
+	buf[used++] = 0x80;
+	if(used > 112)
+	{
+		memset(buf + used, 0, 128 - used);
+		compress(h, buf, 1);
+		used = 0;
+	}
+	memset(buf + used, 0, 112 - used);
+	store_be64(buf + 112, total >> 61);
+	store_be64(buf + 120, total << 3);
+	compress(h, buf, 1);
+	for(int n = 0; n < 8; ++n)
+		store_be64(digest + 8 * n, h[n]);
+	clear();
+}
+
+//----------------------------------------------------------------------------
+// PBKDF2 lanes
+//----------------------------------------------------------------------------
+// One PBKDF2 output block in progress: the HMAC inner and outer states
+//   after the key block, the last U and the running T.  Once U1 is known,
+//   every further iteration hashes exactly one block with each state, so
+//   the padding is fixed and the lanes run in lockstep.
+class Sha256Lane
+{
+public:
+	quint32 istate[8], ostate[8], u[8], t[8];
+};
+
+class Sha512Lane
+{
+public:
+	quint64 istate[8], ostate[8], u[8], t[8];
+};
+
+static void sha256_lane_scalar(Sha256Lane *lane, quint32 iterations)
+{
+	// U and the HMAC inner digest are both 32 bytes after a 64 byte key
+	//   block: a 768 bit message
+	unsigned char block[64];
+	memset(block, 0, sizeof(block));
+	block[32] = 0x80;
+	store_be32(block + 60, 768);
+
+	for(quint32 it = 0; it < iterations; ++it)
+	{
+		quint32 s[8];
+		for(int n = 0; n < 8; ++n)
+			store_be32(block + 4 * n, lane->u[n]);
+		memcpy(s, lane->istate, sizeof(s));
+		Sha256::compress(s, block, 1);
+		for(int n = 0; n < 8; ++n)
+			store_be32(block + 4 * n, s[n]);
+		memcpy(s, lane->ostate, sizeof(s));
+		Sha256::compress(s, block, 1);
+		for(int n = 0; n < 8; ++n)
+		{
+			lane->u[n] = s[n];
+			lane->t[n] ^= s[n];
+		}
+	}
+	wipe(block, sizeof(block));
+}
+
+static void sha512_lane_scalar(Sha512Lane *lane, quint32 iterations)
+{
+	unsigned char block[128];
+	memset(block, 0, sizeof(block));
+	block[64] = 0x80;
+	store_be64(block + 120, 1536);
+
+	for(quint32 it = 0; it < iterations; ++it)
+	{
+		quint64 s[8];
+		for(int n = 0; n < 8; ++n)
+			store_be64(block + 8 * n, lane->u[n]);
+		memcpy(s, lane->istate, sizeof(s));
+		Sha512::compress(s, block, 1);
+		for(int n = 0; n < 8; ++n)
+			store_be64(block + 8 * n, s[n]);
+		memcpy(s, lane->ostate, sizeof(s));
+		Sha512::compress(s, block, 1);
+		for(int n = 0; n < 8; ++n)
+		{
+			lane->u[n] = s[n];
+			lane->t[n] ^= s[n];
+		}
+	}
+	wipe(block, sizeof(block));
+}
+
+#if defined(QCA_X86_SIMD)
+
+// The vector kernels are written once in terms of V and the V_* operations,
+//   which each instruction set defines before expanding them.  W is the
+//   number of lanes, and T the word type.
+
+#define SHA2V_XOR3(a, b, c) V_XOR(V_XOR(a, b), c)
+#define SHA2V_CH(e, f, g) V_XOR(g, V_AND(e, V_XOR(f, g)))
+#define SHA2V_MAJ(a, b, c) V_OR(V_AND(a, b), V_AND(c, V_OR(a, b)))
+
+#define SHA2V_ROUND(S0, S1, K) \
+	{ \
+		V t1 = V_ADD(V_ADD(h, S1(e)), V_ADD(V_CH(e, f, g), V_ADD(V_SET1(K), w[i & 15]))); \
+		V t2 = V_ADD(S0(a), V_MAJ(a, b, c)); \
+		h = g; g = f; f = e; e = V_ADD(d, t1); \
+		d = c; c = b; b = a; a = V_ADD(t1, t2); \
+	}
+
+// s = compress(s, w), w is overwritten by the message schedule
+#define SHA2V_COMPRESS(ROUNDS, S0, S1, s0, s1, K) \
+	{ \
+		V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7]; \
+		for(int i = 0; i < 16; ++i) \
+			SHA2V_ROUND(S0, S1, K[i]) \
+		for(int i = 16; i < ROUNDS; ++i) \
+		{ \
+			w[i & 15] = V_ADD(V_ADD(w[i & 15], s1(w[(i - 2) & 15])), V_ADD(w[(i - 7) & 15], s0(w[(i - 15) & 15]))); \
+			SHA2V_ROUND(S0, S1, K[i]) \
+		} \
+		s[0] = V_ADD(s[0], a); s[1] = V_ADD(s[1], b); s[2] = V_ADD(s[2], c); s[3] = V_ADD(s[3], d); \
+		s[4] = V_ADD(s[4], e); s[5] = V_ADD(s[5], f); s[6] = V_ADD(s[6], g); s[7] = V_ADD(s[7], h); \
+	}
+
+#define SHA256V_S0(x) SHA2V_XOR3(V_ROR(x, 2), V_ROR(x, 13), V_ROR(x, 22))
+#define SHA256V_S1(x) SHA2V_XOR3(V_ROR(x, 6), V_ROR(x, 11), V_ROR(x, 25))
+#define SHA256V_s0(x) SHA2V_XOR3(V_ROR(x, 7), V_ROR(x, 18), V_SHR(x, 3))
+#define SHA256V_s1(x) SHA2V_XOR3(V_ROR(x, 17), V_ROR(x, 19), V_SHR(x, 10))
+
+#define SHA512V_S0(x) SHA2V_XOR3(V_ROR(x, 28), V_ROR(x, 34), V_ROR(x, 39))
+#define SHA512V_S1(x) SHA2V_XOR3(V_ROR(x, 14), V_ROR(x, 18), V_ROR(x, 41))
+#define SHA512V_s0(x) SHA2V_XOR3(V_ROR(x, 1), V_ROR(x, 8), V_SHR(x, 7))
+#define SHA512V_s1(x) SHA2V_XOR3(V_ROR(x, 19), V_ROR(x, 61), V_SHR(x, 6))
+
+// lanes[0..W) are transposed into vectors, iterated, and written back.
+//   'pad' is the first padding word and 'bits' the message length of the
+//   fixed one block messages.
+#define SHA2V_PBKDF2(W, T, ROUNDS, PFX, K, pad, bits) \
+	V istate[8], ostate[8], u[8], t[8]; \
+	for(int n = 0; n < 8; ++n) \
+	{ \
+		T x[4][W]; \
+		for(int l = 0; l < W; ++l) \
+		{ \
+			x[0][l] = lanes[l].istate[n]; \
+			x[1][l] = lanes[l].ostate[n]; \
+			x[2][l] = lanes[l].u[n]; \
+			x[3][l] = lanes[l].t[n]; \
+		} \
+		istate[n] = V_LOAD(x[0]); \
+		ostate[n] = V_LOAD(x[1]); \
+		u[n] = V_LOAD(x[2]); \
+		t[n] = V_LOAD(x[3]); \
+	} \
+	const V vpad = V_SET1(pad); \
+	const V vbits = V_SET1(bits); \
+	const V vzero = V_SET1(0); \
+	for(quint32 it = 0; it < iterations; ++it) \
+	{ \
+		V s[8], w[16]; \
+		for(int n = 0; n < 8; ++n) \
+		{ \
+			s[n] = istate[n]; \
+			w[n] = u[n]; \
+		} \
+		w[8] = vpad; \
+		for(int n = 9; n < 15; ++n) \
+			w[n] = vzero; \
+		w[15] = vbits; \
+		SHA2V_COMPRESS(ROUNDS, PFX##_S0, PFX##_S1, PFX##_s0, PFX##_s1, K) \
+		for(int n = 0; n < 8; ++n) \
+		{ \
+			w[n] = s[n]; \
+			s[n] = ostate[n]; \
+		} \
+		w[8] = vpad; \
+		for(int n = 9; n < 15; ++n) \
+			w[n] = vzero; \
+		w[15] = vbits; \
+		SHA2V_COMPRESS(ROUNDS, PFX##_S0, PFX##_S1, PFX##_s0, PFX##_s1, K) \
+		for(int n = 0; n < 8; ++n) \
+		{ \
+			u[n] = s[n]; \
+			t[n] = V_XOR(t[n], s[n]); \
+		} \
+	} \
+	for(int n = 0; n < 8; ++n) \
+	{ \
+		T x[2][W]; \
+		V_STORE(x[0], u[n]); \
+		V_STORE(x[1], t[n]); \
+		for(int l = 0; l < W; ++l) \
+		{ \
+			lanes[l].u[n] = x[0][l]; \
+			lanes[l].t[n] = x[1][l]; \
+		} \
+	}
+
+#define SHA256V_PBKDF2(W) SHA2V_PBKDF2(W, quint32, 64, SHA256V, sha256_k, (int)0x80000000, 768)
+#define SHA512V_PBKDF2(W) SHA2V_PBKDF2(W, quint64, 80, SHA512V, sha512_k, (qint64)Q_UINT64_C(0x8000000000000000), 1536)
+
+// SSE2
+#define V __m128i
+#define V_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define V_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define V_XOR _mm_xor_si128
+#define V_AND _mm_and_si128
+#define V_OR _mm_or_si128
+#define V_CH SHA2V_CH
+#define V_MAJ SHA2V_MAJ
+
+#define V_ADD _mm_add_epi32
+#define V_SET1(x) _mm_set1_epi32((int)(x))
+#define V_ROR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+#define V_SHR _mm_srli_epi32
+
+QCA_TARGET("sse2")
+static void sha256_lanes_sse2(Sha256Lane *lanes, quint32 iterations)
+{
+	SHA256V_PBKDF2(4)
+}
+
+#undef V_ADD
+#undef V_SET1
+#undef V_ROR
+#undef V_SHR
+#define V_ADD _mm_add_epi64
+#define V_SET1(x) _mm_set1_epi64x((qint64)(x))
+#define V_ROR(x, n) _mm_or_si128(_mm_srli_epi64(x, n), _mm_slli_epi64(x, 64 - (n)))
+#define V_SHR _mm_srli_epi64
+
+QCA_TARGET("sse2")
+static void sha512_lanes_sse2(Sha512Lane *lanes, quint32 iterations)
+{
+	SHA512V_PBKDF2(2)
+}
+
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ADD
+#undef V_SET1
+#undef V_ROR
+#undef V_SHR
+
+// AVX2
+#define V __m256i
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define V_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define V_XOR _mm256_xor_si256
+#define V_AND _mm256_and_si256
+#define V_OR _mm256_or_si256
+
+#define V_ADD _mm256_add_epi32
+#define V_SET1(x) _mm256_set1_epi32((int)(x))
+#define V_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define V_SHR _mm256_srli_epi32
+
+QCA_TARGET("avx2")
+static void sha256_lanes_avx2(Sha256Lane *lanes, quint32 iterations)
+{
+	SHA256V_PBKDF2(8)
+}
+
+#undef V_ADD
+#undef V_SET1
+#undef V_ROR
+#undef V_SHR
+#define V_ADD _mm256_add_epi64
+#define V_SET1(x) _mm256_set1_epi64x((qint64)(x))
+#define V_ROR(x, n) _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define V_SHR _mm256_srli_epi64
+
+QCA_TARGET("avx2")
+static void sha512_lanes_avx2(Sha512Lane *lanes, quint32 iterations)
+{
+	SHA512V_PBKDF2(4)
+}
+
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_CH
+#undef V_MAJ
+#undef V_ADD
+#undef V_SET1
+#undef V_ROR
+#undef V_SHR
+
+// AVX-512, with native rotates and three input logic
+#define V __m512i
+#define V_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define V_STORE(p, v) _mm512_storeu_si512((void *)(p), v)
+#define V_XOR _mm512_xor_si512
+#define V_AND _mm512_and_si512
+#define V_OR _mm512_or_si512
+
+#undef SHA2V_XOR3
+#define SHA2V_XOR3(a, b, c) _mm512_ternarylogic_epi32(a, b, c, 0x96)
+#define V_CH(e, f, g) _mm512_ternarylogic_epi32(e, f, g, 0xca)
+#define V_MAJ(a, b, c) _mm512_ternarylogic_epi32(a, b, c, 0xe8)
+#define V_ADD _mm512_add_epi32
+#define V_SET1(x) _mm512_set1_epi32((int)(x))
+#define V_ROR _mm512_ror_epi32
+#define V_SHR _mm512_srli_epi32
+
+QCA_TARGET("avx512f")
+static void sha256_lanes_avx512(Sha256Lane *lanes, quint32 iterations)
+{
+	SHA256V_PBKDF2(16)
+}
+
+#undef V_ADD
+#undef V_SET1
+#undef V_ROR
+#undef V_SHR
+#define V_ADD _mm512_add_epi64
+#define V_SET1(x) _mm512_set1_epi64((qint64)(x))
+#define V_ROR _mm512_ror_epi64
+#define V_SHR _mm512_srli_epi64
+
+QCA_TARGET("avx512f")
+static void sha512_lanes_avx512(Sha512Lane *lanes, quint32 iterations)
+{
+	SHA512V_PBKDF2(8)
+}
+
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_CH
+#undef V_MAJ
+#undef V_ADD
+#undef V_SET1
+#undef V_ROR
+#undef V_SHR
+
+#endif
+
+// Runs 'iterations' more rounds of PBKDF2 on each lane.  Groups of lanes
+//   go to the widest kernel they fill at least half of, a partial group
+//   is padded with copies of its last lane.
+template<class Lane>
+static void run_lanes(Lane *lanes, int count, quint32 iterations,
+	void (*scalar)(Lane *, quint32), const int *widths, void (* const *kernels)(Lane *, quint32))
+{
+	while(count > 0)
+	{
+		int k = 0;
+		while(widths[k] && (!kernels[k] || count <= widths[k] / 2))
+			++k;
+		if(!widths[k])
+		{
+			scalar(lanes, iterations);
+			++lanes;
+			--count;
+			continue;
+		}
+
+		int width = widths[k];
+		if(count >= width)
+		{
+			kernels[k](lanes, iterations);
+		}
+		else
+		{
+			Lane group[16];
+			memcpy(group, lanes, count * sizeof(Lane));
+			for(int n = count; n < width; ++n)
+				group[n] = lanes[count - 1];
+			kernels[k](group, iterations);
+			memcpy(lanes, group, count * sizeof(Lane));
+			wipe(group, sizeof(group));
+		}
+		lanes += qMin(count, width);
+		count -= qMin(count, width);
+	}
+}
+
+static void sha256_lanes(Sha256Lane *lanes, int count, quint32 iterations)
+{
+	void (*kernels[3])(Sha256Lane *, quint32) = { 0, 0, 0 };
+	int widths[4] = { 16, 8, 4, 0 };
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAVX512))
+		kernels[0] = sha256_lanes_avx512;
+	if(hasCpuFeatures(CpuAVX2))
+		kernels[1] = sha256_lanes_avx2;
+	// one lane at a time with the SHA extensions beats 4 lanes of SSE2
+	if(hasCpuFeatures(CpuSSE2) && !hasCpuFeatures(CpuSHA | CpuSSE41))
+		kernels[2] = sha256_lanes_sse2;
+#endif
+	run_lanes<Sha256Lane>(lanes, count, iterations, sha256_lane_scalar, widths, kernels);
+}
+
+static void sha512_lanes(Sha512Lane *lanes, int count, quint32 iterations)
+{
+	void (*kernels[3])(Sha512Lane *, quint32) = { 0, 0, 0 };
+	int widths[4] = { 8, 4, 2, 0 };
+#if defined(QCA_X86_SIMD)
+	if(hasCpuFeatures(CpuAVX512))
+		kernels[0] = sha512_lanes_avx512;
+	if(hasCpuFeatures(CpuAVX2))
+		kernels[1] = sha512_lanes_avx2;
+	if(hasCpuFeatures(CpuSSE2))
+		kernels[2] = sha512_lanes_sse2;
+#endif
+	run_lanes<Sha512Lane>(lanes, count, iterations, sha512_lane_scalar, widths, kernels);
+}
+
+//----------------------------------------------------------------------------
+// PBKDF2
+//----------------------------------------------------------------------------
+// a thread is only worth starting for this many lane iterations
+#define PBKDF2_PARALLEL_MIN_WORK 4096
+
+// H is Sha256 or Sha512, Word its state word and Lane the matching lane.
+
+// the HMAC inner and outer states after the key block, which every
+//   further HMAC with this key resumes from
+template<class H, class Word>
+static void hmac_states(const unsigned char *secret, int secretLen, const Word *iv,
+	Word *istate, Word *ostate)
+{
+	const int bs = H::BlockSize;
+	unsigned char key[H::BlockSize];
+	memset(key, 0, bs);
+	if(secretLen > bs)
+	{
+		H kh;
+		kh.update(secret, secretLen);
+		kh.final(key);
+	}
+	else
+		memcpy(key, secret, secretLen);
+
+	unsigned char pad[H::BlockSize];
+	for(int n = 0; n < bs; ++n)
+		pad[n] = key[n] ^ 0x36;
+	memcpy(istate, iv, 8 * sizeof(Word));
+	H::compress(istate, pad, 1);
+	for(int n = 0; n < bs; ++n)
+		pad[n] = key[n] ^ 0x5c;
+	memcpy(ostate, iv, 8 * sizeof(Word));
+	H::compress(ostate, pad, 1);
+
+	wipe(key, bs);
+	wipe(pad, bs);
+}
+
+// U1 = T = HMAC(P, S || INT(index))
+template<class H, class Word, class Lane>
+static void start_lane(Lane *lane, const Word *istate, const Word *ostate,
+	const unsigned char *salt, int saltLen, quint32 index)
+{
+	const int ds = H::DigestSize;
+	const int ws = sizeof(Word);
+	unsigned char counter[4];
+	unsigned char digest[H::DigestSize];
+	store_be32(counter, index);
+	H h;
+	h.resume(istate);
+	h.update(salt, saltLen);
+	h.update(counter, 4);
+	h.final(digest);
+	h.resume(ostate);
+	h.update(digest, ds);
+	h.final(digest);
+
+	memcpy(lane->istate, istate, 8 * sizeof(Word));
+	memcpy(lane->ostate, ostate, 8 * sizeof(Word));
+	for(int n = 0; n < 8; ++n)
+	{
+		Word w = 0;
+		for(int i = 0; i < ws; ++i)
+			w = (w << 8) | digest[ws * n + i];
+		lane->u[n] = w;
+		lane->t[n] = w;
+	}
+	wipe(digest, ds);
+}
+
+// the first len bytes of T, big endian
+template<class H, class Word, class Lane>
+static void finish_lane(const Lane *lane, unsigned char *out, int len)
+{
+	const int ds = H::DigestSize;
+	const int ws = sizeof(Word);
+	unsigned char digest[H::DigestSize];
+	for(int n = 0; n < 8; ++n)
+		for(int i = 0; i < ws; ++i)
+			digest[ws * n + i] = (unsigned char)(lane->t[n] >> (8 * (ws - 1 - i)));
+	memcpy(out, digest, qMin(ds, len));
+	wipe(digest, ds);
+}
+
+// Iterates a run of lanes, where consecutive lanes with the same total
+//   count go to the lane kernels together.
+template<class Lane>
+static void iterate_lanes(Lane *lanes, const quint32 *iterations, int count,
+	void (*lanes_fn)(Lane *, int, quint32))
+{
+	int at = 0;
+	while(at < count)
+	{
+		int n = 1;
+		while(at + n < count && iterations[at + n] == iterations[at])
+			++n;
+		if(iterations[at] > 1)
+			lanes_fn(lanes + at, n, iterations[at] - 1);
+		at += n;
+	}
+}
+
+template<class Lane>
+class Pbkdf2Slice : public QRunnable
+{
+public:
+	Lane *lanes;
+	const quint32 *iterations;
+	int count;
+	void (*lanes_fn)(Lane *, int, quint32);
+
+	virtual void run()
+	{
+		iterate_lanes<Lane>(lanes, iterations, count, lanes_fn);
+	}
+};
+
+// Every output block of every job becomes a lane.  Jobs are taken in
+//   order of iteration count, so that blocks which iterate equally often
+//   sit next to each other and share the kernels, and the lanes are split
+//   into contiguous slices for the threads.
+template<class H, class Word, class Lane>
+static void pbkdf2_many(const Pbkdf2Job *jobs, int count, int threads,
+	const Word *iv, void (*lanes_fn)(Lane *, int, quint32))
+{
+	const int ds = H::DigestSize;
+
+	QMap<quint32, int> byIterations;
+	int total = 0;
+	for(int j = 0; j < count; ++j)
+	{
+		byIterations.insertMulti(qMax(jobs[j].iterations, (quint32)1), j);
+		total += (jobs[j].outLen + ds - 1) / ds;
+	}
+	if(total == 0)
+		return;
+
+	QVarLengthArray<Lane, 16> lanes(total);
+	QVarLengthArray<quint32, 16> iterations(total);
+	QVarLengthArray<unsigned char *, 16> outs(total);
+	QVarLengthArray<int, 16> lengths(total);
+	quint64 work = 0;
+	int at = 0;
+	for(QMap<quint32, int>::const_iterator it = byIterations.constBegin(); it != byIterations.constEnd(); ++it)
+	{
+		const Pbkdf2Job &job = jobs[it.value()];
+		Word istate[8], ostate[8];
+		hmac_states<H, Word>(job.secret, job.secretLen, iv, istate, ostate);
+		for(int b = 0; b * ds < job.outLen; ++b)
+		{
+			start_lane<H, Word, Lane>(&lanes[at], istate, ostate, job.salt, job.saltLen, (quint32)(b + 1));
+			iterations[at] = it.key();
+			outs[at] = job.out + b * ds;
+			lengths[at] = job.outLen - b * ds;
+			work += it.key();
+			++at;
+		}
+		wipe(istate, sizeof(istate));
+		wipe(ostate, sizeof(ostate));
+	}
+
+	if(threads <= 0)
+		threads = QThread::idealThreadCount();
+	int slices = (int)qMin((quint64)qMin(threads, total), work / PBKDF2_PARALLEL_MIN_WORK);
+	if(slices < 2)
+		iterate_lanes<Lane>(lanes.data(), iterations.data(), total, lanes_fn);
+	else
+	{
+		int sliceSize = (total + slices - 1) / slices;
+		QList<Pbkdf2Slice<Lane> *> running;
+		QThreadPool pool;
+		pool.setMaxThreadCount(slices);
+		for(int first = 0; first < total; first += sliceSize)
+		{
+			Pbkdf2Slice<Lane> *slice = new Pbkdf2Slice<Lane>;
+			slice->setAutoDelete(false);
+			slice->lanes = lanes.data() + first;
+			slice->iterations = iterations.data() + first;
+			slice->count = qMin(sliceSize, total - first);
+			slice->lanes_fn = lanes_fn;
+			running += slice;
+			pool.start(slice);
+		}
+		pool.waitForDone();
+		qDeleteAll(running);
+	}
+
+	for(int n = 0; n < total; ++n)
+		finish_lane<H, Word, Lane>(&lanes[n], outs[n], lengths[n]);
+	wipe(lanes.data(), total * sizeof(Lane));
+}
+
+// The blocks are iterated together until msecInterval is up, and the
+//   count is returned.
+template<class H, class Word, class Lane>
+static quint32 pbkdf2_timed(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, int msecInterval,
+	unsigned char *out, int outLen, const Word *iv,
+	void (*lanes_fn)(Lane *, int, quint32))
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	const int ds = H::DigestSize;
+	Word istate[8], ostate[8];
+	hmac_states<H, Word>(secret, secretLen, iv, istate, ostate);
+
+	int blocks = (outLen + ds - 1) / ds;
+	QVarLengthArray<Lane, 16> lanes(blocks);
+	for(int b = 0; b < blocks; ++b)
+		start_lane<H, Word, Lane>(&lanes[b], istate, ostate, salt, saltLen, (quint32)(b + 1));
+
+	// the clock is only read every so many iterations, and the derived
+	//   key comes out of the same pass that was timed
+	quint32 iterations = 1;
+	while(timer.elapsed() < msecInterval)
+	{
+		lanes_fn(lanes.data(), blocks, 256);
+		iterations += 256;
+	}
+
+	for(int b = 0; b < blocks; ++b)
+		finish_lane<H, Word, Lane>(&lanes[b], out + b * ds, outLen - b * ds);
+
+	wipe(lanes.data(), blocks * sizeof(Lane));
+	wipe(istate, sizeof(istate));
+	wipe(ostate, sizeof(ostate));
+	return iterations;
+}
+
+static Pbkdf2Job make_job(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, quint32 iterations,
+	unsigned char *out, int outLen)
+{
+	Pbkdf2Job job;
+	job.secret = secret;
+	job.secretLen = secretLen;
+	job.salt = salt;
+	job.saltLen = saltLen;
+	job.iterations = iterations;
+	job.out = out;
+	job.outLen = outLen;
+	return job;
+}
+
+void pbkdf2Sha256(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, quint32 iterations,
+	unsigned char *out, int outLen)
+{
+	Pbkdf2Job job = make_job(secret, secretLen, salt, saltLen, iterations, out, outLen);
+	pbkdf2_many<Sha256, quint32, Sha256Lane>(&job, 1, 0, sha256_iv, sha256_lanes);
+}
+
+void pbkdf2Sha512(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, quint32 iterations,
+	unsigned char *out, int outLen)
+{
+	Pbkdf2Job job = make_job(secret, secretLen, salt, saltLen, iterations, out, outLen);
+	pbkdf2_many<Sha512, quint64, Sha512Lane>(&job, 1, 0, sha512_iv, sha512_lanes);
+}
+
+void pbkdf2Sha256Many(const Pbkdf2Job *jobs, int count, int threads)
+{
+	pbkdf2_many<Sha256, quint32, Sha256Lane>(jobs, count, threads, sha256_iv, sha256_lanes);
+}
+
+void pbkdf2Sha512Many(const Pbkdf2Job *jobs, int count, int threads)
+{
+	pbkdf2_many<Sha512, quint64, Sha512Lane>(jobs, count, threads, sha512_iv, sha512_lanes);
+}
+
+quint32 pbkdf2Sha256Timed(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, int msecInterval,
+	unsigned char *out, int outLen)
+{
+	return pbkdf2_timed<Sha256, quint32, Sha256Lane>(secret, secretLen, salt, saltLen,
+		qMax(msecInterval, 0), out, outLen, sha256_iv, sha256_lanes);
+}
+
+quint32 pbkdf2Sha512Timed(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, int msecInterval,
+	unsigned char *out, int outLen)
+{
+	return pbkdf2_timed<Sha512, quint64, Sha512Lane>(secret, secretLen, salt, saltLen,
+		qMax(msecInterval, 0), out, outLen, sha512_iv, sha512_lanes);
+}
+
+}
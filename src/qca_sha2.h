@@ -0,0 +1,127 @@
+/*
+ * qca_sha2.h - Qt Cryptographic Architecture
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef QCA_SHA2_H
+#define QCA_SHA2_H
+
+// NOTE: this API is private to QCA
+
+#include <QtGlobal>
+
+namespace QCA {
+
+// SHA-256 as in FIPS 180-4.  Uses the SHA extensions when the CPU has them.
+class Sha256
+{
+public:
+	enum { BlockSize = 64, DigestSize = 32 };
+
+	Sha256();
+	~Sha256();
+
+	void clear();
+
+	// continue from a chaining state taken after the first block, as HMAC
+	//   does with its precomputed key blocks
+	void resume(const quint32 *h);
+
+	void update(const unsigned char *data, int len);
+	void final(unsigned char *digest);
+
+	// h = chaining state after 'count' more whole blocks
+	static void compress(quint32 *h, const unsigned char *blocks, int count);
+
+private:
+	quint32 h[8];
+	unsigned char buf[64];
+	int used;
+	quint64 total;
+};
+
+// SHA-512 as in FIPS 180-4
+class Sha512
+{
+public:
+	enum { BlockSize = 128, DigestSize = 64 };
+
+	Sha512();
+	~Sha512();
+
+	void clear();
+	void resume(const quint64 *h);
+	void update(const unsigned char *data, int len);
+	void final(unsigned char *digest);
+
+	static void compress(quint64 *h, const unsigned char *blocks, int count);
+
+private:
+	quint64 h[8];
+	unsigned char buf[128];
+	int used;
+	quint64 total;
+};
+
+// PBKDF2 (RFC 8018) with HMAC-SHA-256 or HMAC-SHA-512.  The HMAC key
+//   blocks are hashed once up front, and the output blocks are iterated
+//   side by side in SIMD lanes: 16 (AVX-512), 8 (AVX2) or 4 (SSE2) for
+//   SHA-256, and 8, 4 or 2 for SHA-512.
+void pbkdf2Sha256(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, quint32 iterations,
+	unsigned char *out, int outLen);
+
+void pbkdf2Sha512(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, quint32 iterations,
+	unsigned char *out, int outLen);
+
+// One derivation for pbkdf2Sha256Many() and pbkdf2Sha512Many()
+class Pbkdf2Job
+{
+public:
+	const unsigned char *secret;
+	int secretLen;
+	const unsigned char *salt;
+	int saltLen;
+	quint32 iterations;
+	unsigned char *out;
+	int outLen;
+};
+
+// Several derivations at once.  The output blocks of all the jobs share
+//   the SIMD lanes, and are spread over up to 'threads' threads (0 for
+//   QThread::idealThreadCount()) when there is enough work.  The single
+//   derivations above go through here too, so the blocks of a long key
+//   are computed in parallel.
+void pbkdf2Sha256Many(const Pbkdf2Job *jobs, int count, int threads);
+void pbkdf2Sha512Many(const Pbkdf2Job *jobs, int count, int threads);
+
+// As pbkdf2Sha256() and pbkdf2Sha512(), iterating for msecInterval
+//   milliseconds instead of a fixed count.  The key comes out of the timed
+//   pass itself, and the number of iterations it took is returned.
+quint32 pbkdf2Sha256Timed(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, int msecInterval,
+	unsigned char *out, int outLen);
+
+quint32 pbkdf2Sha512Timed(const unsigned char *secret, int secretLen,
+	const unsigned char *salt, int saltLen, int msecInterval,
+	unsigned char *out, int outLen);
+
+}
+
+#endif
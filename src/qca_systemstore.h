@@ -31,6 +31,9 @@ namespace QCA {
 bool qca_have_systemstore();
 CertificateCollection qca_get_systemstore(const QString &provider);
 
+// the file the store is read from, or empty if it isn't read from a file
+QString qca_systemstore_file();
+
 }
 
 #endif
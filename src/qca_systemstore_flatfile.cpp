@@ -32,7 +32,15 @@ bool qca_have_systemstore()
 
 CertificateCollection qca_get_systemstore(const QString &provider)
 {
+	// the store may also be a file made by mozcerts --binary
+	if(TrustStoreFile::isTrustStoreFile(QCA_SYSTEMSTORE_PATH))
+		return TrustStoreFile::fromFile(QCA_SYSTEMSTORE_PATH, 0, provider).toCertificateCollection();
 	return CertificateCollection::fromFlatTextFile(QCA_SYSTEMSTORE_PATH, 0, provider);
 }
 
+QString qca_systemstore_file()
+{
+	return QCA_SYSTEMSTORE_PATH;
+}
+
 }
@@ -70,4 +70,9 @@ CertificateCollection qca_get_systemstore(const QString &provider)
 	return col;
 }
 
+QString qca_systemstore_file()
+{
+	return QString();
+}
+
 }
@@ -21,6 +21,12 @@
 
 #include "qca_textfilter.h"
 
+#include "qca_base64.h"
+#include "qca_hex.h"
+
+#include <string.h>
+#include <algorithm>
+
 namespace QCA {
 
 //----------------------------------------------------------------------------
@@ -78,16 +84,6 @@ QString TextFilter::decodeString(const QString &s)
 //----------------------------------------------------------------------------
 // Hex
 //----------------------------------------------------------------------------
-static int enhex(uchar c)
-{
-	if(c < 10)
-		return c + '0';
-	else if(c < 16)
-		return c - 10 + 'a';
-	else
-		return -1;
-}
-
 static int dehex(char c)
 {
 	if(c >= 'a' && c <= 'f')
@@ -114,79 +110,49 @@ void Hex::clear()
 
 MemoryRegion Hex::update(const MemoryRegion &m)
 {
-	QByteArray a = m.toByteArray();
+	const char *in = m.data();
+	int len = m.size();
 	if(_dir == Encode)
 	{
-		QByteArray out(a.size() * 2, 0);
-		int at = 0;
-		int c;
-		for(int n = 0; n < (int)a.size(); ++n)
-		{
-			uchar lo = (uchar)a[n] & 0x0f;
-			uchar hi = (uchar)a[n] >> 4;
-			c = enhex(hi);
-			if(c == -1)
-			{
-				_ok = false;
-				break;
-			}
-			out[at++] = (char)c;
-			c = enhex(lo);
-			if(c == -1)
-			{
-				_ok = false;
-				break;
-			}
-			out[at++] = (char)c;
-		}
-		if(!_ok)
-			return MemoryRegion();
-
+		QByteArray out;
+		out.resize(len * 2);
+		hexEncode((const unsigned char *)in, len, out.data());
 		return out;
 	}
 	else
 	{
-		uchar lo = 0;
-		uchar hi = 0;
-		bool flag = false;
-		if(partial)
-		{
-			hi = val;
-			flag = true;
-		}
+		QByteArray out;
+		out.resize(((partial ? 1 : 0) + len) / 2);
+		unsigned char *at = (unsigned char *)out.data();
 
-		QByteArray out(a.size() / 2, 0);
-		int at = 0;
-		int c;
-		for(int n = 0; n < (int)a.size(); ++n)
+		// the state only changes once the whole input is known to be good
+		if(partial && len > 0)
 		{
-			c = dehex((char)a[n]);
-			if(c == -1)
+			int lo = dehex(in[0]);
+			if(lo == -1)
 			{
 				_ok = false;
-				break;
-			}
-			if(flag)
-			{
-				lo = (uchar)c;
-				uchar full = ((hi & 0x0f) << 4) + (lo & 0x0f);
-				out[at++] = full;
-				flag = false;
-			}
-			else
-			{
-				hi = (uchar)c;
-				flag = true;
+				return MemoryRegion();
 			}
+			*(at++) = (uchar)(((val & 0x0f) << 4) + lo);
+			++in;
+			--len;
 		}
-		if(!_ok)
+
+		int hi = 0;
+		if(!hexDecode(in, len / 2, at) || (len % 2 && (hi = dehex(in[len - 1])) == -1))
+		{
+			_ok = false;
 			return MemoryRegion();
+		}
 
-		if(flag)
+		if(len % 2)
 		{
-			val = hi;
+			val = (uchar)hi;
 			partial = true;
 		}
+		else if(m.size() > 0)
+			partial = false;
 		return out;
 	}
 }
@@ -211,6 +177,7 @@ Base64::Base64(Direction dir)
 {
 	_lb_enabled = false;
 	_lb_column = 76;
+	clear();
 }
 
 void Base64::clear()
@@ -243,270 +210,224 @@ void Base64::setLineBreaksColumn(int column)
 		_lb_column = 76;
 }
 
-static QByteArray b64encode(const QByteArray &s)
+// Puts n characters at out, with a line break whenever the column reaches
+//   lfAt (0 for no line breaks).  Returns the new end of the output.
+static char *put_chars(char *out, const char *chars, int n, int *col, int lfAt)
 {
-	int i;
-	int len = s.size();
-	static char tbl[] =
-		"ABCDEFGH"
-		"IJKLMNOP"
-		"QRSTUVWX"
-		"YZabcdef"
-		"ghijklmn"
-		"opqrstuv"
-		"wxyz0123"
-		"456789+/"
-		"=";
-	int a, b, c;
-
-	QByteArray p((len + 2) / 3 * 4, 0);
-	int at = 0;
-	for(i = 0; i < len; i += 3)
+	for(int i = 0; i < n; ++i)
 	{
-		a = ((unsigned char)s[i] & 3) << 4;
-		if(i + 1 < len)
+		*(out++) = chars[i];
+		if(lfAt > 0 && ++(*col) == lfAt)
 		{
-			a += (unsigned char)s[i + 1] >> 4;
-			b = ((unsigned char)s[i + 1] & 0xf) << 2;
-			if(i + 2 < len)
-			{
-				b += (unsigned char)s[i + 2] >> 6;
-				c = (unsigned char)s[i + 2] & 0x3f;
-			}
-			else
-				c = 64;
+			*(out++) = '\n';
+			*col = 0;
 		}
-		else
-			b = c = 64;
-
-		p[at++] = tbl[(unsigned char)s[i] >> 2];
-		p[at++] = tbl[a];
-		p[at++] = tbl[b];
-		p[at++] = tbl[c];
 	}
-	return p;
+	return out;
 }
 
-static QByteArray b64decode(const QByteArray &s, bool *ok)
+// Encodes whole groups of 3 bytes, inserting line breaks as it goes, so
+//   that the runs between breaks are written straight by the encoder.
+static char *encode_lines(const unsigned char *in, const unsigned char *in_end, int groups,
+	char *out, int *col, int lfAt)
 {
-	// -1 specifies invalid
-	// 64 specifies eof
-	// everything else specifies data
-
-	static signed char tbl[] =
-	{
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63,
-		52,53,54,55,56,57,58,59,60,61,-1,-1,-1,64,-1,-1,
-		-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
-		15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1,
-		-1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
-		41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-	};
-
-	// return value
-	QByteArray p;
-	*ok = true;
-
-	// this should be a multiple of 4
-	int len = s.size();
-	if(len % 4)
+	if(lfAt <= 0)
 	{
-		*ok = false;
-		return p;
+		base64Encode(in, groups, out, in_end - in);
+		return out + groups * 4;
 	}
 
-	p.resize(len / 4 * 3);
-
-	int i;
-	int at = 0;
-
-	int a, b, c, d;
-	c = d = 0;
-
-	for(i = 0; i < len; i += 4)
+	while(groups > 0)
 	{
-		a = tbl[(int)s[i]];
-		b = tbl[(int)s[i + 1]];
-		c = tbl[(int)s[i + 2]];
-		d = tbl[(int)s[i + 3]];
-		if((a == 64 || b == 64) || (a < 0 || b < 0 || c < 0 || d < 0))
+		int n = qMin(groups, (lfAt - *col) / 4);
+		if(n == 0)
 		{
-			p.resize(0);
-			*ok = false;
-			return p;
+			// a group that straddles a line break
+			char q[4];
+			base64Encode(in, 1, q, in_end - in);
+			out = put_chars(out, q, 4, col, lfAt);
+			in += 3;
+			--groups;
+			continue;
 		}
-		p[at++] = ((a & 0x3F) << 2) | ((b >> 4) & 0x03);
-		p[at++] = ((b & 0x0F) << 4) | ((c >> 2) & 0x0F);
-		p[at++] = ((c & 0x03) << 6) | ((d >> 0) & 0x3F);
-	}
 
-	if(c & 64)
-		p.resize(at - 2);
-	else if(d & 64)
-		p.resize(at - 1);
-
-	return p;
+		base64Encode(in, n, out, in_end - in);
+		in += n * 3;
+		out += n * 4;
+		groups -= n;
+		*col += n * 4;
+		if(*col == lfAt)
+		{
+			*(out++) = '\n';
+			*col = 0;
+		}
+	}
+	return out;
 }
 
-static int findLF(const QByteArray &in, int offset)
+// Encodes partial + in, keeping an incomplete group in partial unless this
+//   is the end of the stream.
+static QByteArray b64encode(QByteArray *partial, const char *data, int len, bool last, int *col, int lfAt)
 {
-	for(int n = offset; n < in.size(); ++n)
+	const unsigned char *in = (const unsigned char *)data;
+	int total = partial->size() + len;
+	int chars = total / 3 * 4 + ((last && total % 3) ? 4 : 0);
+	int breaks = lfAt > 0 ? (*col + chars) / lfAt : 0;
+
+	QByteArray out;
+	out.resize(chars + breaks);
+	char *at = out.data();
+
+	unsigned char group[3];
+	int have = partial->size();
+	memcpy(group, partial->data(), have);
+	if(have > 0)
+	{
+		int need = qMin(3 - have, len);
+		if(need > 0)
+			memcpy(group + have, in, need);
+		have += need;
+		in += need;
+		len -= need;
+		if(have == 3)
+		{
+			at = encode_lines(group, group + 3, 1, at, col, lfAt);
+			have = 0;
+		}
+	}
+	if(have == 0)
+	{
+		int groups = len / 3;
+		at = encode_lines(in, in + len, groups, at, col, lfAt);
+		have = len - groups * 3;
+		if(have > 0)
+			memcpy(group, in + groups * 3, have);
+	}
+
+	if(last && have > 0)
 	{
-		if(in[n] == '\n')
-			return n;
+		char q[4];
+		base64EncodeTail(group, have, q);
+		at = put_chars(at, q, 4, col, lfAt);
+		have = 0;
 	}
-	return -1;
+	partial->resize(have);
+	memcpy(partial->data(), group, have);
+
+	Q_ASSERT(at == out.data() + out.size());
+	return out;
 }
 
-static QByteArray insert_linebreaks(const QByteArray &s, int *col, int lfAt)
+// Decodes partial + in.  With line breaks enabled, the runs between them
+//   are decoded in place rather than copied without the breaks first.  An
+//   incomplete quad is kept in partial.  As each update is decoded as a
+//   whole, padding only shortens the output when it ends the input seen so
+//   far.
+static QByteArray b64decode(QByteArray *partial, const char *in, int len, bool lb, bool *ok)
 {
-	QByteArray out = s;
+	*ok = true;
 
-	int needed = (out.size() + *col) / lfAt;   // how many newlines needed?
-	if(needed > 0)
-	{
-		int firstlen = lfAt - *col;                // length of first chunk
-		int at = firstlen + (lfAt * (needed - 1)); // position of last newline
-		int lastlen = out.size() - at;             // length of last chunk
+	QByteArray out;
+	out.resize((partial->size() + len) / 4 * 3);
+	unsigned char *at = (unsigned char *)out.data();
+	unsigned char *out_end = at + out.size();
+	int pad = 0;
 
-		//printf("size=%d,needed=%d,firstlen=%d,at=%d,lastlen=%d\n", out.size(), needed, firstlen, at, lastlen);
+	char quad[4];
+	int have = partial->size();
+	memcpy(quad, partial->data(), have);
 
-		// make room
-		out.resize(out.size() + needed);
+	const char *end = in + len;
+	bool bad = false;
+	while(!bad && in < end)
+	{
+		const char *run_end = end;
+		if(lb)
+		{
+			const char *lf = (const char *)memchr(in, '\n', end - in);
+			if(lf)
+				run_end = lf;
+		}
 
-		// move backwards
-		for(int n = 0; n < needed; ++n)
+		while(have > 0 && have < 4 && in < run_end)
+			quad[have++] = *(in++);
+		if(have == 4)
 		{
-			char *p = out.data() + at;
-			int len;
-			if(n == 0)
-				len = lastlen;
-			else
-				len = lfAt;
-			memmove(p + needed - n, p, len);
-			p[needed - n - 1] = '\n';
-			at -= lfAt;
+			if(!base64Decode(quad, 1, at, 3, &pad))
+			{
+				bad = true;
+				break;
+			}
+			at += 3;
+			have = 0;
+		}
+		if(have == 0)
+		{
+			int quads = (run_end - in) / 4;
+			if(quads > 0 && !base64Decode(in, quads, at, out_end - at, &pad))
+			{
+				bad = true;
+				break;
+			}
+			in += quads * 4;
+			at += quads * 3;
+			while(in < run_end)
+				quad[have++] = *(in++);
 		}
 
-		*col = lastlen;
+		// skip the line break
+		if(in < end)
+			++in;
 	}
-	else
-		*col += out.size();
-
-	return out;
-}
-
-static QByteArray remove_linebreaks(const QByteArray &s)
-{
-	QByteArray out = s;
 
-	int removed = 0;
-	int at = findLF(out, 0);
-	while(at != -1)
+	if(bad)
 	{
-		int next = findLF(out, at + 1);
-		int len;
-		if(next != -1)
-			len = next - at;
-		else
-			len = out.size() - at;
-
-		if(len > 1)
+		// keep the same incomplete quad as when the update succeeds
+		const char *begin = end - len;
+		int total = partial->size() + len;
+		if(lb)
+			total -= std::count(begin, end, '\n');
+		int eat = total % 4;
+		partial->resize(eat);
+		for(const char *p = end - 1; eat > 0; --p)
 		{
-			char *p = out.data() + at;
-			memmove(p - removed, p + 1, len - 1);
+			if(!lb || *p != '\n')
+				(*partial)[--eat] = *p;
 		}
-		++removed;
-		at = next;
+		*ok = false;
+		return QByteArray();
 	}
-	out.resize(out.size() - removed);
 
+	partial->resize(have);
+	memcpy(partial->data(), quad, have);
+	out.resize(at - (unsigned char *)out.data() - pad);
 	return out;
 }
 
-static void appendArray(QByteArray *a, const QByteArray &b)
-{
-	a->append(b);
-}
-
 MemoryRegion Base64::update(const MemoryRegion &m)
 {
-	QByteArray in;
-	if(_dir == Decode && _lb_enabled)
-		in = remove_linebreaks(m.toByteArray());
-	else
-		in = m.toByteArray();
-
-	if(in.isEmpty())
+	if(m.isEmpty())
 		return MemoryRegion();
 
-	int chunk;
 	if(_dir == Encode)
-		chunk = 3;
-	else
-		chunk = 4;
+		return b64encode(&partial, m.data(), m.size(), false, &col, _lb_enabled ? _lb_column : 0);
 
-	int size = partial.size() + in.size();
-	if(size < chunk)
-	{
-		appendArray(&partial, in);
-		return MemoryRegion();
-	}
-
-	int eat = size % chunk;
-
-	// s = partial + a - eat
-	QByteArray s(partial.size() + in.size() - eat, 0);
-	memcpy(s.data(), partial.data(), partial.size());
-	memcpy(s.data() + partial.size(), in.data(), in.size() - eat);
-
-	partial.resize(eat);
-	memcpy(partial.data(), in.data() + in.size() - eat, eat);
-
-	if(_dir == Encode)
-	{
-		if(_lb_enabled)
-			return insert_linebreaks(b64encode(s), &col, _lb_column);
-		else
-			return b64encode(s);
-	}
-	else
-	{
-		bool ok;
-		QByteArray out = b64decode(s, &ok);
-		if(!ok)
-			_ok = false;
-		return out;
-	}
+	bool ok;
+	QByteArray out = b64decode(&partial, m.data(), m.size(), _lb_enabled, &ok);
+	if(!ok)
+		_ok = false;
+	return out;
 }
 
 MemoryRegion Base64::final()
 {
 	if(_dir == Encode)
-	{
-		if(_lb_enabled)
-			return insert_linebreaks(b64encode(partial), &col, _lb_column);
-		else
-			return b64encode(partial);
-	}
-	else
-	{
-		bool ok;
-		QByteArray out = b64decode(partial, &ok);
-		if(!ok)
-			_ok = false;
-		return out;
-	}
+		return b64encode(&partial, 0, 0, true, &col, _lb_enabled ? _lb_column : 0);
+
+	// a quad that was never completed
+	if(!partial.isEmpty())
+		_ok = false;
+	return MemoryRegion();
 }
 
 bool Base64::ok() const
@@ -32,26 +32,32 @@ int main(int argc, char **argv)
 	QCA::Initializer qcaInit;
 	QCoreApplication app(argc, argv);
 
-	if(argc < 3)
+	// --binary writes a QCA::TrustStoreFile instead of PEM
+	QStringList args = app.arguments().mid(1);
+	bool binary = args.removeAll("--binary") > 0;
+
+	if(args.count() < 2)
 	{
-		printf("usage: mozcerts [certdata.txt] [outfile.pem]\n");
+		printf("usage: mozcerts [--binary] [certdata.txt] [outfile]\n");
 		return 0;
 	}
 
-	QFile infile(argv[1]);
+	QFile infile(args[0]);
 	if(!infile.open(QFile::ReadOnly))
 	{
 		fprintf(stderr, "Error opening input file\n");
 		return 1;
 	}
 
-	QFile outfile(argv[2]);
-	if(!outfile.open(QFile::WriteOnly | QFile::Truncate))
+	QFile outfile(args[1]);
+	if(!binary && !outfile.open(QFile::WriteOnly | QFile::Truncate))
 	{
 		fprintf(stderr, "Error opening output file\n");
 		return 1;
 	}
 
+	QList<QByteArray> certs;
+
 	int count = 0;
 	QString name;
 	QTextStream ts(&infile);
@@ -100,6 +106,13 @@ int main(int argc, char **argv)
 
 			printf(">> [%s], %d bytes\n", qPrintable(name), buf.size());
 
+			++count;
+			if(binary)
+			{
+				certs += buf;
+				continue;
+			}
+
 			QTextStream ts(&outfile);
 			ts << "-----BEGIN CERTIFICATE-----" << '\n';
 			QCA::Base64 enc;
@@ -107,11 +120,15 @@ int main(int argc, char **argv)
 			enc.setLineBreaksColumn(64);
 			ts << enc.arrayToString(buf) << '\n';
 			ts << "-----END CERTIFICATE-----" << '\n';
-
-			++count;
 		}
 	}
-	printf("Wrote %d certs to [%s]\n", count, argv[2]);
+
+	if(binary && !QCA::TrustStoreFile::toFile(args[1], certs))
+	{
+		fprintf(stderr, "Error writing output file\n");
+		return 1;
+	}
+	printf("Wrote %d certs to [%s]\n", count, qPrintable(args[1]));
 
 	return 0;
 }
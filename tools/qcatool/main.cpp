@@ -2719,6 +2719,7 @@ static void usage()
 	printf(" help|--help|-h                        This help text\n");
 	printf(" version|--version|-v                  Print version information\n");
 	printf(" plugins                               List available plugins\n");
+	printf(" plugins --bench                       Also pick the fastest per feature\n");
 	printf(" config [command]\n");
 	printf("   save [provider]                     Save default provider config\n");
 	printf("   edit [provider]                     Edit provider config\n");
@@ -2793,6 +2794,7 @@ int main(int argc, char **argv)
 	bool debug = false;
 	bool nosys = false;
 	bool nobundle = false;
+	bool bench = false;
 	QString rootsFile, nonRootsFile;
 
 	for(int n = 0; n < args.count(); ++n)
@@ -2849,6 +2851,8 @@ int main(int argc, char **argv)
 			nosys = true;
 		else if(var == "nobundle")
 			nobundle = true;
+		else if(var == "bench")
+			bench = true;
 		else
 			known = false;
 
@@ -2928,6 +2932,26 @@ int main(int argc, char **argv)
 		else
 			printf("  (none)\n");
 
+		if(bench)
+		{
+			printf("Calibrating...\n");
+			QCA::calibrateProviders();
+			QMap<QString,QString> chosen = QCA::calibratedProviders();
+
+			printf("Fastest Providers:\n");
+			if(!chosen.isEmpty())
+			{
+				QMapIterator<QString,QString> it(chosen);
+				while(it.hasNext())
+				{
+					it.next();
+					printf("  %-24s %s\n", qPrintable(it.key()), qPrintable(it.value()));
+				}
+			}
+			else
+				printf("  (none)\n");
+		}
+
 		QCA::unloadAllPlugins();
 
 		if(debug)
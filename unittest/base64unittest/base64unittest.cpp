@@ -43,6 +43,11 @@ private slots:
     void test1();
     void test2_data();
     void test2();
+    void streaming_data();
+    void streaming();
+    void invalid();
+    void benchmark_data();
+    void benchmark();
 private:
     QCA::Initializer* m_init;
 };
@@ -125,6 +130,120 @@ void Base64UnitTest::test2()
     QCOMPARE( QLatin1String(QCA::base64ToArray(encoded)), raw );
 }
 
+void Base64UnitTest::streaming_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<int>("column"); // 0 for no line breaks
+
+    QTest::newRow("small") << 40 << 0;
+    QTest::newRow("large") << 100000 << 0;
+    QTest::newRow("large, 64") << 100000 << 64;
+    QTest::newRow("large, 76") << 100000 << 76;
+    QTest::newRow("large, 7") << 10000 << 7;
+}
+
+void Base64UnitTest::streaming()
+{
+    QFETCH(int, size);
+    QFETCH(int, column);
+
+    QByteArray raw(size, 0);
+    for (int i = 0; i < size; i++)
+	raw[i] = (char)(i * 7 + (i >> 8));
+
+    QByteArray expected = raw.toBase64();
+    if (column > 0) {
+	QByteArray broken;
+	for (int i = 0; i < expected.size(); i += column) {
+	    broken += expected.mid(i, column);
+	    if (i + column <= expected.size())
+		broken += '\n';
+	}
+	expected = broken;
+    }
+
+    // encode and decode in uneven pieces, so that groups, quads and lines
+    // are split across update() calls
+    QCA::Base64 encoder;
+    if (column > 0) {
+	encoder.setLineBreaksEnabled(true);
+	encoder.setLineBreaksColumn(column);
+    }
+    QByteArray encoded;
+    for (int at = 0, step = 1; at < raw.size(); at += step, step = step % 97 + 1)
+	encoded += encoder.update(raw.mid(at, step)).toByteArray();
+    encoded += encoder.final().toByteArray();
+    QVERIFY( encoder.ok() );
+    QCOMPARE( encoded, expected );
+
+    QCA::Base64 decoder(QCA::Decode);
+    decoder.setLineBreaksEnabled(column > 0);
+    QByteArray decoded;
+    for (int at = 0, step = 1; at < encoded.size(); at += step, step = step % 89 + 1)
+	decoded += decoder.update(encoded.mid(at, step)).toByteArray();
+    decoded += decoder.final().toByteArray();
+    QVERIFY( decoder.ok() );
+    QCOMPARE( decoded, raw );
+}
+
+void Base64UnitTest::invalid()
+{
+    QByteArray encoded = QByteArray(1000, 'x').toBase64();
+
+    // a bad character anywhere, including inside the vector blocks
+    for (int at = 0; at < encoded.size(); at += 37) {
+	QByteArray bad = encoded;
+	bad[at] = '!';
+	QCA::Base64 decoder(QCA::Decode);
+	QVERIFY( decoder.decode(bad).isEmpty() );
+	QVERIFY( !decoder.ok() );
+    }
+
+    // line breaks are only skipped when enabled
+    QByteArray broken = encoded.left(100) + '\n' + encoded.mid(100);
+    QCA::Base64 decoder(QCA::Decode);
+    QVERIFY( decoder.decode(broken).isEmpty() );
+    QVERIFY( !decoder.ok() );
+    decoder.setLineBreaksEnabled(true);
+    QCOMPARE( decoder.decode(broken).toByteArray(), QByteArray(1000, 'x') );
+    QVERIFY( decoder.ok() );
+
+    // an incomplete quad at the end
+    decoder.decode(encoded.left(encoded.size() - 1));
+    QVERIFY( !decoder.ok() );
+}
+
+void Base64UnitTest::benchmark_data()
+{
+    QTest::addColumn<bool>("encode");
+    QTest::addColumn<bool>("lineBreaks");
+
+    QTest::newRow("encode") << true << false;
+    QTest::newRow("encode, line breaks") << true << true;
+    QTest::newRow("decode") << false << false;
+    QTest::newRow("decode, line breaks") << false << true;
+}
+
+void Base64UnitTest::benchmark()
+{
+    QFETCH(bool, encode);
+    QFETCH(bool, lineBreaks);
+
+    QByteArray raw(1024 * 1024, 'x');
+    QCA::Base64 encoder;
+    encoder.setLineBreaksEnabled(lineBreaks);
+    QByteArray encoded = encoder.encode(raw).toByteArray();
+
+    QCA::Base64 base64(encode ? QCA::Encode : QCA::Decode);
+    base64.setLineBreaksEnabled(lineBreaks);
+    QBENCHMARK {
+	base64.clear();
+	base64.update(encode ? raw : encoded);
+	base64.final();
+    }
+    QVERIFY( base64.ok() );
+}
+
 QTEST_MAIN(Base64UnitTest)
 
 #include "base64unittest.moc"
@@ -33,6 +33,25 @@
 #include "import_plugins.h"
 #endif
 
+// a buffer that fails to read past a given position
+class FailingBuffer : public QBuffer
+{
+public:
+	qint64 limit;
+
+	FailingBuffer(QByteArray *data, qint64 _limit) : QBuffer(data), limit(_limit)
+	{
+	}
+
+protected:
+	qint64 readData(char *data, qint64 maxSize)
+	{
+		if(pos() >= limit)
+			return -1;
+		return QBuffer::readData(data, qMin(maxSize, limit - pos()));
+	}
+};
+
 void CipherUnitTest::initTestCase()
 {
 	m_init = new QCA::Initializer;
@@ -113,6 +132,7 @@ void CipherUnitTest::aes128()
 	// providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes128-ecb", provider ) )
@@ -188,6 +208,7 @@ void CipherUnitTest::aes128_cbc()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes128-cbc", provider ) )
@@ -275,6 +296,7 @@ void CipherUnitTest::aes128_cbc_pkcs7()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes128-cbc-pkcs7", provider ) )
@@ -457,6 +479,7 @@ void CipherUnitTest::aes128_ctr()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes128-ctr", provider ) )
@@ -532,6 +555,7 @@ void CipherUnitTest::aes128_gcm()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach (const QString &provider, providersToTest) {
 		if (!QCA::isSupported( "aes128-gcm", provider))
@@ -580,6 +604,19 @@ void CipherUnitTest::aes128_gcm()
 			QCOMPARE(update, plainText);
 			QEXPECT_FAIL("wrongtag", "It's OK", Continue);
 			QVERIFY(reverseCipher.ok());
+
+			// decrypting without a tag can't be authenticated
+			QCA::Cipher untaggedCipher(QString( "aes128"),
+									   QCA::Cipher::GCM,
+									   QCA::Cipher::NoPadding,
+									   QCA::Decode,
+									   key,
+									   iv,
+									   QCA::AuthTag(),
+									   provider);
+			untaggedCipher.update(QCA::hexToArray(payload));
+			untaggedCipher.final();
+			QVERIFY(!untaggedCipher.ok());
 		}
 	}
 }
@@ -662,6 +699,7 @@ void CipherUnitTest::aes192()
 	// providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes192-ecb", provider ) )
@@ -738,6 +776,7 @@ void CipherUnitTest::aes192_cbc()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes192-cbc", provider ) )
@@ -825,6 +864,7 @@ void CipherUnitTest::aes192_cbc_pkcs7()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes192-cbc-pkcs7", provider ) )
@@ -1008,6 +1048,7 @@ void CipherUnitTest::aes192_ctr()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes192-ctr", provider ) )
@@ -1083,6 +1124,7 @@ void CipherUnitTest::aes192_gcm()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach (const QString &provider, providersToTest) {
 		if (!QCA::isSupported( "aes192-gcm", provider))
@@ -1253,6 +1295,7 @@ void CipherUnitTest::aes256()
 	// providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes256-ecb", provider ) )
@@ -1328,6 +1371,7 @@ void CipherUnitTest::aes256_cbc()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes256-cbc", provider ) )
@@ -1416,6 +1460,7 @@ void CipherUnitTest::aes256_cbc_pkcs7()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes256-cbc-pkcs7", provider ) )
@@ -1598,6 +1643,7 @@ void CipherUnitTest::aes256_ctr()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach(const QString provider, providersToTest) {
 		if( !QCA::isSupported( "aes256-ctr", provider ) )
@@ -1673,6 +1719,7 @@ void CipherUnitTest::aes256_gcm()
 	providersToTest.append("qca-gcrypt");
 	providersToTest.append("qca-botan");
 	providersToTest.append("qca-nss");
+	providersToTest.append("default");
 
 	foreach (const QString &provider, providersToTest) {
 		if (!QCA::isSupported( "aes256-gcm", provider))
@@ -3190,6 +3237,680 @@ void CipherUnitTest::cast5()
 	}
 }
 
+void CipherUnitTest::chacha20_data()
+{
+	QTest::addColumn<QString>("plainText");
+	QTest::addColumn<QString>("cipherText");
+	QTest::addColumn<QString>("keyText");
+	QTest::addColumn<QString>("ivText");
+
+	// RFC 8439 section 2.4.2, the IV carries the initial block counter of 1
+	QTest::newRow("rfc8439") << QString("4c616469657320616e642047656e746c656d656e206f662074686520636c617373206f66202739393a204966204920636f756c64206f6666657220796f75206f6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73637265656e20776f756c642062652069742e")
+							 << QString("6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0bf91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d807ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab77937365af90bbf74a35be6b40b8eedf2785e42874d")
+							 << QString("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f")
+							 << QString("01000000000000000000004a00000000");
+
+	// RFC 8439 appendix A.1, test vector 1, with a 12 byte nonce
+	QTest::newRow("zero") << QString("00000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000")
+						  << QString("76b8e0ada0f13d90405d6ae55386bd28bdd219b8a08ded1aa836efcc8b770dc7da41597c5157488d7724e03fb8d84a376a43b8f41518a11cc387b669b2ee6586")
+						  << QString("0000000000000000000000000000000000000000000000000000000000000000")
+						  << QString("000000000000000000000000");
+
+	QTest::newRow("short") << QString("4c616469657320616e642047656e746c656d656e")
+						   << QString("c6bdf594fa87d094756b8d179a7ba25b816398cc")
+						   << QString("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f")
+						   << QString("000000090000004a00000000");
+}
+
+void CipherUnitTest::chacha20()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("default");
+
+	foreach(const QString provider, providersToTest) {
+		if( !QCA::isSupported( "chacha20", provider ) )
+			QWARN( QString( "ChaCha20 not supported for "+provider).toLocal8Bit() );
+		else {
+			QFETCH( QString, plainText );
+			QFETCH( QString, cipherText );
+			QFETCH( QString, keyText );
+			QFETCH( QString, ivText );
+
+			QCA::SymmetricKey key( QCA::hexToArray( keyText ) );
+			QCA::InitializationVector iv( QCA::hexToArray( ivText ) );
+			QCA::Cipher forwardCipher( QString( "chacha20" ),
+									   QCA::Cipher::CTR,
+									   QCA::Cipher::NoPadding,
+									   QCA::Encode,
+									   key,
+									   iv,
+									   provider);
+
+			QCOMPARE( forwardCipher.keyLength().minimum(), 32 );
+			QCOMPARE( forwardCipher.keyLength().maximum(), 32 );
+
+			QString update = QCA::arrayToHex( forwardCipher.update( QCA::hexToArray( plainText ) ).toByteArray() );
+			QVERIFY( forwardCipher.ok() );
+			QCOMPARE( update + QCA::arrayToHex( forwardCipher.final().toByteArray() ), cipherText );
+			QVERIFY( forwardCipher.ok() );
+
+			QCA::Cipher reverseCipher( QString( "chacha20" ),
+									   QCA::Cipher::CTR,
+									   QCA::Cipher::NoPadding,
+									   QCA::Decode,
+									   key,
+									   iv,
+									   provider);
+			update = QCA::arrayToHex( reverseCipher.update( QCA::hexToArray( cipherText ) ).toByteArray() );
+			QVERIFY( reverseCipher.ok() );
+			QCOMPARE( update, plainText.left(update.size() ) );
+			QCOMPARE( update + QCA::arrayToHex( reverseCipher.final().toByteArray() ), plainText );
+			QVERIFY( reverseCipher.ok() );
+		}
+	}
+}
+
+void CipherUnitTest::chacha20CounterWrap()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("default");
+
+	foreach(const QString provider, providersToTest) {
+		if( !QCA::isSupported( "chacha20", provider ) )
+			QWARN( QString( "ChaCha20 not supported for "+provider).toLocal8Bit() );
+		else {
+			QCA::SymmetricKey key( QCA::hexToArray( "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f" ) );
+
+			// the block counter starts 6 blocks short of wrapping, after
+			// that it carries into the first nonce word
+			QCA::InitializationVector iv( QCA::hexToArray( "faffffff010000000200000003000000" ) );
+			QCA::InitializationVector carried( QCA::hexToArray( "00000000020000000200000003000000" ) );
+			QByteArray zero( 64 * 40 + 10, 0 );
+
+			QCA::Cipher whole( QString( "chacha20" ), QCA::Cipher::CTR, QCA::Cipher::NoPadding, QCA::Encode, key, iv, provider );
+			QByteArray stream = whole.update( zero ).toByteArray();
+			QVERIFY( whole.ok() );
+			QCOMPARE( stream.size(), zero.size() );
+
+			QCA::Cipher after( QString( "chacha20" ), QCA::Cipher::CTR, QCA::Cipher::NoPadding, QCA::Encode, key, carried, provider );
+			QByteArray expected = after.update( zero.left( zero.size() - 6 * 64 ) ).toByteArray();
+			QVERIFY( after.ok() );
+			QCOMPARE( QCA::arrayToHex( stream.mid( 6 * 64 ) ), QCA::arrayToHex( expected ) );
+
+			// the same across partial blocks
+			QCA::Cipher pieces( QString( "chacha20" ), QCA::Cipher::CTR, QCA::Cipher::NoPadding, QCA::Encode, key, iv, provider );
+			QByteArray joined;
+			for( int at = 0; at < zero.size(); at += 100 )
+				joined += pieces.update( zero.mid( at, 100 ) ).toByteArray();
+			QVERIFY( pieces.ok() );
+			QCOMPARE( QCA::arrayToHex( joined ), QCA::arrayToHex( stream ) );
+		}
+	}
+}
+
+void CipherUnitTest::chacha20poly1305_data()
+{
+	QTest::addColumn<QString>("plainText");
+	QTest::addColumn<QString>("payload");
+	QTest::addColumn<QString>("tag");
+	QTest::addColumn<QString>("keyText");
+	QTest::addColumn<QString>("ivText");
+
+	// RFC 8439 section 2.8.2 without the additional data
+	QTest::newRow("rfc8439") << QString("4c616469657320616e642047656e746c656d656e206f662074686520636c617373206f66202739393a204966204920636f756c64206f6666657220796f75206f6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73637265656e20776f756c642062652069742e")
+							 << QString("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b6116")
+							 << QString("6a23a4681fd59456aea1d29f82477216")
+							 << QString("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f")
+							 << QString("070000004041424344454647");
+
+	QTest::newRow("empty") << QString("")
+						   << QString("")
+						   << QString("a0784d7a4716f3feb4f64e7f4b39bf04")
+						   << QString("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f")
+						   << QString("070000004041424344454647");
+
+	QTest::newRow("wrongtag") << QString("4c616469657320616e642047656e746c656d656e206f662074686520636c617373206f66202739393a204966204920636f756c64206f6666657220796f75206f6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73637265656e20776f756c642062652069742e")
+							  << QString("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b6116")
+							  << QString("6a23a4681fd59456aea1d29f82477217")
+							  << QString("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f")
+							  << QString("070000004041424344454647");
+}
+
+void CipherUnitTest::chacha20poly1305()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("default");
+
+	foreach (const QString &provider, providersToTest) {
+		if (!QCA::isSupported( "chacha20-poly1305", provider))
+			QWARN(QString("ChaCha20-Poly1305 not supported for " + provider).toLocal8Bit());
+		else {
+			QFETCH(QString, plainText);
+			QFETCH(QString, payload);
+			QFETCH(QString, tag);
+			QFETCH(QString, keyText);
+			QFETCH(QString, ivText);
+
+			QCA::SymmetricKey key(QCA::hexToArray(keyText));
+			QCA::InitializationVector iv(QCA::hexToArray(ivText));
+			QCA::AuthTag authTag(16);
+			QCA::Cipher forwardCipher(QString("chacha20-poly1305"),
+									  QCA::Cipher::GCM,
+									  QCA::Cipher::NoPadding,
+									  QCA::Encode,
+									  key,
+									  iv,
+									  authTag,
+									  provider);
+			QString update = QCA::arrayToHex(forwardCipher.update(QCA::hexToArray(plainText)).toByteArray());
+			QVERIFY(forwardCipher.ok());
+			update += QCA::arrayToHex(forwardCipher.final().toByteArray());
+			authTag = forwardCipher.tag();
+			QEXPECT_FAIL("wrongtag", "It's OK", Continue);
+			QCOMPARE(QCA::arrayToHex(authTag.toByteArray()), tag);
+			QCOMPARE(update, payload);
+			QVERIFY(forwardCipher.ok());
+
+			QCA::Cipher reverseCipher(QString("chacha20-poly1305"),
+									  QCA::Cipher::GCM,
+									  QCA::Cipher::NoPadding,
+									  QCA::Decode,
+									  key,
+									  iv,
+									  QCA::AuthTag(QCA::hexToArray(tag)),
+									  provider);
+
+			update = QCA::arrayToHex(reverseCipher.update(QCA::hexToArray(payload)).toByteArray());
+			QVERIFY(reverseCipher.ok());
+			QCOMPARE(update, plainText.left(update.size()));
+			update += QCA::arrayToHex(reverseCipher.final().toByteArray());
+			QEXPECT_FAIL("wrongtag", "It's OK", Continue);
+			QCOMPARE(update, plainText);
+			QEXPECT_FAIL("wrongtag", "It's OK", Continue);
+			QVERIFY(reverseCipher.ok());
+
+			// decrypting without a tag can't be authenticated
+			QCA::Cipher untaggedCipher(QString("chacha20-poly1305"),
+									   QCA::Cipher::GCM,
+									   QCA::Cipher::NoPadding,
+									   QCA::Decode,
+									   key,
+									   iv,
+									   QCA::AuthTag(),
+									   provider);
+			untaggedCipher.update(QCA::hexToArray(payload));
+			untaggedCipher.final();
+			QVERIFY(!untaggedCipher.ok());
+		}
+	}
+}
+
+void CipherUnitTest::batch_data()
+{
+	QTest::addColumn<QString>("cipherType");
+	QTest::addColumn<int>("mode");
+	QTest::addColumn<QString>("keyText");
+	QTest::addColumn<QString>("ivText");
+	QTest::addColumn<QString>("aadText");
+	QTest::addColumn<QString>("plainText");
+	QTest::addColumn<QString>("payload");
+	QTest::addColumn<QString>("tag");
+
+	// GCM test case 4
+	QTest::newRow("aes128-gcm") << QString("aes128") << (int)QCA::Cipher::GCM
+								<< QString("feffe9928665731c6d6a8f9467308308")
+								<< QString("cafebabefacedbaddecaf888")
+								<< QString("feedfacedeadbeeffeedfacedeadbeefabaddad2")
+								<< QString("d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39")
+								<< QString("42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091")
+								<< QString("5bc94fbc3221a5db94fae95ae7121a47");
+
+	// RFC 8439 section 2.8.2
+	QTest::newRow("chacha20-poly1305") << QString("chacha20-poly1305") << (int)QCA::Cipher::GCM
+									   << QString("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f")
+									   << QString("070000004041424344454647")
+									   << QString("50515253c0c1c2c3c4c5c6c7")
+									   << QString("4c616469657320616e642047656e746c656d656e206f662074686520636c617373206f66202739393a204966204920636f756c64206f6666657220796f75206f6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73637265656e20776f756c642062652069742e")
+									   << QString("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b6116")
+									   << QString("1ae10b594f09e26a7e902ecbd0600691");
+
+	// SP 800-38A F.5.1
+	QTest::newRow("aes128-ctr") << QString("aes128") << (int)QCA::Cipher::CTR
+								<< QString("2b7e151628aed2a6abf7158809cf4f3c")
+								<< QString("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff")
+								<< QString("")
+								<< QString("6bc1bee22e409f96e93d7e117393172a")
+								<< QString("874d6191b620e3261bef6864990db6ce")
+								<< QString("");
+}
+
+void CipherUnitTest::batch()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("default");
+
+	QFETCH(QString, cipherType);
+	QFETCH(int, mode);
+	QFETCH(QString, keyText);
+	QFETCH(QString, ivText);
+	QFETCH(QString, aadText);
+	QFETCH(QString, plainText);
+	QFETCH(QString, payload);
+	QFETCH(QString, tag);
+
+	QCA::Cipher::Mode cipherMode = (QCA::Cipher::Mode)mode;
+	QString algorithm = QCA::Cipher::withAlgorithms(cipherType, cipherMode, QCA::Cipher::NoPadding);
+	bool aead = !tag.isEmpty();
+
+	foreach(const QString &provider, providersToTest) {
+		if(!QCA::isSupported(algorithm.toLatin1(), provider))
+			QWARN(QString(algorithm + " not supported for " + provider).toLocal8Bit());
+		else {
+			QCA::SymmetricKey key(QCA::hexToArray(keyText));
+			QByteArray iv = QCA::hexToArray(ivText);
+			QByteArray aad = QCA::hexToArray(aadText);
+
+			// the known answer first, then messages of assorted sizes
+			// with their own nonces and no additional data
+			const int count = 8;
+			QList<QByteArray> nonces, inputs, outputs, tags;
+			for(int n = 0; n < count; ++n) {
+				QByteArray nonce = iv;
+				nonce[nonce.size() - 1] = (char)(nonce[nonce.size() - 1] + n);
+				nonces += nonce;
+				inputs += (n == 0) ? QCA::hexToArray(plainText) : QCA::Random::randomArray(n * 211).toByteArray();
+				outputs += QByteArray(inputs[n].size(), 0);
+				tags += QByteArray(aead ? 16 : 0, 0);
+			}
+
+			QVector<QCA::Cipher::Record> records(count);
+			for(int n = 0; n < count; ++n) {
+				records[n].nonce = nonces[n].constData();
+				records[n].nonceSize = nonces[n].size();
+				if(n == 0) {
+					records[n].aad = aad.constData();
+					records[n].aadSize = aad.size();
+				}
+				records[n].in = inputs[n].constData();
+				records[n].out = outputs[n].data();
+				records[n].size = inputs[n].size();
+				records[n].tag = tags[n].data();
+				records[n].tagSize = tags[n].size();
+			}
+
+			QCA::Cipher cipher(cipherType, cipherMode, QCA::Cipher::NoPadding, QCA::Encode, key, QCA::InitializationVector(iv), provider);
+			QVERIFY(cipher.encryptBatch(records));
+			QCOMPARE(QCA::arrayToHex(outputs[0]), payload);
+			QCOMPARE(QCA::arrayToHex(tags[0]), tag);
+
+			for(int n = 1; n < count; ++n) {
+				QCA::Cipher single(cipherType, cipherMode, QCA::Cipher::NoPadding, QCA::Encode, key, QCA::InitializationVector(nonces[n]), QCA::AuthTag(tags[n].size()), provider);
+				QCA::SecureArray expected = single.process(inputs[n]);
+				QVERIFY(single.ok());
+				QCOMPARE(QCA::arrayToHex(outputs[n]), QCA::arrayToHex(expected.toByteArray()));
+				QCOMPARE(QCA::arrayToHex(tags[n]), QCA::arrayToHex(single.tag().toByteArray()));
+			}
+
+			// decrypt in place, with one record tampered with
+			if(aead)
+				tags[2][0] = tags[2][0] ^ 0x01;
+			for(int n = 0; n < count; ++n)
+				records[n].in = outputs[n].constData();
+			QList<int> failed;
+			QCOMPARE(cipher.decryptBatch(records, &failed), !aead);
+			if(aead)
+				QCOMPARE(failed, QList<int>() << 2);
+			else
+				QVERIFY(failed.isEmpty());
+			QCOMPARE(QCA::arrayToHex(outputs[0]), plainText);
+			for(int n = 1; n < count; ++n) {
+				if(n != 2 || !aead)
+					QCOMPARE(outputs[n], inputs[n]);
+			}
+			if(aead)
+				QCOMPARE(outputs[2], QByteArray(inputs[2].size(), 0));
+
+			// the cipher is still usable for whole messages
+			QCOMPARE(cipher.process(QCA::hexToArray(plainText)).size(), inputs[0].size());
+			QVERIFY(cipher.ok());
+		}
+	}
+}
+
+void CipherUnitTest::cipherDevice_data()
+{
+	QTest::addColumn<int>("mode");
+	QTest::addColumn<int>("padding");
+
+	QTest::newRow("aes128-cbc-pkcs7") << (int)QCA::Cipher::CBC << (int)QCA::Cipher::PKCS7;
+	QTest::newRow("aes128-ctr") << (int)QCA::Cipher::CTR << (int)QCA::Cipher::NoPadding;
+}
+
+void CipherUnitTest::cipherDevice()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("default");
+
+	QFETCH(int, mode);
+	QFETCH(int, padding);
+
+	QCA::Cipher::Mode cipherMode = (QCA::Cipher::Mode)mode;
+	QCA::Cipher::Padding cipherPadding = (QCA::Cipher::Padding)padding;
+	QString algorithm = QCA::Cipher::withAlgorithms("aes128", cipherMode, cipherPadding);
+
+	foreach(const QString &provider, providersToTest) {
+		if(!QCA::isSupported(algorithm.toLatin1(), provider))
+			QWARN(QString(algorithm + " not supported for " + provider).toLocal8Bit());
+		else {
+			QCA::SymmetricKey key(16);
+			QCA::InitializationVector iv(16);
+			QByteArray input = QCA::Random::randomArray(100003).toByteArray();
+
+			QCA::Cipher single("aes128", cipherMode, cipherPadding, QCA::Encode, key, iv, provider);
+			QByteArray expected = single.process(input).toByteArray();
+			QVERIFY(single.ok());
+
+			// write through a small buffer, so every chunk is split up
+			QBuffer sink;
+			sink.open(QIODevice::WriteOnly);
+			QCA::Cipher encryptor("aes128", cipherMode, cipherPadding, QCA::Encode, key, iv, provider);
+			QCA::CipherDevice writer(&encryptor, &sink);
+			writer.setMaximumBufferSize(1000);
+			QVERIFY(writer.open(QIODevice::WriteOnly));
+			int at = 0;
+			while(at < input.size()) {
+				qint64 n = writer.write(input.constData() + at, qMin(4096, input.size() - at));
+				QVERIFY(n > 0);
+				QVERIFY(n <= 1000);
+				at += (int)n;
+			}
+			writer.close();
+			QVERIFY(writer.ok());
+			QCOMPARE(sink.data(), expected);
+
+			// and read it back
+			QBuffer source(&expected);
+			source.open(QIODevice::ReadOnly);
+			QCA::Cipher decryptor("aes128", cipherMode, cipherPadding, QCA::Decode, key, iv, provider);
+			QCA::CipherDevice reader(&decryptor, &source);
+			reader.setMaximumBufferSize(777);
+			QVERIFY(reader.open(QIODevice::ReadOnly));
+			QByteArray output;
+			while(!reader.atEnd()) {
+				QByteArray chunk = reader.read(500);
+				QVERIFY(chunk.size() <= 500);
+				output += chunk;
+			}
+			QVERIFY(reader.ok());
+			QCOMPARE(output, input);
+
+			// a read error isn't the end of the data
+			FailingBuffer broken(&expected, 2000);
+			broken.open(QIODevice::ReadOnly);
+			QCA::Cipher brokenDecryptor("aes128", cipherMode, cipherPadding, QCA::Decode, key, iv, provider);
+			QCA::CipherDevice brokenReader(&brokenDecryptor, &broken);
+			brokenReader.setMaximumBufferSize(777);
+			QVERIFY(brokenReader.open(QIODevice::ReadOnly));
+			qint64 n;
+			char buf[500];
+			output.clear();
+			while((n = brokenReader.read(buf, sizeof(buf))) > 0)
+				output.append(buf, (int)n);
+			QCOMPARE(n, qint64(-1));
+			QVERIFY(!brokenReader.ok());
+			QVERIFY(!brokenReader.errorString().isEmpty());
+			QVERIFY(output.size() <= 2000);
+			QCOMPARE(output, input.left(output.size()));
+		}
+	}
+}
+
+void CipherUnitTest::pipeline()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("default");
+
+	foreach(const QString &provider, providersToTest) {
+		if(!QCA::isSupported("aes128-cbc-pkcs7", provider) || !QCA::isSupported("hmac(sha1)", provider))
+			QWARN(QString("aes128-cbc-pkcs7 or hmac(sha1) not supported for " + provider).toLocal8Bit());
+		else {
+			QCA::SymmetricKey key(16);
+			QCA::SymmetricKey macKey(20);
+			QCA::InitializationVector iv(16);
+			QByteArray input = QCA::Random::randomArray(70001).toByteArray();
+
+			// encrypt, then MAC, then armor, one stage at a time
+			QCA::Cipher single("aes128", QCA::Cipher::CBC, QCA::Cipher::PKCS7, QCA::Encode, key, iv, provider);
+			QCA::SecureArray cipherText = single.process(input);
+			QVERIFY(single.ok());
+			QCA::MessageAuthenticationCode singleMac("hmac(sha1)", macKey, provider);
+			QString expectedTag = QCA::arrayToHex(singleMac.process(cipherText).toByteArray());
+			QCA::Base64 singleArmor;
+			QByteArray expected = singleArmor.encode(cipherText).toByteArray();
+
+			QCA::Cipher cipher("aes128", QCA::Cipher::CBC, QCA::Cipher::PKCS7, QCA::Encode, key, iv, provider);
+			QCA::MessageAuthenticationCode mac("hmac(sha1)", macKey, provider);
+			QCA::Base64 armor;
+			QCA::Pipeline pipeline;
+			pipeline.append(&cipher).append(&mac).append(&armor);
+			pipeline.setBlockSize(1000);
+			QCOMPARE(pipeline.count(), 3);
+
+			// push, in pieces that do not line up with the blocks
+			QByteArray output;
+			for(int at = 0; at < input.size(); at += 4567)
+				output += pipeline.update(input.mid(at, 4567)).toByteArray();
+			output += pipeline.final().toByteArray();
+			QVERIFY(pipeline.ok());
+			QCOMPARE(output, expected);
+			QCOMPARE(QCA::arrayToHex(mac.final().toByteArray()), expectedTag);
+
+			// pull, through a device
+			pipeline.clear();
+			QBuffer source(&input);
+			source.open(QIODevice::ReadOnly);
+			QCA::CipherDevice reader(&pipeline, &source);
+			QVERIFY(reader.open(QIODevice::ReadOnly));
+			output.clear();
+			while(!reader.atEnd())
+				output += reader.read(3000);
+			QVERIFY(reader.ok());
+			QCOMPARE(output, expected);
+			QCOMPARE(QCA::arrayToHex(mac.final().toByteArray()), expectedTag);
+		}
+	}
+}
+
+void CipherUnitTest::processParallel_data()
+{
+	QTest::addColumn<int>("mode");
+	QTest::addColumn<int>("direction");
+	QTest::addColumn<int>("ivLength");
+	QTest::addColumn<int>("size");
+
+	QTest::newRow("ctr") << (int)QCA::Cipher::CTR << (int)QCA::Encode << 16 << 1024 * 1024 + 37;
+	QTest::newRow("ctr decode") << (int)QCA::Cipher::CTR << (int)QCA::Decode << 16 << 512 * 1024;
+	QTest::newRow("gcm") << (int)QCA::Cipher::GCM << (int)QCA::Encode << 12 << 1024 * 1024 + 5;
+	QTest::newRow("gcm long iv") << (int)QCA::Cipher::GCM << (int)QCA::Encode << 16 << 768 * 1024 + 100;
+	QTest::newRow("ecb") << (int)QCA::Cipher::ECB << (int)QCA::Encode << 0 << 1024 * 1024;
+	QTest::newRow("cbc decode") << (int)QCA::Cipher::CBC << (int)QCA::Decode << 16 << 1024 * 1024;
+}
 
+void CipherUnitTest::processParallel()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("qca-gcrypt");
+	providersToTest.append("qca-botan");
+	providersToTest.append("default");
+
+	QFETCH(int, mode);
+	QFETCH(int, direction);
+	QFETCH(int, ivLength);
+	QFETCH(int, size);
+
+	QCA::Cipher::Mode cipherMode = (QCA::Cipher::Mode)mode;
+	QCA::Direction dir = (QCA::Direction)direction;
+	QString algorithm = QCA::Cipher::withAlgorithms("aes128", cipherMode, QCA::Cipher::NoPadding);
+
+	foreach(const QString &provider, providersToTest) {
+		if(!QCA::isSupported(algorithm.toLatin1(), provider))
+			QWARN(QString(algorithm + " not supported for " + provider).toLocal8Bit());
+		else {
+			QCA::SymmetricKey key(16);
+			QCA::InitializationVector iv(ivLength);
+			QCA::SecureArray input = QCA::Random::randomArray(size);
+			QCA::AuthTag authTag(cipherMode == QCA::Cipher::GCM ? 16 : 0);
+
+			QCA::Cipher serialCipher(QString("aes128"), cipherMode, QCA::Cipher::NoPadding, QCA::Encode, key, iv, authTag, provider);
+			QCA::SecureArray serial = serialCipher.process(input);
+			QVERIFY(serialCipher.ok());
+			QCA::AuthTag serialTag = serialCipher.tag();
+
+			foreach(int threads, QList<int>() << 1 << 2 << 3 << 8) {
+				QCA::Cipher parallelCipher(QString("aes128"), cipherMode, QCA::Cipher::NoPadding, QCA::Encode, key, iv, authTag, provider);
+				QCA::SecureArray parallel = parallelCipher.processParallel(input, threads);
+				QVERIFY(parallelCipher.ok());
+				QCOMPARE(QCA::arrayToHex(parallel.toByteArray()), QCA::arrayToHex(serial.toByteArray()));
+				if(cipherMode == QCA::Cipher::GCM)
+					QCOMPARE(QCA::arrayToHex(parallelCipher.tag().toByteArray()), QCA::arrayToHex(serialTag.toByteArray()));
+
+				if(dir == QCA::Decode || cipherMode == QCA::Cipher::GCM) {
+					QCA::Cipher reverseCipher(QString("aes128"), cipherMode, QCA::Cipher::NoPadding, QCA::Decode, key, iv, serialTag, provider);
+					QCA::SecureArray plain = reverseCipher.processParallel(serial, threads);
+					QVERIFY(reverseCipher.ok());
+					QCOMPARE(QCA::arrayToHex(plain.toByteArray()), QCA::arrayToHex(input.toByteArray()));
+				}
+			}
+
+			if(cipherMode == QCA::Cipher::GCM) {
+				QCA::AuthTag wrongTag(serialTag);
+				wrongTag[0] = wrongTag[0] ^ 0x01;
+				QCA::Cipher reverseCipher(QString("aes128"), cipherMode, QCA::Cipher::NoPadding, QCA::Decode, key, iv, wrongTag, provider);
+				reverseCipher.processParallel(serial, 4);
+				QVERIFY(!reverseCipher.ok());
+
+				// decoding without a tag can't be authenticated
+				QCA::Cipher untaggedCipher(QString("aes128"), cipherMode, QCA::Cipher::NoPadding, QCA::Decode, key, iv, QCA::AuthTag(), provider);
+				QCA::SecureArray untagged = untaggedCipher.processParallel(serial, 4);
+				QVERIFY(!untaggedCipher.ok());
+				QVERIFY(untagged.isEmpty());
+			}
+		}
+	}
+}
+
+void CipherUnitTest::processParallelCounterWrap()
+{
+	QStringList providersToTest;
+	providersToTest.append("qca-ossl");
+	providersToTest.append("qca-gcrypt");
+	providersToTest.append("qca-botan");
+	providersToTest.append("default");
+
+	// 2^20 blocks, so about one iv in 4096 puts the 32-bit gcm counter
+	// close enough to wrapping that one of the segments crosses it
+	const int size = 16 * 1024 * 1024;
+	const quint32 blocks = size / 16;
+
+	foreach(const QString &provider, providersToTest) {
+		if(!QCA::isSupported("aes128-gcm", provider) || !QCA::isSupported("aes128-ecb", provider))
+			QWARN(QString("aes128-gcm not supported for " + provider).toLocal8Bit());
+		else {
+			QCA::SymmetricKey key(QCA::hexToArray("000102030405060708090a0b0c0d0e0f"));
+			QCA::AuthTag authTag(16);
+			QCA::SecureArray zero(16);
+
+			// with an iv that isn't 12 bytes long, J0 is a ghash of the
+			// iv. the first ciphertext block of zeros is E(inc32(J0)), so
+			// decrypting it shows where the counter starts
+			QCA::InitializationVector iv;
+			bool found = false;
+			for(quint32 n = 0; n < 200000 && !found; ++n) {
+				QByteArray candidate(16, 0);
+				candidate[12] = (char)(n >> 24);
+				candidate[13] = (char)(n >> 16);
+				candidate[14] = (char)(n >> 8);
+				candidate[15] = (char)n;
+				QCA::Cipher gcm(QString("aes128"), QCA::Cipher::GCM, QCA::Cipher::NoPadding, QCA::Encode, key, QCA::InitializationVector(candidate), authTag, provider);
+				QCA::SecureArray first = gcm.update(zero);
+				QVERIFY(gcm.ok());
+				QCOMPARE(first.size(), 16);
+				QCA::Cipher ecb(QString("aes128"), QCA::Cipher::ECB, QCA::Cipher::NoPadding, QCA::Decode, key, QCA::InitializationVector(), provider);
+				QCA::SecureArray counter = ecb.process(first);
+				QVERIFY(ecb.ok());
+				QCOMPARE(counter.size(), 16);
+				const unsigned char *p = (const unsigned char *)counter.data();
+				quint32 low = ((quint32)p[12] << 24) | ((quint32)p[13] << 16) | ((quint32)p[14] << 8) | (quint32)p[15];
+				if(low > 0xffffffff - blocks) {
+					iv = QCA::InitializationVector(candidate);
+					found = true;
+				}
+			}
+			QVERIFY(found);
+
+			QCA::SecureArray input = QCA::Random::randomArray(size);
+			QCA::Cipher serialCipher(QString("aes128"), QCA::Cipher::GCM, QCA::Cipher::NoPadding, QCA::Encode, key, iv, authTag, provider);
+			QCA::SecureArray serial = serialCipher.process(input);
+			QVERIFY(serialCipher.ok());
+			QCA::AuthTag serialTag = serialCipher.tag();
+
+			QCA::Cipher parallelCipher(QString("aes128"), QCA::Cipher::GCM, QCA::Cipher::NoPadding, QCA::Encode, key, iv, authTag, provider);
+			QCA::SecureArray parallel = parallelCipher.processParallel(input, 4);
+			QVERIFY(parallelCipher.ok());
+			QVERIFY(parallel == serial);
+			QCOMPARE(QCA::arrayToHex(parallelCipher.tag().toByteArray()), QCA::arrayToHex(serialTag.toByteArray()));
+
+			QCA::Cipher reverseCipher(QString("aes128"), QCA::Cipher::GCM, QCA::Cipher::NoPadding, QCA::Decode, key, iv, serialTag, provider);
+			QCA::SecureArray plain = reverseCipher.processParallel(serial, 4);
+			QVERIFY(reverseCipher.ok());
+			QVERIFY(plain == input);
+		}
+	}
+}
+
+void CipherUnitTest::processParallelBenchmark_data()
+{
+	QTest::addColumn<int>("mode");
+	QTest::addColumn<int>("threads");
+
+	foreach(int threads, QList<int>() << 1 << 2 << 4 << 8) {
+		QTest::newRow(QString("ctr %1 threads").arg(threads).toLatin1()) << (int)QCA::Cipher::CTR << threads;
+		QTest::newRow(QString("gcm %1 threads").arg(threads).toLatin1()) << (int)QCA::Cipher::GCM << threads;
+	}
+}
+
+void CipherUnitTest::processParallelBenchmark()
+{
+	QFETCH(int, mode);
+	QFETCH(int, threads);
+
+	QCA::Cipher::Mode cipherMode = (QCA::Cipher::Mode)mode;
+	if(!QCA::isSupported(QCA::Cipher::withAlgorithms("aes256", cipherMode, QCA::Cipher::NoPadding).toLatin1()))
+	{
+#if QT_VERSION >= 0x050000
+		QSKIP("No provider supports the cipher");
+#else
+		QSKIP("No provider supports the cipher", SkipAll);
+#endif
+	}
+
+	QCA::SymmetricKey key(32);
+	QCA::InitializationVector iv(cipherMode == QCA::Cipher::GCM ? 12 : 16);
+	QCA::AuthTag authTag(cipherMode == QCA::Cipher::GCM ? 16 : 0);
+	QByteArray input(8 * 1024 * 1024, 'x');
+
+	QCA::Cipher cipher(QString("aes256"), cipherMode, QCA::Cipher::NoPadding, QCA::Encode, key, iv, authTag);
+	QBENCHMARK {
+		cipher.processParallel(input, threads);
+	}
+	QVERIFY(cipher.ok());
+}
 
 QTEST_MAIN(CipherUnitTest)
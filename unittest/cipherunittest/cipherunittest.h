@@ -118,6 +118,24 @@ private slots:
 
 	void cast5_data();
 	void cast5();
+
+	void chacha20_data();
+	void chacha20();
+	void chacha20CounterWrap();
+	void chacha20poly1305_data();
+	void chacha20poly1305();
+
+	void batch_data();
+	void batch();
+	void cipherDevice_data();
+	void cipherDevice();
+	void pipeline();
+
+	void processParallel_data();
+	void processParallel();
+	void processParallelCounterWrap();
+	void processParallelBenchmark_data();
+	void processParallelBenchmark();
 private:
 	QCA::Initializer* m_init;
 
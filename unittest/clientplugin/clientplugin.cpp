@@ -24,6 +24,7 @@
  */
 
 #include <QtCrypto>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QPointer>
 #include <QtTest/QtTest>
 
@@ -39,6 +40,8 @@ private slots:
     void initTestCase();
     void cleanupTestCase();
     void testInsertRemovePlugin();
+    void testCalibration();
+    void testCalibrationSkipsFailures();
 
 private:
     QCA::Initializer* m_init;
@@ -106,6 +109,185 @@ void ClientPlugin::testInsertRemovePlugin()
     QVERIFY(provider.isNull());
 }
 
+const QString slowProviderName = "testSlowProvider";
+
+// a sha1 that is very slow and always gives zeros, only for timing
+class SlowHashContext : public QCA::HashContext
+{
+        Q_OBJECT
+
+public:
+        SlowHashContext(QCA::Provider *p) : QCA::HashContext(p, "sha1")
+        {
+        }
+
+        Provider::Context *clone() const
+        {
+                return new SlowHashContext(*this);
+        }
+
+        void clear()
+        {
+        }
+
+        void update(const QCA::MemoryRegion &)
+        {
+                QElapsedTimer timer;
+                timer.start();
+                while(timer.nsecsElapsed() < 100000)
+                        ;
+        }
+
+        QCA::MemoryRegion final()
+        {
+                return QByteArray(20, 0);
+        }
+};
+
+class TestSlowProvider : public QObject, public QCA::Provider
+{
+        Q_OBJECT
+
+public:
+        int qcaVersion() const
+        {
+                return QCA_VERSION;
+        }
+
+        QString name() const
+        {
+                return slowProviderName;
+        }
+
+        QStringList features() const
+        {
+                QStringList list;
+                list += "sha1";
+                return list;
+        }
+
+        Provider::Context *createContext(const QString &type)
+        {
+            if(type == "sha1")
+                return new SlowHashContext(this);
+            else
+                return 0;
+        }
+};
+
+void ClientPlugin::testCalibration()
+{
+    QPointer<TestSlowProvider> provider = new TestSlowProvider;
+    QVERIFY(QCA::insertProvider(provider, 0));
+
+    // by priority the slow provider wins
+    QCOMPARE(QCA::Hash("sha1").provider()->name(), slowProviderName);
+
+    QCA::calibrateProviders(QStringList() << "sha1");
+    QMap<QString,QString> chosen = QCA::calibratedProviders();
+    QVERIFY(chosen.contains("sha1"));
+    QVERIFY(chosen["sha1"] != slowProviderName);
+    QCOMPARE(QCA::Hash("sha1").provider()->name(), chosen["sha1"]);
+
+    // naming a provider still works
+    QCOMPARE(QCA::Hash("sha1", slowProviderName).provider()->name(), slowProviderName);
+
+    QVERIFY(QCA::unloadProvider(slowProviderName));
+}
+
+const QString brokenProviderName = "testBrokenProvider";
+
+// an aes128-ctr that fails straight away, which would make it the fastest
+class BrokenCipherContext : public QCA::CipherContext
+{
+        Q_OBJECT
+
+public:
+        BrokenCipherContext(QCA::Provider *p) : QCA::CipherContext(p, "aes128-ctr")
+        {
+        }
+
+        Provider::Context *clone() const
+        {
+                return new BrokenCipherContext(*this);
+        }
+
+        void setup(QCA::Direction, const QCA::SymmetricKey &, const QCA::InitializationVector &, const QCA::AuthTag &)
+        {
+        }
+
+        QCA::KeyLength keyLength() const
+        {
+                return QCA::KeyLength(16, 16, 1);
+        }
+
+        int blockSize() const
+        {
+                return 1;
+        }
+
+        QCA::AuthTag tag() const
+        {
+                return QCA::AuthTag();
+        }
+
+        bool update(const QCA::SecureArray &, QCA::SecureArray *)
+        {
+                return false;
+        }
+
+        bool final(QCA::SecureArray *)
+        {
+                return false;
+        }
+};
+
+class TestBrokenProvider : public QObject, public QCA::Provider
+{
+        Q_OBJECT
+
+public:
+        int qcaVersion() const
+        {
+                return QCA_VERSION;
+        }
+
+        QString name() const
+        {
+                return brokenProviderName;
+        }
+
+        QStringList features() const
+        {
+                QStringList list;
+                list += "aes128-ctr";
+                return list;
+        }
+
+        Provider::Context *createContext(const QString &type)
+        {
+            if(type == "aes128-ctr")
+                return new BrokenCipherContext(this);
+            else
+                return 0;
+        }
+};
+
+void ClientPlugin::testCalibrationSkipsFailures()
+{
+    QPointer<TestBrokenProvider> provider = new TestBrokenProvider;
+    QVERIFY(QCA::insertProvider(provider, 0));
+
+    QCA::calibrateProviders(QStringList() << "aes128-ctr");
+    QMap<QString,QString> chosen = QCA::calibratedProviders();
+
+    // the built-in aes is there to be chosen instead
+    QVERIFY(chosen.contains("aes128-ctr"));
+    QVERIFY(chosen["aes128-ctr"] != brokenProviderName);
+
+    QVERIFY(QCA::unloadProvider(brokenProviderName));
+}
+
 QTEST_MAIN(ClientPlugin)
 
 #include "clientplugin.moc"
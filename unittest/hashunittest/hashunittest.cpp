@@ -69,6 +69,7 @@ private slots:
     void whirlpooltest_data();
     void whirlpooltest();
     void whirlpoollongtest();
+    void hashingDevice();
 private:
     QCA::Initializer* m_init;
 };
@@ -522,6 +523,7 @@ void HashUnitTest::sha256test()
     providersToTest.append("qca-botan");
     providersToTest.append("qca-nss");
     providersToTest.append("qca-ipp");
+    providersToTest.append("default");
 
     QFETCH(QByteArray, input);
     QFETCH(QString, expectedHash);
@@ -546,6 +548,7 @@ void HashUnitTest::sha256longtest()
     providersToTest.append("qca-botan");
     providersToTest.append("qca-nss");
     providersToTest.append("qca-ipp");
+    providersToTest.append("default");
 
     foreach(QString provider, providersToTest) {
 	if(!QCA::isSupported("sha256", provider))
@@ -678,6 +681,7 @@ void HashUnitTest::sha512test()
     providersToTest.append("qca-botan");
     providersToTest.append("qca-nss");
     providersToTest.append("qca-ipp");
+    providersToTest.append("default");
 
     QFETCH(QByteArray, input);
     QFETCH(QString, expectedHash);
@@ -703,6 +707,7 @@ void HashUnitTest::sha512longtest()
     providersToTest.append("qca-botan");
     providersToTest.append("qca-nss");
     providersToTest.append("qca-ipp");
+    providersToTest.append("default");
 
     foreach(QString provider, providersToTest) {
 	if(!QCA::isSupported("sha512", provider))
@@ -889,6 +894,51 @@ void HashUnitTest::whirlpoollongtest()
 }
 
 
+void HashUnitTest::hashingDevice()
+{
+    QStringList providersToTest;
+    providersToTest.append("qca-ossl");
+    providersToTest.append("default");
+
+    QByteArray input = QCA::Random::randomArray(50000).toByteArray();
+
+    foreach(QString provider, providersToTest) {
+	if(!QCA::isSupported("sha1", provider))
+	    QWARN(QString("SHA1 not supported for "+provider).toLocal8Bit());
+	else {
+	    QString expected = QCA::Hash("sha1", provider).hashToString(input);
+
+	    // reading: the data is passed on unchanged, and hashed
+	    QBuffer source(&input);
+	    source.open(QIODevice::ReadOnly);
+	    QCA::Hash readHash("sha1", provider);
+	    QCA::HashingDevice reader(&readHash, &source);
+	    QVERIFY(reader.open(QIODevice::ReadOnly));
+	    QByteArray output;
+	    while(!reader.atEnd())
+		output += reader.read(3001);
+	    QCOMPARE(output, input);
+	    QCOMPARE(QString(QCA::arrayToHex(readHash.final().toByteArray())), expected);
+
+	    // writing
+	    QBuffer sink;
+	    sink.open(QIODevice::WriteOnly);
+	    QCA::Hash writeHash("sha1", provider);
+	    QCA::HashingDevice writer(&writeHash, &sink);
+	    writer.setMaximumBufferSize(4096);
+	    QVERIFY(writer.open(QIODevice::WriteOnly));
+	    int at = 0;
+	    while(at < input.size()) {
+		qint64 n = writer.write(input.constData() + at, input.size() - at);
+		QVERIFY(n > 0);
+		at += (int)n;
+	    }
+	    QCOMPARE(sink.data(), input);
+	    QCOMPARE(QString(QCA::arrayToHex(writeHash.final().toByteArray())), expected);
+	}
+    }
+}
+
 QTEST_MAIN(HashUnitTest)
 
 #include "hashunittest.moc"
@@ -41,6 +41,10 @@ private slots:
     void testHexString();
     void testIncrementalUpdate();
     void testBrokenInput();
+    void testLongInput();
+    void testBrokenLongInput();
+    void benchmark_data();
+    void benchmark();
 private:
     QCA::Initializer* m_init;
 };
@@ -115,6 +119,68 @@ void HexUnitTest::testBrokenInput()
     QCOMPARE(hexObject.ok(), false);
 }
 
+void HexUnitTest::testLongInput()
+{
+    // long enough for the vector code, with a tail that isn't
+    QByteArray raw(1000, 0);
+    for (int i = 0; i < raw.size(); i++)
+	raw[i] = (char)(i * 13 + (i >> 8));
+    QString encoded = QString::fromLatin1(raw.toHex());
+
+    QCOMPARE( QCA::arrayToHex(raw), encoded );
+    QCOMPARE( QCA::hexToArray(encoded), raw );
+    QCOMPARE( QCA::hexToArray(encoded.toUpper()), raw );
+
+    // odd sized pieces, so that digit pairs are split across update() calls
+    QCA::Hex hexObject(QCA::Decode);
+    QByteArray text = encoded.toLatin1();
+    QByteArray decoded;
+    for (int at = 0, step = 1; at < text.size(); at += step, step = step % 71 + 2)
+	decoded += hexObject.update(text.mid(at, step)).toByteArray();
+    decoded += hexObject.final().toByteArray();
+    QVERIFY( hexObject.ok() );
+    QCOMPARE( decoded, raw );
+}
+
+void HexUnitTest::testBrokenLongInput()
+{
+    QString encoded = QString::fromLatin1(QByteArray(500, 'x').toHex());
+
+    for (int at = 0; at < encoded.size(); at += 29) {
+	QString bad = encoded;
+	bad[at] = QChar('g');
+	QVERIFY( QCA::hexToArray(bad).isEmpty() );
+
+	// not Latin-1 at all
+	bad[at] = QChar(0x0137);
+	QVERIFY( QCA::hexToArray(bad).isEmpty() );
+    }
+
+    QVERIFY( QCA::hexToArray(encoded.left(encoded.size() - 1)).isEmpty() );
+}
+
+void HexUnitTest::benchmark_data()
+{
+    QTest::addColumn<bool>("encode");
+
+    QTest::newRow("arrayToHex") << true;
+    QTest::newRow("hexToArray") << false;
+}
+
+void HexUnitTest::benchmark()
+{
+    QFETCH(bool, encode);
+
+    QByteArray raw(1024 * 1024, 'x');
+    QString encoded = QCA::arrayToHex(raw);
+    QBENCHMARK {
+	if (encode)
+	    QCA::arrayToHex(raw);
+	else
+	    QCA::hexToArray(encoded);
+    }
+}
+
 QTEST_MAIN(HexUnitTest)
 
 #include "hexunittest.moc"
@@ -24,6 +24,7 @@
  */
 
 #include <QtCrypto>
+#include <QtCore/QPointer>
 #include <QtTest/QtTest>
 
 #ifdef QT_STATICPLUGIN
@@ -45,9 +46,19 @@ private slots:
     void pbkdf2Tests_data();
     void pbkdf2Tests();
 	void pbkdf2TimeTest();
+    void pbkdf2sha2Tests_data();
+    void pbkdf2sha2Tests();
+    void pbkdf2sha2TimeTest();
+    void pbkdf2MakeKeysTest();
+    void argon2idTests_data();
+    void argon2idTests();
+    void scryptTests_data();
+    void scryptTests();
+    void memoryHardTimeTest();
     void pbkdf2extraTests();
     void hkdfTests_data();
     void hkdfTests();
+    void hkdfDefaultContextTest();
 private:
     QCA::Initializer* m_init;
 };
@@ -477,28 +488,404 @@ void KDFUnitTest::pbkdf2extraTests()
     }
 }
 
+void KDFUnitTest::pbkdf2sha2Tests_data()
+{
+    QTest::addColumn<QString>("algorithm");
+    QTest::addColumn<QString>("secret");
+    QTest::addColumn<QString>("salt");
+    QTest::addColumn<unsigned int>("iterationCount");
+    QTest::addColumn<QString>("output");
+
+    // RFC 7914, section 11
+    QTest::newRow("sha256-1") << QString("sha256")
+		       << QString("passwd")
+		       << QString("salt")
+		       << static_cast<unsigned int>(1)
+		       << QString("55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783");
+
+    QTest::newRow("sha256-2") << QString("sha256")
+		       << QString("Password")
+		       << QString("NaCl")
+		       << static_cast<unsigned int>(80000)
+		       << QString("4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d");
+
+    QTest::newRow("sha256-3") << QString("sha256")
+		       << QString("password")
+		       << QString("salt")
+		       << static_cast<unsigned int>(4096)
+		       << QString("c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a");
+
+    // a password longer than a block, and enough output blocks to fill
+    // several SIMD lanes
+    QTest::newRow("sha256-4") << QString("sha256")
+		       << QString("passwordPASSWORDpassword").repeated(3)
+		       << QString("saltSALTsaltSALTsaltSALTsaltSALTsalt")
+		       << static_cast<unsigned int>(1000)
+		       << QString("82cad81fa70ec02cdad01e50c09342dbd24997234a3b9eebcc294a2fef00e10e2f52e91d813134137ff995d3892e610002a4ba5ded49dcaf89c9b9119ebed7bf1754523325419463aee2a968738d4b786515a0ec8d30657cb6d3f466ee1ef1b8ba61fc8678715eb4e289b77729a2cdf22bb06bcf7e29c3762bdbbdab5111a2fa431eeddf10659477001783fc55f775e2beff8ef442d878c2855d41b961f5568a69cdc432f86434fa93c1c31ae065822542b719060a682c427216ce9b28182703029fa5e3d9b459b7e83a976bb5649b5b9cd381e5a404b792c3fd12f554bda87c1ecc77a1992ab35bfb24e12331a12db7406a43bb4c41c4c652bd4b03036bd67ecf1499c791dc2573439384d2e1845bb870d176327fef8256e1caf2fdf3fb72608b4f9e595f913abcf3ab3175");
+
+    QTest::newRow("sha512-1") << QString("sha512")
+		       << QString("password")
+		       << QString("salt")
+		       << static_cast<unsigned int>(1)
+		       << QString("867f70cf1ade02cff3752599a3a53dc4af34c7a669815ae5d513554e1c8cf252c02d470a285a0501bad999bfe943c08f050235d7d68b1da55e63f73b60a57fce");
+
+    QTest::newRow("sha512-2") << QString("sha512")
+		       << QString("passwordPASSWORDpassword")
+		       << QString("saltSALTsaltSALTsaltSALTsaltSALTsalt")
+		       << static_cast<unsigned int>(4096)
+		       << QString("8c0511f4c6e597c6ac6315d8f0362e225f3c501495ba23b868c005174dc4ee71115b59f9e60cd9532fa33e0f75aefe30225c583a186cd82bd4daea9724a3d3b8");
+
+    QTest::newRow("sha512-3") << QString("sha512")
+		       << QString("passwordPASSWORDpassword").repeated(6)
+		       << QString("saltSALTsaltSALTsaltSALTsaltSALTsalt")
+		       << static_cast<unsigned int>(1000)
+		       << QString("f2d3d00df4e3e6e65ced62b9066848638ade4e39bc70d2aa59d1871b252f9cc1b495c82bdb4a490bf4ecca322f29ebc1aa952b1e37b2bf9371a751309058af3c1c4b6b82f0ab1fb44d0eb977969a6bf1ce577767d30f82b58b8d6ce10fbddfdd27710471d7b97112de9fbe9d0b8e1a0eea918c369641c42c78bc2d2284461a0254800ef2a3e67445d83c5792ef931af4b29eb9455194002919fb0809925ac54cfc7fb68852c17fb2c0095b6c2cbe12f1c35474e1884c565f462a3c4ce3ee2fd1f9d408146abc214faa5d06ab805c3940b01f1f12adfe3773ddbe664a5dbf95958caee14bdd2fb04a8cfad954b3c0b4cf298408f5719974b555a46f35e7af41731a9b6cd7b5f2511485d56d92207b8889cb6a9ab85747508df589ec685520626a173f1e5bfa0f812582bbc56496c2de809b59fa7e572fbf60fdc92905ddd65385");
+}
+
+void KDFUnitTest::pbkdf2sha2Tests()
+{
+    QStringList providersToTest;
+    providersToTest.append("qca-ossl");
+    providersToTest.append("default");
+
+    QFETCH(QString, algorithm);
+    QFETCH(QString, secret);
+    QFETCH(QString, salt);
+    QFETCH(unsigned int, iterationCount);
+    QFETCH(QString, output);
+
+    foreach(QString provider, providersToTest) {
+	if(!QCA::isSupported(QString("pbkdf2(%1)").arg(algorithm).toLatin1(), provider))
+	    QWARN(QString("PBKDF version 2 with "+algorithm+" not supported for "+provider).toLocal8Bit());
+	else {
+	    QCA::SecureArray password(secret.toLatin1());
+	    QCA::InitializationVector iv(salt.toLatin1());
+	    QCA::SymmetricKey key = QCA::PBKDF2(algorithm, provider).makeKey( password,
+								   iv,
+								   output.size() / 2,
+								   iterationCount);
+	    QCOMPARE( QCA::arrayToHex( key.toByteArray() ), output );
+	}
+    }
+}
+
+void KDFUnitTest::pbkdf2sha2TimeTest()
+{
+    QStringList providersToTest;
+    providersToTest.append("qca-ossl");
+    providersToTest.append("default");
+
+    QStringList algorithms;
+    algorithms << "sha256" << "sha512";
+
+    QCA::SecureArray password("secret");
+    QCA::InitializationVector iv(QByteArray("salt"));
+    // several output blocks, so the timed pass has to iterate them all
+    unsigned int outputLength = 100;
+    int timeInterval = 200;
+    unsigned int iterationCount;
+
+    foreach(QString provider, providersToTest) {
+	foreach(QString algorithm, algorithms) {
+	    if(!QCA::isSupported(QString("pbkdf2(%1)").arg(algorithm).toLatin1(), provider)) {
+		QString warning("PBKDF version 2 with %1 not supported for %2");
+		QWARN(warning.arg(algorithm, provider).toStdString().c_str());
+	    } else {
+		QCA::SymmetricKey key1(QCA::PBKDF2(algorithm, provider).makeKey(password,
+										iv,
+										outputLength,
+										timeInterval,
+										&iterationCount));
+		QVERIFY( iterationCount >= 1 );
+
+		QCA::SymmetricKey key2(QCA::PBKDF2(algorithm, provider).makeKey(password,
+										iv,
+										outputLength,
+										iterationCount));
+
+		QCOMPARE( key1.size(), (int)outputLength );
+		QCOMPARE( key1, key2 );
+	    }
+	}
+    }
+}
+
+void KDFUnitTest::pbkdf2MakeKeysTest()
+{
+    QStringList providersToTest;
+    providersToTest.append("qca-ossl");
+    providersToTest.append("qca-botan");
+    providersToTest.append("qca-gcrypt");
+    providersToTest.append("default");
+
+    QStringList algorithms;
+    algorithms << "sha1" << "sha256" << "sha512";
+
+    // different secrets, salts, lengths and counts, so that the jobs
+    // can't be confused with one another
+    QList<QCA::KeyDerivationFunction::Job> jobs;
+    for(int n = 0; n < 40; ++n) {
+	QCA::SecureArray password(QByteArray("secret") + QByteArray::number(n));
+	QCA::InitializationVector iv(QByteArray("salt") + QByteArray::number(n * 7));
+	jobs += QCA::KeyDerivationFunction::Job(password, iv, 16 + (n % 5) * 20, 1 + (n % 3) * 500);
+    }
+
+    foreach(QString provider, providersToTest) {
+	foreach(QString algorithm, algorithms) {
+	    if(!QCA::isSupported(QString("pbkdf2(%1)").arg(algorithm).toLatin1(), provider)) {
+		QString warning("PBKDF version 2 with %1 not supported for %2");
+		QWARN(warning.arg(algorithm, provider).toStdString().c_str());
+	    } else {
+		QCA::PBKDF2 pbkdf(algorithm, provider);
+		QList<QCA::SymmetricKey> keys = pbkdf.makeKeys(jobs);
+		QList<QCA::SymmetricKey> serialKeys = pbkdf.makeKeys(jobs, 1);
+		QCOMPARE( keys.count(), jobs.count() );
+		QCOMPARE( serialKeys.count(), jobs.count() );
+		for(int n = 0; n < jobs.count(); ++n) {
+		    const QCA::KeyDerivationFunction::Job &job = jobs[n];
+		    QCA::SymmetricKey key = pbkdf.makeKey(job.secret, job.salt, job.keyLength, job.iterationCount);
+		    QCOMPARE( keys[n], key );
+		    QCOMPARE( serialKeys[n], key );
+		}
+	    }
+	}
+    }
+}
+
+void KDFUnitTest::argon2idTests_data()
+{
+    QTest::addColumn<QString>("secret");
+    QTest::addColumn<QString>("salt");
+    QTest::addColumn<unsigned int>("memoryCost");
+    QTest::addColumn<unsigned int>("timeCost");
+    QTest::addColumn<unsigned int>("lanes");
+    QTest::addColumn<QString>("output");
+
+    QTest::newRow("1") << QString("password")
+		       << QString("somesalt")
+		       << static_cast<unsigned int>(256)
+		       << static_cast<unsigned int>(2)
+		       << static_cast<unsigned int>(1)
+		       << QString("9dfeb910e80bad0311fee20f9c0e2b12c17987b4cac90c2ef54d5b3021c68bfe");
+
+    QTest::newRow("2") << QString("password")
+		       << QString("diffsaltdiffsalt")
+		       << static_cast<unsigned int>(1024)
+		       << static_cast<unsigned int>(1)
+		       << static_cast<unsigned int>(4)
+		       << QString("240df2c935618270886d5ac87098860dca9d285ac109cbd70dc44c7bba174c6dece0e37fb763d4f5af035b18c1dca57502bdc15240a4e01dc02ae7145c52e169");
+
+    QTest::newRow("3") << QString()
+		       << QString("saltsaltsalt")
+		       << static_cast<unsigned int>(64)
+		       << static_cast<unsigned int>(5)
+		       << static_cast<unsigned int>(2)
+		       << QString("29f9ed5d84a20da96bb07ef725737749");
+}
+
+void KDFUnitTest::argon2idTests()
+{
+    QStringList providersToTest;
+    providersToTest.append("default");
+
+    QFETCH(QString, secret);
+    QFETCH(QString, salt);
+    QFETCH(unsigned int, memoryCost);
+    QFETCH(unsigned int, timeCost);
+    QFETCH(unsigned int, lanes);
+    QFETCH(QString, output);
+
+    foreach(QString provider, providersToTest) {
+	if(!QCA::isSupported("argon2id", provider))
+	    QWARN(QString("Argon2id not supported for "+provider).toLocal8Bit());
+	else {
+	    QCA::SecureArray password(secret.toLatin1());
+	    QCA::InitializationVector iv(salt.toLatin1());
+	    QCA::KeyDerivationFunction::Parameters parameters;
+	    parameters.memoryCost = memoryCost;
+	    parameters.timeCost = timeCost;
+	    parameters.lanes = lanes;
+
+	    // the number of threads must not change the key
+	    for(int threads = 1; threads <= 3; ++threads) {
+		parameters.threads = threads;
+		QCA::SymmetricKey key = QCA::Argon2id(provider).makeKey( password,
+									 iv,
+									 output.size() / 2,
+									 parameters);
+		QCOMPARE( QCA::arrayToHex( key.toByteArray() ), output );
+	    }
+	}
+    }
+}
+
+void KDFUnitTest::scryptTests_data()
+{
+    QTest::addColumn<QString>("secret");
+    QTest::addColumn<QString>("salt");
+    QTest::addColumn<unsigned int>("cost");
+    QTest::addColumn<unsigned int>("blockSize");
+    QTest::addColumn<unsigned int>("lanes");
+    QTest::addColumn<QString>("output");
+
+    // RFC 7914, section 12
+    QTest::newRow("1") << QString()
+		       << QString()
+		       << static_cast<unsigned int>(16)
+		       << static_cast<unsigned int>(1)
+		       << static_cast<unsigned int>(1)
+		       << QString("77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906");
+
+    QTest::newRow("2") << QString("password")
+		       << QString("NaCl")
+		       << static_cast<unsigned int>(1024)
+		       << static_cast<unsigned int>(8)
+		       << static_cast<unsigned int>(16)
+		       << QString("fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640");
+
+    QTest::newRow("3") << QString("pleaseletmein")
+		       << QString("SodiumChloride")
+		       << static_cast<unsigned int>(16384)
+		       << static_cast<unsigned int>(8)
+		       << static_cast<unsigned int>(1)
+		       << QString("7023bdcb3afd7348461c06cd81fd38ebfda8fbba904f8e3ea9b543f6545da1f2d5432955613f0fcf62d49705242a9af9e61e85dc0d651e40dfcf017b45575887");
+}
+
+void KDFUnitTest::scryptTests()
+{
+    QStringList providersToTest;
+    providersToTest.append("qca-ossl");
+    providersToTest.append("default");
+
+    QFETCH(QString, secret);
+    QFETCH(QString, salt);
+    QFETCH(unsigned int, cost);
+    QFETCH(unsigned int, blockSize);
+    QFETCH(unsigned int, lanes);
+    QFETCH(QString, output);
+
+    foreach(QString provider, providersToTest) {
+	if(!QCA::isSupported("scrypt", provider))
+	    QWARN(QString("scrypt not supported for "+provider).toLocal8Bit());
+	else {
+	    QCA::SecureArray password(secret.toLatin1());
+	    QCA::InitializationVector iv(salt.toLatin1());
+	    QCA::KeyDerivationFunction::Parameters parameters;
+	    parameters.memoryCost = cost;
+	    parameters.blockSize = blockSize;
+	    parameters.lanes = lanes;
+	    QCA::SymmetricKey key = QCA::Scrypt(provider).makeKey( password,
+								   iv,
+								   output.size() / 2,
+								   parameters);
+	    QCOMPARE( QCA::arrayToHex( key.toByteArray() ), output );
+
+	    // N is not a power of 2
+	    parameters.memoryCost = cost + 1;
+	    QVERIFY( QCA::Scrypt(provider).makeKey(password, iv, 16, parameters).isEmpty() );
+
+	    // 4 GiB is more than either provider may use
+	    parameters.memoryCost = 1u << 22;
+	    parameters.blockSize = 8;
+	    QVERIFY( QCA::Scrypt(provider).makeKey(password, iv, 16, parameters).isEmpty() );
+	}
+    }
+}
+
+void KDFUnitTest::memoryHardTimeTest()
+{
+    QStringList providersToTest;
+    providersToTest.append("qca-ossl");
+    providersToTest.append("default");
+
+    QStringList algorithms;
+    algorithms << "argon2id" << "scrypt";
+
+    QCA::SecureArray password("secret");
+    QCA::InitializationVector iv(QByteArray("saltsalt"));
+    unsigned int outputLength = 32;
+    int timeInterval = 200;
+    unsigned int iterationCount;
+
+    foreach(QString provider, providersToTest) {
+	foreach(QString algorithm, algorithms) {
+	    if(!QCA::isSupported(algorithm.toLatin1(), provider)) {
+		QString warning("%1 not supported for %2");
+		QWARN(warning.arg(algorithm, provider).toStdString().c_str());
+	    } else {
+		QCA::KeyDerivationFunction kdf = (algorithm == "argon2id")
+		    ? (QCA::KeyDerivationFunction)QCA::Argon2id(provider)
+		    : (QCA::KeyDerivationFunction)QCA::Scrypt(provider);
+		QCA::SymmetricKey key1 = kdf.makeKey(password, iv, outputLength, timeInterval, &iterationCount);
+		QVERIFY( iterationCount >= 1 );
+		// the timed scrypt keeps V within 1 GiB
+		if(algorithm == "scrypt")
+		    QVERIFY( 128 * 8 * (quint64)iterationCount <= Q_UINT64_C(1) << 30 );
+		QCA::SymmetricKey key2 = kdf.makeKey(password, iv, outputLength, iterationCount);
+		QCOMPARE( key1.size(), (int)outputLength );
+		QCOMPARE( key1, key2 );
+	    }
+	}
+    }
+}
+
 void KDFUnitTest::hkdfTests_data()
 {
+    QTest::addColumn<QString>("algorithm"); // the hash
     QTest::addColumn<QString>("secret");  // usually a password or passphrase
     QTest::addColumn<QString>("salt");    // a salt or initialisation vector
     QTest::addColumn<QString>("info");    // an additional info
     QTest::addColumn<QString>("output");  // the key you get back
 
     // RFC 5869, Appendix A
-    QTest::newRow("1") << QString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b")
+    QTest::newRow("1") << QString("sha256")
+		       << QString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b")
 		       << QString("000102030405060708090a0b0c")
 		       << QString("f0f1f2f3f4f5f6f7f8f9")
 		       << QString("3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf34007208d5b887185865");
 
-    QTest::newRow("2") << QString("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f404142434445464748494a4b4c4d4e4f")
+    QTest::newRow("2") << QString("sha256")
+		       << QString("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f404142434445464748494a4b4c4d4e4f")
 		       << QString("606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9fa0a1a2a3a4a5a6a7a8a9aaabacadaeaf")
 		       << QString("b0b1b2b3b4b5b6b7b8b9babbbcbdbebfc0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedfe0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff")
 		       << QString("b11e398dc80327a1c8e7f78c596a49344f012eda2d4efad8a050cc4c19afa97c59045a99cac7827271cb41c65e590e09da3275600c2f09b8367793a9aca3db71cc30c58179ec3e87c14c01d5c1f3434f1d87");
 
-    QTest::newRow("3") << QString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b")
+    QTest::newRow("3") << QString("sha256")
+		       << QString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b")
 		       << QString()
 		       << QString()
 		       << QString("8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d9d201395faa4b61a96c8");
+
+    QTest::newRow("4") << QString("sha1")
+		       << QString("0b0b0b0b0b0b0b0b0b0b0b")
+		       << QString("000102030405060708090a0b0c")
+		       << QString("f0f1f2f3f4f5f6f7f8f9")
+		       << QString("085a01ea1b10f36933068b56efa5ad81a4f14b822f5b091568a9cdd4f155fda2c22e422478d305f3f896");
+
+    QTest::newRow("7") << QString("sha1")
+		       << QString("0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c")
+		       << QString()
+		       << QString()
+		       << QString("2c91117204d745f3500d636a62f64f0ab3bae548aa53d423b0d1f27ebba6f5e5673a081d70cce7acfc48");
+
+    // the RFC has no SHA-384 or SHA-512 vectors, these are from Python's hmac
+    QTest::newRow("sha384") << QString("sha384")
+			    << QString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b")
+			    << QString("000102030405060708090a0b0c")
+			    << QString("f0f1f2f3f4f5f6f7f8f9")
+			    << QString("9b5097a86038b805309076a44b3a9f38063e25b516dcbf369f394cfab43685f748b6457763e4f0204fc5d95d1da3e62587b22eb8943d0fab6bb631a2fe9df1a6");
+
+    QTest::newRow("sha512") << QString("sha512")
+			    << QString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b")
+			    << QString("000102030405060708090a0b0c")
+			    << QString("f0f1f2f3f4f5f6f7f8f9")
+			    << QString("832390086cda71fb47625bb5ceb168e4c8e26a1a16ed34d9fc7fe92c1481579338da362cb8d9f925d7cbcce0dff7098769cf15959867d571c1715450cb530137be3fb62f3cf32b84feba8f1eb1b563e20d9749b8640b8264c4b69b14ad5199115e1d609c");
+
+    QTest::newRow("sha512 no salt") << QString("sha512")
+				    << QString("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b")
+				    << QString()
+				    << QString()
+				    << QString("f5fa02b18298a72a8c23898a8703472c6eb179dc204c03425c970e3b164bf90fff22d04836d0e2343bac");
 }
 
 void KDFUnitTest::hkdfTests()
@@ -508,28 +895,181 @@ void KDFUnitTest::hkdfTests()
     //providersToTest.append("qca-gcrypt");
     providersToTest.append("qca-botan");
 
+    QFETCH(QString, algorithm);
     QFETCH(QString, secret);
     QFETCH(QString, salt);
     QFETCH(QString, info);
     QFETCH(QString, output);
 
     foreach(QString provider, providersToTest) {
-	if(!QCA::isSupported("hkdf(sha256)", provider))
-	    QWARN(QString("HKDF with SHA256 not supported for "+provider).toLocal8Bit());
+	if(!QCA::isSupported(QString("hkdf(%1)").arg(algorithm).toLatin1().constData(), provider))
+	    QWARN(QString("HKDF with %1 not supported for %2").arg(algorithm, provider).toLocal8Bit());
 	else {
 	    QCA::SecureArray password = QCA::hexToArray( secret );
 	    QCA::InitializationVector saltv( QCA::hexToArray( salt ) );
 	    QCA::InitializationVector infov( QCA::hexToArray( info ) );
-	    QCA::SymmetricKey key = QCA::HKDF("sha256", provider).makeKey( password,
-								   saltv,
-								   infov,
-								   output.size() / 2 );
+	    QCA::HKDF hkdf(algorithm, provider);
+	    QCA::SymmetricKey key = hkdf.makeKey( password,
+						  saltv,
+						  infov,
+						  output.size() / 2 );
 	    QCOMPARE( QCA::arrayToHex( key.toByteArray() ), output );
 
+	    // extract once, expand twice to go through the cached HMAC state
+	    QCA::SymmetricKey prk = hkdf.extract( password, saltv );
+	    QVERIFY( !prk.isEmpty() );
+	    QCOMPARE( QCA::arrayToHex( hkdf.expand( prk, infov, output.size() / 2 ).toByteArray() ), output );
+	    QCOMPARE( QCA::arrayToHex( hkdf.expand( prk, infov, 16 ).toByteArray() ), output.left( 32 ) );
+	    QVERIFY( hkdf.expand( prk, infov, 255 * prk.size() + 1 ).isEmpty() );
 	}
     }
 }
 
+const QString hkdfProviderName = "testHkdfProvider";
+
+// hmac(sha256) built on the sha256 of another provider, so that the
+// HKDFContext defaults have an HMAC of their own provider to use
+class TestHmacContext : public QCA::MACContext
+{
+    Q_OBJECT
+
+public:
+    TestHmacContext(QCA::Provider *p) : QCA::MACContext(p, "hmac(sha256)")
+    {
+    }
+
+    Provider::Context *clone() const
+    {
+	return new TestHmacContext(*this);
+    }
+
+    void setup(const QCA::SymmetricKey &key)
+    {
+	QCA::SecureArray k = key;
+	if(k.size() > 64)
+	    k = QCA::Hash("sha256").hash(k);
+	k.resize(64);
+	m_ipad = k;
+	m_opad = k;
+	for(int n = 0; n < 64; ++n) {
+	    m_ipad[n] = m_ipad[n] ^ 0x36;
+	    m_opad[n] = m_opad[n] ^ 0x5c;
+	}
+	m_data.clear();
+    }
+
+    QCA::KeyLength keyLength() const
+    {
+	return anyKeyLength();
+    }
+
+    void update(const QCA::MemoryRegion &in)
+    {
+	m_data += in;
+    }
+
+    void final(QCA::MemoryRegion *out)
+    {
+	QCA::Hash inner("sha256");
+	inner.update(m_ipad);
+	inner.update(m_data);
+	QCA::Hash outer("sha256");
+	outer.update(m_opad);
+	outer.update(inner.final());
+	*out = outer.final();
+	m_data.clear();
+    }
+
+private:
+    QCA::SecureArray m_ipad, m_opad, m_data;
+};
+
+// an hkdf(sha256) that leaves extract() and expand() to HKDFContext
+class TestHkdfContext : public QCA::HKDFContext
+{
+    Q_OBJECT
+
+public:
+    TestHkdfContext(QCA::Provider *p) : QCA::HKDFContext(p, "hkdf(sha256)")
+    {
+    }
+
+    Provider::Context *clone() const
+    {
+	return new TestHkdfContext(*this);
+    }
+
+    QCA::SymmetricKey makeKey(const QCA::SecureArray &secret, const QCA::InitializationVector &salt,
+			      const QCA::InitializationVector &info, unsigned int keyLength)
+    {
+	return expand(extract(secret, salt), info, keyLength);
+    }
+};
+
+class TestHkdfProvider : public QObject, public QCA::Provider
+{
+    Q_OBJECT
+
+public:
+    int qcaVersion() const
+    {
+	return QCA_VERSION;
+    }
+
+    QString name() const
+    {
+	return hkdfProviderName;
+    }
+
+    QStringList features() const
+    {
+	QStringList list;
+	list += "hmac(sha256)";
+	list += "hkdf(sha256)";
+	return list;
+    }
+
+    Provider::Context *createContext(const QString &type)
+    {
+	if(type == "hmac(sha256)")
+	    return new TestHmacContext(this);
+	else if(type == "hkdf(sha256)")
+	    return new TestHkdfContext(this);
+	else
+	    return 0;
+    }
+};
+
+void KDFUnitTest::hkdfDefaultContextTest()
+{
+    QPointer<TestHkdfProvider> provider = new TestHkdfProvider;
+    QVERIFY(QCA::insertProvider(provider, 10));
+
+    QCA::HKDF hkdf("sha256", hkdfProviderName);
+    QCOMPARE(hkdf.provider()->name(), hkdfProviderName);
+
+    // RFC 5869, Appendix A, test cases 1 and 3
+    QCA::SecureArray secret = QCA::hexToArray("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b");
+    QCA::InitializationVector salt(QCA::hexToArray("000102030405060708090a0b0c"));
+    QCA::InitializationVector info(QCA::hexToArray("f0f1f2f3f4f5f6f7f8f9"));
+    QString output("3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf34007208d5b887185865");
+
+    QCA::SymmetricKey prk = hkdf.extract(secret, salt);
+    QCOMPARE(QCA::arrayToHex(prk.toByteArray()),
+	     QString("077709362c2e32df0ddc3f0dc47bba6390b6c73bb50f9c3122ec844ad7c2b3e5"));
+    QCOMPARE(QCA::arrayToHex(hkdf.expand(prk, info, 42).toByteArray()), output);
+    QCOMPARE(QCA::arrayToHex(hkdf.expand(prk, info, 16).toByteArray()), output.left(32));
+    QCOMPARE(QCA::arrayToHex(hkdf.makeKey(secret, salt, info, 42).toByteArray()), output);
+    QVERIFY(hkdf.expand(prk, info, 255 * 32 + 1).isEmpty());
+
+    // no salt stands for HashLen zeros
+    QCOMPARE(QCA::arrayToHex(hkdf.makeKey(secret, QCA::InitializationVector(),
+					  QCA::InitializationVector(), 42).toByteArray()),
+	     QString("8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d9d201395faa4b61a96c8"));
+
+    QVERIFY(QCA::unloadProvider(hkdfProviderName));
+}
+
 QTEST_MAIN(KDFUnitTest)
 
 #include "kdfunittest.moc"
@@ -44,6 +44,7 @@ private slots:
     void HMACSHA384();
     void HMACSHA512();
     void HMACRMD160();
+    void poly1305();
 private:
     QCA::Initializer* m_init;
 };
@@ -612,6 +613,54 @@ void MACUnitTest::HMACRMD160()
     }
 }
 
+void MACUnitTest::poly1305()
+{
+    QStringList providersToTest;
+    providersToTest.append("qca-ossl");
+    providersToTest.append("default");
+
+    foreach(const QString provider, providersToTest) {
+        if( !QCA::isSupported( "poly1305", provider ) )
+            QWARN( QString( "Poly1305 not supported for "+provider).toLocal8Bit() );
+        else {
+	    QCA::MessageAuthenticationCode lenTest( "poly1305", QCA::SymmetricKey(), provider );
+	    QCOMPARE( lenTest.validKeyLength( 32 ), true );
+	    QCOMPARE( lenTest.validKeyLength( 16 ), false );
+
+	    // RFC 8439, section 2.5.2
+	    QCA::MessageAuthenticationCode test1( "poly1305", QCA::SymmetricKey(), provider );
+	    QCA::SymmetricKey key1( QCA::hexToArray( "85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b" ) );
+	    test1.setup( key1 );
+	    QCA::SecureArray data1( "Cryptographic Forum Research Group" );
+	    test1.update( data1 );
+	    QCOMPARE( QCA::arrayToHex( test1.final().toByteArray() ), QString( "a8061dc1305136c6c22b8baf0c0127a9" ) );
+
+	    // RFC 8439, appendix A.3, test vector 1
+	    QCA::SymmetricKey key2( QCA::SecureArray( 32, 0 ) );
+	    QCA::MessageAuthenticationCode test2( "poly1305", key2, provider );
+	    test2.update( QCA::SecureArray( 64, 0 ) );
+	    QCOMPARE( QCA::arrayToHex( test2.final().toByteArray() ), QString( "00000000000000000000000000000000" ) );
+
+	    // h reaches 2^130 - 5 and has to be reduced
+	    QCA::SymmetricKey key3( QCA::hexToArray( "0200000000000000000000000000000000000000000000000000000000000000" ) );
+	    QCA::MessageAuthenticationCode test3( "poly1305", key3, provider );
+	    test3.update( QCA::SecureArray( 16, (char)0xff ) );
+	    QCOMPARE( QCA::arrayToHex( test3.final().toByteArray() ), QString( "03000000000000000000000000000000" ) );
+
+	    // many blocks, fed in pieces that don't line up with them
+	    QCA::SymmetricKey key4( QCA::hexToArray( "0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20" ) );
+	    QCA::MessageAuthenticationCode test4( "poly1305", key4, provider );
+	    for ( int i = 0; i < 40; i++ )
+		test4.update( QCA::SecureArray( 25, (char)0xdd ) );
+	    QCOMPARE( QCA::arrayToHex( test4.final().toByteArray() ), QString( "7ceb81124d185e62831e4c476bf6f3d6" ) );
+
+	    test4.clear(); // reuse the key
+	    test4.update( QCA::SecureArray( 1000, (char)0xdd ) );
+	    QCOMPARE( QCA::arrayToHex( test4.final().toByteArray() ), QString( "7ceb81124d185e62831e4c476bf6f3d6" ) );
+	}
+    }
+}
+
 QTEST_MAIN(MACUnitTest)
 
 #include "macunittest.moc"
@@ -24,8 +24,14 @@
  */
 
 #include <QtCrypto>
+#include <QtCore/QPointer>
 #include <QtTest/QtTest>
 
+#ifdef Q_OS_UNIX
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #ifdef QT_STATICPLUGIN
 #include "import_plugins.h"
 #endif
@@ -40,6 +46,9 @@ private slots:
     void hexConversions();
     void capabilities();
     void secureMemory();
+    void randomReservoir();
+    void randomReservoirInvalidation();
+    void randomReservoirFork();
 private:
     QCA::Initializer* m_init;
 };
@@ -111,6 +120,172 @@ void StaticUnitTest::secureMemory()
     QCOMPARE( QCA::haveSecureMemory(), true );
 }
 
+void StaticUnitTest::randomReservoir()
+{
+    for (int i = 0; i < 10000; i++) {
+	QVERIFY( QCA::Random::randomBounded(7) < 7 );
+    }
+    QCOMPARE( QCA::Random::randomBounded(1), (quint32)0 );
+    QCOMPARE( QCA::Random::randomBounded(0), (quint32)0 );
+
+    // enough values to go through several refills, all different
+    QSet<quint64> seen;
+    for (int i = 0; i < 10000; i++) {
+	seen.insert( QCA::Random::randomUInt64() );
+    }
+    QCOMPARE( seen.size(), 10000 );
+
+    // small requests come from the reservoir, large ones from the provider
+    QByteArray small(100, 0);
+    QByteArray large(100000, 0);
+    QCA::Random::fill(small.data(), small.size());
+    QCA::Random::fill(large.data(), large.size());
+    QVERIFY( small != QByteArray(100, 0) );
+    QVERIFY( large.left(1000) != QByteArray(1000, 0) );
+    QVERIFY( large.right(1000) != QByteArray(1000, 0) );
+
+    // switching the global provider throws the buffered bytes away
+    QString provider = QCA::globalRandomProvider();
+    QCA::setGlobalRandomProvider( "default" );
+    QSet<quint32> after;
+    for (int i = 0; i < 100; i++) {
+	after.insert( QCA::Random::randomUInt32() );
+    }
+    QVERIFY( after.size() > 90 );
+    QCA::setGlobalRandomProvider( provider );
+}
+
+const QString randomProviderName = "testRandomProvider";
+
+// the number of nextBytes() calls so far, which is also the value of
+// every byte returned by the last call
+static int randomBatches = 0;
+
+class CountingRandomContext : public QCA::RandomContext
+{
+    Q_OBJECT
+
+public:
+    CountingRandomContext(QCA::Provider *p) : QCA::RandomContext(p)
+    {
+    }
+
+    Provider::Context *clone() const
+    {
+	return new CountingRandomContext(provider());
+    }
+
+    QCA::SecureArray nextBytes(int size)
+    {
+	++randomBatches;
+	return QCA::SecureArray(size, (char)randomBatches);
+    }
+};
+
+class TestRandomProvider : public QObject, public QCA::Provider
+{
+    Q_OBJECT
+
+public:
+    int qcaVersion() const
+    {
+	return QCA_VERSION;
+    }
+
+    QString name() const
+    {
+	return randomProviderName;
+    }
+
+    QStringList features() const
+    {
+	QStringList list;
+	list += "random";
+	return list;
+    }
+
+    Provider::Context *createContext(const QString &type)
+    {
+	if(type == "random")
+	    return new CountingRandomContext(this);
+	else
+	    return 0;
+    }
+};
+
+void StaticUnitTest::randomReservoirInvalidation()
+{
+    QPointer<TestRandomProvider> provider = new TestRandomProvider;
+    QVERIFY( QCA::insertProvider(provider, 10) );
+    QString previous = QCA::globalRandomProvider();
+
+    // leave bytes of the previous provider in the reservoir
+    QCA::Random::randomUInt32();
+
+    QCA::setGlobalRandomProvider( randomProviderName );
+    QCOMPARE( QCA::globalRandomProvider(), randomProviderName );
+    randomBatches = 0;
+    QCOMPARE( QCA::Random::randomUInt64(), Q_UINT64_C(0x0101010101010101) );
+    QCOMPARE( QCA::Random::randomUInt64(), Q_UINT64_C(0x0101010101010101) );
+    QCOMPARE( randomBatches, 1 );
+
+    // a new random object of the same provider is a new generation too
+    QCA::setGlobalRandomProvider( randomProviderName );
+    QCOMPARE( QCA::Random::randomUInt64(), Q_UINT64_C(0x0202020202020202) );
+    QCOMPARE( randomBatches, 2 );
+
+    // and the bytes of this one are gone once the previous one is back
+    QCA::setGlobalRandomProvider( previous );
+    QVERIFY( QCA::Random::randomUInt64() != Q_UINT64_C(0x0202020202020202) );
+    QCOMPARE( randomBatches, 2 );
+
+    QVERIFY( QCA::unloadProvider(randomProviderName) );
+}
+
+void StaticUnitTest::randomReservoirFork()
+{
+#ifdef Q_OS_UNIX
+    QPointer<TestRandomProvider> provider = new TestRandomProvider;
+    QVERIFY( QCA::insertProvider(provider, 10) );
+    QString previous = QCA::globalRandomProvider();
+
+    QCA::setGlobalRandomProvider( randomProviderName );
+    randomBatches = 0;
+    QCOMPARE( QCA::Random::randomChar(), (uchar)1 );
+
+    int fds[2];
+    QCOMPARE( pipe(fds), 0 );
+    pid_t pid = fork();
+    QVERIFY( pid >= 0 );
+    if (pid == 0) {
+	// the child must refill rather than repeat what the parent has left
+	uchar c = QCA::Random::randomChar();
+	_exit(write(fds[1], &c, 1) == 1 ? 0 : 1);
+    }
+    ::close(fds[1]);
+    uchar child = 0;
+    ssize_t got = read(fds[0], &child, 1);
+    ::close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    QCOMPARE( got, (ssize_t)1 );
+    QCOMPARE( child, (uchar)2 );
+
+    // the parent goes on with its own buffered bytes
+    QCOMPARE( QCA::Random::randomChar(), (uchar)1 );
+    QCOMPARE( randomBatches, 1 );
+
+    QCA::setGlobalRandomProvider( previous );
+    QVERIFY( QCA::unloadProvider(randomProviderName) );
+#else
+#if QT_VERSION >= 0x050000
+    QSKIP("fork() is only available on Unix");
+#else
+    QSKIP("fork() is only available on Unix", SkipAll);
+#endif
+#endif
+}
+
 QTEST_MAIN(StaticUnitTest)
 
 #include "staticunittest.moc"